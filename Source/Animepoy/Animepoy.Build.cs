@@ -1,60 +1,64 @@
-// Copyright Epic Games, Inc. All Rights Reserved.
-
-using System.IO;
-using UnrealBuildTool;
-
-public class Animepoy : ModuleRules
-{
-    public Animepoy(ReadOnlyTargetRules Target) : base(Target)
-    {
-        PCHUsage = ModuleRules.PCHUsageMode.UseExplicitOrSharedPCHs;
-
-        PublicIncludePaths.AddRange(
-            new string[] {
-				// ... add public include paths required here ...
-			}
-            );
-
-
-        PrivateIncludePaths.AddRange(
-            new string[] {
-				// ... add other private include paths required here ...
-				Path.Combine(GetModuleDirectory("Renderer"), "Private"),
-            }
-            );
-
-
-        PublicDependencyModuleNames.AddRange(
-            new string[]
-            {
-                "Core",
-				// ... add other public dependencies that you statically link with here ...
-			}
-            );
-
-
-        PrivateDependencyModuleNames.AddRange(
-            new string[]
-            {
-                "CoreUObject",
-                "Engine",
-                "RHI",
-                "Renderer",
-                "RenderCore",
-                "Projects",
-                "MaterialShaderQualitySettings",
-                "ApplicationCore",
-            }
-            );
-
-
-        DynamicallyLoadedModuleNames.AddRange(
-            new string[]
-            {
-				// ... add any modules that your module loads dynamically here ...
-			}
-            );
-
-        PrivateDefinitions.Add("USE_POST_DEFERRED_LIGHTING_PASS=0");
-    }
-}
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+using System.IO;
+using UnrealBuildTool;
+
+public class Animepoy : ModuleRules
+{
+    public Animepoy(ReadOnlyTargetRules Target) : base(Target)
+    {
+        PCHUsage = ModuleRules.PCHUsageMode.UseExplicitOrSharedPCHs;
+
+        PublicIncludePaths.AddRange(
+            new string[] {
+				// ... add public include paths required here ...
+			}
+            );
+
+
+        PrivateIncludePaths.AddRange(
+            new string[] {
+				// ... add other private include paths required here ...
+				Path.Combine(GetModuleDirectory("Renderer"), "Private"),
+            }
+            );
+
+
+        PublicDependencyModuleNames.AddRange(
+            new string[]
+            {
+                "Core",
+				// ... add other public dependencies that you statically link with here ...
+			}
+            );
+
+
+        PrivateDependencyModuleNames.AddRange(
+            new string[]
+            {
+                "CoreUObject",
+                "Engine",
+                "RHI",
+                "Renderer",
+                "RenderCore",
+                "Projects",
+                "MaterialShaderQualitySettings",
+                "ApplicationCore",
+                "ImageCore",
+                "ImageWrapper",
+                "Json",
+                "JsonUtilities",
+            }
+            );
+
+
+        DynamicallyLoadedModuleNames.AddRange(
+            new string[]
+            {
+				// ... add any modules that your module loads dynamically here ...
+			}
+            );
+
+        PrivateDefinitions.Add("USE_POST_DEFERRED_LIGHTING_PASS=0");
+    }
+}
@@ -1,74 +1,239 @@
-// Fill out your copyright notice in the Description page of Project Settings.
-
-
-#include "Animepoy.h"
-#include "AnimepoySubsystem.h"
-
-// Sets default values
-AAnimepoy::AAnimepoy()
-{
-	PrimaryActorTick.bCanEverTick = true;
-}
-
-// Called when the game starts or when spawned
-void AAnimepoy::BeginPlay()
-{
-	Super::BeginPlay();
-
-	if (const UWorld* World = GetWorld())
-	{
-		if (UAnimepoySubsystem* WorldSubsystem = World->GetSubsystem<UAnimepoySubsystem>())
-		{
-			WorldSubsystem->OnActorSpawned(this);
-		}
-	}
-}
-
-void AAnimepoy::BeginDestroy()
-{
-	if (const UWorld* World = GetWorld())
-	{
-		if (UAnimepoySubsystem* WorldSubsystem = World->GetSubsystem<UAnimepoySubsystem>())
-		{
-			WorldSubsystem->OnActorDeleted(this);
-		}
-	}
-
-	Super::BeginDestroy();
-}
-
-void AAnimepoy::Tick(float DeltaSeconds)
-{
-	Super::Tick(DeltaSeconds);
-
-	if (const UWorld* World = GetWorld()) 
-	{
-		if (UAnimepoySubsystem* AnimepoySubsystem = World->GetSubsystem<UAnimepoySubsystem>()) 
-		{
-			FAnimepoyRenderProxy TempSettings;
-			TempSettings.bEnable = !this->IsHidden();
-
-			TempSettings.bLineArt = bLineArt && LineWidth > 0 && LineColor.A != 0.f;
-			TempSettings.LineColor = LineColor;
-			TempSettings.LineWidth = LineWidth;
-			TempSettings.DepthLineIntensity = DepthLineIntensity;
-			TempSettings.NormalLineIntensity = NormalLineIntensity;
-			TempSettings.MaterialLineIntensity = MaterialLineIntensity;
-			TempSettings.PlanarLineIntensity = PlanarLineIntensity;
-			TempSettings.bPreviewLine = bPreviewLine;
-
-			TempSettings.bPrePostProcessKuwaharaFilter = bPrePostProcessKuwaharaFilter;
-			TempSettings.PrePostProcessKuwaharaFilterSize = PrePostProcessKuwaharaFilterSize;
-
-			TempSettings.bDiffusionFilter = bDiffusionFilter && DiffusionFilterIntensity != 0.f;
-			TempSettings.DiffusionFilterIntensity = DiffusionFilterIntensity;
-			TempSettings.DiffusionLuminanceMin = DiffusionLuminanceMin;
-			TempSettings.DiffusionLuminanceMax = DiffusionLuminanceMax;
-			TempSettings.DiffusionBlurPercentage = DiffusionBlurPercentage;
-			TempSettings.DiffusionBlendMode = DiffusionBlendMode;
-			TempSettings.bPreviewDiffusionMask = bPreviewDiffusionMask;
-
-			AnimepoySubsystem->SetAnimepoyRenderProxy(TempSettings);
-		}
-	}
-}
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Animepoy.h"
+#include "AnimepoySubsystem.h"
+#include "AnimepoyStats.h"
+
+DECLARE_CYCLE_STAT(TEXT("Publish Render Proxy"), STAT_AnimepoyPublishRenderProxy, STATGROUP_Animepoy);
+
+// Sets default values
+AAnimepoy::AAnimepoy()
+{
+	// Settings reach the renderer through PublishRenderProxy when they change.
+	PrimaryActorTick.bCanEverTick = false;
+}
+
+// Called when the game starts or when spawned
+void AAnimepoy::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (const UWorld* World = GetWorld())
+	{
+		if (UAnimepoySubsystem* WorldSubsystem = World->GetSubsystem<UAnimepoySubsystem>())
+		{
+			WorldSubsystem->OnActorSpawned(this);
+		}
+	}
+
+	PublishRenderProxy();
+}
+
+void AAnimepoy::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// Editor worlds never call EndPlay, the subsystem hears of deleted actors from the editor there.
+	if (const UWorld* World = GetWorld())
+	{
+		if (UAnimepoySubsystem* WorldSubsystem = World->GetSubsystem<UAnimepoySubsystem>())
+		{
+			WorldSubsystem->OnActorDeleted(this);
+		}
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void AAnimepoy::PostRegisterAllComponents()
+{
+	Super::PostRegisterAllComponents();
+
+	// Editor worlds never call BeginPlay.
+	PublishRenderProxy();
+}
+
+void AAnimepoy::PublishRenderProxy()
+{
+	SCOPE_CYCLE_COUNTER(STAT_AnimepoyPublishRenderProxy);
+	CSV_SCOPED_TIMING_STAT(Animepoy, PublishRenderProxy);
+
+	if (const UWorld* World = GetWorld())
+	{
+		if (UAnimepoySubsystem* AnimepoySubsystem = World->GetSubsystem<UAnimepoySubsystem>())
+		{
+			AnimepoySubsystem->SetAnimepoyRenderProxy(CreateRenderProxy());
+		}
+	}
+}
+
+FAnimepoyRenderProxy AAnimepoy::CreateRenderProxy() const
+{
+	FAnimepoyRenderProxy RenderProxy;
+	RenderProxy.bEnable = !IsHidden();
+
+	RenderProxy.bLineArt = bLineArt && LineWidth > 0 && LineColor.A != 0.f;
+	RenderProxy.LineColor = LineColor;
+	RenderProxy.LineWidth = LineWidth;
+	RenderProxy.DepthLineIntensity = DepthLineIntensity;
+	RenderProxy.NormalLineIntensity = NormalLineIntensity;
+	RenderProxy.MaterialLineIntensity = MaterialLineIntensity;
+	RenderProxy.PlanarLineIntensity = PlanarLineIntensity;
+	RenderProxy.bPreviewLine = bPreviewLine;
+
+	RenderProxy.bPrePostProcessKuwaharaFilter = bPrePostProcessKuwaharaFilter;
+	RenderProxy.PrePostProcessKuwaharaFilterSize = PrePostProcessKuwaharaFilterSize;
+	RenderProxy.PrePostProcessKuwaharaFilterResolution = PrePostProcessKuwaharaFilterResolution;
+	RenderProxy.bGBufferKuwaharaFilter = bGBufferKuwaharaFilter && (bGBufferKuwaharaFilterBaseColor || bGBufferKuwaharaFilterNormal || bGBufferKuwaharaFilterMaterial);
+	RenderProxy.bGBufferKuwaharaFilterBaseColor = bGBufferKuwaharaFilterBaseColor;
+	RenderProxy.bGBufferKuwaharaFilterNormal = bGBufferKuwaharaFilterNormal;
+	RenderProxy.bGBufferKuwaharaFilterMaterial = bGBufferKuwaharaFilterMaterial;
+	RenderProxy.GBufferKuwaharaFilterSize = GBufferKuwaharaFilterSize;
+
+	RenderProxy.bDiffusionFilter = bDiffusionFilter && DiffusionFilterIntensity != 0.f;
+	RenderProxy.DiffusionFilterIntensity = DiffusionFilterIntensity;
+	RenderProxy.DiffusionLuminanceMin = DiffusionLuminanceMin;
+	RenderProxy.DiffusionLuminanceMax = DiffusionLuminanceMax;
+	RenderProxy.DiffusionBlurPercentage = DiffusionBlurPercentage;
+	RenderProxy.DiffusionBlendMode = DiffusionBlendMode;
+	RenderProxy.bPreviewDiffusionMask = bPreviewDiffusionMask;
+
+	return RenderProxy;
+}
+
+void AAnimepoy::SetActorHiddenInGame(bool bNewHidden)
+{
+	Super::SetActorHiddenInGame(bNewHidden);
+
+	PublishRenderProxy();
+}
+
+#if WITH_EDITOR
+void AAnimepoy::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	PublishRenderProxy();
+}
+
+void AAnimepoy::PostEditUndo()
+{
+	Super::PostEditUndo();
+
+	PublishRenderProxy();
+}
+#endif
+
+void AAnimepoy::SetLineArt(bool bInLineArt)
+{
+	SetRenderProperty(bLineArt, bInLineArt);
+}
+
+void AAnimepoy::SetLineColor(const FLinearColor& InLineColor)
+{
+	SetRenderProperty(LineColor, InLineColor);
+}
+
+void AAnimepoy::SetLineWidth(int32 InLineWidth)
+{
+	SetRenderProperty(LineWidth, InLineWidth);
+}
+
+void AAnimepoy::SetDepthLineIntensity(float InDepthLineIntensity)
+{
+	SetRenderProperty(DepthLineIntensity, InDepthLineIntensity);
+}
+
+void AAnimepoy::SetNormalLineIntensity(float InNormalLineIntensity)
+{
+	SetRenderProperty(NormalLineIntensity, InNormalLineIntensity);
+}
+
+void AAnimepoy::SetPlanarLineIntensity(float InPlanarLineIntensity)
+{
+	SetRenderProperty(PlanarLineIntensity, InPlanarLineIntensity);
+}
+
+void AAnimepoy::SetMaterialLineIntensity(float InMaterialLineIntensity)
+{
+	SetRenderProperty(MaterialLineIntensity, InMaterialLineIntensity);
+}
+
+void AAnimepoy::SetPreviewLine(bool bInPreviewLine)
+{
+	SetRenderProperty(bPreviewLine, bInPreviewLine);
+}
+
+void AAnimepoy::SetPrePostProcessKuwaharaFilter(bool bInPrePostProcessKuwaharaFilter)
+{
+	SetRenderProperty(bPrePostProcessKuwaharaFilter, bInPrePostProcessKuwaharaFilter);
+}
+
+void AAnimepoy::SetPrePostProcessKuwaharaFilterSize(int32 InPrePostProcessKuwaharaFilterSize)
+{
+	SetRenderProperty(PrePostProcessKuwaharaFilterSize, InPrePostProcessKuwaharaFilterSize);
+}
+
+void AAnimepoy::SetPrePostProcessKuwaharaFilterResolution(EAnimeKuwaharaFilterResolution InPrePostProcessKuwaharaFilterResolution)
+{
+	SetRenderProperty(PrePostProcessKuwaharaFilterResolution, InPrePostProcessKuwaharaFilterResolution);
+}
+
+void AAnimepoy::SetGBufferKuwaharaFilter(bool bInGBufferKuwaharaFilter)
+{
+	SetRenderProperty(bGBufferKuwaharaFilter, bInGBufferKuwaharaFilter);
+}
+
+void AAnimepoy::SetGBufferKuwaharaFilterBaseColor(bool bInGBufferKuwaharaFilterBaseColor)
+{
+	SetRenderProperty(bGBufferKuwaharaFilterBaseColor, bInGBufferKuwaharaFilterBaseColor);
+}
+
+void AAnimepoy::SetGBufferKuwaharaFilterNormal(bool bInGBufferKuwaharaFilterNormal)
+{
+	SetRenderProperty(bGBufferKuwaharaFilterNormal, bInGBufferKuwaharaFilterNormal);
+}
+
+void AAnimepoy::SetGBufferKuwaharaFilterMaterial(bool bInGBufferKuwaharaFilterMaterial)
+{
+	SetRenderProperty(bGBufferKuwaharaFilterMaterial, bInGBufferKuwaharaFilterMaterial);
+}
+
+void AAnimepoy::SetGBufferKuwaharaFilterSize(int32 InGBufferKuwaharaFilterSize)
+{
+	SetRenderProperty(GBufferKuwaharaFilterSize, InGBufferKuwaharaFilterSize);
+}
+
+void AAnimepoy::SetDiffusionFilter(bool bInDiffusionFilter)
+{
+	SetRenderProperty(bDiffusionFilter, bInDiffusionFilter);
+}
+
+void AAnimepoy::SetDiffusionFilterIntensity(float InDiffusionFilterIntensity)
+{
+	SetRenderProperty(DiffusionFilterIntensity, InDiffusionFilterIntensity);
+}
+
+void AAnimepoy::SetDiffusionLuminanceMin(float InDiffusionLuminanceMin)
+{
+	SetRenderProperty(DiffusionLuminanceMin, InDiffusionLuminanceMin);
+}
+
+void AAnimepoy::SetDiffusionLuminanceMax(float InDiffusionLuminanceMax)
+{
+	SetRenderProperty(DiffusionLuminanceMax, InDiffusionLuminanceMax);
+}
+
+void AAnimepoy::SetDiffusionBlurPercentage(float InDiffusionBlurPercentage)
+{
+	SetRenderProperty(DiffusionBlurPercentage, InDiffusionBlurPercentage);
+}
+
+void AAnimepoy::SetDiffusionBlendMode(EAnimeDiffusionBlendMode InDiffusionBlendMode)
+{
+	SetRenderProperty(DiffusionBlendMode, InDiffusionBlendMode);
+}
+
+void AAnimepoy::SetPreviewDiffusionMask(bool bInPreviewDiffusionMask)
+{
+	SetRenderProperty(bPreviewDiffusionMask, bInPreviewDiffusionMask);
+}
@@ -0,0 +1,614 @@
+// @Custom
+#include "AnimepoyBatchCommandlet.h"
+#include "Animepoy.h"
+#include "AnimepoyCPU.h"
+#include "AnimepoyModule.h"
+#include "Async/MappedFileHandle.h"
+#include "Dom/JsonObject.h"
+#include "GenericPlatform/GenericPlatformFile.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "IImageWrapperModule.h"
+#include "ImageCore.h"
+#include "JsonObjectConverter.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Modules/ModuleManager.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+#include "Tasks/Task.h"
+#include "UObject/Package.h"
+#include <atomic>
+
+namespace
+{
+	// Shared by the frames in flight. Only the counters change once the frames start.
+	struct FBatchContext
+	{
+		FString InputDir;
+		FString OutputDir;
+		FString GBufferDir;
+		FIntPoint RawSize = FIntPoint::ZeroValue;
+		int64 MemoryBudget = 0;
+		FAnimepoyRenderProxy RenderProxy;
+		IImageWrapperModule* ImageWrapperModule = nullptr;
+		std::atomic<int32> NumFailed{ 0 };
+		std::atomic<int64> NumPixels{ 0 };
+		mutable std::atomic<bool> bWarnedDecodedOverBudget{ false };
+	};
+
+	// Raw frames are filtered straight from the mapping, compressed ones are decoded from it without a read buffer.
+	struct FMappedFile
+	{
+		TUniquePtr<IMappedFileHandle> Handle;
+		TUniquePtr<IMappedFileRegion> Region;
+
+		bool Open(const FString& Filename)
+		{
+			Handle.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Filename));
+			if (Handle)
+			{
+				Region.Reset(Handle->MapRegion());
+			}
+			return Region.IsValid();
+		}
+
+		// The region has to go before the file.
+		void Close()
+		{
+			Region.Reset();
+			Handle.Reset();
+		}
+
+		~FMappedFile()
+		{
+			Close();
+		}
+	};
+
+	// Linear RGBA floats, in Decoded or in File.
+	struct FFrameImage
+	{
+		FIntPoint Size = FIntPoint::ZeroValue;
+		const float* Pixels = nullptr;
+		FMappedFile File;
+		FImage Decoded;
+
+		void Reset()
+		{
+			Size = FIntPoint::ZeroValue;
+			Pixels = nullptr;
+			File.Close();
+			Decoded = FImage();
+		}
+	};
+
+	struct FBatchFrame
+	{
+		FString Filename;
+		FFrameImage Color;
+		LineArtCPU::FGBuffer GBuffer;
+		bool bGBuffer = false;
+		bool bValid = false;
+		TArray64<float> Output;
+	};
+
+	bool IsRawFile(const FString& Filename)
+	{
+		return FPaths::GetExtension(Filename).Equals(TEXT("raw"), ESearchCase::IgnoreCase);
+	}
+
+	bool IsFrameFile(const FString& Filename)
+	{
+		const FString Extension = FPaths::GetExtension(Filename);
+		return IsRawFile(Filename) || Extension.Equals(TEXT("exr"), ESearchCase::IgnoreCase) || Extension.Equals(TEXT("png"), ESearchCase::IgnoreCase);
+	}
+
+	bool LoadImage(const FString& Filename, const FBatchContext& Context, FFrameImage& OutImage)
+	{
+		if (!OutImage.File.Open(Filename))
+		{
+			UE_LOG(LogAnimepoy, Error, TEXT("Cannot map %s"), *Filename);
+			return false;
+		}
+
+		const uint8* Data = OutImage.File.Region->GetMappedPtr();
+		const int64 DataSize = OutImage.File.Region->GetMappedSize();
+
+		if (IsRawFile(Filename))
+		{
+			const int64 ExpectedSize = int64(Context.RawSize.X) * Context.RawSize.Y * 4 * sizeof(float);
+			if (DataSize != ExpectedSize || ExpectedSize == 0)
+			{
+				UE_LOG(LogAnimepoy, Error, TEXT("%s is %lld bytes, -RawSize=%dx%d needs %lld"), *Filename, DataSize, Context.RawSize.X, Context.RawSize.Y, ExpectedSize);
+				return false;
+			}
+
+			OutImage.Size = Context.RawSize;
+			OutImage.Pixels = reinterpret_cast<const float*>(Data);
+			return true;
+		}
+
+		if (!Context.ImageWrapperModule->DecompressImage(Data, DataSize, OutImage.Decoded))
+		{
+			UE_LOG(LogAnimepoy, Error, TEXT("Cannot decode %s"), *Filename);
+			return false;
+		}
+
+		OutImage.File.Close();
+		OutImage.Decoded.ChangeFormat(ERawImageFormat::RGBA32F, EGammaSpace::Linear);
+		OutImage.Size = FIntPoint(OutImage.Decoded.SizeX, OutImage.Decoded.SizeY);
+		OutImage.Pixels = reinterpret_cast<const float*>(OutImage.Decoded.RawData.GetData());
+		return true;
+	}
+
+	bool SaveImage(const FString& Filename, FIntPoint Size, TArray64<float>& Pixels, const FBatchContext& Context)
+	{
+		if (IsRawFile(Filename))
+		{
+			return FFileHelper::SaveArrayToFile(TArrayView64<const uint8>(reinterpret_cast<const uint8*>(Pixels.GetData()), Pixels.Num() * sizeof(float)), *Filename);
+		}
+
+		const bool bPNG = FPaths::GetExtension(Filename).Equals(TEXT("png"), ESearchCase::IgnoreCase);
+		const FImageView Image(Pixels.GetData(), Size.X, Size.Y, 1, ERawImageFormat::RGBA32F, EGammaSpace::Linear);
+
+		FImage Converted;
+		if (bPNG)
+		{
+			Converted.Init(Size.X, Size.Y, ERawImageFormat::BGRA8, EGammaSpace::sRGB);
+			FImageCore::CopyImage(Image, Converted);
+		}
+
+		TArray64<uint8> Compressed;
+		if (!Context.ImageWrapperModule->CompressImage(Compressed, bPNG ? EImageFormat::PNG : EImageFormat::EXR, bPNG ? FImageView(Converted) : Image))
+		{
+			UE_LOG(LogAnimepoy, Error, TEXT("Cannot encode %s"), *Filename);
+			return false;
+		}
+
+		return FFileHelper::SaveArrayToFile(Compressed, *Filename);
+	}
+
+	// The view of the G-buffer dumps of the frame called Name, false when there are none.
+	bool LoadView(const FString& Name, const FBatchContext& Context, LineArtCPU::FGBuffer& OutGBuffer)
+	{
+		const FString ViewFilename = Context.GBufferDir / Name + TEXT(".View.json");
+		if (Context.GBufferDir.IsEmpty() || !FPaths::FileExists(ViewFilename))
+		{
+			return false;
+		}
+
+		FString ViewJson;
+		TSharedPtr<FJsonObject> View;
+		const TArray<TSharedPtr<FJsonValue>>* Matrix = nullptr;
+		if (!FFileHelper::LoadFileToString(ViewJson, *ViewFilename)
+			|| !FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(ViewJson), View)
+			|| !View.IsValid()
+			|| !View->TryGetArrayField(TEXT("SvPositionToTranslatedWorld"), Matrix)
+			|| Matrix->Num() != 16)
+		{
+			UE_LOG(LogAnimepoy, Error, TEXT("%s needs SvPositionToTranslatedWorld as 16 numbers"), *ViewFilename);
+			return false;
+		}
+
+		for (int32 Index = 0; Index < 16; ++Index)
+		{
+			OutGBuffer.SvPositionToTranslatedWorld.M[Index / 4][Index % 4] = (float)(*Matrix)[Index]->AsNumber();
+		}
+
+		const TArray<TSharedPtr<FJsonValue>>* Origin = nullptr;
+		if (View->TryGetArrayField(TEXT("TranslatedWorldCameraOrigin"), Origin) && Origin->Num() == 3)
+		{
+			OutGBuffer.TranslatedWorldCameraOrigin = FVector3f((float)(*Origin)[0]->AsNumber(), (float)(*Origin)[1]->AsNumber(), (float)(*Origin)[2]->AsNumber());
+		}
+
+		return true;
+	}
+
+	// The G-buffer of a frame is dumped like the frame, raw for raw frames and EXR otherwise.
+	FString GetGBufferFilename(const FString& Filename, const TCHAR* Plane, const FBatchContext& Context)
+	{
+		return Context.GBufferDir / FPaths::GetBaseFilename(Filename) + Plane + (IsRawFile(Filename) ? TEXT(".raw") : TEXT(".exr"));
+	}
+
+	// The dumps of each G-buffer plane of the frame in Filename.
+	bool LoadGBufferPlanes(const FString& Filename, const FBatchContext& Context, FFrameImage& OutDeviceZ, FFrameImage& OutGBufferA, FFrameImage& OutGBufferB)
+	{
+		return LoadImage(GetGBufferFilename(Filename, TEXT(".DeviceZ"), Context), Context, OutDeviceZ)
+			&& LoadImage(GetGBufferFilename(Filename, TEXT(".GBufferA"), Context), Context, OutGBufferA)
+			&& LoadImage(GetGBufferFilename(Filename, TEXT(".GBufferB"), Context), Context, OutGBufferB);
+	}
+
+	// G-buffer dumps of the frame in Filename, false when there are none.
+	bool LoadGBuffer(const FString& Filename, FIntPoint Size, const FBatchContext& Context, LineArtCPU::FGBuffer& OutGBuffer)
+	{
+		const FString Name = FPaths::GetBaseFilename(Filename);
+		if (!LoadView(Name, Context, OutGBuffer))
+		{
+			return false;
+		}
+
+		FFrameImage DeviceZ;
+		FFrameImage GBufferA;
+		FFrameImage GBufferB;
+		if (!LoadGBufferPlanes(Filename, Context, DeviceZ, GBufferA, GBufferB))
+		{
+			return false;
+		}
+
+		if (DeviceZ.Size != Size || GBufferA.Size != Size || GBufferB.Size != Size)
+		{
+			UE_LOG(LogAnimepoy, Error, TEXT("The G-buffer of %s does not match the %dx%d frame"), *Name, Size.X, Size.Y);
+			return false;
+		}
+
+		// The line stages index the planes with int32, frames past that stream their raw dumps in tiles.
+		if (int64(Size.X) * Size.Y > MAX_int32)
+		{
+			UE_LOG(LogAnimepoy, Error, TEXT("The G-buffer of %s is too large to hold, filter it as a raw frame over -MemoryBudget"), *Name);
+			return false;
+		}
+
+		const int32 NumPixels = Size.X * Size.Y;
+		OutGBuffer.Size = Size;
+		OutGBuffer.DeviceZ.SetNumUninitialized(NumPixels);
+		for (int32 Index = 0; Index < NumPixels; ++Index)
+		{
+			OutGBuffer.DeviceZ[Index] = DeviceZ.Pixels[4 * int64(Index)];
+		}
+
+		OutGBuffer.GBufferA = TArray<FLinearColor>(reinterpret_cast<const FLinearColor*>(GBufferA.Pixels), NumPixels);
+		OutGBuffer.GBufferB = TArray<FLinearColor>(reinterpret_cast<const FLinearColor*>(GBufferB.Pixels), NumPixels);
+		return true;
+	}
+
+	bool DecodeFrame(FBatchFrame& Frame, const FBatchContext& Context)
+	{
+		if (!LoadImage(Context.InputDir / Frame.Filename, Context, Frame.Color))
+		{
+			return false;
+		}
+
+		Frame.bGBuffer = Context.RenderProxy.bLineArt && LoadGBuffer(Frame.Filename, Frame.Color.Size, Context, Frame.GBuffer);
+		return true;
+	}
+
+	// The largest color channel of NumPixels RGBA pixels.
+	float GetMaxColor(const float* Pixels, int64 NumPixels)
+	{
+		float MaxColor = 0.f;
+		for (int64 Index = 0; Index < NumPixels; ++Index)
+		{
+			MaxColor = FMath::Max3(MaxColor, FMath::Max(Pixels[4 * Index], Pixels[4 * Index + 1]), Pixels[4 * Index + 2]);
+		}
+		return MaxColor;
+	}
+
+	// The diffusion filter runs on display values, as after the tonemapper, so HDR frames glow differently than in the editor.
+	void WarnOverDisplayRange(const FString& Filename, float MaxColor, const FBatchContext& Context)
+	{
+		if (Context.RenderProxy.bDiffusionFilter && MaxColor > 1.f)
+		{
+			UE_LOG(LogAnimepoy, Warning, TEXT("%s has colors up to %.2f. The diffusion filter expects tonemapped frames in [0, 1]"), *Filename, MaxColor);
+		}
+	}
+
+	void FilterFrame(FBatchFrame& Frame, const FBatchContext& Context)
+	{
+		const FIntPoint Size = Frame.Color.Size;
+		Frame.Output.SetNumUninitialized(4 * int64(Size.X) * Size.Y);
+
+		if (Context.RenderProxy.bDiffusionFilter)
+		{
+			WarnOverDisplayRange(Frame.Filename, GetMaxColor(Frame.Color.Pixels, int64(Size.X) * Size.Y), Context);
+		}
+
+		const LineArtCPU::FGBuffer* GBuffer = Frame.bGBuffer ? &Frame.GBuffer : nullptr;
+		if (Context.MemoryBudget > 0 && AnimepoyCPU::GetFrameBytes(Size, Context.RenderProxy, Frame.bGBuffer) > Context.MemoryBudget)
+		{
+			// Decoding needs the whole frame, so only the buffers of the stages keep to the budget. Raw frames stream from their files instead.
+			if (!Context.bWarnedDecodedOverBudget.exchange(true))
+			{
+				UE_LOG(LogAnimepoy, Warning, TEXT("%s is over -MemoryBudget. Decoded frames are held whole with only their stages in tiles, .raw frames stream from disk"), *Frame.Filename);
+			}
+
+			Frame.bValid = AnimepoyCPU::FilterTiled(AnimepoyCPU::MakeTiledImage(Frame.Color.Pixels, Frame.Output.GetData(), Size, GBuffer), Context.RenderProxy, Context.MemoryBudget);
+		}
+		else
+		{
+			AnimepoyCPU::FilterFrame(Frame.Color.Pixels, Frame.Output.GetData(), Size, GBuffer, Context.RenderProxy);
+		}
+
+		// The output holds the frame from here on.
+		Frame.Color.Reset();
+		Frame.Color.Size = Size;
+		Frame.GBuffer = LineArtCPU::FGBuffer();
+	}
+
+	// Rows of Rect out of the mapped RGBA pixels of Image.
+	void CopyRows(const FFrameImage& Image, const FIntRect& Rect, float* OutPixels)
+	{
+		for (int32 Y = 0; Y < Rect.Height(); ++Y)
+		{
+			FMemory::Memcpy(OutPixels + 4 * Y * Rect.Width(), Image.Pixels + 4 * (int64(Rect.Min.Y + Y) * Image.Size.X + Rect.Min.X), 4 * Rect.Width() * sizeof(float));
+		}
+	}
+
+	// A raw frame over the memory budget, filtered a tile at a time from its mapping into the output file.
+	// Only the tiles and the diffusion mask are allocated, the mapped pages belong to the file cache.
+	bool FilterTiledFrame(const FString& Filename, const FBatchContext& Context)
+	{
+		FFrameImage Color;
+		if (!LoadImage(Context.InputDir / Filename, Context, Color))
+		{
+			return false;
+		}
+
+		// Raw G-buffer dumps, RGBA floats of the frame size like the frame.
+		LineArtCPU::FGBuffer View;
+		FFrameImage DeviceZ;
+		FFrameImage GBufferA;
+		FFrameImage GBufferB;
+		const bool bGBuffer = Context.RenderProxy.bLineArt
+			&& LoadView(FPaths::GetBaseFilename(Filename), Context, View)
+			&& LoadGBufferPlanes(Filename, Context, DeviceZ, GBufferA, GBufferB);
+
+		const FString OutputFilename = Context.OutputDir / Filename;
+		const FIntPoint Size = Color.Size;
+		const int64 RowBytes = 4 * sizeof(float) * int64(Size.X);
+
+		TUniquePtr<IFileHandle> Output(FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*OutputFilename, false, true));
+		if (!Output || !Output->Truncate(RowBytes * Size.Y))
+		{
+			UE_LOG(LogAnimepoy, Error, TEXT("Cannot create %s"), *OutputFilename);
+			return false;
+		}
+
+		// Checked on the tiles as they are read, the frame is not held at once.
+		float MaxColor = 0.f;
+
+		AnimepoyCPU::FTiledImage Image;
+		Image.Size = Size;
+		Image.ReadColor = [&Color, &MaxColor](const FIntRect& Rect, float* OutPixels)
+		{
+			CopyRows(Color, Rect, OutPixels);
+			MaxColor = FMath::Max(MaxColor, GetMaxColor(OutPixels, Rect.Area()));
+			return true;
+		};
+
+		if (bGBuffer)
+		{
+			Image.ReadGBuffer = [&](const FIntRect& Rect, LineArtCPU::FGBuffer& OutGBuffer)
+			{
+				OutGBuffer = View;
+				OutGBuffer.Size = Rect.Size();
+				OutGBuffer.DeviceZ.SetNumUninitialized(Rect.Area());
+				OutGBuffer.GBufferA.SetNumUninitialized(Rect.Area());
+				OutGBuffer.GBufferB.SetNumUninitialized(Rect.Area());
+				CopyRows(GBufferA, Rect, &OutGBuffer.GBufferA[0].R);
+				CopyRows(GBufferB, Rect, &OutGBuffer.GBufferB[0].R);
+
+				for (int32 Y = 0; Y < Rect.Height(); ++Y)
+				{
+					for (int32 X = 0; X < Rect.Width(); ++X)
+					{
+						OutGBuffer.DeviceZ[Y * Rect.Width() + X] = DeviceZ.Pixels[4 * (int64(Rect.Min.Y + Y) * Size.X + Rect.Min.X + X)];
+					}
+				}
+				return true;
+			};
+		}
+
+		// Tiles are written row by row at their place in the file, and read back the same way for the diffusion composite.
+		Image.WriteOutput = [&](const FIntRect& Rect, const float* Pixels)
+		{
+			for (int32 Y = 0; Y < Rect.Height(); ++Y)
+			{
+				if (!Output->Seek(RowBytes * (Rect.Min.Y + Y) + 4 * sizeof(float) * Rect.Min.X)
+					|| !Output->Write(reinterpret_cast<const uint8*>(Pixels + 4 * Y * Rect.Width()), 4 * sizeof(float) * Rect.Width()))
+				{
+					UE_LOG(LogAnimepoy, Error, TEXT("Cannot write %s"), *OutputFilename);
+					return false;
+				}
+			}
+			return true;
+		};
+		Image.ReadOutput = [&](const FIntRect& Rect, float* OutPixels)
+		{
+			for (int32 Y = 0; Y < Rect.Height(); ++Y)
+			{
+				if (!Output->Seek(RowBytes * (Rect.Min.Y + Y) + 4 * sizeof(float) * Rect.Min.X)
+					|| !Output->Read(reinterpret_cast<uint8*>(OutPixels + 4 * Y * Rect.Width()), 4 * sizeof(float) * Rect.Width()))
+				{
+					UE_LOG(LogAnimepoy, Error, TEXT("Cannot read back %s"), *OutputFilename);
+					return false;
+				}
+			}
+			return true;
+		};
+
+		const bool bFiltered = AnimepoyCPU::FilterTiled(Image, Context.RenderProxy, Context.MemoryBudget);
+		WarnOverDisplayRange(Filename, MaxColor, Context);
+		return bFiltered;
+	}
+
+	// Properties of Settings over the defaults of Preset, mapped to the renderer like the actor does.
+	bool LoadSettings(const FString& Params, FAnimepoyRenderProxy& OutRenderProxy)
+	{
+		UClass* PresetClass = AAnimepoy::StaticClass();
+
+		FString Preset;
+		if (FParse::Value(*Params, TEXT("Preset="), Preset))
+		{
+			PresetClass = LoadClass<AAnimepoy>(nullptr, *Preset);
+			if (!PresetClass)
+			{
+				UE_LOG(LogAnimepoy, Error, TEXT("%s is not a class derived from AAnimepoy"), *Preset);
+				return false;
+			}
+		}
+
+		AAnimepoy* Settings = NewObject<AAnimepoy>(GetTransientPackage(), PresetClass, NAME_None, RF_Transient);
+
+		FString SettingsFilename;
+		if (FParse::Value(*Params, TEXT("Settings="), SettingsFilename))
+		{
+			FString SettingsJson;
+			TSharedPtr<FJsonObject> JsonObject;
+			if (!FFileHelper::LoadFileToString(SettingsJson, *SettingsFilename)
+				|| !FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(SettingsJson), JsonObject)
+				|| !JsonObject.IsValid()
+				|| !FJsonObjectConverter::JsonObjectToUStruct(JsonObject.ToSharedRef(), PresetClass, Settings, CPF_Edit))
+			{
+				UE_LOG(LogAnimepoy, Error, TEXT("Cannot read the settings in %s"), *SettingsFilename);
+				return false;
+			}
+		}
+
+		OutRenderProxy = Settings->CreateRenderProxy();
+
+		if (OutRenderProxy.bPrePostProcessKuwaharaFilter && OutRenderProxy.PrePostProcessKuwaharaFilterResolution != EAnimeKuwaharaFilterResolution::Full)
+		{
+			UE_LOG(LogAnimepoy, Warning, TEXT("The batch Kuwahara filter always runs at full resolution"));
+		}
+
+		if (OutRenderProxy.bGBufferKuwaharaFilter)
+		{
+			UE_LOG(LogAnimepoy, Warning, TEXT("The G-buffer Kuwahara filter needs the renderer and is skipped"));
+		}
+
+		return true;
+	}
+}
+
+UAnimepoyBatchCommandlet::UAnimepoyBatchCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UAnimepoyBatchCommandlet::Main(const FString& Params)
+{
+	FBatchContext Context;
+	if (!FParse::Value(*Params, TEXT("Input="), Context.InputDir) || !FParse::Value(*Params, TEXT("Output="), Context.OutputDir))
+	{
+		UE_LOG(LogAnimepoy, Error, TEXT("Usage: -run=AnimepoyBatch -Input=<Dir> -Output=<Dir> [-Settings=<Json>] [-Preset=<Class>] [-GBuffer=<Dir>] [-RawSize=<W>x<H>] [-InFlight=<N>] [-MemoryBudget=<MB>]"));
+		return 1;
+	}
+
+	FParse::Value(*Params, TEXT("GBuffer="), Context.GBufferDir);
+
+	FString RawSize;
+	FString RawWidth;
+	FString RawHeight;
+	if (FParse::Value(*Params, TEXT("RawSize="), RawSize) && RawSize.Split(TEXT("x"), &RawWidth, &RawHeight))
+	{
+		Context.RawSize = FIntPoint(FCString::Atoi(*RawWidth), FCString::Atoi(*RawHeight));
+	}
+
+	// Frames between decode and encode, each holding its input and output.
+	int32 MaxInFlight = 3;
+	FParse::Value(*Params, TEXT("InFlight="), MaxInFlight);
+	MaxInFlight = FMath::Max(MaxInFlight, 1);
+
+	int64 MemoryBudgetMegabytes = 0;
+	if (FParse::Value(*Params, TEXT("MemoryBudget="), MemoryBudgetMegabytes))
+	{
+		Context.MemoryBudget = MemoryBudgetMegabytes * 1024 * 1024;
+	}
+
+	if (!LoadSettings(Params, Context.RenderProxy))
+	{
+		return 1;
+	}
+
+	TArray<FString> Frames;
+	IFileManager::Get().FindFiles(Frames, *(Context.InputDir / TEXT("*")), true, false);
+	Frames.RemoveAll([](const FString& Filename) { return !IsFrameFile(Filename); });
+	Frames.Sort();
+
+	if (Frames.IsEmpty())
+	{
+		UE_LOG(LogAnimepoy, Error, TEXT("No .exr, .png or .raw frames in %s"), *Context.InputDir);
+		return 1;
+	}
+
+	IFileManager::Get().MakeDirectory(*Context.OutputDir, true);
+	Context.ImageWrapperModule = &FModuleManager::LoadModuleChecked<IImageWrapperModule>(TEXT("ImageWrapper"));
+
+	const FAnimepoyRenderProxy& RenderProxy = Context.RenderProxy;
+	UE_LOG(LogAnimepoy, Display, TEXT("Stylizing %d frames from %s, Kuwahara %d, lines %d, diffusion %d, %d in flight"),
+		Frames.Num(), *Context.InputDir, RenderProxy.bPrePostProcessKuwaharaFilter, RenderProxy.bLineArt && !Context.GBufferDir.IsEmpty(), RenderProxy.bDiffusionFilter, MaxInFlight);
+
+	// Decode, filter and encode of a frame run in order, different frames overlap. The filters use every core on their own,
+	// so the window only has to cover the file and codec time of the frames around the one being filtered.
+	// Decoded frames over the budget are filtered in tiles by FilterFrame once their size is known.
+	const bool bTiledRawFrames = Context.MemoryBudget > 0
+		&& AnimepoyCPU::GetFrameBytes(Context.RawSize, RenderProxy, RenderProxy.bLineArt && !Context.GBufferDir.IsEmpty()) > Context.MemoryBudget;
+
+	const double StartSeconds = FPlatformTime::Seconds();
+	TArray<UE::Tasks::FTask> InFlight;
+	for (const FString& Filename : Frames)
+	{
+		// Tiled frames take the whole budget and every core, so they run alone.
+		if (bTiledRawFrames && IsRawFile(Filename))
+		{
+			UE::Tasks::Wait(InFlight);
+			InFlight.Reset();
+
+			if (FilterTiledFrame(Filename, Context))
+			{
+				Context.NumPixels += int64(Context.RawSize.X) * Context.RawSize.Y;
+			}
+			else
+			{
+				++Context.NumFailed;
+			}
+			continue;
+		}
+
+		if (InFlight.Num() >= MaxInFlight)
+		{
+			InFlight[0].Wait();
+			InFlight.RemoveAt(0);
+		}
+
+		TSharedRef<FBatchFrame> Frame = MakeShared<FBatchFrame>();
+		Frame->Filename = Filename;
+
+		const UE::Tasks::FTask Decode = UE::Tasks::Launch(UE_SOURCE_LOCATION, [Frame, &Context]
+			{
+				Frame->bValid = DecodeFrame(*Frame, Context);
+			});
+
+		const UE::Tasks::FTask Filter = UE::Tasks::Launch(UE_SOURCE_LOCATION, [Frame, &Context]
+			{
+				if (Frame->bValid)
+				{
+					FilterFrame(*Frame, Context);
+				}
+			}, UE::Tasks::Prerequisites(Decode));
+
+		InFlight.Add(UE::Tasks::Launch(UE_SOURCE_LOCATION, [Frame, &Context]
+			{
+				if (Frame->bValid && SaveImage(Context.OutputDir / Frame->Filename, Frame->Color.Size, Frame->Output, Context))
+				{
+					Context.NumPixels += int64(Frame->Color.Size.X) * Frame->Color.Size.Y;
+				}
+				else
+				{
+					++Context.NumFailed;
+				}
+			}, UE::Tasks::Prerequisites(Filter)));
+	}
+
+	UE::Tasks::Wait(InFlight);
+
+	const double Seconds = FPlatformTime::Seconds() - StartSeconds;
+	UE_LOG(LogAnimepoy, Display, TEXT("Stylized %d frames in %.2f s, %.2f frames/s, %.2f MP/s, %d failed"),
+		Frames.Num() - Context.NumFailed.load(), Seconds, (Frames.Num() - Context.NumFailed.load()) / Seconds, Context.NumPixels.load() / 1e6 / Seconds, Context.NumFailed.load());
+
+	return Context.NumFailed.load() > 0 ? 1 : 0;
+}
@@ -0,0 +1,29 @@
+// @Custom
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "AnimepoyBatchCommandlet.generated.h"
+
+// Stylizes a directory of frames on the CPU with the Kuwahara, line and diffusion stages of an AAnimepoy.
+//
+// UnrealEditor-Cmd <Project> -run=AnimepoyBatch -Input=<Dir> -Output=<Dir> [-Settings=<Json>] [-Preset=<Class>] [-GBuffer=<Dir>] [-RawSize=<W>x<H>] [-InFlight=<N>] [-MemoryBudget=<MB>]
+//
+// Frames are .exr, .png or .raw, the last being RGBA floats with no header, all -RawSize. They are written to Output in the same format.
+// The diffusion filter sees the frames sRGB encoded, like after the tonemapper, so HDR frames with colors over 1 are warned about.
+// Settings is a JSON object of AAnimepoy property names, applied over the defaults of Preset, a Blueprint class derived from AAnimepoy.
+// Lines are drawn on the frames with <Name>.DeviceZ.exr, <Name>.GBufferA.exr, <Name>.GBufferB.exr and <Name>.View.json in GBuffer,
+// the view holding SvPositionToTranslatedWorld as 16 numbers in row major order and optionally TranslatedWorldCameraOrigin.
+// The G-buffer dumps of raw frames are <Name>.DeviceZ.raw, <Name>.GBufferA.raw and <Name>.GBufferB.raw instead, RGBA floats like the frames.
+// Raw frames whose buffers would exceed MemoryBudget are filtered in tiles straight from and to their files, see AnimepoyCPU::FilterTiled.
+// Decoded .exr and .png frames over MemoryBudget are held whole and only their stages are filtered in tiles, with a warning.
+UCLASS()
+class UAnimepoyBatchCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UAnimepoyBatchCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,41 @@
+// @Custom
+#pragma once
+
+#include "ScreenPass.h"
+
+// Views of one family that share the same textures side by side, like stereo eyes or split screen,
+// can run a pass as one dispatch over the union of their rects. Matches MAX_BATCHED_VIEWS.
+constexpr int32 GMaxBatchedViews = 4;
+
+// Rects of the batched views. Empty when the pass runs for its own view only.
+using FBatchedViewRects = TArray<FIntRect, TInlineAllocator<GMaxBatchedViews>>;
+
+BEGIN_SHADER_PARAMETER_STRUCT(FBatchedViewParameters, )
+	SHADER_PARAMETER(uint32, NumBatchedViews)
+	SHADER_PARAMETER_ARRAY(FIntVector4, BatchedViewRects, [GMaxBatchedViews])
+END_SHADER_PARAMETER_STRUCT()
+
+// Returns the rect a pass covers, the union of the batched views or ViewRect.
+inline FIntRect GetBatchedViewRect(const FIntRect& ViewRect, const FBatchedViewRects& BatchedViewRects)
+{
+	FIntRect Rect = ViewRect;
+	for (const FIntRect& BatchedViewRect : BatchedViewRects)
+	{
+		Rect.Union(BatchedViewRect);
+	}
+	return Rect;
+}
+
+inline FBatchedViewParameters GetBatchedViewParameters(const FBatchedViewRects& BatchedViewRects)
+{
+	check(BatchedViewRects.Num() <= GMaxBatchedViews);
+
+	FBatchedViewParameters Parameters{};
+	Parameters.NumBatchedViews = BatchedViewRects.Num();
+	for (int32 Index = 0; Index < BatchedViewRects.Num(); ++Index)
+	{
+		const FIntRect& Rect = BatchedViewRects[Index];
+		Parameters.BatchedViewRects[Index] = FIntVector4(Rect.Min.X, Rect.Min.Y, Rect.Max.X, Rect.Max.Y);
+	}
+	return Parameters;
+}
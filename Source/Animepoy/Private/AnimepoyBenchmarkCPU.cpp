@@ -0,0 +1,66 @@
+// @Custom
+#include "AnimepoyBenchmarkCPU.h"
+#include "AnimepoyModule.h"
+#include "Async/TaskGraphInterfaces.h"
+
+namespace AnimepoyBenchmarkCPU
+{
+	int32 GetNumCores()
+	{
+		return FMath::Max(FPlatformMisc::NumberOfCores(), 1);
+	}
+
+	void LogHeader(const FString& Title, int32 NumIterations)
+	{
+		// ParallelFor runs on the workers and the calling thread.
+		const int32 NumThreads = FTaskGraphInterface::Get().GetNumWorkerThreads() + 1;
+		UE_LOG(LogAnimepoy, Display, TEXT("%s, best of %d, %d threads on %d cores"), *Title, NumIterations, NumThreads, GetNumCores());
+	}
+
+	double MeasureSeconds(int32 NumIterations, TFunctionRef<void()> Function)
+	{
+		double BestSeconds = MAX_dbl;
+		for (int32 Iteration = 0; Iteration < NumIterations; ++Iteration)
+		{
+			const double StartSeconds = FPlatformTime::Seconds();
+			Function();
+			BestSeconds = FMath::Min(BestSeconds, FPlatformTime::Seconds() - StartSeconds);
+		}
+		return BestSeconds;
+	}
+
+	void LogThroughput(const FString& Label, double Megapixels, double Seconds, double SingleThreadSeconds, const FString& Details)
+	{
+		FString Line = FString::Printf(TEXT("  %s: %8.2f ms %8.2f MP/s (%.2f MP/s per core)"), *Label, Seconds * 1000.0, Megapixels / Seconds, Megapixels / Seconds / GetNumCores());
+		if (SingleThreadSeconds > 0.0)
+		{
+			Line += FString::Printf(TEXT(", %7.2f MP/s on one core"), Megapixels / SingleThreadSeconds);
+		}
+		if (!Details.IsEmpty())
+		{
+			Line += TEXT(", ") + Details;
+		}
+		UE_LOG(LogAnimepoy, Display, TEXT("%s"), *Line);
+	}
+
+	FImageDifference CompareImages(TConstArrayView<FLinearColor> Reference, TConstArrayView<FLinearColor> Result, bool bAlpha)
+	{
+		check(Reference.Num() == Result.Num());
+
+		FImageDifference Difference;
+		for (int32 Index = 0; Index < Reference.Num(); ++Index)
+		{
+			const FLinearColor Delta = Reference[Index] - Result[Index];
+			float Error = FMath::Max3(FMath::Abs(Delta.R), FMath::Abs(Delta.G), FMath::Abs(Delta.B));
+			Error = bAlpha ? FMath::Max(Error, FMath::Abs(Delta.A)) : Error;
+			Difference.MaxError = FMath::Max(Difference.MaxError, Error);
+			Difference.NumDifferent += Error > 0.f ? 1 : 0;
+		}
+		return Difference;
+	}
+
+	void LogDifference(const FString& Label, const FImageDifference& Difference)
+	{
+		UE_LOG(LogAnimepoy, Display, TEXT("  %s: %d pixels differ, max difference to the reference %.3g"), *Label, Difference.NumDifferent, Difference.MaxError);
+	}
+}
@@ -0,0 +1,32 @@
+// @Custom
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Timing and checks shared by the Animepoy.*.BenchmarkCPU commands of the CPU stages.
+namespace AnimepoyBenchmarkCPU
+{
+	// Physical cores, which throughput per core is divided by. Hyperthreads share the vector units of their core.
+	int32 GetNumCores();
+
+	// Logs Title with the iterations, the threads ParallelFor runs on and the cores.
+	void LogHeader(const FString& Title, int32 NumIterations);
+
+	// Best wall time of NumIterations calls to Function, in seconds.
+	double MeasureSeconds(int32 NumIterations, TFunctionRef<void()> Function);
+
+	// Logs the time and throughput of Label over Megapixels, per core and, with SingleThreadSeconds, on one core.
+	// Details are appended to the line.
+	void LogThroughput(const FString& Label, double Megapixels, double Seconds, double SingleThreadSeconds = 0.0, const FString& Details = FString());
+
+	struct FImageDifference
+	{
+		float MaxError = 0.f;
+		int32 NumDifferent = 0;
+	};
+
+	// The largest difference of the RGB channels of two images of the same size, also of alpha with bAlpha.
+	FImageDifference CompareImages(TConstArrayView<FLinearColor> Reference, TConstArrayView<FLinearColor> Result, bool bAlpha = false);
+
+	void LogDifference(const FString& Label, const FImageDifference& Difference);
+}
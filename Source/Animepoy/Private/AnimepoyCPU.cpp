@@ -0,0 +1,397 @@
+// @Custom
+#include "AnimepoyCPU.h"
+#include "AnimepoyBenchmarkCPU.h"
+#include "AnimepoyModule.h"
+#include "DiffusionFilterCPU.h"
+#include "KuwaharaFilterCPU.h"
+#include "KuwaharaFilterReference.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/Optional.h"
+
+namespace AnimepoyCPU
+{
+	namespace
+	{
+		// Tiles of the Kuwahara summed area table. Tiles and aprons start on this grid, so the tile-local tables are those of the whole image.
+		constexpr int32 GTableTileSize = 16;
+
+		// Bytes per pixel of a tile held by each stage: the pixels read and the tile cropped from them,
+		// the tile-local table and the prefix sums, and the G-buffer with its decoded planes and line buffers.
+		constexpr int64 GColorBytesPerPixel = 2 * sizeof(FLinearColor);
+		constexpr int64 GKuwaharaBytesPerPixel = 24;
+		constexpr int64 GLineBytesPerPixel = 104;
+
+		// Share of the budget for the diffusion mask, the tiles get the rest.
+		constexpr int64 GDiffusionMaskBudgetDivisor = 4;
+
+		int64 GetBytesPerPixel(const FAnimepoyRenderProxy& RenderProxy, bool bLines)
+		{
+			return GColorBytesPerPixel + (RenderProxy.bPrePostProcessKuwaharaFilter ? GKuwaharaBytesPerPixel : 0) + (bLines ? GLineBytesPerPixel : 0);
+		}
+
+		void DrawLines(float* SceneColor, FIntPoint Size, const LineArtCPU::FGBuffer& GBuffer, const FLineArtPassInputs& Inputs, bool bSingleThread)
+		{
+			const FLineArtThresholds Thresholds = GetLineArtThresholds(Inputs);
+
+			TArray<uint16> LineTexture;
+			TArray<float> LineDepth;
+			LineArtCPU::DetectLines(GBuffer, Thresholds, LineTexture, bSingleThread);
+			LineArtCPU::DilateLines(LineTexture, Size, Thresholds, LineDepth, bSingleThread);
+			LineArtCPU::CompositeLines(SceneColor, Size, LineDepth, Inputs.LineColor, Inputs.bPreview, bSingleThread);
+		}
+
+		// Pixels per ParallelFor task of the display encoding.
+		constexpr int64 GEncodeBlockSize = 16 * 1024;
+
+		// The sRGB transfer function, extended past [0, 1] so that decoding gives back any linear value.
+		float EncodeDisplay(float Linear)
+		{
+			return Linear <= 0.0031308f ? 12.92f * Linear : 1.055f * FMath::Pow(Linear, 1.f / 2.4f) - 0.055f;
+		}
+
+		float DecodeDisplay(float Display)
+		{
+			return Display <= 0.04045f ? Display / 12.92f : FMath::Pow((Display + 0.055f) / 1.055f, 2.4f);
+		}
+
+		// The tonemapper hands the diffusion filter display values, so the linear frame is encoded around it. Alpha is kept.
+		void ConvertColors(float* Pixels, int64 NumPixels, float (*Convert)(float), bool bSingleThread)
+		{
+			ParallelFor((int32)FMath::DivideAndRoundUp(NumPixels, GEncodeBlockSize), [Pixels, NumPixels, Convert](int32 Block)
+				{
+					const int64 End = FMath::Min((Block + 1) * GEncodeBlockSize, NumPixels);
+					for (int64 Index = Block * GEncodeBlockSize; Index < End; ++Index)
+					{
+						float* Pixel = Pixels + 4 * Index;
+						Pixel[0] = Convert(Pixel[0]);
+						Pixel[1] = Convert(Pixel[1]);
+						Pixel[2] = Convert(Pixel[2]);
+					}
+				}, bSingleThread ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+		}
+
+		// Copies Rect out of RGBA pixels SourceWidth wide.
+		void CopyRect(const float* Source, int32 SourceWidth, const FIntRect& Rect, float* Dest)
+		{
+			for (int32 Y = 0; Y < Rect.Height(); ++Y)
+			{
+				FMemory::Memcpy(Dest + 4 * Y * Rect.Width(), Source + 4 * (int64(Rect.Min.Y + Y) * SourceWidth + Rect.Min.X), 4 * Rect.Width() * sizeof(float));
+			}
+		}
+
+		// Copies the pixels of Rect into RGBA pixels DestWidth wide.
+		void PasteRect(const float* Source, const FIntRect& Rect, float* Dest, int32 DestWidth)
+		{
+			for (int32 Y = 0; Y < Rect.Height(); ++Y)
+			{
+				FMemory::Memcpy(Dest + 4 * (int64(Rect.Min.Y + Y) * DestWidth + Rect.Min.X), Source + 4 * Y * Rect.Width(), 4 * Rect.Width() * sizeof(float));
+			}
+		}
+
+		// The largest tile on the alignment whose pixels with the apron fit in Budget, at least one alignment.
+		int32 GetTileSize(int64 Budget, int64 BytesPerPixel, int32 Apron, int32 Alignment, FIntPoint Size)
+		{
+			const int64 Side = (int64)FMath::Sqrt(double(FMath::Max<int64>(Budget, 0)) / double(BytesPerPixel));
+			const int64 TileSize = FMath::Max<int64>((Side - 2 * Apron) / Alignment * Alignment, Alignment);
+			return (int32)FMath::Min<int64>(TileSize, Align(FMath::Max(Size.X, Size.Y), Alignment));
+		}
+
+		void BenchmarkFilterTiled(const TArray<FString>& Args)
+		{
+			const int32 Width = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 16) : 4096;
+			const int32 Height = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 16) : 4096;
+			const int64 BudgetMegabytes = Args.Num() > 2 ? FMath::Max<int64>(FCString::Atoi64(*Args[2]), 1) : 64;
+			const int32 FilterSize = Args.Num() > 3 ? FMath::Clamp(FCString::Atoi(*Args[3]), 1, 256) : 4;
+			const FIntPoint Size(Width, Height);
+			const double Megapixels = double(Width) * Height / 1e6;
+
+			// AAnimepoy defaults with every CPU stage on.
+			FAnimepoyRenderProxy RenderProxy = GetDefault<AAnimepoy>()->CreateRenderProxy();
+			RenderProxy.bLineArt = true;
+			RenderProxy.LineWidth = 3;
+			RenderProxy.bPrePostProcessKuwaharaFilter = true;
+			RenderProxy.PrePostProcessKuwaharaFilterSize = FilterSize;
+			RenderProxy.bDiffusionFilter = true;
+
+			TArray<FLinearColor> Image;
+			KuwaharaFilterReference::GenerateTestImage(Size, EKuwaharaFilterTargetType::SceneColor, Image);
+			LineArtCPU::FGBuffer GBuffer;
+			LineArtCPU::GenerateTestGBuffer(Size, GBuffer);
+
+			TArray<FLinearColor> Reference;
+			Reference.SetNumUninitialized(Image.Num());
+			const double FrameSeconds = AnimepoyBenchmarkCPU::MeasureSeconds(1, [&] { FilterFrame(&Image[0].R, &Reference[0].R, Size, &GBuffer, RenderProxy); });
+
+			TArray<FLinearColor> Result;
+			Result.SetNumZeroed(Image.Num());
+
+			const FTiledImage TiledImage = MakeTiledImage(&Image[0].R, &Result[0].R, Size, &GBuffer);
+
+			const double TiledSeconds = AnimepoyBenchmarkCPU::MeasureSeconds(1, [&] { FilterTiled(TiledImage, RenderProxy, BudgetMegabytes * 1024 * 1024); });
+
+			AnimepoyBenchmarkCPU::LogHeader(FString::Printf(TEXT("Tiled CPU stages, %dx%d, FilterSize %d"), Width, Height, FilterSize), 1);
+			AnimepoyBenchmarkCPU::LogThroughput(TEXT("Whole frame"), Megapixels, FrameSeconds, 0.0, FString::Printf(TEXT("%.1f MB"), GetFrameBytes(Size, RenderProxy, true) / (1024.0 * 1024.0)));
+			AnimepoyBenchmarkCPU::LogThroughput(TEXT("Tiled"), Megapixels, TiledSeconds, 0.0, FString::Printf(TEXT("%lld MB budget"), BudgetMegabytes));
+			AnimepoyBenchmarkCPU::LogDifference(TEXT("Tiled against the whole frame"), AnimepoyBenchmarkCPU::CompareImages(Reference, Result));
+		}
+
+		FAutoConsoleCommand GBenchmarkFilterTiledCommand(
+			TEXT("Animepoy.Tiled.BenchmarkCPU"),
+			TEXT("Runs every CPU stage on a synthetic image as a whole frame and in tiles within a memory budget, and compares the two.\n")
+			TEXT("Usage: Animepoy.Tiled.BenchmarkCPU [Width=4096] [Height=4096] [BudgetMB=64] [FilterSize=4]"),
+			FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkFilterTiled));
+	}
+
+	FLineArtPassInputs GetLineArtInputs(const FAnimepoyRenderProxy& RenderProxy)
+	{
+		FLineArtPassInputs Inputs;
+		Inputs.DepthLineIntensity = RenderProxy.DepthLineIntensity;
+		Inputs.NormalLineIntensity = RenderProxy.NormalLineIntensity;
+		Inputs.MaterialLineIntensity = RenderProxy.MaterialLineIntensity;
+		Inputs.PlanarLineIntensity = RenderProxy.PlanarLineIntensity;
+		Inputs.NonLineSpecular = 0.f;
+		Inputs.LineWidth = RenderProxy.LineWidth;
+		Inputs.LineColor = RenderProxy.LineColor;
+		Inputs.bPreview = RenderProxy.bPreviewLine;
+		return Inputs;
+	}
+
+	FPostProcessDiffusionInputs GetDiffusionInputs(const FAnimepoyRenderProxy& RenderProxy)
+	{
+		FPostProcessDiffusionInputs Inputs;
+		Inputs.PreTonemapColor = nullptr;
+		Inputs.Intensity = RenderProxy.DiffusionFilterIntensity;
+		Inputs.LuminanceMin = RenderProxy.DiffusionLuminanceMin;
+		Inputs.LuminanceMax = RenderProxy.DiffusionLuminanceMax;
+		Inputs.bPreTonemapLuminance = false;
+		Inputs.BlurPercentage = RenderProxy.DiffusionBlurPercentage;
+		Inputs.BlendMode = (int32)RenderProxy.DiffusionBlendMode;
+		Inputs.bDebugMask = RenderProxy.bPreviewDiffusionMask;
+		return Inputs;
+	}
+
+	void FilterFrame(const float* Input, float* Output, FIntPoint Size, const LineArtCPU::FGBuffer* GBuffer, const FAnimepoyRenderProxy& RenderProxy, bool bSingleThread)
+	{
+		check(Input && Output && Size.X > 0 && Size.Y > 0);
+
+		if (RenderProxy.bPrePostProcessKuwaharaFilter)
+		{
+			KuwaharaFilterCPU::KuwaharaFilter(Input, Output, Size, EKuwaharaFilterTargetType::SceneColor, RenderProxy.PrePostProcessKuwaharaFilterSize, FVector3f(1.f, 0.f, 0.f), bSingleThread);
+		}
+		else if (Output != Input)
+		{
+			FMemory::Memcpy(Output, Input, 4 * int64(Size.X) * Size.Y * sizeof(float));
+		}
+
+		if (RenderProxy.bLineArt && GBuffer && GBuffer->Size == Size)
+		{
+			DrawLines(Output, Size, *GBuffer, GetLineArtInputs(RenderProxy), bSingleThread);
+		}
+
+		if (RenderProxy.bDiffusionFilter)
+		{
+			const int64 NumPixels = int64(Size.X) * Size.Y;
+			ConvertColors(Output, NumPixels, &EncodeDisplay, bSingleThread);
+			DiffusionFilterCPU::DiffusionFilter(Output, Output, Size, GetDiffusionInputs(RenderProxy), nullptr, FIntPoint::ZeroValue, bSingleThread);
+			ConvertColors(Output, NumPixels, &DecodeDisplay, bSingleThread);
+		}
+	}
+
+	int64 GetFrameBytes(FIntPoint Size, const FAnimepoyRenderProxy& RenderProxy, bool bLines)
+	{
+		const int64 MaskBytes = RenderProxy.bDiffusionFilter ? DiffusionFilterCPU::FTiledMask::GetMaskBytes(Size, 0) : 0;
+		return GetBytesPerPixel(RenderProxy, bLines && RenderProxy.bLineArt) * Size.X * Size.Y + MaskBytes;
+	}
+
+	FTiledImage MakeTiledImage(const float* Input, float* Output, FIntPoint Size, const LineArtCPU::FGBuffer* GBuffer)
+	{
+		check(Input && Output && Output != Input);
+
+		FTiledImage Image;
+		Image.Size = Size;
+		Image.ReadColor = [Input, Size](const FIntRect& Rect, float* OutPixels)
+		{
+			CopyRect(Input, Size.X, Rect, OutPixels);
+			return true;
+		};
+
+		if (GBuffer && GBuffer->Size == Size)
+		{
+			Image.ReadGBuffer = [GBuffer, Size](const FIntRect& Rect, LineArtCPU::FGBuffer& OutGBuffer)
+			{
+				OutGBuffer.Size = Rect.Size();
+				OutGBuffer.DeviceZ.SetNumUninitialized(Rect.Area());
+				OutGBuffer.GBufferA.SetNumUninitialized(Rect.Area());
+				OutGBuffer.GBufferB.SetNumUninitialized(Rect.Area());
+				for (int32 Y = 0; Y < Rect.Height(); ++Y)
+				{
+					const int64 SourceIndex = int64(Rect.Min.Y + Y) * Size.X + Rect.Min.X;
+					FMemory::Memcpy(&OutGBuffer.DeviceZ[Y * Rect.Width()], &GBuffer->DeviceZ[SourceIndex], Rect.Width() * sizeof(float));
+					FMemory::Memcpy(&OutGBuffer.GBufferA[Y * Rect.Width()], &GBuffer->GBufferA[SourceIndex], Rect.Width() * sizeof(FLinearColor));
+					FMemory::Memcpy(&OutGBuffer.GBufferB[Y * Rect.Width()], &GBuffer->GBufferB[SourceIndex], Rect.Width() * sizeof(FLinearColor));
+				}
+				OutGBuffer.SvPositionToTranslatedWorld = GBuffer->SvPositionToTranslatedWorld;
+				OutGBuffer.TranslatedWorldCameraOrigin = GBuffer->TranslatedWorldCameraOrigin;
+				return true;
+			};
+		}
+
+		Image.WriteOutput = [Output, Size](const FIntRect& Rect, const float* Pixels)
+		{
+			PasteRect(Pixels, Rect, Output, Size.X);
+			return true;
+		};
+		Image.ReadOutput = [Output, Size](const FIntRect& Rect, float* OutPixels)
+		{
+			CopyRect(Output, Size.X, Rect, OutPixels);
+			return true;
+		};
+
+		return Image;
+	}
+
+	bool FilterTiled(const FTiledImage& Image, const FAnimepoyRenderProxy& RenderProxy, int64 MemoryBudget, bool bSingleThread)
+	{
+		const FIntPoint Size = Image.Size;
+		check(Size.X > 0 && Size.Y > 0 && Image.ReadColor && Image.WriteOutput);
+
+		const bool bKuwahara = RenderProxy.bPrePostProcessKuwaharaFilter;
+		const bool bLines = RenderProxy.bLineArt && Image.ReadGBuffer;
+		const FLineArtPassInputs LineArtInputs = GetLineArtInputs(RenderProxy);
+		const FLineArtThresholds Thresholds = GetLineArtThresholds(LineArtInputs);
+
+		int64 TileBudget = MemoryBudget;
+		TOptional<DiffusionFilterCPU::FTiledMask> DiffusionMask;
+		if (RenderProxy.bDiffusionFilter)
+		{
+			check(Image.ReadOutput);
+			DiffusionMask.Emplace(Size, GetDiffusionInputs(RenderProxy), MemoryBudget / GDiffusionMaskBudgetDivisor);
+			TileBudget -= DiffusionFilterCPU::FTiledMask::GetMaskBytes(Size, DiffusionMask->GetLevel());
+		}
+
+		// Pixels past each side of the tile a stage reads. Lines pair each pixel with its neighbours, then search around it.
+		int32 Apron = 0;
+		if (bKuwahara)
+		{
+			Apron = RenderProxy.PrePostProcessKuwaharaFilterSize;
+		}
+		if (bLines)
+		{
+			Apron = FMath::Max(Apron, FMath::Max(-Thresholds.SearchRangeMin, Thresholds.SearchRangeMax) + 1);
+		}
+		Apron = Align(Apron, GTableTileSize);
+
+		// Both are powers of two, so the larger is a multiple of the other.
+		const int32 Alignment = FMath::Max(GTableTileSize, DiffusionMask ? DiffusionMask->GetAlignment() : 1);
+		const int64 BytesPerPixel = GetBytesPerPixel(RenderProxy, bLines);
+		const int32 TileSize = GetTileSize(TileBudget, BytesPerPixel, Apron, Alignment, Size);
+
+		const int64 TileBytes = BytesPerPixel * FMath::Square(int64(TileSize) + 2 * Apron);
+		if (TileBytes > TileBudget)
+		{
+			UE_LOG(LogAnimepoy, Warning, TEXT("%d pixel tiles with %d pixels of apron need %.1f MB, over the %.1f MB left in the budget"),
+				TileSize, Apron, TileBytes / (1024.0 * 1024.0), TileBudget / (1024.0 * 1024.0));
+		}
+
+		UE_LOG(LogAnimepoy, Display, TEXT("Filtering %dx%d in %d pixel tiles with %d pixels of apron%s"),
+			Size.X, Size.Y, TileSize, Apron, DiffusionMask ? *FString::Printf(TEXT(", diffusion mask from level %d"), DiffusionMask->GetLevel()) : TEXT(""));
+
+		const auto ForEachTile = [Size, TileSize](TFunctionRef<bool(const FIntRect&)> Function)
+		{
+			for (int32 MinY = 0; MinY < Size.Y; MinY += TileSize)
+			{
+				for (int32 MinX = 0; MinX < Size.X; MinX += TileSize)
+				{
+					if (!Function(FIntRect(MinX, MinY, FMath::Min(MinX + TileSize, Size.X), FMath::Min(MinY + TileSize, Size.Y))))
+					{
+						return false;
+					}
+				}
+			}
+			return true;
+		};
+
+		// Without Kuwahara or lines the input is the stylized image, so the first pass only adds to the mask and the composite reads the input.
+		const bool bStylize = bKuwahara || bLines;
+
+		TArray<float> Pixels;
+		TArray<float> Tile;
+		LineArtCPU::FGBuffer GBuffer;
+
+		const bool bStylized = ForEachTile([&](const FIntRect& TileRect)
+			{
+				const FIntRect ReadRect = bStylize
+					? FIntRect(FIntPoint::ComponentMax(TileRect.Min - FIntPoint(Apron), FIntPoint::ZeroValue), FIntPoint::ComponentMin(TileRect.Max + FIntPoint(Apron), Size))
+					: TileRect;
+				const FIntPoint ReadSize = ReadRect.Size();
+
+				Pixels.SetNumUninitialized(4 * ReadRect.Area());
+				if (!Image.ReadColor(ReadRect, Pixels.GetData()))
+				{
+					return false;
+				}
+
+				if (bKuwahara)
+				{
+					KuwaharaFilterCPU::KuwaharaFilter(Pixels.GetData(), Pixels.GetData(), ReadSize, EKuwaharaFilterTargetType::SceneColor, RenderProxy.PrePostProcessKuwaharaFilterSize, FVector3f(1.f, 0.f, 0.f), bSingleThread);
+				}
+
+				if (bLines)
+				{
+					if (!Image.ReadGBuffer(ReadRect, GBuffer))
+					{
+						return false;
+					}
+					check(GBuffer.Size == ReadSize);
+
+					// SvPosition of the crop starts at ReadRect.Min of the image.
+					GBuffer.Min = ReadRect.Min;
+					DrawLines(Pixels.GetData(), ReadSize, GBuffer, LineArtInputs, bSingleThread);
+				}
+
+				float* TilePixels = Pixels.GetData();
+				if (ReadRect != TileRect)
+				{
+					Tile.SetNumUninitialized(4 * TileRect.Area());
+					CopyRect(Pixels.GetData(), ReadSize.X, TileRect - ReadRect.Min, Tile.GetData());
+					TilePixels = Tile.GetData();
+				}
+
+				if ((bStylize || !DiffusionMask) && !Image.WriteOutput(TileRect, TilePixels))
+				{
+					return false;
+				}
+
+				// The written tile stays linear, the mask is added up from the display values.
+				if (DiffusionMask)
+				{
+					ConvertColors(TilePixels, TileRect.Area(), &EncodeDisplay, bSingleThread);
+					DiffusionMask->AddTile(TilePixels, TileRect, bSingleThread);
+				}
+
+				return true;
+			});
+
+		if (!bStylized || !DiffusionMask)
+		{
+			return bStylized;
+		}
+
+		DiffusionMask->Blur(bSingleThread);
+
+		return ForEachTile([&](const FIntRect& TileRect)
+			{
+				Tile.SetNumUninitialized(4 * TileRect.Area());
+				if (!(bStylize ? Image.ReadOutput(TileRect, Tile.GetData()) : Image.ReadColor(TileRect, Tile.GetData())))
+				{
+					return false;
+				}
+
+				ConvertColors(Tile.GetData(), TileRect.Area(), &EncodeDisplay, bSingleThread);
+				DiffusionMask->Composite(Tile.GetData(), Tile.GetData(), TileRect, bSingleThread);
+				ConvertColors(Tile.GetData(), TileRect.Area(), &DecodeDisplay, bSingleThread);
+				return Image.WriteOutput(TileRect, Tile.GetData());
+			});
+	}
+}
@@ -0,0 +1,51 @@
+// @Custom
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Animepoy.h"
+#include "LineArtCPU.h"
+#include "PostProcessDiffusionFilter.h"
+
+// The CPU stages of an AAnimepoy in the order of the scene view extension: the Kuwahara filter, the lines and the diffusion filter.
+namespace AnimepoyCPU
+{
+	// The pass inputs AAnimepoy settings map to, as the scene view extension fills them.
+	FLineArtPassInputs GetLineArtInputs(const FAnimepoyRenderProxy& RenderProxy);
+	FPostProcessDiffusionInputs GetDiffusionInputs(const FAnimepoyRenderProxy& RenderProxy);
+
+	// Filters Size.X * Size.Y linear RGBA pixels, 4 floats each with no row padding. Output may be Input.
+	// Lines are drawn only with a GBuffer of the same size. The diffusion filter runs after the tonemapper on the GPU,
+	// so it filters the sRGB encoding of the pixels and is meant for frames in [0, 1].
+	void FilterFrame(const float* Input, float* Output, FIntPoint Size, const LineArtCPU::FGBuffer* GBuffer, const FAnimepoyRenderProxy& RenderProxy, bool bSingleThread = false);
+
+	// Peak bytes of FilterFrame on a Size frame, including the input and output.
+	int64 GetFrameBytes(FIntPoint Size, const FAnimepoyRenderProxy& RenderProxy, bool bLines);
+
+	// An image kept outside of memory, like a raw file of a 16K poster, read and written a rectangle at a time.
+	// Pixels are RGBA floats of the rectangle with no row padding. The callbacks log their own errors.
+	struct FTiledImage
+	{
+		FIntPoint Size = FIntPoint::ZeroValue;
+
+		TFunction<bool(const FIntRect& Rect, float* OutPixels)> ReadColor;
+
+		// The G-buffer of Rect, with SvPositionToTranslatedWorld of the whole image. Unbound for no lines.
+		TFunction<bool(const FIntRect& Rect, LineArtCPU::FGBuffer& OutGBuffer)> ReadGBuffer;
+
+		// The diffusion filter reads the written tiles back once its mask is complete.
+		TFunction<bool(const FIntRect& Rect, const float* Pixels)> WriteOutput;
+		TFunction<bool(const FIntRect& Rect, float* OutPixels)> ReadOutput;
+	};
+
+	// An image of whole frames in memory, for frames that fit but whose stages do not, and for checking FilterTiled against FilterFrame.
+	// Input, Output and GBuffer are as in FilterFrame, except that Output may not be Input since the aprons are read after
+	// the tiles next to them are written. The buffers must outlive the image.
+	FTiledImage MakeTiledImage(const float* Input, float* Output, FIntPoint Size, const LineArtCPU::FGBuffer* GBuffer);
+
+	// FilterFrame a tile at a time, with the buffers sized to MemoryBudget bytes instead of the image.
+	// The Kuwahara filter and the lines read an apron around each tile, aligned to the tiles of the summed area table,
+	// so every pixel sees the same neighbours as in the whole image. The diffusion mask is added up from the tiles in
+	// a first pass and composited onto the written tiles in a second, see DiffusionFilterCPU::FTiledMask.
+	// Tiles never shrink below their apron, so a budget too small for it is exceeded with a warning.
+	bool FilterTiled(const FTiledImage& Image, const FAnimepoyRenderProxy& RenderProxy, int64 MemoryBudget, bool bSingleThread = false);
+}
@@ -0,0 +1,102 @@
+// @Custom
+#include "AnimepoyPassTimer.h"
+#include "RenderingThread.h"
+
+void FAnimepoyPassTimer::ReadBack()
+{
+	check(IsInRenderingThread());
+
+	while (!PendingFrames.IsEmpty())
+	{
+		FFrameQueries& Frame = PendingFrames[0];
+		if (Frame.Frame == GFrameCounterRenderThread)
+		{
+			break;
+		}
+
+		FAnimepoyPassTimings Timings;
+		bool bReady = true;
+
+		for (FPassQueries& Pass : Frame.Passes)
+		{
+			// Absolute time queries resolve to microseconds.
+			uint64 BeginTime = 0;
+			uint64 EndTime = 0;
+			if (!RHIGetRenderQueryResult(Pass.BeginQuery.GetQuery(), BeginTime, false) || !RHIGetRenderQueryResult(Pass.EndQuery.GetQuery(), EndTime, false))
+			{
+				bReady = false;
+				break;
+			}
+
+			const float Milliseconds = EndTime > BeginTime ? (EndTime - BeginTime) / 1000.f : 0.f;
+			switch (Pass.Pass)
+			{
+			case EAnimepoyTimedPass::KuwaharaFilter: Timings.KuwaharaFilter += Milliseconds; break;
+			case EAnimepoyTimedPass::LineArt: Timings.LineArt += Milliseconds; break;
+			case EAnimepoyTimedPass::DiffusionFilter: Timings.DiffusionFilter += Milliseconds; break;
+			}
+		}
+
+		if (!bReady && PendingFrames.Num() < MaxPendingFrames)
+		{
+			break;
+		}
+
+		if (bReady)
+		{
+			FrameTimings.Enqueue(Timings);
+		}
+
+		// Releases the queries back to the pool.
+		PendingFrames.RemoveAt(0);
+	}
+}
+
+void FAnimepoyPassTimer::BeginPass(FRDGBuilder& GraphBuilder, EAnimepoyTimedPass Pass)
+{
+	check(IsInRenderingThread() && !bPassOpen);
+
+	if (!GSupportsTimestampRenderQueries || GetQualityGovernorBudget_RenderThread() <= 0.f)
+	{
+		return;
+	}
+
+	if (!QueryPool)
+	{
+		QueryPool = RHICreateRenderQueryPool(RQT_AbsoluteTime);
+	}
+
+	if (PendingFrames.IsEmpty() || PendingFrames.Last().Frame != GFrameCounterRenderThread)
+	{
+		PendingFrames.AddDefaulted_GetRef().Frame = GFrameCounterRenderThread;
+	}
+
+	FPassQueries& PassQueries = PendingFrames.Last().Passes.AddDefaulted_GetRef();
+	PassQueries.Pass = Pass;
+	AddTimestamp(GraphBuilder, PassQueries.BeginQuery);
+	bPassOpen = true;
+}
+
+void FAnimepoyPassTimer::EndPass(FRDGBuilder& GraphBuilder)
+{
+	if (bPassOpen)
+	{
+		AddTimestamp(GraphBuilder, PendingFrames.Last().Passes.Last().EndQuery);
+		bPassOpen = false;
+	}
+}
+
+void FAnimepoyPassTimer::AddTimestamp(FRDGBuilder& GraphBuilder, FRHIPooledRenderQuery& OutQuery)
+{
+	OutQuery = QueryPool->AllocateQuery();
+	FRHIRenderQuery* Query = OutQuery.GetQuery();
+
+	// The pooled query stays in PendingFrames until it is read back, long after the graph has executed.
+	GraphBuilder.AddPass(
+		RDG_EVENT_NAME("AnimepoyTimestamp"),
+		ERDGPassFlags::NeverCull,
+		[Query](FRHICommandListImmediate& RHICmdList)
+		{
+			RHICmdList.EndRenderQuery(Query);
+		});
+}
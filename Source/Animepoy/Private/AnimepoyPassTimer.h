@@ -0,0 +1,85 @@
+// @Custom
+#pragma once
+
+#include "RenderGraphBuilder.h"
+#include "Containers/Queue.h"
+#include "AnimepoyQualityGovernor.h"
+
+enum class EAnimepoyTimedPass : uint8
+{
+	KuwaharaFilter,
+	LineArt,
+	DiffusionFilter,
+};
+
+// Measures the GPU time of the Animepoy passes with timestamp queries while the quality governor is on.
+// Frames are read back a few frames late without waiting and handed to the game thread summed over their views.
+class FAnimepoyPassTimer
+{
+public:
+	// Render thread. Reads back the frames whose queries have finished.
+	void ReadBack();
+
+	// Render thread. Times the passes added to GraphBuilder until EndPass.
+	void BeginPass(FRDGBuilder& GraphBuilder, EAnimepoyTimedPass Pass);
+	void EndPass(FRDGBuilder& GraphBuilder);
+
+	// Game thread. Timings of the frames read back since the last call, oldest first.
+	bool PopFrameTimings(FAnimepoyPassTimings& OutTimings)
+	{
+		return FrameTimings.Dequeue(OutTimings);
+	}
+
+private:
+	struct FPassQueries
+	{
+		EAnimepoyTimedPass Pass;
+		FRHIPooledRenderQuery BeginQuery;
+		FRHIPooledRenderQuery EndQuery;
+	};
+
+	struct FFrameQueries
+	{
+		uint64 Frame = 0;
+		TArray<FPassQueries, TInlineAllocator<4>> Passes;
+	};
+
+	// Frames this far behind have likely been dropped by a device reset, their queries are given up.
+	static constexpr int32 MaxPendingFrames = 8;
+
+	void AddTimestamp(FRDGBuilder& GraphBuilder, FRHIPooledRenderQuery& OutQuery);
+
+	// Render thread.
+	FRenderQueryPoolRHIRef QueryPool;
+	TArray<FFrameQueries> PendingFrames;
+	bool bPassOpen = false;
+
+	TQueue<FAnimepoyPassTimings, EQueueMode::Spsc> FrameTimings;
+};
+
+// Times the passes added in its scope, nothing when the timer is null.
+class FAnimepoyScopedPassTimer
+{
+public:
+	FAnimepoyScopedPassTimer(FAnimepoyPassTimer* InTimer, FRDGBuilder& InGraphBuilder, EAnimepoyTimedPass Pass)
+		: Timer(InTimer)
+		, GraphBuilder(InGraphBuilder)
+	{
+		if (Timer)
+		{
+			Timer->BeginPass(GraphBuilder, Pass);
+		}
+	}
+
+	~FAnimepoyScopedPassTimer()
+	{
+		if (Timer)
+		{
+			Timer->EndPass(GraphBuilder);
+		}
+	}
+
+private:
+	FAnimepoyPassTimer* Timer;
+	FRDGBuilder& GraphBuilder;
+};
@@ -0,0 +1,120 @@
+// @Custom
+#include "AnimepoyPipelinePrecache.h"
+#include "AnimepoyModule.h"
+#include "CommonRenderResources.h"
+#include "PipelineStateCache.h"
+#include "SceneTexturesConfig.h"
+
+FAnimepoyPipelinePrecache::FAnimepoyPipelinePrecache(FRHICommandListImmediate& InRHICmdList, EShaderPlatform ShaderPlatform, bool bInBlocking)
+	: RHICmdList(InRHICmdList)
+	, ShaderMap(GetGlobalShaderMap(ShaderPlatform))
+	, bBlocking(bInBlocking)
+{
+	SceneDepthFormat = PF_DepthStencil;
+
+	const FSceneTexturesConfig& Config = FSceneTexturesConfig::Get();
+	if (Config.ColorFormat != PF_Unknown)
+	{
+		SceneColorFormat = Config.ColorFormat;
+		SceneColorFlags = Config.ColorCreateFlags;
+		SceneDepthFlags = Config.DepthCreateFlags;
+	}
+	else
+	{
+		// Nothing rendered yet, assume the default r.SceneColorFormat.
+		SceneColorFormat = PF_FloatRGBA;
+		SceneColorFlags = TexCreate_RenderTargetable | TexCreate_ShaderResource | TexCreate_UAV;
+		SceneDepthFlags = TexCreate_DepthStencilTargetable | TexCreate_ShaderResource;
+	}
+}
+
+void FAnimepoyPipelinePrecache::AddComputeShader(const TShaderRef<FShader>& ComputeShader)
+{
+	FRHIComputeShader* ComputeShaderRHI = ComputeShader.GetComputeShader();
+	if (bBlocking)
+	{
+		PipelineStateCache::GetAndOrCreateComputePipelineState(RHICmdList, ComputeShaderRHI, false);
+	}
+	else
+	{
+		PipelineStateCache::PrecacheComputePipelineState(ComputeShaderRHI);
+	}
+	++NumPipelines;
+}
+
+void FAnimepoyPipelinePrecache::AddFullscreenPass(const TShaderRef<FShader>& PixelShader, FRHIBlendState* BlendState, EPixelFormat Format, ETextureCreateFlags Flags)
+{
+	TShaderMapRef<FScreenVertexShaderVS> VertexShader(ShaderMap);
+
+	FGraphicsPipelineStateInitializer Initializer;
+	Initializer.RenderTargetsEnabled = 1;
+	Initializer.RenderTargetFormats[0] = Format;
+	Initializer.RenderTargetFlags[0] = Flags;
+	Initializer.NumSamples = 1;
+	Initializer.BlendState = BlendState ? BlendState : TStaticBlendState<>::GetRHI();
+	Initializer.RasterizerState = TStaticRasterizerState<>::GetRHI();
+	Initializer.DepthStencilState = TStaticDepthStencilState<false, CF_Always>::GetRHI();
+	Initializer.BoundShaderState.VertexDeclarationRHI = GFilterVertexDeclaration.VertexDeclarationRHI;
+	Initializer.BoundShaderState.VertexShaderRHI = VertexShader.GetVertexShader();
+	Initializer.BoundShaderState.PixelShaderRHI = PixelShader.GetPixelShader();
+	Initializer.PrimitiveType = PT_TriangleList;
+
+	AddGraphicsPipeline(Initializer);
+}
+
+void FAnimepoyPipelinePrecache::AddSceneColorPipeline(FGraphicsPipelineStateInitializer& Initializer, bool bSceneDepth, FExclusiveDepthStencil DepthStencilAccess)
+{
+	Initializer.RenderTargetsEnabled = 1;
+	Initializer.RenderTargetFormats[0] = SceneColorFormat;
+	Initializer.RenderTargetFlags[0] = SceneColorFlags;
+	Initializer.NumSamples = 1;
+
+	if (bSceneDepth)
+	{
+		Initializer.DepthStencilTargetFormat = SceneDepthFormat;
+		Initializer.DepthStencilTargetFlag = SceneDepthFlags;
+		Initializer.DepthTargetLoadAction = ERenderTargetLoadAction::ELoad;
+		Initializer.DepthTargetStoreAction = DepthStencilAccess.IsDepthWrite() ? ERenderTargetStoreAction::EStore : ERenderTargetStoreAction::ENoAction;
+		Initializer.StencilTargetLoadAction = ERenderTargetLoadAction::ENoAction;
+		Initializer.StencilTargetStoreAction = ERenderTargetStoreAction::ENoAction;
+		Initializer.DepthStencilAccess = DepthStencilAccess;
+	}
+
+	AddGraphicsPipeline(Initializer);
+}
+
+void FAnimepoyPipelinePrecache::AddGraphicsPipeline(const FGraphicsPipelineStateInitializer& Initializer)
+{
+	if (bBlocking)
+	{
+		PipelineStateCache::GetAndOrCreateGraphicsPipelineState(RHICmdList, Initializer, EApplyRendertargetOption::DoNothing);
+	}
+	else
+	{
+		PipelineStateCache::PrecacheGraphicsPipelineState(Initializer);
+	}
+	++NumPipelines;
+}
+
+int32 PrecacheAnimepoyPipelines(FRHICommandListImmediate& RHICmdList, EShaderPlatform ShaderPlatform, bool bBlocking)
+{
+	check(IsInRenderingThread());
+
+	if (!bBlocking && !PipelineStateCache::IsPSOPrecachingEnabled())
+	{
+		return 0;
+	}
+
+	FAnimepoyPipelinePrecache Precache(RHICmdList, ShaderPlatform, bBlocking);
+	if (!Precache.GetShaderMap())
+	{
+		return 0;
+	}
+
+	PrecacheKuwaharaFilterPipelines(Precache);
+	PrecacheLineArtPipelines(Precache);
+	PrecacheDiffusionFilterPipelines(Precache);
+
+	UE_LOG(LogAnimepoy, Verbose, TEXT("%s %d pipelines"), bBlocking ? TEXT("Created") : TEXT("Precached"), Precache.GetNumPipelines());
+	return Precache.GetNumPipelines();
+}
@@ -0,0 +1,68 @@
+// @Custom
+#pragma once
+
+#include "GlobalShader.h"
+#include "RHIStaticStates.h"
+
+// Collects the pipelines of the Animepoy passes before their first frame, so enabling a pass at runtime does not hitch.
+// Asynchronous precaching hands them to the engine's PSO precaching, blocking warm-up creates them on the spot.
+class FAnimepoyPipelinePrecache
+{
+public:
+	FAnimepoyPipelinePrecache(FRHICommandListImmediate& RHICmdList, EShaderPlatform ShaderPlatform, bool bBlocking);
+
+	const FGlobalShaderMap* GetShaderMap() const { return ShaderMap; }
+
+	// Scene color and depth as the renderer last configured them, or the default formats before its first frame.
+	EPixelFormat GetSceneColorFormat() const { return SceneColorFormat; }
+	ETextureCreateFlags GetSceneColorFlags() const { return SceneColorFlags; }
+
+	void AddComputeShader(const TShaderRef<FShader>& ComputeShader);
+
+	// The pipeline FPixelShaderUtils::AddFullscreenPass creates for PixelShader drawing into one render target.
+	void AddFullscreenPass(const TShaderRef<FShader>& PixelShader, FRHIBlendState* BlendState, EPixelFormat Format, ETextureCreateFlags Flags);
+
+	// Render targets of Initializer are filled in from scene color and, with bSceneDepth, scene depth.
+	void AddSceneColorPipeline(FGraphicsPipelineStateInitializer& Initializer, bool bSceneDepth, FExclusiveDepthStencil DepthStencilAccess = FExclusiveDepthStencil::DepthNop_StencilNop);
+
+	// Permutations the shader map does not hold, like the wave intrinsics ones on platforms without waves, are skipped.
+	template<typename ShaderType>
+	void ForEachPermutation(TFunctionRef<void(const TShaderRef<ShaderType>&)> Function) const
+	{
+		for (int32 PermutationId = 0; PermutationId < ShaderType::FPermutationDomain::PermutationCount; ++PermutationId)
+		{
+			if (ShaderMap->HasShader(&ShaderType::GetStaticType(), PermutationId))
+			{
+				Function(ShaderMap->GetShader<ShaderType>(PermutationId));
+			}
+		}
+	}
+
+	template<typename ShaderType>
+	void AddComputeShaders()
+	{
+		ForEachPermutation<ShaderType>([this](const TShaderRef<ShaderType>& ComputeShader) { AddComputeShader(ComputeShader); });
+	}
+
+	int32 GetNumPipelines() const { return NumPipelines; }
+
+private:
+	void AddGraphicsPipeline(const FGraphicsPipelineStateInitializer& Initializer);
+
+	FRHICommandListImmediate& RHICmdList;
+	const FGlobalShaderMap* ShaderMap;
+	EPixelFormat SceneColorFormat;
+	ETextureCreateFlags SceneColorFlags;
+	EPixelFormat SceneDepthFormat;
+	ETextureCreateFlags SceneDepthFlags;
+	bool bBlocking;
+	int32 NumPipelines = 0;
+};
+
+// Each pass lists the pipelines it may create at runtime.
+void PrecacheKuwaharaFilterPipelines(FAnimepoyPipelinePrecache& Precache);
+void PrecacheLineArtPipelines(FAnimepoyPipelinePrecache& Precache);
+void PrecacheDiffusionFilterPipelines(FAnimepoyPipelinePrecache& Precache);
+
+// Render thread. Precaches or, with bBlocking, creates the pipelines of every Animepoy pass and returns how many were requested.
+int32 PrecacheAnimepoyPipelines(FRHICommandListImmediate& RHICmdList, EShaderPlatform ShaderPlatform, bool bBlocking);
@@ -0,0 +1,276 @@
+// @Custom
+#include "AnimepoyQualityGovernor.h"
+#include "AnimepoyModule.h"
+#include "Containers/Queue.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+
+namespace {
+	static TAutoConsoleVariable<float> CVarQualityGovernorBudget(
+		TEXT("r.Animepoy.Governor.Budget"),
+		0.f,
+		TEXT("GPU milliseconds per frame the Animepoy passes are fitted into by scaling their quality down.\n")
+		TEXT(" 0: off, use the settings of the actor as they are (default)"),
+		ECVF_RenderThreadSafe);
+
+	const float GKuwaharaFilterSizeScales[] = { 1.f, 0.75f, 0.5f, 0.5f, 0.5f };
+	const EAnimeKuwaharaFilterResolution GKuwaharaFilterResolutions[] = {
+		EAnimeKuwaharaFilterResolution::Full,
+		EAnimeKuwaharaFilterResolution::Full,
+		EAnimeKuwaharaFilterResolution::Full,
+		EAnimeKuwaharaFilterResolution::Half,
+		EAnimeKuwaharaFilterResolution::Quarter,
+	};
+	const float GDiffusionBlurScales[] = { 1.f, 0.75f, 0.5f };
+
+	static_assert(UE_ARRAY_COUNT(GKuwaharaFilterSizeScales) == FAnimepoyQualityLevels::MaxKuwaharaFilter + 1, "One scale per Kuwahara level");
+	static_assert(UE_ARRAY_COUNT(GKuwaharaFilterResolutions) == FAnimepoyQualityLevels::MaxKuwaharaFilter + 1, "One resolution per Kuwahara level");
+	static_assert(UE_ARRAY_COUNT(GDiffusionBlurScales) == FAnimepoyQualityLevels::MaxDiffusionFilter + 1, "One scale per diffusion level");
+
+	int32 ScaleFilterSize(int32 FilterSize, int32 Level)
+	{
+		return FMath::Max(FMath::RoundToInt(FilterSize * GKuwaharaFilterSizeScales[Level]), 1);
+	}
+}
+
+float GetQualityGovernorBudget()
+{
+	return CVarQualityGovernorBudget.GetValueOnGameThread();
+}
+
+float GetQualityGovernorBudget_RenderThread()
+{
+	return CVarQualityGovernorBudget.GetValueOnRenderThread();
+}
+
+void SetQualityGovernorBudget(float BudgetMs)
+{
+	CVarQualityGovernorBudget->Set(BudgetMs, ECVF_SetByCode);
+}
+
+FAnimepoyRenderProxy FAnimepoyQualityLevels::Apply(const FAnimepoyRenderProxy& RenderProxy) const
+{
+	FAnimepoyRenderProxy Result = RenderProxy;
+
+	Result.PrePostProcessKuwaharaFilterSize = ScaleFilterSize(RenderProxy.PrePostProcessKuwaharaFilterSize, KuwaharaFilter);
+	Result.PrePostProcessKuwaharaFilterResolution = FMath::Max(RenderProxy.PrePostProcessKuwaharaFilterResolution, GKuwaharaFilterResolutions[KuwaharaFilter]);
+	Result.GBufferKuwaharaFilterSize = ScaleFilterSize(RenderProxy.GBufferKuwaharaFilterSize, KuwaharaFilter);
+
+	Result.bLineArtAmortize |= LineArt > 0;
+
+	Result.DiffusionBlurPercentage = RenderProxy.DiffusionBlurPercentage * GDiffusionBlurScales[DiffusionFilter];
+
+	return Result;
+}
+
+FString FAnimepoyQualityLevels::ToString() const
+{
+	return FString::Printf(TEXT("KuwaharaFilter=%d LineArt=%d DiffusionFilter=%d"), KuwaharaFilter, LineArt, DiffusionFilter);
+}
+
+bool FAnimepoyQualityGovernor::Update(const FAnimepoyPassTimings& Timings, float BudgetMs)
+{
+	if (BudgetMs <= 0.f)
+	{
+		const bool bChanged = Levels != FAnimepoyQualityLevels{};
+		Reset();
+		return bChanged;
+	}
+
+	if (FramesSinceUpgrade < MAX_int32)
+	{
+		++FramesSinceUpgrade;
+	}
+
+	if (FramesToSettle > 0)
+	{
+		--FramesToSettle;
+		return false;
+	}
+
+	// Smoothing starts over after each change, the frames before it measured other levels.
+	if (bHasTimings)
+	{
+		SmoothedTimings.KuwaharaFilter = FMath::Lerp(SmoothedTimings.KuwaharaFilter, Timings.KuwaharaFilter, Settings.Smoothing);
+		SmoothedTimings.LineArt = FMath::Lerp(SmoothedTimings.LineArt, Timings.LineArt, Settings.Smoothing);
+		SmoothedTimings.DiffusionFilter = FMath::Lerp(SmoothedTimings.DiffusionFilter, Timings.DiffusionFilter, Settings.Smoothing);
+	}
+	else
+	{
+		SmoothedTimings = Timings;
+		bHasTimings = true;
+	}
+
+	// As many frames as a downgrade waits for are enough to know what the last one saved.
+	if (++FramesMeasured == Settings.DowngradeFrames && !Downgrades.IsEmpty() && Downgrades.Last().PassTimeAfter < 0.f)
+	{
+		Downgrades.Last().PassTimeAfter = GetPassTime(Downgrades.Last().Pass);
+	}
+
+	const float Total = SmoothedTimings.GetTotal();
+	FramesOverBudget = Total > BudgetMs ? FramesOverBudget + 1 : 0;
+	FramesUnderBudget = Total <= BudgetMs * Settings.UpgradeThreshold ? FramesUnderBudget + 1 : 0;
+
+	if (FramesOverBudget >= Settings.DowngradeFrames)
+	{
+		return Downgrade();
+	}
+
+	if (FramesUnderBudget >= UpgradeFrames && !Downgrades.IsEmpty())
+	{
+		// Only restore a pass whose predicted cost at the higher level still fits.
+		const FDowngrade& LastDowngrade = Downgrades.Last();
+		const float PassTime = GetPassTime(LastDowngrade.Pass);
+		const float RestoredPassTime = LastDowngrade.PassTimeAfter > 0.f ? PassTime * LastDowngrade.PassTimeBefore / LastDowngrade.PassTimeAfter : LastDowngrade.PassTimeBefore;
+		if (Total - PassTime + RestoredPassTime <= BudgetMs)
+		{
+			return Upgrade();
+		}
+	}
+
+	return false;
+}
+
+void FAnimepoyQualityGovernor::Reset()
+{
+	*this = FAnimepoyQualityGovernor(Settings);
+}
+
+float FAnimepoyQualityGovernor::GetPassTime(EPass Pass) const
+{
+	switch (Pass)
+	{
+	case EPass::KuwaharaFilter: return SmoothedTimings.KuwaharaFilter;
+	case EPass::LineArt: return SmoothedTimings.LineArt;
+	default: return SmoothedTimings.DiffusionFilter;
+	}
+}
+
+bool FAnimepoyQualityGovernor::Downgrade()
+{
+	struct FCandidate
+	{
+		EPass Pass;
+		int32& Level;
+		int32 MaxLevel;
+	};
+
+	FCandidate Candidates[] = {
+		{ EPass::KuwaharaFilter, Levels.KuwaharaFilter, FAnimepoyQualityLevels::MaxKuwaharaFilter },
+		{ EPass::LineArt, Levels.LineArt, FAnimepoyQualityLevels::MaxLineArt },
+		{ EPass::DiffusionFilter, Levels.DiffusionFilter, FAnimepoyQualityLevels::MaxDiffusionFilter },
+	};
+
+	FCandidate* MostExpensive = nullptr;
+	for (FCandidate& Candidate : Candidates)
+	{
+		if (Candidate.Level < Candidate.MaxLevel && GetPassTime(Candidate.Pass) > 0.f && (!MostExpensive || GetPassTime(Candidate.Pass) > GetPassTime(MostExpensive->Pass)))
+		{
+			MostExpensive = &Candidate;
+		}
+	}
+
+	if (!MostExpensive)
+	{
+		// Nothing left to scale down, keep measuring.
+		FramesOverBudget = 0;
+		return false;
+	}
+
+	if (FramesSinceUpgrade <= Settings.FailedUpgradeWindow)
+	{
+		UpgradeFrames = FMath::Min(UpgradeFrames * 2, Settings.MaxUpgradeFrames);
+	}
+
+	Downgrades.Add({ MostExpensive->Pass, GetPassTime(MostExpensive->Pass), -1.f });
+	++MostExpensive->Level;
+	FramesSinceUpgrade = MAX_int32;
+
+	OnChanged();
+	return true;
+}
+
+bool FAnimepoyQualityGovernor::Upgrade()
+{
+	switch (Downgrades.Pop().Pass)
+	{
+	case EPass::KuwaharaFilter: --Levels.KuwaharaFilter; break;
+	case EPass::LineArt: --Levels.LineArt; break;
+	case EPass::DiffusionFilter: --Levels.DiffusionFilter; break;
+	}
+	FramesSinceUpgrade = 0;
+
+	OnChanged();
+	return true;
+}
+
+void FAnimepoyQualityGovernor::OnChanged()
+{
+	FramesOverBudget = 0;
+	FramesUnderBudget = 0;
+	FramesToSettle = Settings.SettleFrames;
+	bHasTimings = false;
+	FramesMeasured = 0;
+}
+
+namespace {
+	// Replays a synthetic load through the governor: the base costs, twice them in the middle third, then the base costs again.
+	// Each level scales its pass like a rough cost model and the timings arrive a few frames late, like GPU readbacks.
+	void SimulateQualityGovernor(const TArray<FString>& Args)
+	{
+		if (Args.Num() < 4)
+		{
+			UE_LOG(LogAnimepoy, Display, TEXT("Usage: Animepoy.Governor.Simulate <BudgetMs> <KuwaharaMs> <LineArtMs> <DiffusionMs> [Frames]"));
+			return;
+		}
+
+		const float BudgetMs = FCString::Atof(*Args[0]);
+		const FAnimepoyPassTimings BaseTimings{ FCString::Atof(*Args[1]), FCString::Atof(*Args[2]), FCString::Atof(*Args[3]) };
+		const int32 NumFrames = Args.Num() > 4 ? FCString::Atoi(*Args[4]) : 1800;
+
+		static const float KuwaharaFilterCosts[] = { 1.f, 0.9f, 0.8f, 0.3f, 0.1f };
+		static const float LineArtCosts[] = { 1.f, 0.55f };
+		static const float DiffusionFilterCosts[] = { 1.f, 0.85f, 0.7f };
+		constexpr int32 ReadbackLatency = 3;
+
+		FAnimepoyQualityGovernor Governor;
+		TQueue<FAnimepoyPassTimings> InFlight;
+		FRandomStream Noise(0x414E494D);
+		int32 NumChanges = 0;
+		int32 NumFramesOverBudget = 0;
+
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			const FAnimepoyQualityLevels& Levels = Governor.GetLevels();
+			const float Load = (Frame >= NumFrames / 3 && Frame < NumFrames * 2 / 3) ? 2.f : 1.f;
+
+			FAnimepoyPassTimings Timings;
+			Timings.KuwaharaFilter = BaseTimings.KuwaharaFilter * Load * KuwaharaFilterCosts[Levels.KuwaharaFilter] * Noise.FRandRange(0.95f, 1.05f);
+			Timings.LineArt = BaseTimings.LineArt * Load * LineArtCosts[Levels.LineArt] * Noise.FRandRange(0.95f, 1.05f);
+			Timings.DiffusionFilter = BaseTimings.DiffusionFilter * Load * DiffusionFilterCosts[Levels.DiffusionFilter] * Noise.FRandRange(0.95f, 1.05f);
+			NumFramesOverBudget += Timings.GetTotal() > BudgetMs;
+			InFlight.Enqueue(Timings);
+
+			if (Frame < ReadbackLatency)
+			{
+				continue;
+			}
+
+			FAnimepoyPassTimings ReadBack;
+			InFlight.Dequeue(ReadBack);
+			if (Governor.Update(ReadBack, BudgetMs))
+			{
+				++NumChanges;
+				UE_LOG(LogAnimepoy, Display, TEXT("Frame %4d: %.2fms smoothed %.2fms -> %s"), Frame, ReadBack.GetTotal(), Governor.GetSmoothedTimings().GetTotal(), *Governor.GetLevels().ToString());
+			}
+		}
+
+		UE_LOG(LogAnimepoy, Display, TEXT("%d frames, %d changes, %d frames over the %.2fms budget, final %s"), NumFrames, NumChanges, NumFramesOverBudget, BudgetMs, *Governor.GetLevels().ToString());
+	}
+
+	static FAutoConsoleCommand CmdSimulateQualityGovernor(
+		TEXT("Animepoy.Governor.Simulate"),
+		TEXT("Runs the quality governor on a synthetic timing trace and logs every change.\n")
+		TEXT("Animepoy.Governor.Simulate <BudgetMs> <KuwaharaMs> <LineArtMs> <DiffusionMs> [Frames]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&SimulateQualityGovernor));
+}
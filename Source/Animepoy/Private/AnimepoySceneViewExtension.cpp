@@ -1,114 +1,387 @@
-// Fill out your copyright notice in the Description page of Project AnimepoyRenderProxy.
-
-
-#include "AnimepoySceneViewExtension.h"
-#include "ShaderCompilerCore.h"
-#include "ScreenPass.h"
-#include "SceneTexturesConfig.h"
-#include "SceneTextureParameters.h"
-#include "ShaderParameterUtils.h"
-#include "PixelShaderUtils.h"
-#include "PostProcess/PostProcessing.h"
-#include "PostProcess/PostProcessMaterialInputs.h"
-#include "AnimepoySubsystem.h"
-#include "Animepoy.h"
-#include "PostProcessLineArt.h"
-#include "PostProcessKuwaharaFilter.h"
-#include "PostProcessDiffusionFilter.h"
-
-FAnimepoySceneViewExtension::FAnimepoySceneViewExtension(const FAutoRegister& AutoRegister, UAnimepoySubsystem* WorldSubsystem)
-	: FSceneViewExtensionBase(AutoRegister)
-	, WorldSubsystem(WorldSubsystem)
-{
-}
-
-void FAnimepoySceneViewExtension::SetupView(FSceneViewFamily& InViewFamily, FSceneView& InView)
-{
-	AnimepoyRenderProxy = WorldSubsystem->GetAnimepoyRenderProxy();
-	bEnable = InView.Family->Scene->GetWorld() == WorldSubsystem->GetWorld() && AnimepoyRenderProxy.bEnable;
-}
-
-#if USE_POST_DEFERRED_LIGHTING_PASS
-void FAnimepoySceneViewExtension::PostDeferredLighting_RenderThread(FRDGBuilder& GraphBuilder, FSceneView& InView, TRDGUniformBufferRef<FSceneTextureUniformParameters> SceneTextures)
-{
-	check(InView.bIsViewInfo);
-	auto& View = static_cast<const FViewInfo&>(InView);
-
-	if (ShouldProcessThisView() && AnimepoyRenderProxy.bLineArt)
-	{
-		FLineArtPassInputs PassInputs;
-		PassInputs.SceneTextures = SceneTextures;
-		PassInputs.DepthLineIntensity = AnimepoyRenderProxy.DepthLineIntensity;
-		PassInputs.NormalLineIntensity = AnimepoyRenderProxy.NormalLineIntensity;
-		PassInputs.PlanarLineIntensity = AnimepoyRenderProxy.PlanarLineIntensity;
-		PassInputs.MaterialLineIntensity = AnimepoyRenderProxy.MaterialLineIntensity;
-		PassInputs.LineWidth = AnimepoyRenderProxy.LineWidth;
-		PassInputs.LineColor = AnimepoyRenderProxy.LineColor;
-		PassInputs.bPreview = AnimepoyRenderProxy.bPreviewLine;
-
-		AddLineArtPass(GraphBuilder, View, PassInputs);
-	}
-}
-#endif // USE_POST_DEFERRED_LIGHTING_PASS
-
-void FAnimepoySceneViewExtension::PrePostProcessPass_RenderThread(FRDGBuilder& GraphBuilder, const FSceneView& InView, const FPostProcessingInputs& Inputs)
-{
-	check(InView.bIsViewInfo);
-	auto& View = static_cast<const FViewInfo&>(InView);
-
-	if (ShouldProcessThisView() && AnimepoyRenderProxy.bPrePostProcessKuwaharaFilter)
-	{
-		FKuwaharaFilterInputs PassInputs;
-		PassInputs.Target = (*Inputs.SceneTextures)->SceneColorTexture;
-		PassInputs.TargetType = EKuwaharaFilterTargetType::SceneColor;
-		PassInputs.FilterSize = AnimepoyRenderProxy.PrePostProcessKuwaharaFilterSize;
-
-		AddKuwaharaFilterPass(GraphBuilder, View, PassInputs);
-	}
-
-#if !USE_POST_DEFERRED_LIGHTING_PASS
-	if (ShouldProcessThisView() && AnimepoyRenderProxy.bLineArt)
-	{
-		FLineArtPassInputs PassInputs;
-		PassInputs.SceneTextures = Inputs.SceneTextures;
-		PassInputs.DepthLineIntensity = AnimepoyRenderProxy.DepthLineIntensity;
-		PassInputs.NormalLineIntensity = AnimepoyRenderProxy.NormalLineIntensity;
-		PassInputs.PlanarLineIntensity = AnimepoyRenderProxy.PlanarLineIntensity;
-		PassInputs.MaterialLineIntensity = AnimepoyRenderProxy.MaterialLineIntensity;
-		PassInputs.LineWidth = AnimepoyRenderProxy.LineWidth;
-		PassInputs.LineColor = AnimepoyRenderProxy.LineColor;
-		PassInputs.bPreview = AnimepoyRenderProxy.bPreviewLine;
-
-		AddLineArtPass(GraphBuilder, View, PassInputs);
-	}
-#endif // !USE_POST_DEFERRED_LIGHTING_PASS
-}
-
-void FAnimepoySceneViewExtension::SubscribeToPostProcessingPass(EPostProcessingPass Pass, FAfterPassCallbackDelegateArray& InOutPassCallbacks, bool bIsPassEnabled)
-{
-	if (Pass == EPostProcessingPass::Tonemap && ShouldProcessThisView() && AnimepoyRenderProxy.bDiffusionFilter)
-	{
-		InOutPassCallbacks.Add(FAfterPassCallbackDelegate::CreateLambda([this](FRDGBuilder& GraphBuilder, const FSceneView& InView, const FPostProcessMaterialInputs& Inputs) ->FScreenPassTexture {
-			check(InView.bIsViewInfo);
-			auto& View = static_cast<const FViewInfo&>(InView);
-
-			FPostProcessDiffusionInputs PassInputs;
-			PassInputs.OverrideOutput = Inputs.OverrideOutput;
-			PassInputs.SceneColor = FScreenPassTexture::CopyFromSlice(GraphBuilder, Inputs.GetInput(EPostProcessMaterialInput::SceneColor));
-			PassInputs.PreTonemapColor = (*Inputs.SceneTextures.SceneTextures.GetUniformBuffer())->SceneColorTexture;
-			PassInputs.Intensity = AnimepoyRenderProxy.DiffusionFilterIntensity;
-			PassInputs.LuminanceMin = AnimepoyRenderProxy.DiffusionLuminanceMin;
-			PassInputs.LuminanceMax = AnimepoyRenderProxy.DiffusionLuminanceMax;
-			PassInputs.BlurPercentage = AnimepoyRenderProxy.DiffusionBlurPercentage;
-			PassInputs.BlendMode = (int32)AnimepoyRenderProxy.DiffusionBlendMode;
-			PassInputs.bDebugMask = AnimepoyRenderProxy.bPreviewDiffusionMask;
-
-			return AddPostProcessDiffusionPass(GraphBuilder, View, PassInputs);
-			}));
-	}
-}
-
-bool FAnimepoySceneViewExtension::ShouldProcessThisView() const
-{
-	return bEnable;
-}
+// Fill out your copyright notice in the Description page of Project AnimepoyRenderProxy.
+
+
+#include "AnimepoySceneViewExtension.h"
+#include "ShaderCompilerCore.h"
+#include "ScreenPass.h"
+#include "SceneTexturesConfig.h"
+#include "SceneTextureParameters.h"
+#include "ShaderParameterUtils.h"
+#include "PixelShaderUtils.h"
+#include "PostProcess/PostProcessing.h"
+#include "PostProcess/PostProcessMaterialInputs.h"
+#include "AnimepoySubsystem.h"
+#include "Animepoy.h"
+#include "PostProcessLineArt.h"
+#include "PostProcessKuwaharaFilter.h"
+#include "PostProcessDiffusionFilter.h"
+#include "AnimepoyStats.h"
+#include "AnimepoyModule.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Setup View"), STAT_AnimepoySetupView, STATGROUP_Animepoy);
+
+static TAutoConsoleVariable<int32> CVarAnimepoyBatchViews(
+	TEXT("r.Animepoy.BatchViews"),
+	1,
+	TEXT("Runs the Kuwahara filter and line detection once for all views of a family, like both stereo eyes, when they share the same settings.\n")
+	TEXT(" 0: one pass per view\n")
+	TEXT(" 1: one pass per family (default)"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarAnimepoyAsyncCompute(
+	TEXT("r.Animepoy.AsyncCompute"),
+	0,
+	TEXT("Detects lines on the async compute queue while the Kuwahara filter runs on the graphics queue, where the platform supports it efficiently.\n")
+	TEXT("Ignored while the quality governor is on, since it times the passes on the graphics queue.\n")
+	TEXT(" 0: graphics queue (default)\n")
+	TEXT(" 1: async compute queue"),
+	ECVF_RenderThreadSafe);
+
+namespace {
+	// A batched pass runs with the settings of the first view for all of them.
+	bool HasSameGBufferKuwaharaFilterSettings(const FAnimepoyRenderProxy& A, const FAnimepoyRenderProxy& B)
+	{
+		return A.GBufferKuwaharaFilterSize == B.GBufferKuwaharaFilterSize
+			&& A.bGBufferKuwaharaFilterBaseColor == B.bGBufferKuwaharaFilterBaseColor
+			&& A.bGBufferKuwaharaFilterNormal == B.bGBufferKuwaharaFilterNormal
+			&& A.bGBufferKuwaharaFilterMaterial == B.bGBufferKuwaharaFilterMaterial;
+	}
+
+	bool HasSameKuwaharaFilterSettings(const FAnimepoyRenderProxy& A, const FAnimepoyRenderProxy& B)
+	{
+		return A.PrePostProcessKuwaharaFilterSize == B.PrePostProcessKuwaharaFilterSize
+			&& A.PrePostProcessKuwaharaFilterResolution == B.PrePostProcessKuwaharaFilterResolution;
+	}
+
+	bool HasSameLineArtSettings(const FAnimepoyRenderProxy& A, const FAnimepoyRenderProxy& B)
+	{
+		return A.DepthLineIntensity == B.DepthLineIntensity
+			&& A.NormalLineIntensity == B.NormalLineIntensity
+			&& A.PlanarLineIntensity == B.PlanarLineIntensity
+			&& A.MaterialLineIntensity == B.MaterialLineIntensity
+			&& A.LineWidth == B.LineWidth
+			&& A.LineColor == B.LineColor
+			&& A.bPreviewLine == B.bPreviewLine;
+	}
+
+	// Views without a state, like scene captures, all have the view key 0, so they are told apart by their index in the family.
+	// The index is above the 32 bits of the view keys, so it never takes the state of a view with a key.
+	uint64 GetViewStateKey(const FSceneView& InView)
+	{
+		if (InView.GetViewKey() != 0)
+		{
+			return InView.GetViewKey();
+		}
+
+		// A view is set up right before or after it is added to its family.
+		const int32 ViewIndex = InView.Family->Views.Find(&InView);
+		return (uint64(1) << 32) | uint32(ViewIndex != INDEX_NONE ? ViewIndex : InView.Family->Views.Num());
+	}
+}
+
+bool UseAsyncLineDetection(bool bOverlapped)
+{
+	if (CVarAnimepoyAsyncCompute.GetValueOnRenderThread() == 0 || !GSupportsEfficientAsyncCompute || !bOverlapped)
+	{
+		return false;
+	}
+
+	// Warns again each time the governor is turned on.
+	static bool bWarned = false;
+	if (GetQualityGovernorBudget_RenderThread() > 0.f)
+	{
+		UE_CLOG(!bWarned, LogAnimepoy, Warning, TEXT("r.Animepoy.AsyncCompute is ignored while r.Animepoy.Governor.Budget is set, the governor times the passes on the graphics queue."));
+		bWarned = true;
+		return false;
+	}
+
+	bWarned = false;
+	return true;
+}
+
+FAnimepoySceneViewExtension::FAnimepoySceneViewExtension(const FAutoRegister& AutoRegister, UAnimepoySubsystem* WorldSubsystem)
+	: FSceneViewExtensionBase(AutoRegister)
+	, WorldSubsystem(WorldSubsystem)
+{
+}
+
+void FAnimepoySceneViewExtension::SetupView(FSceneViewFamily& InViewFamily, FSceneView& InView)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AnimepoySetupView);
+	CSV_SCOPED_TIMING_STAT(Animepoy, SetupView);
+
+	WorldSubsystem->UpdateAnimepoyRenderProxy(AnimepoyRenderProxy);
+
+	FAnimepoyRenderProxy& ViewProxy = PendingViewProxies.Add(GetViewStateKey(InView), AnimepoyRenderProxy);
+	ViewProxy.bEnable = InView.Family->Scene->GetWorld() == WorldSubsystem->GetWorld() && AnimepoyRenderProxy.bEnable;
+}
+
+void FAnimepoySceneViewExtension::BeginRenderViewFamily(FSceneViewFamily& InViewFamily)
+{
+	// The subsystem may drop the extension before the render thread gets to the command.
+	TWeakPtr<FAnimepoySceneViewExtension, ESPMode::ThreadSafe> WeakThis = StaticCastSharedRef<FAnimepoySceneViewExtension>(AsShared());
+	ENQUEUE_RENDER_COMMAND(AnimepoyUpdateViewStates)([WeakThis, ViewProxies = MoveTemp(PendingViewProxies)](FRHICommandListImmediate& RHICmdList)
+		{
+			if (TSharedPtr<FAnimepoySceneViewExtension, ESPMode::ThreadSafe> This = WeakThis.Pin())
+			{
+				This->UpdateViewStates_RenderThread(ViewProxies);
+			}
+		});
+
+	PendingViewProxies.Reset();
+}
+
+void FAnimepoySceneViewExtension::UpdateViewStates_RenderThread(const TMap<uint64, FAnimepoyRenderProxy>& ViewProxies)
+{
+	BeginAnimepoyTransientTextureFrame();
+	PassTimer.ReadBack();
+
+	const uint64 FrameCounter = GFrameCounterRenderThread;
+	for (const TPair<uint64, FAnimepoyRenderProxy>& ViewProxy : ViewProxies)
+	{
+		TUniquePtr<FAnimepoyViewState>& ViewState = ViewStates.FindOrAdd(ViewProxy.Key);
+		if (!ViewState)
+		{
+			ViewState = MakeUnique<FAnimepoyViewState>();
+		}
+		ViewState->RenderProxy = ViewProxy.Value;
+		ViewState->LastUsedFrame = FrameCounter;
+	}
+
+	// Drop the state of views that stopped rendering.
+	for (auto It = ViewStates.CreateIterator(); It; ++It)
+	{
+		if (It.Value()->LastUsedFrame + 60 < FrameCounter)
+		{
+			It.RemoveCurrent();
+		}
+	}
+}
+
+#if USE_POST_DEFERRED_LIGHTING_PASS
+void FAnimepoySceneViewExtension::PostDeferredLighting_RenderThread(FRDGBuilder& GraphBuilder, FSceneView& InView, TRDGUniformBufferRef<FSceneTextureUniformParameters> SceneTextures)
+{
+	check(InView.bIsViewInfo);
+	auto& View = static_cast<const FViewInfo&>(InView);
+
+	FAnimepoyViewState* ViewState = GetViewState(InView);
+	if (!ViewState)
+	{
+		return;
+	}
+
+	const FAnimepoyRenderProxy& RenderProxy = ViewState->RenderProxy;
+	FBatchedViewRects BatchedViewRects;
+
+	if (RenderProxy.bGBufferKuwaharaFilter && GetBatchedViews(InView, [](const FAnimepoyRenderProxy& Proxy) { return Proxy.bGBufferKuwaharaFilter; }, HasSameGBufferKuwaharaFilterSettings, BatchedViewRects))
+	{
+		FKuwaharaFilterMultiTargetInputs PassInputs;
+		PassInputs.BaseColor = RenderProxy.bGBufferKuwaharaFilterBaseColor ? (*SceneTextures)->GBufferCTexture : nullptr;
+		PassInputs.Normal = RenderProxy.bGBufferKuwaharaFilterNormal ? (*SceneTextures)->GBufferATexture : nullptr;
+		PassInputs.Material = RenderProxy.bGBufferKuwaharaFilterMaterial ? (*SceneTextures)->GBufferBTexture : nullptr;
+		PassInputs.FilterSize = RenderProxy.GBufferKuwaharaFilterSize;
+		PassInputs.BatchedViewRects = BatchedViewRects;
+
+		FAnimepoyScopedPassTimer PassTimerScope(&PassTimer, GraphBuilder, EAnimepoyTimedPass::KuwaharaFilter);
+		AddKuwaharaFilterMultiTargetPass(GraphBuilder, View, PassInputs);
+	}
+
+	if (RenderProxy.bLineArt && GetBatchedViews(InView, [](const FAnimepoyRenderProxy& Proxy) { return Proxy.bLineArt && !IsLineArtAmortized(Proxy.bLineArtAmortize); }, HasSameLineArtSettings, BatchedViewRects))
+	{
+		FLineArtPassInputs PassInputs;
+		PassInputs.SceneTextures = SceneTextures;
+		PassInputs.DepthLineIntensity = RenderProxy.DepthLineIntensity;
+		PassInputs.NormalLineIntensity = RenderProxy.NormalLineIntensity;
+		PassInputs.PlanarLineIntensity = RenderProxy.PlanarLineIntensity;
+		PassInputs.MaterialLineIntensity = RenderProxy.MaterialLineIntensity;
+		PassInputs.LineWidth = RenderProxy.LineWidth;
+		PassInputs.LineColor = RenderProxy.LineColor;
+		PassInputs.bPreview = RenderProxy.bPreviewLine;
+		PassInputs.History = InView.GetViewKey() != 0 ? &ViewState->LineArtHistory : nullptr;
+		PassInputs.bAmortize = IsLineArtAmortized(RenderProxy.bLineArtAmortize);
+		PassInputs.BatchedViewRects = BatchedViewRects;
+
+		// Nothing is left to overlap the detection with, so it stays on the graphics queue.
+		FAnimepoyScopedPassTimer PassTimerScope(&PassTimer, GraphBuilder, EAnimepoyTimedPass::LineArt);
+		AddLineArtPass(GraphBuilder, View, PassInputs);
+	}
+}
+#endif // USE_POST_DEFERRED_LIGHTING_PASS
+
+void FAnimepoySceneViewExtension::PrePostProcessPass_RenderThread(FRDGBuilder& GraphBuilder, const FSceneView& InView, const FPostProcessingInputs& Inputs)
+{
+	check(InView.bIsViewInfo);
+	auto& View = static_cast<const FViewInfo&>(InView);
+
+	FAnimepoyViewState* ViewState = GetViewState(InView);
+	if (!ViewState)
+	{
+		return;
+	}
+
+	const FAnimepoyRenderProxy& RenderProxy = ViewState->RenderProxy;
+
+	// Only the full resolution filter clamps its windows to each batched view.
+	const auto IsBatchedKuwaharaFilter = [](const FAnimepoyRenderProxy& Proxy)
+	{
+		return Proxy.bPrePostProcessKuwaharaFilter && Proxy.PrePostProcessKuwaharaFilterResolution == EAnimeKuwaharaFilterResolution::Full;
+	};
+
+	FBatchedViewRects KuwaharaFilterViewRects;
+	const bool bKuwaharaFilter = RenderProxy.bPrePostProcessKuwaharaFilter && GetBatchedViews(InView, IsBatchedKuwaharaFilter, HasSameKuwaharaFilterSettings, KuwaharaFilterViewRects);
+
+#if !USE_POST_DEFERRED_LIGHTING_PASS
+	// Lines drawn for a later view would otherwise be filtered by that view's Kuwahara pass.
+	const auto IsBatchedLineArt = [&IsBatchedKuwaharaFilter](const FAnimepoyRenderProxy& Proxy)
+	{
+		return Proxy.bLineArt && !IsLineArtAmortized(Proxy.bLineArtAmortize) && (!Proxy.bPrePostProcessKuwaharaFilter || IsBatchedKuwaharaFilter(Proxy));
+	};
+	const auto HasSameLineArtAndKuwaharaFilterSettings = [](const FAnimepoyRenderProxy& A, const FAnimepoyRenderProxy& B)
+	{
+		return HasSameLineArtSettings(A, B)
+			&& A.bPrePostProcessKuwaharaFilter == B.bPrePostProcessKuwaharaFilter
+			&& (!A.bPrePostProcessKuwaharaFilter || HasSameKuwaharaFilterSettings(A, B));
+	};
+
+	FLineArtPassInputs LineArtInputs;
+	FLineArtDetection LineArtDetection;
+	const bool bLineArt = RenderProxy.bLineArt && GetBatchedViews(InView, IsBatchedLineArt, HasSameLineArtAndKuwaharaFilterSettings, LineArtInputs.BatchedViewRects);
+
+	// The detection only reads the G-buffer, so it goes first and overlaps the Kuwahara filter when it runs on the async compute queue.
+	if (bLineArt)
+	{
+		LineArtInputs.SceneTextures = Inputs.SceneTextures;
+		LineArtInputs.DepthLineIntensity = RenderProxy.DepthLineIntensity;
+		LineArtInputs.NormalLineIntensity = RenderProxy.NormalLineIntensity;
+		LineArtInputs.PlanarLineIntensity = RenderProxy.PlanarLineIntensity;
+		LineArtInputs.MaterialLineIntensity = RenderProxy.MaterialLineIntensity;
+		LineArtInputs.LineWidth = RenderProxy.LineWidth;
+		LineArtInputs.LineColor = RenderProxy.LineColor;
+		LineArtInputs.bPreview = RenderProxy.bPreviewLine;
+		LineArtInputs.History = InView.GetViewKey() != 0 ? &ViewState->LineArtHistory : nullptr;
+		LineArtInputs.bAmortize = IsLineArtAmortized(RenderProxy.bLineArtAmortize);
+		LineArtInputs.bAsyncCompute = UseAsyncLineDetection(bKuwaharaFilter);
+
+		FAnimepoyScopedPassTimer PassTimerScope(&PassTimer, GraphBuilder, EAnimepoyTimedPass::LineArt);
+		LineArtDetection = AddLineArtDetectionPass(GraphBuilder, View, LineArtInputs);
+	}
+#endif // !USE_POST_DEFERRED_LIGHTING_PASS
+
+	if (bKuwaharaFilter)
+	{
+		FKuwaharaFilterInputs PassInputs;
+		PassInputs.Target = (*Inputs.SceneTextures)->SceneColorTexture;
+		PassInputs.TargetType = EKuwaharaFilterTargetType::SceneColor;
+		PassInputs.FilterSize = RenderProxy.PrePostProcessKuwaharaFilterSize;
+		PassInputs.DownsampleFactor = 1 << (int32)RenderProxy.PrePostProcessKuwaharaFilterResolution;
+		PassInputs.SceneDepth = (*Inputs.SceneTextures)->SceneDepthTexture;
+		PassInputs.BatchedViewRects = KuwaharaFilterViewRects;
+
+		FAnimepoyScopedPassTimer PassTimerScope(&PassTimer, GraphBuilder, EAnimepoyTimedPass::KuwaharaFilter);
+		AddKuwaharaFilterPass(GraphBuilder, View, PassInputs);
+	}
+
+#if !USE_POST_DEFERRED_LIGHTING_PASS
+	if (bLineArt)
+	{
+		FAnimepoyScopedPassTimer PassTimerScope(&PassTimer, GraphBuilder, EAnimepoyTimedPass::LineArt);
+		AddLineArtCompositePass(GraphBuilder, View, LineArtInputs, LineArtDetection);
+	}
+#endif // !USE_POST_DEFERRED_LIGHTING_PASS
+}
+
+void FAnimepoySceneViewExtension::SubscribeToPostProcessingPass(EPostProcessingPass Pass, FAfterPassCallbackDelegateArray& InOutPassCallbacks, bool bIsPassEnabled)
+{
+	if (Pass != EPostProcessingPass::Tonemap)
+	{
+		return;
+	}
+
+	// Subscribing does not say for which view, so views without the filter pass the scene color through.
+	bool bDiffusionFilter = false;
+	for (const TPair<uint64, TUniquePtr<FAnimepoyViewState>>& ViewState : ViewStates)
+	{
+		bDiffusionFilter |= ViewState.Value->RenderProxy.bEnable && ViewState.Value->RenderProxy.bDiffusionFilter;
+	}
+
+	if (bDiffusionFilter)
+	{
+		// Only called while rendering a view family, which holds the extension.
+		InOutPassCallbacks.Add(FAfterPassCallbackDelegate::CreateLambda([this](FRDGBuilder& GraphBuilder, const FSceneView& InView, const FPostProcessMaterialInputs& Inputs) ->FScreenPassTexture {
+			check(InView.bIsViewInfo);
+			auto& View = static_cast<const FViewInfo&>(InView);
+
+			// Only a slice of a texture array needs a copy, otherwise the composite may write the tonemapped texture in place.
+			const FScreenPassTextureSlice SceneColorSlice = Inputs.GetInput(EPostProcessMaterialInput::SceneColor);
+			FRDGTextureRef SceneColorTexture = SceneColorSlice.TextureSRV->Desc.Texture;
+			const FScreenPassTexture SceneColor = SceneColorTexture->Desc.IsTextureArray()
+				? FScreenPassTexture::CopyFromSlice(GraphBuilder, SceneColorSlice)
+				: FScreenPassTexture(SceneColorTexture, SceneColorSlice.ViewRect);
+
+			const FAnimepoyViewState* ViewState = GetViewState(InView);
+			if (!ViewState || !ViewState->RenderProxy.bDiffusionFilter)
+			{
+				if (Inputs.OverrideOutput.IsValid())
+				{
+					AddDrawTexturePass(GraphBuilder, View, SceneColor, Inputs.OverrideOutput);
+					return Inputs.OverrideOutput;
+				}
+				return SceneColor;
+			}
+
+			const FAnimepoyRenderProxy& RenderProxy = ViewState->RenderProxy;
+
+			FPostProcessDiffusionInputs PassInputs;
+			PassInputs.OverrideOutput = Inputs.OverrideOutput;
+			PassInputs.SceneColor = SceneColor;
+			PassInputs.PreTonemapColor = (*Inputs.SceneTextures.SceneTextures.GetUniformBuffer())->SceneColorTexture;
+			PassInputs.Intensity = RenderProxy.DiffusionFilterIntensity;
+			PassInputs.LuminanceMin = RenderProxy.DiffusionLuminanceMin;
+			PassInputs.LuminanceMax = RenderProxy.DiffusionLuminanceMax;
+			PassInputs.BlurPercentage = RenderProxy.DiffusionBlurPercentage;
+			PassInputs.BlendMode = (int32)RenderProxy.DiffusionBlendMode;
+			PassInputs.bDebugMask = RenderProxy.bPreviewDiffusionMask;
+
+			FAnimepoyScopedPassTimer PassTimerScope(&PassTimer, GraphBuilder, EAnimepoyTimedPass::DiffusionFilter);
+			return AddPostProcessDiffusionPass(GraphBuilder, View, PassInputs);
+			}));
+	}
+}
+
+FAnimepoyViewState* FAnimepoySceneViewExtension::GetViewState(const FSceneView& InView)
+{
+	check(IsInRenderingThread());
+
+	TUniquePtr<FAnimepoyViewState>* ViewState = ViewStates.Find(GetViewStateKey(InView));
+	return ViewState && (*ViewState)->RenderProxy.bEnable ? ViewState->Get() : nullptr;
+}
+
+bool FAnimepoySceneViewExtension::GetBatchedViews(const FSceneView& InView, TFunctionRef<bool(const FAnimepoyRenderProxy&)> IsPassEnabled, TFunctionRef<bool(const FAnimepoyRenderProxy&, const FAnimepoyRenderProxy&)> HasSameSettings, FBatchedViewRects& OutViewRects)
+{
+	OutViewRects.Reset();
+
+	const TArray<const FSceneView*>& FamilyViews = InView.Family->Views;
+	if (CVarAnimepoyBatchViews.GetValueOnRenderThread() == 0 || FamilyViews.Num() < 2 || FamilyViews.Num() > GMaxBatchedViews)
+	{
+		return true;
+	}
+
+	const FAnimepoyRenderProxy* FirstProxy = nullptr;
+	for (const FSceneView* FamilyView : FamilyViews)
+	{
+		const FAnimepoyViewState* ViewState = FamilyView->bIsViewInfo ? GetViewState(*FamilyView) : nullptr;
+		if (!ViewState || !IsPassEnabled(ViewState->RenderProxy) || (FirstProxy && !HasSameSettings(*FirstProxy, ViewState->RenderProxy)))
+		{
+			OutViewRects.Reset();
+			return true;
+		}
+
+		FirstProxy = FirstProxy ? FirstProxy : &ViewState->RenderProxy;
+
+		OutViewRects.Add(static_cast<const FViewInfo*>(FamilyView)->ViewRect);
+	}
+
+	// The renderer points the family at its FViewInfos, so the first of them runs the pass.
+	return FamilyViews[0] == &InView;
+}
@@ -1,32 +1,68 @@
-// Fill out your copyright notice in the Description page of Project Settings.
-
-#pragma once
-
-#include "CoreMinimal.h"
-#include "SceneViewExtension.h"
-#include "AnimepoySubsystem.h"
-
-class FAnimepoySceneViewExtension : public FSceneViewExtensionBase
-{
-public:
-	FAnimepoySceneViewExtension(const FAutoRegister& AutoRegister, UAnimepoySubsystem* WorldSubsystem);
-
-	virtual void SetupViewFamily(FSceneViewFamily& InViewFamily) override {}
-	virtual void SetupView(FSceneViewFamily& InViewFamily, FSceneView& InView) override;
-	virtual void BeginRenderViewFamily(FSceneViewFamily& InViewFamily) override {}
-
-#if USE_POST_DEFERRED_LIGHTING_PASS
-	// Called right after deferred lighting, before fog rendering.
-	virtual void PostDeferredLighting_RenderThread(FRDGBuilder& GraphBuilder, FSceneView& InView, TRDGUniformBufferRef<FSceneTextureUniformParameters> SceneTextures) override;
-#endif // USE_POST_DEFERRED_LIGHTING_PASS
-
-	virtual void PrePostProcessPass_RenderThread(FRDGBuilder& GraphBuilder, const FSceneView& InView, const FPostProcessingInputs& Inputs) override;
-	virtual void SubscribeToPostProcessingPass(EPostProcessingPass Pass, FAfterPassCallbackDelegateArray& InOutPassCallbacks, bool bIsPassEnabled) override;
-
-private:
-	UAnimepoySubsystem* WorldSubsystem{};
-	FAnimepoyRenderProxy AnimepoyRenderProxy;
-	bool bEnable;
-
-	bool ShouldProcessThisView() const;
-};
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SceneViewExtension.h"
+#include "AnimepoySubsystem.h"
+#include "PostProcessLineArt.h"
+#include "AnimepoyPassTimer.h"
+
+// Settings of one view, taken in SetupView and handed to the render thread with its view family.
+struct FAnimepoyViewState
+{
+	FAnimepoyRenderProxy RenderProxy = {};
+	FLineArtHistory LineArtHistory;
+	uint64 LastUsedFrame = 0;
+};
+
+// Render thread. Whether line detection runs on the async compute queue, see r.Animepoy.AsyncCompute.
+// bOverlapped is whether graphics work that does not depend on it, the Kuwahara filter, is added before its composite.
+bool UseAsyncLineDetection(bool bOverlapped);
+
+class FAnimepoySceneViewExtension : public FSceneViewExtensionBase
+{
+public:
+	FAnimepoySceneViewExtension(const FAutoRegister& AutoRegister, UAnimepoySubsystem* WorldSubsystem);
+
+	virtual void SetupViewFamily(FSceneViewFamily& InViewFamily) override {}
+	virtual void SetupView(FSceneViewFamily& InViewFamily, FSceneView& InView) override;
+	virtual void BeginRenderViewFamily(FSceneViewFamily& InViewFamily) override;
+
+#if USE_POST_DEFERRED_LIGHTING_PASS
+	// Called right after deferred lighting, before fog rendering.
+	virtual void PostDeferredLighting_RenderThread(FRDGBuilder& GraphBuilder, FSceneView& InView, TRDGUniformBufferRef<FSceneTextureUniformParameters> SceneTextures) override;
+#endif // USE_POST_DEFERRED_LIGHTING_PASS
+
+	virtual void PrePostProcessPass_RenderThread(FRDGBuilder& GraphBuilder, const FSceneView& InView, const FPostProcessingInputs& Inputs) override;
+	virtual void SubscribeToPostProcessingPass(EPostProcessingPass Pass, FAfterPassCallbackDelegateArray& InOutPassCallbacks, bool bIsPassEnabled) override;
+
+	// GPU time of the passes for the quality governor.
+	FAnimepoyPassTimer& GetPassTimer() { return PassTimer; }
+
+private:
+	UAnimepoySubsystem* WorldSubsystem{};
+
+	// Game thread. Last snapshot taken from the subsystem, only copied again when the actor publishes a change.
+	FAnimepoyRenderProxy AnimepoyRenderProxy = {};
+
+	// Game thread. Settings of the views set up since the last BeginRenderViewFamily, keyed by FSceneView::GetViewKey(),
+	// or by the index in the family for views without a state.
+	TMap<uint64, FAnimepoyRenderProxy> PendingViewProxies;
+
+	// Render thread, keyed like PendingViewProxies. Boxed because the graph extracts into the line art history after later views are added.
+	TMap<uint64, TUniquePtr<FAnimepoyViewState>> ViewStates;
+
+	FAnimepoyPassTimer PassTimer;
+
+	// Takes the settings of the views of a family before it renders.
+	void UpdateViewStates_RenderThread(const TMap<uint64, FAnimepoyRenderProxy>& ViewProxies);
+
+	// Returns null when the view does not render Animepoy.
+	FAnimepoyViewState* GetViewState(const FSceneView& InView);
+
+	// Collects the rects of the views in the family of InView that can run a pass as one, all of them or none.
+	// Views batch only when HasSameSettings holds between the first of them and each other, since the pass takes its settings from InView.
+	// Returns false when an earlier view of the family already ran the pass for InView.
+	bool GetBatchedViews(const FSceneView& InView, TFunctionRef<bool(const FAnimepoyRenderProxy&)> IsPassEnabled, TFunctionRef<bool(const FAnimepoyRenderProxy&, const FAnimepoyRenderProxy&)> HasSameSettings, FBatchedViewRects& OutViewRects);
+};
\ No newline at end of file
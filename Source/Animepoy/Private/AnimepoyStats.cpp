@@ -0,0 +1,91 @@
+// @Custom
+#include "AnimepoyStats.h"
+#include "RenderUtils.h"
+#include "RenderingThread.h"
+
+CSV_DEFINE_CATEGORY(Animepoy, true);
+
+DECLARE_MEMORY_STAT(TEXT("Summed Area Table Memory"), STAT_AnimepoySummedAreaTableMemory, STATGROUP_Animepoy);
+DECLARE_MEMORY_STAT(TEXT("Kuwahara Filter Input Memory"), STAT_AnimepoyKuwaharaFilterInputMemory, STATGROUP_Animepoy);
+DECLARE_MEMORY_STAT(TEXT("Line Texture Memory"), STAT_AnimepoyLineTextureMemory, STATGROUP_Animepoy);
+DECLARE_MEMORY_STAT(TEXT("Diffusion Mask Memory"), STAT_AnimepoyDiffusionMaskMemory, STATGROUP_Animepoy);
+DECLARE_MEMORY_STAT(TEXT("Diffusion Blur Memory"), STAT_AnimepoyDiffusionBlurMemory, STATGROUP_Animepoy);
+
+namespace {
+	struct FTransientTextureBytes
+	{
+		uint64 Frame = 0;
+		int64 Bytes[(int32)EAnimepoyTransientTexture::MAX] = {};
+	};
+
+	FTransientTextureBytes GTransientTextureBytes;
+
+	void SetTransientTextureStat(EAnimepoyTransientTexture Type, int64 Bytes)
+	{
+		switch (Type)
+		{
+		case EAnimepoyTransientTexture::SummedAreaTable:
+			SET_MEMORY_STAT(STAT_AnimepoySummedAreaTableMemory, Bytes);
+			break;
+		case EAnimepoyTransientTexture::KuwaharaFilterInput:
+			SET_MEMORY_STAT(STAT_AnimepoyKuwaharaFilterInputMemory, Bytes);
+			break;
+		case EAnimepoyTransientTexture::LineTexture:
+			SET_MEMORY_STAT(STAT_AnimepoyLineTextureMemory, Bytes);
+			break;
+		case EAnimepoyTransientTexture::DiffusionMask:
+			SET_MEMORY_STAT(STAT_AnimepoyDiffusionMaskMemory, Bytes);
+			break;
+		case EAnimepoyTransientTexture::DiffusionBlur:
+			SET_MEMORY_STAT(STAT_AnimepoyDiffusionBlurMemory, Bytes);
+			break;
+		}
+	}
+}
+
+void BeginAnimepoyTransientTextureFrame()
+{
+	check(IsInRenderingThread());
+
+	if (GTransientTextureBytes.Frame == GFrameCounterRenderThread)
+	{
+		return;
+	}
+
+	GTransientTextureBytes = FTransientTextureBytes{ GFrameCounterRenderThread };
+	for (int32 Type = 0; Type < (int32)EAnimepoyTransientTexture::MAX; ++Type)
+	{
+		SetTransientTextureStat((EAnimepoyTransientTexture)Type, 0);
+	}
+}
+
+void AddAnimepoyTransientTexture(EAnimepoyTransientTexture Type, const FRDGTextureDesc& Desc)
+{
+	BeginAnimepoyTransientTextureFrame();
+
+	// Before platform alignment and compression of render targets.
+	const int64 Bytes = (int64)CalcTextureSize(Desc.Extent.X, Desc.Extent.Y, Desc.Format, Desc.NumMips) * Desc.ArraySize;
+
+	int64& TotalBytes = GTransientTextureBytes.Bytes[(int32)Type];
+	TotalBytes += Bytes;
+	SetTransientTextureStat(Type, TotalBytes);
+
+	switch (Type)
+	{
+	case EAnimepoyTransientTexture::SummedAreaTable:
+		CSV_CUSTOM_STAT(Animepoy, SummedAreaTableMB, Bytes / (1024.0f * 1024.0f), ECsvCustomStatOp::Accumulate);
+		break;
+	case EAnimepoyTransientTexture::KuwaharaFilterInput:
+		CSV_CUSTOM_STAT(Animepoy, KuwaharaFilterInputMB, Bytes / (1024.0f * 1024.0f), ECsvCustomStatOp::Accumulate);
+		break;
+	case EAnimepoyTransientTexture::LineTexture:
+		CSV_CUSTOM_STAT(Animepoy, LineTextureMB, Bytes / (1024.0f * 1024.0f), ECsvCustomStatOp::Accumulate);
+		break;
+	case EAnimepoyTransientTexture::DiffusionMask:
+		CSV_CUSTOM_STAT(Animepoy, DiffusionMaskMB, Bytes / (1024.0f * 1024.0f), ECsvCustomStatOp::Accumulate);
+		break;
+	case EAnimepoyTransientTexture::DiffusionBlur:
+		CSV_CUSTOM_STAT(Animepoy, DiffusionBlurMB, Bytes / (1024.0f * 1024.0f), ECsvCustomStatOp::Accumulate);
+		break;
+	}
+}
@@ -0,0 +1,27 @@
+// @Custom
+#pragma once
+
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "RenderGraphResources.h"
+
+DECLARE_STATS_GROUP(TEXT("Animepoy"), STATGROUP_Animepoy, STATCAT_Advanced);
+
+CSV_DECLARE_CATEGORY_EXTERN(Animepoy);
+
+// Transient textures whose size is reported by "stat Animepoy" and the Animepoy CSV category.
+enum class EAnimepoyTransientTexture
+{
+	SummedAreaTable,
+	KuwaharaFilterInput,
+	LineTexture,
+	DiffusionMask,
+	DiffusionBlur,
+	MAX
+};
+
+// Starts a new total once per render thread frame, so the counters drop to zero while the effect is off.
+void BeginAnimepoyTransientTextureFrame();
+
+// Adds a texture created this frame to the total of its kind over all views.
+void AddAnimepoyTransientTexture(EAnimepoyTransientTexture Type, const FRDGTextureDesc& Desc);
@@ -0,0 +1,12 @@
+// @Custom
+#pragma once
+
+#include "HAL/IConsoleManager.h"
+
+// With Substrate the G-buffer holds no GBufferB material data, which the line detection and the G-buffer Kuwahara filter read.
+// r.Substrate is read only, so the lookup is done once.
+inline bool IsSubstrateEnabled()
+{
+	static const TConsoleVariableData<int32>* CVarSubstrate = IConsoleManager::Get().FindTConsoleVariableDataInt(TEXT("r.Substrate"));
+	return CVarSubstrate && CVarSubstrate->GetValueOnAnyThread() > 0;
+}
@@ -1,63 +1,135 @@
-// Fill out your copyright notice in the Description page of Project Settings.
-
-
-#include "AnimepoySubsystem.h"
-#include "EngineUtils.h"
-#include "Animepoy.h"
-#include "AnimepoySceneViewExtension.h"
-
-void UAnimepoySubsystem::Initialize(FSubsystemCollectionBase& Collection)
-{
-	Super::Initialize(Collection);
-
-	AnimepoySceneViewExtension = FSceneViewExtensions::NewExtension<FAnimepoySceneViewExtension>(this);
-
-#if WITH_EDITOR
-	if (GetWorld()->WorldType == EWorldType::Editor)
-	{
-		GEngine->OnLevelActorAdded().AddUObject(this, &UAnimepoySubsystem::OnActorSpawned);
-		GEngine->OnLevelActorDeleted().AddUObject(this, &UAnimepoySubsystem::OnActorDeleted);
-		GEngine->OnLevelActorListChanged().AddUObject(this, &UAnimepoySubsystem::OnActorListChanged);
-	}
-#endif
-}
-
-void UAnimepoySubsystem::Deinitialize()
-{
-	Super::Deinitialize();
-
-#if WITH_EDITOR
-	if (GetWorld()->WorldType == EWorldType::Editor)
-	{
-		GEngine->OnLevelActorAdded().RemoveAll(this);
-		GEngine->OnLevelActorDeleted().RemoveAll(this);
-		GEngine->OnLevelActorListChanged().RemoveAll(this);
-	}
-#endif
-}
-
-void UAnimepoySubsystem::OnActorSpawned(AActor* Actor)
-{
-	AAnimepoy* AsAnimepoy = Cast<AAnimepoy>(Actor);
-	if (AsAnimepoy)
-	{
-		Animepoy = AsAnimepoy;
-	}
-}
-
-void UAnimepoySubsystem::OnActorDeleted(AActor* Actor)
-{
-	if ((AActor*)Animepoy == Actor)
-	{
-		Animepoy = nullptr;
-	}
-}
-
-void UAnimepoySubsystem::OnActorListChanged()
-{
-	for (TActorIterator<AAnimepoy> It(GetWorld()); It; ++It)
-	{
-		Animepoy = *It;
-		break;
-	}
-}
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "AnimepoySubsystem.h"
+#include "EngineUtils.h"
+#include "Animepoy.h"
+#include "AnimepoySceneViewExtension.h"
+#include "AnimepoyPipelinePrecache.h"
+#include "AnimepoyModule.h"
+
+void UAnimepoySubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	AnimepoySceneViewExtension = FSceneViewExtensions::NewExtension<FAnimepoySceneViewExtension>(this);
+
+	// Hands every pass to the engine's PSO precaching, which skips this when r.PSOPrecaching is off.
+	if (GetWorld()->IsGameWorld() || GetWorld()->WorldType == EWorldType::Editor)
+	{
+		ENQUEUE_RENDER_COMMAND(AnimepoyPrecachePipelines)([ShaderPlatform = GShaderPlatformForFeatureLevel[GMaxRHIFeatureLevel]](FRHICommandListImmediate& RHICmdList)
+			{
+				PrecacheAnimepoyPipelines(RHICmdList, ShaderPlatform, false);
+			});
+	}
+
+#if WITH_EDITOR
+	if (GetWorld()->WorldType == EWorldType::Editor)
+	{
+		GEngine->OnLevelActorAdded().AddUObject(this, &UAnimepoySubsystem::OnActorSpawned);
+		GEngine->OnLevelActorDeleted().AddUObject(this, &UAnimepoySubsystem::OnActorDeleted);
+		GEngine->OnLevelActorListChanged().AddUObject(this, &UAnimepoySubsystem::OnActorListChanged);
+	}
+#endif
+}
+
+void UAnimepoySubsystem::Deinitialize()
+{
+	Super::Deinitialize();
+
+#if WITH_EDITOR
+	if (GetWorld()->WorldType == EWorldType::Editor)
+	{
+		GEngine->OnLevelActorAdded().RemoveAll(this);
+		GEngine->OnLevelActorDeleted().RemoveAll(this);
+		GEngine->OnLevelActorListChanged().RemoveAll(this);
+	}
+#endif
+}
+
+void UAnimepoySubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	const float BudgetMs = GetQualityGovernorBudget();
+	const FAnimepoyQualityLevels PreviousLevels = QualityGovernor.GetLevels();
+
+	FAnimepoyPassTimings Timings;
+	while (AnimepoySceneViewExtension->GetPassTimer().PopFrameTimings(Timings))
+	{
+		QualityGovernor.Update(Timings, BudgetMs);
+	}
+
+	// Turning the governor off has no frame to read back.
+	if (BudgetMs <= 0.f)
+	{
+		QualityGovernor.Reset();
+	}
+
+	if (QualityGovernor.GetLevels() != PreviousLevels)
+	{
+		UE_LOG(LogAnimepoy, Verbose, TEXT("Quality governor %s, %.2fms of %.2fms"), *QualityGovernor.GetLevels().ToString(), QualityGovernor.GetSmoothedTimings().GetTotal(), BudgetMs);
+		SetAnimepoyRenderProxy(BaseRenderProxy);
+	}
+}
+
+TStatId UAnimepoySubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UAnimepoySubsystem, STATGROUP_Tickables);
+}
+
+void UAnimepoySubsystem::SetQualityBudget(float BudgetMs)
+{
+	SetQualityGovernorBudget(BudgetMs);
+}
+
+void UAnimepoySubsystem::WarmUpShaders(bool bWaitForCompletion)
+{
+	ENQUEUE_RENDER_COMMAND(AnimepoyWarmUpShaders)([ShaderPlatform = GShaderPlatformForFeatureLevel[GMaxRHIFeatureLevel]](FRHICommandListImmediate& RHICmdList)
+		{
+			PrecacheAnimepoyPipelines(RHICmdList, ShaderPlatform, true);
+		});
+
+	if (bWaitForCompletion)
+	{
+		FlushRenderingCommands();
+	}
+}
+
+void UAnimepoySubsystem::OnActorSpawned(AActor* Actor)
+{
+	AAnimepoy* AsAnimepoy = Cast<AAnimepoy>(Actor);
+	if (AsAnimepoy)
+	{
+		Animepoy = AsAnimepoy;
+	}
+}
+
+void UAnimepoySubsystem::OnActorDeleted(AActor* Actor)
+{
+	// Settings are only published on change, so the deleted actor's would otherwise stay on screen.
+	if (Cast<AAnimepoy>(Actor) && Animepoy.Get() == Actor)
+	{
+		SelectAnimepoy(Actor);
+	}
+}
+
+void UAnimepoySubsystem::OnActorListChanged()
+{
+	SelectAnimepoy(nullptr);
+}
+
+void UAnimepoySubsystem::SelectAnimepoy(const AActor* DeletedActor)
+{
+	Animepoy = nullptr;
+	for (TActorIterator<AAnimepoy> It(GetWorld()); It; ++It)
+	{
+		if (*It != DeletedActor && !It->IsActorBeingDestroyed())
+		{
+			Animepoy = *It;
+			break;
+		}
+	}
+
+	SetAnimepoyRenderProxy(Animepoy.IsValid() ? Animepoy->CreateRenderProxy() : FAnimepoyRenderProxy{});
+}
@@ -0,0 +1,550 @@
+// @Custom
+#include "DiffusionFilterCPU.h"
+#include "DiffusionFilterReference.h"
+#include "AnimepoyBenchmarkCPU.h"
+#include "AnimepoyModule.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/VectorRegister.h"
+
+namespace DiffusionFilterCPU
+{
+	namespace
+	{
+		// Matches DOWNSAMPLE_FACTOR.
+		constexpr int32 GDownsampleFactor = 4;
+
+		// DIFFUSION_BLEND_MODE
+		enum class EBlendKernel : uint8
+		{
+			Lighten,
+			Screen,
+			Overlay,
+			SoftLight,
+			Debug,
+			MAX
+		};
+
+		struct FImage
+		{
+			FIntPoint Size;
+			TArray<FLinearColor> Texels;
+
+			explicit FImage(FIntPoint InSize)
+				: Size(InSize)
+			{
+				Texels.SetNumUninitialized(Size.X * Size.Y);
+			}
+
+			VectorRegister4Float Load(int32 X, int32 Y) const
+			{
+				return VectorLoad(&Texels[FMath::Clamp(Y, 0, Size.Y - 1) * Size.X + FMath::Clamp(X, 0, Size.X - 1)].R);
+			}
+		};
+
+		FIntPoint GetMipExtent(FIntPoint Extent, int32 MipLevel)
+		{
+			return FIntPoint(FMath::Max(Extent.X >> MipLevel, 1), FMath::Max(Extent.Y >> MipLevel, 1));
+		}
+
+		VectorRegister4Float VectorLerp(const VectorRegister4Float& A, const VectorRegister4Float& B, const VectorRegister4Float& Alpha)
+		{
+			return VectorMultiplyAdd(VectorSubtract(B, A), Alpha, A);
+		}
+
+		// One axis of Texture2DSampleLevel with GlobalBilinearClampedSampler.
+		struct FBilinearTap
+		{
+			int32 Index0;
+			int32 Index1;
+			float Frac;
+		};
+
+		FBilinearTap GetBilinearTap(float UV, int32 Size)
+		{
+			const float Position = UV * Size - 0.5f;
+			const int32 Index = FMath::FloorToInt(Position);
+			return { FMath::Clamp(Index, 0, Size - 1), FMath::Clamp(Index + 1, 0, Size - 1), Position - Index };
+		}
+
+		// Luminance of Common.ush
+		float Luminance(const VectorRegister4Float& Color)
+		{
+			FVector4f Value;
+			VectorStore(Color, &Value.X);
+			return Value.X * 0.3f + Value.Y * 0.59f + Value.Z * 0.11f;
+		}
+
+		// SampleSceneColor and SamplePreTonemapColor, the average of a DOWNSAMPLE_FACTOR square from Min.
+		VectorRegister4Float SampleBlock(const float* Color, FIntPoint Size, FIntPoint Min)
+		{
+			VectorRegister4Float Sum = VectorZeroFloat();
+			for (int32 Y = FMath::Max(Min.Y, 0); Y < FMath::Min(Min.Y + GDownsampleFactor, Size.Y); ++Y)
+			{
+				for (int32 X = FMath::Max(Min.X, 0); X < FMath::Min(Min.X + GDownsampleFactor, Size.X); ++X)
+				{
+					Sum = VectorAdd(Sum, VectorLoad(Color + 4 * (Y * Size.X + X)));
+				}
+			}
+			return VectorMultiply(Sum, VectorSetFloat1(1.f / (GDownsampleFactor * GDownsampleFactor)));
+		}
+
+		// GenerateMask for every texel of mip 0.
+		FImage GenerateMask(const float* SceneColor, FIntPoint Size, const FPostProcessDiffusionInputs& Inputs, const float* PreTonemapColor, FIntPoint PreTonemapSize, EParallelForFlags ParallelForFlags)
+		{
+			FImage Mask(FIntPoint::DivideAndRoundUp(Size, GDownsampleFactor));
+
+			const float LuminanceMin = FMath::Clamp(Inputs.LuminanceMin, 0.f, 1.f);
+			const float InvLuminanceWidth = 1.f / FMath::Max(Inputs.LuminanceMax - Inputs.LuminanceMin, 0.00001f);
+			const bool bPreTonemapLuminance = Inputs.bPreTonemapLuminance && PreTonemapColor != nullptr;
+
+			ParallelFor(Mask.Size.Y, [&](int32 Y)
+				{
+					for (int32 X = 0; X < Mask.Size.X; ++X)
+					{
+						const VectorRegister4Float Color = SampleBlock(SceneColor, Size, GDownsampleFactor * FIntPoint(X, Y));
+
+						float Luma;
+						if (bPreTonemapLuminance)
+						{
+							const FIntPoint PreTonemapMin(
+								FMath::TruncToInt(PreTonemapSize.X * (float(X) / Mask.Size.X)),
+								FMath::TruncToInt(PreTonemapSize.Y * (float(Y) / Mask.Size.Y)));
+							Luma = Luminance(SampleBlock(PreTonemapColor, PreTonemapSize, PreTonemapMin));
+						}
+						else
+						{
+							Luma = Luminance(Color);
+						}
+
+						FLinearColor& Texel = Mask.Texels[Y * Mask.Size.X + X];
+						VectorStore(Color, &Texel.R);
+						Texel.A = FMath::Clamp((Luma - LuminanceMin) * InvLuminanceWidth, 0.f, 1.f);
+					}
+				}, ParallelForFlags);
+
+			return Mask;
+		}
+
+		// One mip of GenerateMaskPyramidCS, 2x2 boxes.
+		FImage Downsample(const FImage& Source, FIntPoint Extent, EParallelForFlags ParallelForFlags)
+		{
+			FImage Result(Extent);
+			const VectorRegister4Float Quarter = VectorSetFloat1(0.25f);
+
+			ParallelFor(Extent.Y, [&](int32 Y)
+				{
+					for (int32 X = 0; X < Extent.X; ++X)
+					{
+						VectorRegister4Float Color = VectorAdd(Source.Load(2 * X, 2 * Y), Source.Load(2 * X + 1, 2 * Y));
+						Color = VectorAdd(Color, VectorAdd(Source.Load(2 * X, 2 * Y + 1), Source.Load(2 * X + 1, 2 * Y + 1)));
+						VectorStore(VectorMultiply(Color, Quarter), &Result.Texels[Y * Extent.X + X].R);
+					}
+				}, ParallelForFlags);
+
+			return Result;
+		}
+
+		// 1 2 1 along each axis, the 3x3 tent of BlurUpsampleCS.
+		constexpr float GTentWeights[3] = { 0.25f, 0.5f, 0.25f };
+
+		// Bilinear taps at UV and one texel of Extent to either side.
+		TArray<FBilinearTap> GetTentTaps(int32 Extent, int32 SourceExtent)
+		{
+			TArray<FBilinearTap> Taps;
+			Taps.SetNumUninitialized(3 * Extent);
+			for (int32 Index = 0; Index < Extent; ++Index)
+			{
+				const float UV = (Index + 0.5f) / Extent;
+				Taps[3 * Index + 0] = GetBilinearTap(UV - 1.f / Extent, SourceExtent);
+				Taps[3 * Index + 1] = GetBilinearTap(UV, SourceExtent);
+				Taps[3 * Index + 2] = GetBilinearTap(UV + 1.f / Extent, SourceExtent);
+			}
+
+			return Taps;
+		}
+
+		// BlurUpsampleCS. The tent of bilinear taps is separable, so it runs as a horizontal and a vertical pass of three taps.
+		FImage Upsample(const FImage& Source, const FImage& Base, float SourceWeight, EParallelForFlags ParallelForFlags)
+		{
+			const TArray<FBilinearTap> ColumnTaps = GetTentTaps(Base.Size.X, Source.Size.X);
+			const TArray<FBilinearTap> RowTaps = GetTentTaps(Base.Size.Y, Source.Size.Y);
+
+			// Every source row filtered horizontally to the width of Base.
+			FImage Horizontal(FIntPoint(Base.Size.X, Source.Size.Y));
+			ParallelFor(Source.Size.Y, [&](int32 Y)
+				{
+					const FLinearColor* SourceRow = &Source.Texels[Y * Source.Size.X];
+					for (int32 X = 0; X < Base.Size.X; ++X)
+					{
+						VectorRegister4Float Color = VectorZeroFloat();
+						for (int32 Tap = 0; Tap < 3; ++Tap)
+						{
+							const FBilinearTap& BilinearTap = ColumnTaps[3 * X + Tap];
+							const VectorRegister4Float Sample = VectorLerp(VectorLoad(&SourceRow[BilinearTap.Index0].R), VectorLoad(&SourceRow[BilinearTap.Index1].R), VectorSetFloat1(BilinearTap.Frac));
+							Color = VectorMultiplyAdd(Sample, VectorSetFloat1(GTentWeights[Tap]), Color);
+						}
+						VectorStore(Color, &Horizontal.Texels[Y * Base.Size.X + X].R);
+					}
+				}, ParallelForFlags);
+
+			FImage Result(Base.Size);
+			const VectorRegister4Float BlendWeight = VectorSetFloat1(SourceWeight);
+
+			ParallelFor(Base.Size.Y, [&](int32 Y)
+				{
+					for (int32 X = 0; X < Base.Size.X; ++X)
+					{
+						VectorRegister4Float Color = VectorZeroFloat();
+						for (int32 Tap = 0; Tap < 3; ++Tap)
+						{
+							const FBilinearTap& BilinearTap = RowTaps[3 * Y + Tap];
+							const VectorRegister4Float Sample = VectorLerp(
+								VectorLoad(&Horizontal.Texels[BilinearTap.Index0 * Base.Size.X + X].R),
+								VectorLoad(&Horizontal.Texels[BilinearTap.Index1 * Base.Size.X + X].R),
+								VectorSetFloat1(BilinearTap.Frac));
+							Color = VectorMultiplyAdd(Sample, VectorSetFloat1(GTentWeights[Tap]), Color);
+						}
+
+						const int32 Index = Y * Base.Size.X + X;
+						if (SourceWeight < 1.f)
+						{
+							Color = VectorLerp(VectorLoad(&Base.Texels[Index].R), Color, BlendWeight);
+						}
+						VectorStore(Color, &Result.Texels[Index].R);
+					}
+				}, ParallelForFlags);
+
+			return Result;
+		}
+
+		// The pyramid of a MaskSize mask, starting from Mask at FirstLevel and blurred back up to it.
+		// A mask held at a level at or above the top of the pyramid is already coarser than the blur and is returned as is.
+		FImage BlurPyramid(FImage Mask, int32 FirstLevel, FIntPoint MaskSize, float BlurPercentage, EParallelForFlags ParallelForFlags)
+		{
+			const FDiffusionBlurPyramid Pyramid = GetDiffusionBlurPyramid(MaskSize, BlurPercentage);
+			const int32 NumLevels = Pyramid.NumLevels - FirstLevel;
+			if (NumLevels <= 0)
+			{
+				return Mask;
+			}
+
+			// Mips[Index] is level FirstLevel + Index.
+			TArray<FImage> Mips;
+			Mips.Add(MoveTemp(Mask));
+			for (int32 Index = 1; Index <= NumLevels; ++Index)
+			{
+				FImage Mip = Downsample(Mips[Index - 1], GetMipExtent(MaskSize, FirstLevel + Index), ParallelForFlags);
+				Mips.Add(MoveTemp(Mip));
+			}
+
+			FImage Result = Upsample(Mips[NumLevels], Mips[NumLevels - 1], Pyramid.TopLevelWeight, ParallelForFlags);
+			for (int32 Index = NumLevels - 2; Index >= 0; --Index)
+			{
+				Result = Upsample(Result, Mips[Index], 1.f, ParallelForFlags);
+			}
+
+			return Result;
+		}
+
+		// BlendLighten, BlendScreen, BlendOverlay and BlendSoftLight on all four channels, alpha is restored by the caller.
+		template<EBlendKernel Kernel>
+		VectorRegister4Float BlendColor(const VectorRegister4Float& Base, const VectorRegister4Float& Blend)
+		{
+			const VectorRegister4Float One = VectorOneFloat();
+			const VectorRegister4Float Two = VectorSetFloat1(2.f);
+
+			if constexpr (Kernel == EBlendKernel::Lighten)
+			{
+				return VectorMax(Base, Blend);
+			}
+			else if constexpr (Kernel == EBlendKernel::Screen)
+			{
+				return VectorSubtract(One, VectorMultiply(VectorSubtract(One, Base), VectorSubtract(One, Blend)));
+			}
+			else if constexpr (Kernel == EBlendKernel::Overlay)
+			{
+				const VectorRegister4Float Multiply = VectorMultiply(Two, VectorMultiply(Base, Blend));
+				const VectorRegister4Float Screen = VectorSubtract(One, VectorMultiply(Two, VectorMultiply(VectorSubtract(One, Base), VectorSubtract(One, Blend))));
+				return VectorSelect(VectorCompareLT(Base, VectorSetFloat1(0.5f)), Multiply, Screen);
+			}
+			else if constexpr (Kernel == EBlendKernel::SoftLight)
+			{
+				const VectorRegister4Float TwoBlend = VectorMultiply(Two, Blend);
+				return VectorMultiplyAdd(VectorMultiply(VectorSubtract(One, TwoBlend), Base), Base, VectorMultiply(TwoBlend, Base));
+			}
+			else
+			{
+				return VectorMultiply(Blend, VectorReplicate(Blend, 3));
+			}
+		}
+
+		// CompositeCS for the pixels of Rect in a Size image, with the blend switch resolved by Kernel.
+		// SceneColor and Output hold only Rect, with no row padding.
+		template<EBlendKernel Kernel>
+		void Composite(const float* SceneColor, float* Output, const FIntRect& Rect, FIntPoint Size, TConstArrayView<FLinearColor> Blurred, FIntPoint BlurredSize, float BlendAmount, EParallelForFlags ParallelForFlags)
+		{
+			const FIntPoint RectSize = Rect.Size();
+
+			TArray<FBilinearTap> ColumnTaps;
+			ColumnTaps.SetNumUninitialized(RectSize.X);
+			for (int32 X = 0; X < RectSize.X; ++X)
+			{
+				ColumnTaps[X] = GetBilinearTap((Rect.Min.X + X + 0.5f) / Size.X, BlurredSize.X);
+			}
+
+			// Only the columns of the blurred mask under Rect are blended vertically.
+			const int32 MinColumn = ColumnTaps[0].Index0;
+			const int32 NumColumns = ColumnTaps.Last().Index1 - MinColumn + 1;
+
+			const VectorRegister4Float Amount = VectorSetFloat1(BlendAmount);
+			const VectorRegister4Float ColorMask = GlobalVectorConstants::XYZMask();
+
+			ParallelFor(RectSize.Y, [&](int32 Y)
+				{
+					// The two rows of the blurred mask under this row, blended vertically once.
+					const FBilinearTap RowTap = GetBilinearTap((Rect.Min.Y + Y + 0.5f) / Size.Y, BlurredSize.Y);
+					const VectorRegister4Float RowFrac = VectorSetFloat1(RowTap.Frac);
+
+					TArray<FLinearColor, TInlineAllocator<512>> BlurredRow;
+					BlurredRow.SetNumUninitialized(NumColumns);
+					for (int32 Column = 0; Column < NumColumns; ++Column)
+					{
+						const VectorRegister4Float Color = VectorLerp(
+							VectorLoad(&Blurred[RowTap.Index0 * BlurredSize.X + MinColumn + Column].R),
+							VectorLoad(&Blurred[RowTap.Index1 * BlurredSize.X + MinColumn + Column].R),
+							RowFrac);
+						VectorStore(Color, &BlurredRow[Column].R);
+					}
+
+					for (int32 X = 0; X < RectSize.X; ++X)
+					{
+						const FBilinearTap& ColumnTap = ColumnTaps[X];
+						const VectorRegister4Float BlurredColor = VectorLerp(
+							VectorLoad(&BlurredRow[ColumnTap.Index0 - MinColumn].R),
+							VectorLoad(&BlurredRow[ColumnTap.Index1 - MinColumn].R),
+							VectorSetFloat1(ColumnTap.Frac));
+
+						const int32 Index = 4 * (Y * RectSize.X + X);
+						const VectorRegister4Float Color = VectorLoad(SceneColor + Index);
+						const VectorRegister4Float BlendedColor = BlendColor<Kernel>(Color, BlurredColor);
+
+						// The debug mask blends with an alpha of 1.
+						const VectorRegister4Float Alpha = Kernel == EBlendKernel::Debug ? Amount : VectorMultiply(Amount, VectorReplicate(BlurredColor, 3));
+						VectorStore(VectorSelect(ColorMask, VectorLerp(Color, BlendedColor, Alpha), Color), Output + Index);
+					}
+				}, ParallelForFlags);
+		}
+
+		// Same selection as AddPostProcessDiffusionPass.
+		void Composite(const FPostProcessDiffusionInputs& Inputs, const float* SceneColor, float* Output, const FIntRect& Rect, FIntPoint Size, TConstArrayView<FLinearColor> Blurred, FIntPoint BlurredSize, EParallelForFlags ParallelForFlags)
+		{
+			const EBlendKernel Kernel = Inputs.bDebugMask ? EBlendKernel::Debug : (EBlendKernel)FMath::Clamp(Inputs.BlendMode, 0, (int32)EBlendKernel::MAX - 1);
+			const float BlendAmount = Inputs.bDebugMask ? 1.f : FMath::Clamp(Inputs.Intensity, 0.f, 1.f);
+
+			switch (Kernel)
+			{
+			case EBlendKernel::Lighten: Composite<EBlendKernel::Lighten>(SceneColor, Output, Rect, Size, Blurred, BlurredSize, BlendAmount, ParallelForFlags); break;
+			case EBlendKernel::Screen: Composite<EBlendKernel::Screen>(SceneColor, Output, Rect, Size, Blurred, BlurredSize, BlendAmount, ParallelForFlags); break;
+			case EBlendKernel::Overlay: Composite<EBlendKernel::Overlay>(SceneColor, Output, Rect, Size, Blurred, BlurredSize, BlendAmount, ParallelForFlags); break;
+			case EBlendKernel::SoftLight: Composite<EBlendKernel::SoftLight>(SceneColor, Output, Rect, Size, Blurred, BlurredSize, BlendAmount, ParallelForFlags); break;
+			default: Composite<EBlendKernel::Debug>(SceneColor, Output, Rect, Size, Blurred, BlurredSize, BlendAmount, ParallelForFlags); break;
+			}
+		}
+
+		// Soft gradients with a grid of bright spots to glow.
+		void GenerateTestImage(FIntPoint Size, TArray<FLinearColor>& OutImage)
+		{
+			OutImage.SetNumUninitialized(Size.X * Size.Y);
+			ParallelFor(Size.Y, [&OutImage, Size](int32 Y)
+				{
+					for (int32 X = 0; X < Size.X; ++X)
+					{
+						const float U = (X + 0.5f) / Size.X;
+						const float V = (Y + 0.5f) / Size.Y;
+						const float Spot = FMath::Square(FMath::Sin(40.f * U) * FMath::Sin(24.f * V));
+						const float Base = 0.2f + 0.3f * U * V;
+						OutImage[Y * Size.X + X] = FLinearColor(Base + 0.8f * FMath::Pow(Spot, 8.f), Base + 0.6f * FMath::Pow(Spot, 8.f), 0.3f * V, 1.f);
+					}
+				});
+		}
+
+		void BenchmarkDiffusionFilter(const TArray<FString>& Args)
+		{
+			const float BlurPercentage = Args.Num() > 0 ? FCString::Atof(*Args[0]) : 5.f;
+			const int32 NumIterations = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 3;
+			const int32 MaxHeight = Args.Num() > 2 ? FCString::Atoi(*Args[2]) : 4320;
+
+			const FIntPoint Resolutions[] = { FIntPoint(1920, 1080), FIntPoint(3840, 2160), FIntPoint(7680, 4320) };
+			const TCHAR* BlendModeNames[] = { TEXT("Lighten"), TEXT("Screen"), TEXT("Overlay"), TEXT("SoftLight") };
+
+			// AAnimepoy defaults.
+			FPostProcessDiffusionInputs Inputs;
+			Inputs.Intensity = 0.5f;
+			Inputs.LuminanceMin = 0.f;
+			Inputs.LuminanceMax = 1.f;
+			Inputs.bPreTonemapLuminance = false;
+			Inputs.BlurPercentage = BlurPercentage;
+			Inputs.bDebugMask = false;
+
+			AnimepoyBenchmarkCPU::LogHeader(FString::Printf(TEXT("Diffusion CPU filter, BlurPercentage %.1f"), BlurPercentage), NumIterations);
+
+			for (const FIntPoint& Size : Resolutions)
+			{
+				if (Size.Y > MaxHeight)
+				{
+					continue;
+				}
+
+				TArray<FLinearColor> Image;
+				GenerateTestImage(Size, Image);
+				TArray<FLinearColor> Result;
+				Result.SetNumUninitialized(Image.Num());
+
+				const double Megapixels = double(Size.X) * Size.Y / 1e6;
+				for (int32 BlendMode = 0; BlendMode < (int32)UE_ARRAY_COUNT(BlendModeNames); ++BlendMode)
+				{
+					Inputs.BlendMode = BlendMode;
+
+					const double Seconds = AnimepoyBenchmarkCPU::MeasureSeconds(NumIterations, [&] { DiffusionFilter(&Image[0].R, &Result[0].R, Size, Inputs); });
+					AnimepoyBenchmarkCPU::LogThroughput(FString::Printf(TEXT("%dx%d %-9s"), Size.X, Size.Y, BlendModeNames[BlendMode]), Megapixels, Seconds);
+				}
+			}
+
+			// The separable blur against the reference pyramid.
+			const FIntPoint MaskSize(480, 270);
+			TArray<FLinearColor> Image;
+			GenerateTestImage(MaskSize, Image);
+
+			TArray<FLinearColor> Reference;
+			TArray<FLinearColor> Blurred;
+			DiffusionFilterReference::PyramidBlur(Image, MaskSize, BlurPercentage, Reference);
+			BlurMask(Image, MaskSize, BlurPercentage, Blurred);
+
+			AnimepoyBenchmarkCPU::LogDifference(FString::Printf(TEXT("Blur of a %dx%d mask"), MaskSize.X, MaskSize.Y), AnimepoyBenchmarkCPU::CompareImages(Reference, Blurred, true));
+		}
+
+		FAutoConsoleCommand GBenchmarkDiffusionFilterCommand(
+			TEXT("Animepoy.Diffusion.BenchmarkCPU"),
+			TEXT("Times the CPU diffusion filter per blend mode at 1080p, 4K and 8K on a synthetic image and checks its blur against the reference.\n")
+			TEXT("Usage: Animepoy.Diffusion.BenchmarkCPU [BlurPercentage=5] [Iterations=3] [MaxHeight=4320]"),
+			FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkDiffusionFilter));
+	}
+
+	void DiffusionFilter(
+		const float* SceneColor,
+		float* Output,
+		FIntPoint Size,
+		const FPostProcessDiffusionInputs& Inputs,
+		const float* PreTonemapColor,
+		FIntPoint PreTonemapSize,
+		bool bSingleThread)
+	{
+		check(SceneColor && Output && Size.X > 0 && Size.Y > 0);
+		check(!Inputs.bPreTonemapLuminance || (PreTonemapColor && PreTonemapSize.X > 0 && PreTonemapSize.Y > 0));
+
+		const EParallelForFlags ParallelForFlags = bSingleThread ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None;
+
+		FImage Mask = GenerateMask(SceneColor, Size, Inputs, PreTonemapColor, PreTonemapSize, ParallelForFlags);
+		const FIntPoint MaskSize = Mask.Size;
+		const FImage Blurred = BlurPyramid(MoveTemp(Mask), 0, MaskSize, Inputs.BlurPercentage, ParallelForFlags);
+
+		Composite(Inputs, SceneColor, Output, FIntRect(FIntPoint::ZeroValue, Size), Size, Blurred.Texels, Blurred.Size, ParallelForFlags);
+	}
+
+	void BlurMask(TConstArrayView<FLinearColor> Mask, FIntPoint MaskSize, float BlurPercentage, TArray<FLinearColor>& Output, bool bSingleThread)
+	{
+		check(Mask.Num() == MaskSize.X * MaskSize.Y);
+
+		FImage Image(MaskSize);
+		Image.Texels = Mask;
+
+		FImage Blurred = BlurPyramid(MoveTemp(Image), 0, MaskSize, BlurPercentage, bSingleThread ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+		Output = MoveTemp(Blurred.Texels);
+	}
+
+	FTiledMask::FTiledMask(FIntPoint InSize, const FPostProcessDiffusionInputs& InInputs, int64 MaxBytes)
+		: Size(InSize)
+		, Inputs(InInputs)
+	{
+		check(Size.X > 0 && Size.Y > 0 && !Inputs.bPreTonemapLuminance);
+
+		const FIntPoint BaseMaskSize = FIntPoint::DivideAndRoundUp(Size, GDownsampleFactor);
+		while (GetMaskBytes(Size, Level) > MaxBytes && GetMipExtent(BaseMaskSize, Level) != FIntPoint(1, 1))
+		{
+			++Level;
+		}
+
+		MaskSize = GetMipExtent(BaseMaskSize, Level);
+		Mask.SetNumZeroed(MaskSize.X * MaskSize.Y);
+	}
+
+	int32 FTiledMask::GetAlignment() const
+	{
+		return GDownsampleFactor << Level;
+	}
+
+	void FTiledMask::AddTile(const float* SceneColor, const FIntRect& Rect, bool bSingleThread)
+	{
+		const int32 Alignment = GetAlignment();
+		check(Rect.Min.X % Alignment == 0 && Rect.Min.Y % Alignment == 0);
+
+		// Texels of the level whose whole block lies in Rect. The pyramid drops the blocks past the truncated mip extent.
+		const FIntPoint Min = Rect.Min / Alignment;
+		const FIntPoint Max = FIntPoint::ComponentMin(FIntPoint::DivideAndRoundUp(Rect.Max, Alignment), MaskSize);
+		const FIntPoint RectSize = Rect.Size();
+
+		const int32 BlockSize = 1 << Level;
+		const float BlockWeight = 1.f / (BlockSize * BlockSize);
+		const float LuminanceMin = FMath::Clamp(Inputs.LuminanceMin, 0.f, 1.f);
+		const float InvLuminanceWidth = 1.f / FMath::Max(Inputs.LuminanceMax - Inputs.LuminanceMin, 0.00001f);
+
+		ParallelFor(FMath::Max(Max.Y - Min.Y, 0), [&](int32 Row)
+			{
+				const int32 Y = Min.Y + Row;
+				for (int32 X = Min.X; X < Max.X; ++X)
+				{
+					// GenerateMask for each texel of mip 0 in the block, then the 2x2 boxes of the mips above in one average.
+					VectorRegister4Float ColorSum = VectorZeroFloat();
+					float AlphaSum = 0.f;
+					for (int32 BlockY = 0; BlockY < BlockSize; ++BlockY)
+					{
+						for (int32 BlockX = 0; BlockX < BlockSize; ++BlockX)
+						{
+							const FIntPoint PixelMin = GDownsampleFactor * (BlockSize * FIntPoint(X, Y) + FIntPoint(BlockX, BlockY)) - Rect.Min;
+							const VectorRegister4Float Color = SampleBlock(SceneColor, RectSize, PixelMin);
+							ColorSum = VectorAdd(ColorSum, Color);
+							AlphaSum += FMath::Clamp((Luminance(Color) - LuminanceMin) * InvLuminanceWidth, 0.f, 1.f);
+						}
+					}
+
+					FLinearColor& Texel = Mask[Y * MaskSize.X + X];
+					VectorStore(VectorMultiply(ColorSum, VectorSetFloat1(BlockWeight)), &Texel.R);
+					Texel.A = AlphaSum * BlockWeight;
+				}
+			}, bSingleThread ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+	}
+
+	void FTiledMask::Blur(bool bSingleThread)
+	{
+		FImage Image(MaskSize);
+		Image.Texels = MoveTemp(Mask);
+
+		FImage Blurred = BlurPyramid(MoveTemp(Image), Level, FIntPoint::DivideAndRoundUp(Size, GDownsampleFactor), Inputs.BlurPercentage, bSingleThread ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+		Mask = MoveTemp(Blurred.Texels);
+	}
+
+	void FTiledMask::Composite(const float* SceneColor, float* Output, const FIntRect& Rect, bool bSingleThread) const
+	{
+		DiffusionFilterCPU::Composite(Inputs, SceneColor, Output, Rect, Size, Mask, MaskSize, bSingleThread ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+	}
+
+	int64 FTiledMask::GetMaskBytes(FIntPoint Size, int32 Level)
+	{
+		// The level, the levels above it at a third of it, and the horizontal pass and result of the last upsample.
+		constexpr int64 NumCopies = 4;
+
+		const FIntPoint Extent = GetMipExtent(FIntPoint::DivideAndRoundUp(Size, GDownsampleFactor), Level);
+		return NumCopies * Extent.X * Extent.Y * int64(sizeof(FLinearColor));
+	}
+}
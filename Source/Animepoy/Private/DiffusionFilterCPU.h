@@ -0,0 +1,64 @@
+// @Custom
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PostProcessDiffusionFilter.h"
+
+// Diffusion filter on the CPU, for rendering the glow offline on machines without a GPU.
+// Follows GenerateMaskPyramidCS, BlurUpsampleCS and CompositeCS with the settings of FPostProcessDiffusionInputs.
+// Like the DIFFUSION_BLEND_MODE permutation, each blend mode composites with its own instantiation of the kernel.
+namespace DiffusionFilterCPU
+{
+	// Filters Size.X * Size.Y RGBA pixels, 4 floats each with no row padding. Alpha is kept. Output may be SceneColor.
+	// With Inputs.bPreTonemapLuminance the mask luminance comes from PreTonemapColor, PreTonemapSize RGBA pixels.
+	// Pixels past the edge of the image read as black, like loads outside the texture.
+	void DiffusionFilter(
+		const float* SceneColor,
+		float* Output,
+		FIntPoint Size,
+		const FPostProcessDiffusionInputs& Inputs,
+		const float* PreTonemapColor = nullptr,
+		FIntPoint PreTonemapSize = FIntPoint::ZeroValue,
+		bool bSingleThread = false);
+
+	// The blur pyramid alone, like DiffusionFilterReference::PyramidBlur.
+	void BlurMask(TConstArrayView<FLinearColor> Mask, FIntPoint MaskSize, float BlurPercentage, TArray<FLinearColor>& Output, bool bSingleThread = false);
+
+	// The filter for an image too large to hold at once. Tiles of the image are added to the mask, the mask is blurred,
+	// then the tiles are composited one by one. Without pre-tonemap luminance.
+	// When the mask pyramid would not fit in MaxBytes, the mask is held from a coarser level of the pyramid. Each texel then
+	// averages the block of mask texels the pyramid would, and the glow is composited from that level, skipping the tent
+	// upsamples of the levels below it.
+	class FTiledMask
+	{
+	public:
+		FTiledMask(FIntPoint InSize, const FPostProcessDiffusionInputs& InInputs, int64 MaxBytes);
+
+		// Tiles start at multiples of the alignment and end on them or at the edge of the image.
+		int32 GetAlignment() const;
+
+		int32 GetLevel() const
+		{
+			return Level;
+		}
+
+		// GenerateMask and the pyramid down to the level for the pixels of Rect, held in SceneColor with no row padding.
+		void AddTile(const float* SceneColor, const FIntRect& Rect, bool bSingleThread = false);
+
+		// The blur of the pyramid from the level, once every tile is added.
+		void Blur(bool bSingleThread = false);
+
+		// CompositeCS for the pixels of Rect, held in SceneColor and Output with no row padding. Output may be SceneColor.
+		void Composite(const float* SceneColor, float* Output, const FIntRect& Rect, bool bSingleThread = false) const;
+
+		// Peak bytes of a mask held from Level, with the smaller levels and the targets of an upsample.
+		static int64 GetMaskBytes(FIntPoint Size, int32 Level);
+
+	private:
+		FIntPoint Size;
+		FPostProcessDiffusionInputs Inputs;
+		int32 Level = 0;
+		FIntPoint MaskSize;
+		TArray<FLinearColor> Mask;
+	};
+}
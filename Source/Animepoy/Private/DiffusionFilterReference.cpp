@@ -0,0 +1,286 @@
+// @Custom
+#include "DiffusionFilterReference.h"
+#include "AnimepoyModule.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Math/RandomStream.h"
+
+namespace DiffusionFilterReference
+{
+	namespace
+	{
+		struct FImage
+		{
+			FIntPoint Size;
+			TArray<FLinearColor> Texels;
+
+			explicit FImage(FIntPoint InSize)
+				: Size(InSize)
+			{
+				Texels.SetNumZeroed(Size.X * Size.Y);
+			}
+
+			const FLinearColor& Load(int32 X, int32 Y) const
+			{
+				return Texels[FMath::Clamp(Y, 0, Size.Y - 1) * Size.X + FMath::Clamp(X, 0, Size.X - 1)];
+			}
+
+			// Texture2DSampleLevel with GlobalBilinearClampedSampler.
+			FLinearColor Sample(FVector2f UV) const
+			{
+				const FVector2f Position = UV * FVector2f(Size) - FVector2f(0.5f, 0.5f);
+				const int32 X = FMath::FloorToInt(Position.X);
+				const int32 Y = FMath::FloorToInt(Position.Y);
+				const float FracX = Position.X - X;
+				const float FracY = Position.Y - Y;
+
+				const FLinearColor Top = FMath::Lerp(Load(X, Y), Load(X + 1, Y), FracX);
+				const FLinearColor Bottom = FMath::Lerp(Load(X, Y + 1), Load(X + 1, Y + 1), FracX);
+				return FMath::Lerp(Top, Bottom, FracY);
+			}
+		};
+
+		FIntPoint GetMipExtent(FIntPoint Extent, int32 MipLevel)
+		{
+			return FIntPoint(FMath::Max(Extent.X >> MipLevel, 1), FMath::Max(Extent.Y >> MipLevel, 1));
+		}
+
+		// GenerateMaskPyramidCS, 2x2 boxes.
+		FImage Downsample(const FImage& Source, FIntPoint Extent)
+		{
+			FImage Result(Extent);
+
+			for (int32 Y = 0; Y < Extent.Y; ++Y)
+			{
+				for (int32 X = 0; X < Extent.X; ++X)
+				{
+					FLinearColor Color = Source.Load(2 * X, 2 * Y);
+					Color += Source.Load(2 * X + 1, 2 * Y);
+					Color += Source.Load(2 * X, 2 * Y + 1);
+					Color += Source.Load(2 * X + 1, 2 * Y + 1);
+					Result.Texels[Y * Extent.X + X] = 0.25f * Color;
+				}
+			}
+
+			return Result;
+		}
+
+		// BlurUpsampleCS
+		FImage Upsample(const FImage& Source, const FImage& Base, float SourceWeight)
+		{
+			FImage Result(Base.Size);
+			const FVector2f Offset = FVector2f(1.f, 1.f) / FVector2f(Base.Size);
+
+			for (int32 Y = 0; Y < Base.Size.Y; ++Y)
+			{
+				for (int32 X = 0; X < Base.Size.X; ++X)
+				{
+					const FVector2f UV = (FVector2f(X, Y) + FVector2f(0.5f, 0.5f)) / FVector2f(Base.Size);
+					FLinearColor Color = 4.f * Source.Sample(UV);
+					Color += 2.f * Source.Sample(UV + FVector2f(-Offset.X, 0.f));
+					Color += 2.f * Source.Sample(UV + FVector2f(+Offset.X, 0.f));
+					Color += 2.f * Source.Sample(UV + FVector2f(0.f, -Offset.Y));
+					Color += 2.f * Source.Sample(UV + FVector2f(0.f, +Offset.Y));
+					Color += Source.Sample(UV + FVector2f(-Offset.X, -Offset.Y));
+					Color += Source.Sample(UV + FVector2f(+Offset.X, -Offset.Y));
+					Color += Source.Sample(UV + FVector2f(-Offset.X, +Offset.Y));
+					Color += Source.Sample(UV + FVector2f(+Offset.X, +Offset.Y));
+					Color *= 1.f / 16.f;
+
+					const int32 Index = Y * Base.Size.X + X;
+					Result.Texels[Index] = SourceWeight < 1.f ? FMath::Lerp(Base.Texels[Index], Color, SourceWeight) : Color;
+				}
+			}
+
+			return Result;
+		}
+
+		float GetGaussianRadius(FIntPoint Size, float BlurPercentage)
+		{
+			return Size.X * FMath::Max(BlurPercentage, 0.f) * 0.01f * 0.5f;
+		}
+
+		// A diffusion mask stand-in: dark background, soft gradients and small bright highlights.
+		void GenerateTestMask(FIntPoint Size, TArray<FLinearColor>& OutMask)
+		{
+			FRandomStream Random(762);
+			OutMask.SetNumUninitialized(Size.X * Size.Y);
+
+			for (int32 Y = 0; Y < Size.Y; ++Y)
+			{
+				for (int32 X = 0; X < Size.X; ++X)
+				{
+					const float U = (X + 0.5f) / Size.X;
+					const float V = (Y + 0.5f) / Size.Y;
+					const float Alpha = FMath::Clamp(0.5f + 0.5f * FMath::Sin(6.f * U) * FMath::Cos(4.f * V), 0.f, 1.f);
+					OutMask[Y * Size.X + X] = FLinearColor(U, V, 0.5f, Alpha);
+				}
+			}
+
+			for (int32 Index = 0; Index < 64; ++Index)
+			{
+				const int32 X = Random.RandHelper(Size.X);
+				const int32 Y = Random.RandHelper(Size.Y);
+				OutMask[Y * Size.X + X] = FLinearColor(1.f, 1.f, 1.f, 1.f);
+			}
+		}
+
+		void CompareBlur(const TArray<FString>& Args)
+		{
+			const FIntPoint Size(
+				Args.Num() > 0 ? FMath::Clamp(FCString::Atoi(*Args[0]), 16, 4096) : 480,
+				Args.Num() > 1 ? FMath::Clamp(FCString::Atoi(*Args[1]), 16, 4096) : 270);
+
+			TArray<FLinearColor> Mask;
+			GenerateTestMask(Size, Mask);
+
+			UE_LOG(LogAnimepoy, Display, TEXT("Diffusion blur, %dx%d mask"), Size.X, Size.Y);
+
+			TArray<FLinearColor> Gaussian;
+			TArray<FLinearColor> Pyramid;
+			for (float BlurPercentage : { 0.5f, 1.f, 2.f, 5.f, 10.f, 20.f, 50.f, 100.f })
+			{
+				double StartTime = FPlatformTime::Seconds();
+				GaussianBlur(Mask, Size, BlurPercentage, Gaussian);
+				const double GaussianTime = FPlatformTime::Seconds() - StartTime;
+
+				StartTime = FPlatformTime::Seconds();
+				PyramidBlur(Mask, Size, BlurPercentage, Pyramid);
+				const double PyramidTime = FPlatformTime::Seconds() - StartTime;
+
+				double SquaredError = 0.0;
+				for (int32 Index = 0; Index < Mask.Num(); ++Index)
+				{
+					SquaredError += FMath::Square(Gaussian[Index].A - Pyramid[Index].A);
+				}
+
+				const FBlurCost GaussianCost = GetGaussianBlurCost(Size, BlurPercentage);
+				const FBlurCost PyramidCost = GetPyramidBlurCost(Size, BlurPercentage);
+				const FDiffusionBlurPyramid Levels = GetDiffusionBlurPyramid(Size, BlurPercentage);
+
+				UE_LOG(LogAnimepoy, Display, TEXT("  BlurPercentage %5.1f  Gaussian %2d passes %7.1f fetches %8.2f ms  Pyramid %d levels (%.2f) %2d passes %5.1f fetches %8.2f ms  alpha rms error %.4f"),
+					BlurPercentage,
+					GaussianCost.Passes, GaussianCost.Fetches, GaussianTime * 1000.0,
+					Levels.NumLevels, Levels.TopLevelWeight, PyramidCost.Passes, PyramidCost.Fetches, PyramidTime * 1000.0,
+					FMath::Sqrt(SquaredError / Mask.Num()));
+			}
+		}
+
+		FAutoConsoleCommand GCompareBlurCommand(
+			TEXT("Animepoy.Diffusion.CompareBlur"),
+			TEXT("Blurs a synthetic diffusion mask with the engine Gaussian and the diffusion blur pyramid over a range of BlurPercentage and logs error and cost.\n")
+			TEXT("Usage: Animepoy.Diffusion.CompareBlur [Width=480] [Height=270]"),
+			FConsoleCommandWithArgsDelegate::CreateStatic(&CompareBlur));
+	}
+
+	void GaussianBlur(TConstArrayView<FLinearColor> Input, FIntPoint Size, float BlurPercentage, TArray<FLinearColor>& Output)
+	{
+		check(Input.Num() == Size.X * Size.Y);
+
+		const float Radius = GetGaussianRadius(Size, BlurPercentage);
+		const int32 IntegerRadius = FMath::CeilToInt(Radius);
+		if (IntegerRadius == 0)
+		{
+			Output = Input;
+			return;
+		}
+
+		TArray<float> Weights;
+		float WeightSum = 0.f;
+		for (int32 Offset = -IntegerRadius; Offset <= IntegerRadius; ++Offset)
+		{
+			const float Weight = FMath::Exp(-16.f * FMath::Square(Offset / Radius));
+			Weights.Add(Weight);
+			WeightSum += Weight;
+		}
+
+		FImage Source(Size);
+		Source.Texels = Input;
+		FImage Horizontal(Size);
+		for (int32 Y = 0; Y < Size.Y; ++Y)
+		{
+			for (int32 X = 0; X < Size.X; ++X)
+			{
+				FLinearColor Color(0.f, 0.f, 0.f, 0.f);
+				for (int32 Offset = -IntegerRadius; Offset <= IntegerRadius; ++Offset)
+				{
+					Color += Weights[Offset + IntegerRadius] * Source.Load(X + Offset, Y);
+				}
+				Horizontal.Texels[Y * Size.X + X] = Color / WeightSum;
+			}
+		}
+
+		Output.SetNumUninitialized(Size.X * Size.Y);
+		for (int32 Y = 0; Y < Size.Y; ++Y)
+		{
+			for (int32 X = 0; X < Size.X; ++X)
+			{
+				FLinearColor Color(0.f, 0.f, 0.f, 0.f);
+				for (int32 Offset = -IntegerRadius; Offset <= IntegerRadius; ++Offset)
+				{
+					Color += Weights[Offset + IntegerRadius] * Horizontal.Load(X, Y + Offset);
+				}
+				Output[Y * Size.X + X] = Color / WeightSum;
+			}
+		}
+	}
+
+	void PyramidBlur(TConstArrayView<FLinearColor> Input, FIntPoint Size, float BlurPercentage, TArray<FLinearColor>& Output)
+	{
+		check(Input.Num() == Size.X * Size.Y);
+
+		const FDiffusionBlurPyramid Pyramid = GetDiffusionBlurPyramid(Size, BlurPercentage);
+
+		TArray<FImage> Mips;
+		Mips.Emplace(Size);
+		Mips[0].Texels = Input;
+		for (int32 MipLevel = 1; MipLevel <= Pyramid.NumLevels; ++MipLevel)
+		{
+			Mips.Add(Downsample(Mips[MipLevel - 1], GetMipExtent(Size, MipLevel)));
+		}
+
+		FImage Result = Mips[Pyramid.NumLevels];
+		for (int32 MipLevel = Pyramid.NumLevels - 1; MipLevel >= 0; --MipLevel)
+		{
+			const bool bTopLevel = MipLevel == Pyramid.NumLevels - 1;
+			Result = Upsample(Result, Mips[MipLevel], bTopLevel ? Pyramid.TopLevelWeight : 1.f);
+		}
+
+		Output = MoveTemp(Result.Texels);
+	}
+
+	FBlurCost GetGaussianBlurCost(FIntPoint Size, float BlurPercentage)
+	{
+		// Two passes, the engine pairs taps into bilinear fetches.
+		const int32 IntegerRadius = FMath::CeilToInt(GetGaussianRadius(Size, BlurPercentage));
+
+		FBlurCost Cost;
+		Cost.Passes = IntegerRadius > 0 ? 2 : 0;
+		Cost.Fetches = Cost.Passes * (IntegerRadius + 1);
+		return Cost;
+	}
+
+	FBlurCost GetPyramidBlurCost(FIntPoint Size, float BlurPercentage)
+	{
+		const FDiffusionBlurPyramid Pyramid = GetDiffusionBlurPyramid(Size, BlurPercentage);
+		const double NumTexels = (double)Size.X * Size.Y;
+
+		// The mips are reduced in groupshared memory by the mask pass, only the upsamples are passes of their own.
+		FBlurCost Cost;
+		for (int32 MipLevel = 1; MipLevel <= Pyramid.NumLevels; ++MipLevel)
+		{
+			const FIntPoint Extent = GetMipExtent(Size, MipLevel);
+			Cost.Fetches += 4.0 * Extent.X * Extent.Y / NumTexels;
+		}
+
+		for (int32 MipLevel = Pyramid.NumLevels - 1; MipLevel >= 0; --MipLevel)
+		{
+			const FIntPoint Extent = GetMipExtent(Size, MipLevel);
+			const bool bTopLevel = MipLevel == Pyramid.NumLevels - 1;
+			Cost.Fetches += (bTopLevel && Pyramid.TopLevelWeight < 1.f ? 10.0 : 9.0) * Extent.X * Extent.Y / NumTexels;
+			Cost.Passes++;
+		}
+
+		return Cost;
+	}
+}
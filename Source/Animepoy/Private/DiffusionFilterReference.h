@@ -0,0 +1,27 @@
+// @Custom
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PostProcessDiffusionFilter.h"
+
+// CPU model of the diffusion blur. It follows GenerateMaskPyramidCS and BlurUpsampleCS in float
+// so the pyramid can be compared with the Gaussian it replaces off-GPU.
+namespace DiffusionFilterReference
+{
+	// Texture fetches per mask texel, bilinear taps counted once. Passes exclude the mask generation.
+	struct FBlurCost
+	{
+		double Fetches = 0.0;
+		int32 Passes = 0;
+	};
+
+	// Separable Gaussian of AddGaussianBlurPass with KernelSizePercent = BlurPercentage, clamped addressing.
+	void GaussianBlur(TConstArrayView<FLinearColor> Input, FIntPoint Size, float BlurPercentage, TArray<FLinearColor>& Output);
+
+	// Blur pyramid of AddPostProcessDiffusionPass.
+	void PyramidBlur(TConstArrayView<FLinearColor> Input, FIntPoint Size, float BlurPercentage, TArray<FLinearColor>& Output);
+
+	FBlurCost GetGaussianBlurCost(FIntPoint Size, float BlurPercentage);
+
+	FBlurCost GetPyramidBlurCost(FIntPoint Size, float BlurPercentage);
+}
@@ -0,0 +1,412 @@
+// @Custom
+#include "KuwaharaFilterCPU.h"
+#include "KuwaharaFilterReference.h"
+#include "AnimepoyBenchmarkCPU.h"
+#include "AnimepoyModule.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/VectorRegister.h"
+
+namespace KuwaharaFilterCPU
+{
+	namespace
+	{
+		// Matches the thread groups of KuwaharaFilterSetupCS.
+		constexpr int32 GTileSize = 16;
+
+		// LoadValue, LinearValue and ScalarValue of the shader.
+		class FValueModel
+		{
+		public:
+			FValueModel(EKuwaharaFilterTargetType TargetType, const FVector3f& ViewForward)
+				: bNormal(TargetType == EKuwaharaFilterTargetType::Normal)
+			{
+				switch (TargetType)
+				{
+				case EKuwaharaFilterTargetType::Normal: LinearWeights = 0.5f * ViewForward; break;
+				case EKuwaharaFilterTargetType::Material: LinearWeights = FVector3f(1.f, 1.f, 1.f); break;
+				default: LinearWeights = FVector3f(0.3f, 0.59f, 0.11f); break;
+				}
+			}
+
+			bool IsNormal() const
+			{
+				return bNormal;
+			}
+
+			VectorRegister4Float Load(const float* Pixel) const
+			{
+				FVector3f Value(Pixel[0], Pixel[1], Pixel[2]);
+				if (bNormal)
+				{
+					Value = 2.f * Value - FVector3f(1.f);
+				}
+
+				return MakeVectorRegisterFloat(Value.X, Value.Y, Value.Z, FMath::Square(ScalarValue(Value)));
+			}
+
+			float ScalarValue(const FVector3f& Value) const
+			{
+				const float LinearValue = Value | LinearWeights;
+				return bNormal ? LinearValue + 0.5f : LinearValue;
+			}
+
+		private:
+			bool bNormal;
+			FVector3f LinearWeights;
+		};
+
+		VectorRegister4Float LoadEntry(const TArray<FVector4f>& Entries, int32 Index)
+		{
+			return VectorLoad(&Entries[Index].X);
+		}
+
+		VectorRegister4Double LoadEntry(const TArray<FVector4d>& Entries, int32 Index)
+		{
+			return VectorLoad(&Entries[Index].X);
+		}
+
+		// Tile-local table of KuwaharaFilterSetupCS, plus the prefix sums of KuwaharaFilterPrefixCS above MaxTileLocalFilterSize.
+		// A tile-local entry sums at most one tile, but the prefix sums grow with the image, and a region is the difference
+		// of four of them. They are accumulated and kept in double so large stills keep the precision of a small frame.
+		class FSummedAreaTable
+		{
+		public:
+			FSummedAreaTable(const FValueModel& Model, const float* Input, FIntPoint InSize, bool bHierarchical, EParallelForFlags ParallelForFlags)
+				: Size(InSize)
+				, NumTiles(FIntPoint::DivideAndRoundUp(InSize, GTileSize))
+				, NumPrefixTiles(FIntPoint::ComponentMax(NumTiles - FIntPoint(1, 1), FIntPoint(1, 1)))
+			{
+				Values.SetNumUninitialized(Size.X * Size.Y);
+
+				ParallelFor(NumTiles.Y, [this, &Model, Input](int32 TileY)
+					{
+						const int32 MinY = TileY * GTileSize;
+						const int32 MaxY = FMath::Min(MinY + GTileSize, Size.Y);
+
+						for (int32 Y = MinY; Y < MaxY; ++Y)
+						{
+							for (int32 MinX = 0; MinX < Size.X; MinX += GTileSize)
+							{
+								const int32 MaxX = FMath::Min(MinX + GTileSize, Size.X);
+
+								// Sum horizontally, then add the row above within the tile.
+								VectorRegister4Float RowSum = VectorZeroFloat();
+								for (int32 X = MinX; X < MaxX; ++X)
+								{
+									const int32 Index = Y * Size.X + X;
+									RowSum = VectorAdd(RowSum, Model.Load(Input + 4 * Index));
+
+									const VectorRegister4Float Value = Y > MinY ? VectorAdd(RowSum, LoadEntry(Values, Index - Size.X)) : RowSum;
+									VectorStore(Value, &Values[Index].X);
+								}
+							}
+						}
+					}, ParallelForFlags);
+
+				if (bHierarchical)
+				{
+					BuildPrefixSums(ParallelForFlags);
+				}
+			}
+
+			VectorRegister4Float Load(int32 X, int32 Y) const
+			{
+				return LoadEntry(Values, Y * Size.X + X);
+			}
+
+			// LoadHierarchicalSummedAreaTable
+			VectorRegister4Double LoadHierarchical(int32 X, int32 Y) const
+			{
+				if (X < 0 || Y < 0)
+				{
+					return VectorZeroDouble();
+				}
+
+				const int32 TileX = X / GTileSize;
+				const int32 TileY = Y / GTileSize;
+				VectorRegister4Double Value = VectorRegister4Double(Load(X, Y));
+
+				if (TileX > 0)
+				{
+					Value = VectorAdd(Value, LoadEntry(RowPrefix, Y * NumPrefixTiles.X + TileX - 1));
+				}
+
+				if (TileY > 0)
+				{
+					Value = VectorAdd(Value, LoadEntry(ColumnPrefix, (TileY - 1) * Size.X + X));
+				}
+
+				if (TileX > 0 && TileY > 0)
+				{
+					Value = VectorAdd(Value, LoadEntry(TilePrefix, (TileY - 1) * NumPrefixTiles.X + TileX - 1));
+				}
+
+				return Value;
+			}
+
+		private:
+			// KuwaharaFilterPrefixCS
+			void BuildPrefixSums(EParallelForFlags ParallelForFlags)
+			{
+				RowPrefix.SetNumZeroed(NumPrefixTiles.X * Size.Y);
+				ColumnPrefix.SetNumZeroed(Size.X * NumPrefixTiles.Y);
+				TilePrefix.SetNumZeroed(NumPrefixTiles.X * NumPrefixTiles.Y);
+
+				ParallelFor(Size.Y, [this](int32 Y)
+					{
+						VectorRegister4Double Sum = VectorZeroDouble();
+						for (int32 TileX = 0; TileX < NumTiles.X - 1; ++TileX)
+						{
+							Sum = VectorAdd(Sum, VectorRegister4Double(Load(GTileSize * TileX + GTileSize - 1, Y)));
+							VectorStore(Sum, &RowPrefix[Y * NumPrefixTiles.X + TileX].X);
+						}
+					}, ParallelForFlags);
+
+				ParallelFor(NumTiles.X, [this](int32 ColumnTileX)
+					{
+						const int32 MaxX = FMath::Min(ColumnTileX * GTileSize + GTileSize, Size.X);
+						for (int32 X = ColumnTileX * GTileSize; X < MaxX; ++X)
+						{
+							VectorRegister4Double Sum = VectorZeroDouble();
+							for (int32 TileY = 0; TileY < NumTiles.Y - 1; ++TileY)
+							{
+								Sum = VectorAdd(Sum, VectorRegister4Double(Load(X, GTileSize * TileY + GTileSize - 1)));
+								VectorStore(Sum, &ColumnPrefix[TileY * Size.X + X].X);
+							}
+						}
+					}, ParallelForFlags);
+
+				for (int32 TileX = 0; TileX < NumTiles.X - 1; ++TileX)
+				{
+					VectorRegister4Double Sum = VectorZeroDouble();
+					for (int32 TileY = 0; TileY < NumTiles.Y - 1; ++TileY)
+					{
+						Sum = VectorAdd(Sum, LoadEntry(RowPrefix, (GTileSize * TileY + GTileSize - 1) * NumPrefixTiles.X + TileX));
+						VectorStore(Sum, &TilePrefix[TileY * NumPrefixTiles.X + TileX].X);
+					}
+				}
+			}
+
+			FIntPoint Size;
+			FIntPoint NumTiles;
+			FIntPoint NumPrefixTiles;
+			TArray<FVector4f> Values;
+			TArray<FVector4d> RowPrefix;
+			TArray<FVector4d> ColumnPrefix;
+			TArray<FVector4d> TilePrefix;
+		};
+
+		// Sum of the tile-local table over Region, CalcAverageAndVariance before the division.
+		VectorRegister4Float SumRegion(const FSummedAreaTable& Table, const FIntVector4& Region, FIntPoint Border)
+		{
+			Border.X = Region.Z < Border.X + GTileSize ? Border.X : Border.X + GTileSize;
+			Border.Y = Region.W < Border.Y + GTileSize ? Border.Y : Border.Y + GTileSize;
+
+			const FIntPoint P0(Region.X - 1, Region.Y - 1);
+			const FIntPoint P1(Region.Z, Region.W);
+
+			VectorRegister4Float Value = Table.Load(P1.X, P1.Y);
+
+			const bool bOnBorderX = Region.X == Border.X;
+			if (!bOnBorderX)
+			{
+				Value = VectorSubtract(Value, Table.Load(P0.X, P1.Y));
+			}
+
+			const bool bOnBorderY = Region.Y == Border.Y;
+			if (!bOnBorderY)
+			{
+				Value = VectorSubtract(Value, Table.Load(P1.X, P0.Y));
+			}
+
+			if (!bOnBorderX && !bOnBorderY)
+			{
+				Value = VectorAdd(Value, Table.Load(P0.X, P0.Y));
+			}
+
+			const bool bUnderBorderX = Region.X < Border.X;
+			if (bUnderBorderX)
+			{
+				Value = VectorAdd(Value, Table.Load(Border.X - 1, P1.Y));
+
+				if (!bOnBorderY)
+				{
+					Value = VectorSubtract(Value, Table.Load(Border.X - 1, P0.Y));
+				}
+			}
+
+			const bool bUnderBorderY = Region.Y < Border.Y;
+			if (bUnderBorderY)
+			{
+				Value = VectorAdd(Value, Table.Load(P1.X, Border.Y - 1));
+
+				if (!bOnBorderX)
+				{
+					Value = VectorSubtract(Value, Table.Load(P0.X, Border.Y - 1));
+				}
+			}
+
+			if (bUnderBorderX && bUnderBorderY)
+			{
+				Value = VectorAdd(Value, Table.Load(Border.X - 1, Border.Y - 1));
+			}
+
+			return Value;
+		}
+
+		// CalcHierarchicalAverageAndVariance before the division. The region sum is small again, so it goes back to float.
+		VectorRegister4Float SumHierarchicalRegion(const FSummedAreaTable& Table, const FIntVector4& Region)
+		{
+			VectorRegister4Double Value = Table.LoadHierarchical(Region.Z, Region.W);
+			Value = VectorSubtract(Value, Table.LoadHierarchical(Region.X - 1, Region.W));
+			Value = VectorSubtract(Value, Table.LoadHierarchical(Region.Z, Region.Y - 1));
+			return MakeVectorRegisterFloatFromDouble(VectorAdd(Value, Table.LoadHierarchical(Region.X - 1, Region.Y - 1)));
+		}
+
+		void BenchmarkKuwaharaFilter(const TArray<FString>& Args)
+		{
+			const int32 Width = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 16) : 1920;
+			const int32 Height = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 16) : 1080;
+			const int32 NumIterations = Args.Num() > 2 ? FMath::Max(FCString::Atoi(*Args[2]), 1) : 3;
+			const FIntPoint Size(Width, Height);
+			const double Megapixels = double(Width) * Height / 1e6;
+
+			const EKuwaharaFilterTargetType TargetTypes[] = {
+				EKuwaharaFilterTargetType::SceneColor,
+				EKuwaharaFilterTargetType::Normal,
+				EKuwaharaFilterTargetType::Material,
+			};
+
+			AnimepoyBenchmarkCPU::LogHeader(FString::Printf(TEXT("Kuwahara CPU filter, %dx%d"), Width, Height), NumIterations);
+
+			for (EKuwaharaFilterTargetType TargetType : TargetTypes)
+			{
+				TArray<FLinearColor> Image;
+				KuwaharaFilterReference::GenerateTestImage(Size, TargetType, Image);
+				TArray<FLinearColor> Result;
+				Result.SetNumUninitialized(Image.Num());
+
+				for (int32 FilterSize = 1; FilterSize <= 7; ++FilterSize)
+				{
+					const auto Filter = [&](bool bSingleThread)
+					{
+						KuwaharaFilter(&Image[0].R, &Result[0].R, Size, TargetType, FilterSize, FVector3f(1.f, 0.f, 0.f), bSingleThread);
+					};
+
+					const double SingleThreadSeconds = AnimepoyBenchmarkCPU::MeasureSeconds(NumIterations, [&] { Filter(true); });
+					const double ParallelSeconds = AnimepoyBenchmarkCPU::MeasureSeconds(NumIterations, [&] { Filter(false); });
+
+					AnimepoyBenchmarkCPU::LogThroughput(FString::Printf(TEXT("TargetType %d FilterSize %d"), (int32)TargetType, FilterSize), Megapixels, ParallelSeconds, SingleThreadSeconds);
+				}
+			}
+
+			// The scalar reference is slow, so it only checks a small image.
+			const FIntPoint CheckSize(256, 256);
+			for (EKuwaharaFilterTargetType TargetType : TargetTypes)
+			{
+				TArray<FLinearColor> Image;
+				KuwaharaFilterReference::GenerateTestImage(CheckSize, TargetType, Image);
+
+				for (const int32 FilterSize : { 4, KuwaharaFilterReference::MaxTileLocalFilterSize + 5 })
+				{
+					TArray<FLinearColor> Reference;
+					TArray<int32> Regions;
+					Reference.SetNumUninitialized(Image.Num());
+					Regions.SetNumUninitialized(Image.Num());
+					KuwaharaFilterReference::KuwaharaFilter(Image, CheckSize, TargetType, FilterSize, KuwaharaFilterReference::ESummedAreaTableEncoding::Float32, Reference, Regions);
+
+					TArray<FLinearColor> Result;
+					Result.SetNumUninitialized(Image.Num());
+					KuwaharaFilter(&Image[0].R, &Result[0].R, CheckSize, TargetType, FilterSize);
+
+					AnimepoyBenchmarkCPU::LogDifference(FString::Printf(TEXT("TargetType %d FilterSize %d"), (int32)TargetType, FilterSize), AnimepoyBenchmarkCPU::CompareImages(Reference, Result));
+				}
+			}
+		}
+
+		FAutoConsoleCommand GBenchmarkKuwaharaFilterCommand(
+			TEXT("Animepoy.Kuwahara.BenchmarkCPU"),
+			TEXT("Times the CPU Kuwahara filter for FilterSize 1 to 7 on a synthetic image and checks it against the reference.\n")
+			TEXT("Usage: Animepoy.Kuwahara.BenchmarkCPU [Width=1920] [Height=1080] [Iterations=3]"),
+			FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkKuwaharaFilter));
+	}
+
+	void KuwaharaFilter(
+		const float* Input,
+		float* Output,
+		FIntPoint Size,
+		EKuwaharaFilterTargetType TargetType,
+		int32 FilterSize,
+		const FVector3f& ViewForward,
+		bool bSingleThread)
+	{
+		check(Input && Output && Size.X > 0 && Size.Y > 0 && FilterSize >= 1);
+
+		const EParallelForFlags ParallelForFlags = bSingleThread ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None;
+		const bool bHierarchical = FilterSize > KuwaharaFilterReference::MaxTileLocalFilterSize;
+
+		const FValueModel Model(TargetType, ViewForward);
+		const FSummedAreaTable Table(Model, Input, Size, bHierarchical, ParallelForFlags);
+
+		// Every pixel only reads the table, so rows of tiles are independent. Output may alias Input for the same reason.
+		ParallelFor(FIntPoint::DivideAndRoundUp(Size, GTileSize).Y, [&](int32 TileY)
+			{
+				const int32 MinY = TileY * GTileSize;
+				const int32 MaxY = FMath::Min(MinY + GTileSize, Size.Y);
+
+				for (int32 Y = MinY; Y < MaxY; ++Y)
+				{
+					const int32 Top = FMath::Max(Y - FilterSize, 0);
+					const int32 Bottom = FMath::Min(Y + FilterSize, Size.Y - 1);
+
+					for (int32 X = 0; X < Size.X; ++X)
+					{
+						const int32 Left = FMath::Max(X - FilterSize, 0);
+						const int32 Right = FMath::Min(X + FilterSize, Size.X - 1);
+						const FIntPoint Border(X - X % GTileSize, Y - Y % GTileSize);
+
+						const FIntVector4 Regions[4] = {
+							FIntVector4(Left, Top, X, Y),
+							FIntVector4(X, Top, Right, Y),
+							FIntVector4(Left, Y, X, Bottom),
+							FIntVector4(X, Y, Right, Bottom),
+						};
+
+						FVector4f MinAverage;
+						float MinVariance = 0.f;
+						for (int32 Index = 0; Index < 4; ++Index)
+						{
+							const FIntVector4& Region = Regions[Index];
+							const VectorRegister4Float Sum = bHierarchical ? SumHierarchicalRegion(Table, Region) : SumRegion(Table, Region, Border);
+							const float InvCount = 1.f / float((Region.Z - Region.X + 1) * (Region.W - Region.Y + 1));
+
+							FVector4f Average;
+							VectorStore(VectorMultiply(Sum, VectorSetFloat1(InvCount)), &Average.X);
+
+							// The first region wins ties, like the strict less than of the shader.
+							const float Variance = Average.W - FMath::Square(Model.ScalarValue(FVector3f(Average)));
+							if (Index == 0 || Variance < MinVariance)
+							{
+								MinVariance = Variance;
+								MinAverage = Average;
+							}
+						}
+
+						FVector3f Value(MinAverage);
+						if (Model.IsNormal())
+						{
+							Value = 0.5f * Value.GetSafeNormal() + FVector3f(0.5f);
+						}
+
+						const int32 PixelIndex = 4 * (Y * Size.X + X);
+						const float Alpha = Input[PixelIndex + 3];
+						Output[PixelIndex + 0] = Value.X;
+						Output[PixelIndex + 1] = Value.Y;
+						Output[PixelIndex + 2] = Value.Z;
+						Output[PixelIndex + 3] = Alpha;
+					}
+				}
+			}, ParallelForFlags);
+	}
+}
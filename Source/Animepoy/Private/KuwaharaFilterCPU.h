@@ -0,0 +1,26 @@
+// @Custom
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PostProcessKuwaharaFilter.h"
+
+// Kuwahara filter on the CPU, for machines without a GPU like render farm nodes post-processing frames.
+// Builds the tile-local summed area tables of KuwaharaFilterSetupCS in float and reads them like CalcAverageAndVariance,
+// so it matches KuwaharaFilterReference with ESummedAreaTableEncoding::Float32. The prefix sums above MaxTileLocalFilterSize
+// are kept in double, as they grow with the image. Tile rows run in parallel, the four channels of each table entry in one vector register.
+//
+// Table tiles start at multiples of 16 pixels, so up to MaxTileLocalFilterSize a crop starting on that grid with FilterSize
+// pixels of apron filters its inside exactly like the whole image does.
+namespace KuwaharaFilterCPU
+{
+	// Filters Size.X * Size.Y RGBA pixels, 4 floats each with no row padding, like KuwaharaFilterCS.
+	// Alpha is copied. Output may be Input.
+	void KuwaharaFilter(
+		const float* Input,
+		float* Output,
+		FIntPoint Size,
+		EKuwaharaFilterTargetType TargetType,
+		int32 FilterSize,
+		const FVector3f& ViewForward = FVector3f(1.f, 0.f, 0.f),
+		bool bSingleThread = false);
+}
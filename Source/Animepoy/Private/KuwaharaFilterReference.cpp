@@ -0,0 +1,790 @@
+// @Custom
+#include "KuwaharaFilterReference.h"
+#include "AnimepoyModule.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/Float16.h"
+#include "Math/RandomStream.h"
+
+namespace KuwaharaFilterReference
+{
+	namespace
+	{
+		constexpr int32 GTileSize = 16;
+
+		class FValueModel
+		{
+		public:
+			FValueModel(EKuwaharaFilterTargetType InTargetType, const FVector3f& InViewForward)
+				: TargetType(InTargetType)
+				, ViewForward(InViewForward)
+			{
+			}
+
+			bool IsNormal() const
+			{
+				return TargetType == EKuwaharaFilterTargetType::Normal;
+			}
+
+			// LoadValue
+			FVector4f Load(const FLinearColor& Color) const
+			{
+				FVector3f Value(Color.R, Color.G, Color.B);
+				if (IsNormal())
+				{
+					Value = 2.f * Value - FVector3f(1.f);
+				}
+
+				return FVector4f(Value, FMath::Square(ScalarValue(Value)));
+			}
+
+			FLinearColor Store(const FVector3f& Value, float Alpha) const
+			{
+				const FVector3f Encoded = IsNormal() ? 0.5f * Value + FVector3f(0.5f) : Value;
+				return FLinearColor(Encoded.X, Encoded.Y, Encoded.Z, Alpha);
+			}
+
+			float LinearValue(const FVector3f& Value) const
+			{
+				switch (TargetType)
+				{
+				case EKuwaharaFilterTargetType::Normal: return 0.5f * (Value | ViewForward);
+				case EKuwaharaFilterTargetType::Material: return Value.X + Value.Y + Value.Z;
+				default: return 0.3f * Value.X + 0.59f * Value.Y + 0.11f * Value.Z;
+				}
+			}
+
+			float ScalarValue(const FVector3f& Value) const
+			{
+				return IsNormal() ? LinearValue(Value) + 0.5f : LinearValue(Value);
+			}
+
+		private:
+			EKuwaharaFilterTargetType TargetType;
+			FVector3f ViewForward;
+		};
+
+		float QuantizeSnorm16(float Value)
+		{
+			return FMath::RoundToFloat(FMath::Clamp(Value, -1.f, 1.f) * 32767.f) / 32767.f;
+		}
+
+		FVector4f QuantizeFloat16(const FVector4f& Value)
+		{
+			return FVector4f(FFloat16(Value.X).GetFloat(), FFloat16(Value.Y).GetFloat(), FFloat16(Value.Z).GetFloat(), FFloat16(Value.W).GetFloat());
+		}
+
+		// Tile-local summed area table as KuwaharaFilterSetupCS stores it.
+		class FSummedAreaTable
+		{
+		public:
+			FSummedAreaTable(const FValueModel& InModel, TConstArrayView<FLinearColor> Input, FIntPoint InSize, ESummedAreaTableEncoding InEncoding)
+				: Model(InModel)
+				, Size(InSize)
+				, NumTiles(FIntPoint::DivideAndRoundUp(InSize, GTileSize))
+				, Encoding(InEncoding)
+			{
+				Values.SetNumUninitialized(Size.X * Size.Y);
+				Tiles.SetNumZeroed(NumTiles.X * NumTiles.Y);
+
+				FVector4f Summed[GTileSize][GTileSize];
+				for (int32 TileY = 0; TileY < NumTiles.Y; ++TileY)
+				{
+					for (int32 TileX = 0; TileX < NumTiles.X; ++TileX)
+					{
+						const FIntPoint TileOrigin(TileX * GTileSize, TileY * GTileSize);
+
+						for (int32 Y = 0; Y < GTileSize; ++Y)
+						{
+							FVector4f Sum(0.f, 0.f, 0.f, 0.f);
+							for (int32 X = 0; X < GTileSize; ++X)
+							{
+								const int32 SrcX = FMath::Min(TileOrigin.X + X, Size.X - 1);
+								const int32 SrcY = FMath::Min(TileOrigin.Y + Y, Size.Y - 1);
+								Sum += Model.Load(Input[SrcY * Size.X + SrcX]);
+								Summed[Y][X] = Sum;
+							}
+						}
+
+						for (int32 Y = 1; Y < GTileSize; ++Y)
+						{
+							for (int32 X = 0; X < GTileSize; ++X)
+							{
+								Summed[Y][X] += Summed[Y - 1][X];
+							}
+						}
+
+						StoreTile(TileOrigin, Summed);
+					}
+				}
+
+				BuildPrefixSums();
+			}
+
+			FVector3f GetTileMean(FIntPoint PixelPos) const
+			{
+				return Tiles[(PixelPos.Y / GTileSize) * NumTiles.X + PixelPos.X / GTileSize].Mean;
+			}
+
+			// DecodeSummedAreaTable
+			FVector4f Load(FIntPoint PixelPos, const FVector3f& ReferenceMean) const
+			{
+				const FVector4f& Encoded = Values[PixelPos.Y * Size.X + PixelPos.X];
+				if (Encoding != ESummedAreaTableEncoding::TileRelativeSnorm16)
+				{
+					return Encoded;
+				}
+
+				const FTile& Tile = Tiles[(PixelPos.Y / GTileSize) * NumTiles.X + PixelPos.X / GTileSize];
+				const float Count = float((PixelPos.X % GTileSize + 1) * (PixelPos.Y % GTileSize + 1));
+
+				const FVector3f Centered = Tile.Scale * FVector3f(Encoded);
+				const FVector3f DeltaMean = Tile.Mean - ReferenceMean;
+				const float DeltaScalar = Model.LinearValue(DeltaMean);
+
+				return FVector4f(
+					Centered + Count * DeltaMean,
+					Tile.SecondMomentScale * Encoded.W + 2.f * DeltaScalar * Model.LinearValue(Centered) + Count * FMath::Square(DeltaScalar));
+			}
+
+			// GetHierarchicalReferenceMean
+			FVector3f GetReferenceMean() const
+			{
+				return Encoding == ESummedAreaTableEncoding::TileRelativeSnorm16 ? GetTileMean(FIntPoint(Size.X / 2, Size.Y / 2)) : FVector3f(0.f);
+			}
+
+			// LoadHierarchicalSummedAreaTable
+			FVector4f LoadHierarchical(FIntPoint PixelPos) const
+			{
+				if (PixelPos.X < 0 || PixelPos.Y < 0)
+				{
+					return FVector4f(0.f, 0.f, 0.f, 0.f);
+				}
+
+				const FIntPoint TilePos(PixelPos.X / GTileSize, PixelPos.Y / GTileSize);
+				FVector4f Value = Load(PixelPos, GetReferenceMean());
+
+				if (TilePos.X > 0)
+				{
+					Value += RowPrefix[PixelPos.Y * NumPrefixTiles.X + TilePos.X - 1];
+				}
+
+				if (TilePos.Y > 0)
+				{
+					Value += ColumnPrefix[(TilePos.Y - 1) * Size.X + PixelPos.X];
+				}
+
+				if (TilePos.X > 0 && TilePos.Y > 0)
+				{
+					Value += TilePrefix[(TilePos.Y - 1) * NumPrefixTiles.X + TilePos.X - 1];
+				}
+
+				return Value;
+			}
+
+		private:
+			struct FTile
+			{
+				FVector3f Mean;
+				float Scale;
+				float SecondMomentScale;
+			};
+
+			void StoreTile(FIntPoint TileOrigin, const FVector4f (&Summed)[GTileSize][GTileSize])
+			{
+				const FIntPoint TileSize(FMath::Min(GTileSize, Size.X - TileOrigin.X), FMath::Min(GTileSize, Size.Y - TileOrigin.Y));
+
+				if (Encoding != ESummedAreaTableEncoding::TileRelativeSnorm16)
+				{
+					for (int32 Y = 0; Y < TileSize.Y; ++Y)
+					{
+						for (int32 X = 0; X < TileSize.X; ++X)
+						{
+							const FVector4f& Value = Summed[Y][X];
+							Values[(TileOrigin.Y + Y) * Size.X + TileOrigin.X + X] = Encoding == ESummedAreaTableEncoding::Float16 ? QuantizeFloat16(Value) : Value;
+						}
+					}
+					return;
+				}
+
+				const FVector4f& TileSummedValue = Summed[GTileSize - 1][GTileSize - 1];
+				const FVector3f TileMean = FVector3f(TileSummedValue) / float(GTileSize * GTileSize);
+				const float TileMeanScalar = Model.ScalarValue(TileMean);
+
+				FVector4f Centered[GTileSize][GTileSize];
+				float MaxCentered = 0.f;
+				for (int32 Y = 0; Y < GTileSize; ++Y)
+				{
+					for (int32 X = 0; X < GTileSize; ++X)
+					{
+						const float Count = float((X + 1) * (Y + 1));
+						const FVector3f CenteredValue = FVector3f(Summed[Y][X]) - Count * TileMean;
+						const float CenteredSecondMoment = Summed[Y][X].W - 2.f * TileMeanScalar * Model.LinearValue(CenteredValue) - Count * FMath::Square(TileMeanScalar);
+
+						Centered[Y][X] = FVector4f(CenteredValue, CenteredSecondMoment);
+						MaxCentered = FMath::Max(MaxCentered, CenteredValue.GetAbsMax());
+					}
+				}
+
+				const float MaxCenteredSecondMoment = TileSummedValue.W - float(GTileSize * GTileSize) * FMath::Square(TileMeanScalar);
+				const int32 ScaleExponent = FMath::CeilToInt(FMath::Log2(FMath::Max(MaxCentered, 1e-20f)));
+				const int32 SecondMomentScaleExponent = FMath::CeilToInt(FMath::Log2(FMath::Max(MaxCenteredSecondMoment, 1e-20f)));
+
+				FTile& Tile = Tiles[(TileOrigin.Y / GTileSize) * NumTiles.X + TileOrigin.X / GTileSize];
+				Tile.Mean = TileMean;
+				Tile.Scale = FMath::Exp2(float(ScaleExponent));
+				Tile.SecondMomentScale = FMath::Exp2(float(SecondMomentScaleExponent));
+
+				for (int32 Y = 0; Y < TileSize.Y; ++Y)
+				{
+					for (int32 X = 0; X < TileSize.X; ++X)
+					{
+						const FVector4f& Value = Centered[Y][X];
+						Values[(TileOrigin.Y + Y) * Size.X + TileOrigin.X + X] = FVector4f(
+							QuantizeSnorm16(Value.X / Tile.Scale),
+							QuantizeSnorm16(Value.Y / Tile.Scale),
+							QuantizeSnorm16(Value.Z / Tile.Scale),
+							QuantizeSnorm16(Value.W / Tile.SecondMomentScale));
+					}
+				}
+			}
+
+			// KuwaharaFilterPrefixCS
+			void BuildPrefixSums()
+			{
+				NumPrefixTiles = FIntPoint::ComponentMax(NumTiles - FIntPoint(1, 1), FIntPoint(1, 1));
+				RowPrefix.SetNumZeroed(NumPrefixTiles.X * Size.Y);
+				ColumnPrefix.SetNumZeroed(Size.X * NumPrefixTiles.Y);
+				TilePrefix.SetNumZeroed(NumPrefixTiles.X * NumPrefixTiles.Y);
+
+				const FVector3f ReferenceMean = GetReferenceMean();
+
+				for (int32 Y = 0; Y < Size.Y; ++Y)
+				{
+					FVector4f Sum(0.f, 0.f, 0.f, 0.f);
+					for (int32 TileX = 0; TileX < NumTiles.X - 1; ++TileX)
+					{
+						Sum += Load(FIntPoint(GTileSize * TileX + GTileSize - 1, Y), ReferenceMean);
+						RowPrefix[Y * NumPrefixTiles.X + TileX] = Sum;
+					}
+				}
+
+				for (int32 X = 0; X < Size.X; ++X)
+				{
+					FVector4f Sum(0.f, 0.f, 0.f, 0.f);
+					for (int32 TileY = 0; TileY < NumTiles.Y - 1; ++TileY)
+					{
+						Sum += Load(FIntPoint(X, GTileSize * TileY + GTileSize - 1), ReferenceMean);
+						ColumnPrefix[TileY * Size.X + X] = Sum;
+					}
+				}
+
+				for (int32 TileX = 0; TileX < NumTiles.X - 1; ++TileX)
+				{
+					FVector4f Sum(0.f, 0.f, 0.f, 0.f);
+					for (int32 TileY = 0; TileY < NumTiles.Y - 1; ++TileY)
+					{
+						Sum += RowPrefix[(GTileSize * TileY + GTileSize - 1) * NumPrefixTiles.X + TileX];
+						TilePrefix[TileY * NumPrefixTiles.X + TileX] = Sum;
+					}
+				}
+			}
+
+			const FValueModel& Model;
+			FIntPoint Size;
+			FIntPoint NumTiles;
+			FIntPoint NumPrefixTiles;
+			ESummedAreaTableEncoding Encoding;
+			TArray<FVector4f> Values;
+			TArray<FTile> Tiles;
+			TArray<FVector4f> RowPrefix;
+			TArray<FVector4f> ColumnPrefix;
+			TArray<FVector4f> TilePrefix;
+		};
+
+		// CalcAverageAndVariance without USE_CACHE.
+		FVector4f CalcAverageAndVariance(const FSummedAreaTable& Table, const FValueModel& Model, ESummedAreaTableEncoding Encoding, const FIntVector4& Region, FIntPoint Border)
+		{
+			Border.X = Region.Z < Border.X + GTileSize ? Border.X : Border.X + GTileSize;
+			Border.Y = Region.W < Border.Y + GTileSize ? Border.Y : Border.Y + GTileSize;
+
+			const bool bRelative = Encoding == ESummedAreaTableEncoding::TileRelativeSnorm16;
+			const FVector3f ReferenceMean = bRelative ? Table.GetTileMean(Border) : FVector3f(0.f);
+			auto SummedAreaTable = [&](int32 X, int32 Y) { return Table.Load(FIntPoint(X, Y), ReferenceMean); };
+
+			const FIntPoint P0(Region.X - 1, Region.Y - 1);
+			const FIntPoint P1(Region.Z, Region.W);
+
+			FVector4f Value = SummedAreaTable(P1.X, P1.Y);
+
+			const bool bOnBorderX = Region.X == Border.X;
+			if (!bOnBorderX)
+			{
+				Value -= SummedAreaTable(P0.X, P1.Y);
+			}
+
+			const bool bOnBorderY = Region.Y == Border.Y;
+			if (!bOnBorderY)
+			{
+				Value -= SummedAreaTable(P1.X, P0.Y);
+			}
+
+			if (!bOnBorderX && !bOnBorderY)
+			{
+				Value += SummedAreaTable(P0.X, P0.Y);
+			}
+
+			const bool bUnderBorderX = Region.X < Border.X;
+			if (bUnderBorderX)
+			{
+				Value += SummedAreaTable(Border.X - 1, P1.Y);
+
+				if (!bOnBorderY)
+				{
+					Value -= SummedAreaTable(Border.X - 1, P0.Y);
+				}
+			}
+
+			const bool bUnderBorderY = Region.Y < Border.Y;
+			if (bUnderBorderY)
+			{
+				Value += SummedAreaTable(P1.X, Border.Y - 1);
+
+				if (!bOnBorderX)
+				{
+					Value -= SummedAreaTable(P0.X, Border.Y - 1);
+				}
+			}
+
+			if (bUnderBorderX && bUnderBorderY)
+			{
+				Value += SummedAreaTable(Border.X - 1, Border.Y - 1);
+			}
+
+			Value = Value * (1.f / float((Region.Z - Region.X + 1) * (Region.W - Region.Y + 1)));
+
+			FVector3f Average(Value);
+			if (bRelative)
+			{
+				Value.W -= FMath::Square(Model.LinearValue(Average));
+				Average += ReferenceMean;
+			}
+			else
+			{
+				Value.W -= FMath::Square(Model.ScalarValue(Average));
+			}
+
+			if (Model.IsNormal())
+			{
+				Average = Average.GetSafeNormal();
+			}
+
+			return FVector4f(Average, Value.W);
+		}
+
+		// CalcHierarchicalAverageAndVariance, used above MaxTileLocalFilterSize.
+		FVector4f CalcHierarchicalAverageAndVariance(const FSummedAreaTable& Table, const FValueModel& Model, ESummedAreaTableEncoding Encoding, const FIntVector4& Region)
+		{
+			FVector4f Value = Table.LoadHierarchical(FIntPoint(Region.Z, Region.W));
+			Value -= Table.LoadHierarchical(FIntPoint(Region.X - 1, Region.W));
+			Value -= Table.LoadHierarchical(FIntPoint(Region.Z, Region.Y - 1));
+			Value += Table.LoadHierarchical(FIntPoint(Region.X - 1, Region.Y - 1));
+
+			Value = Value * (1.f / float((Region.Z - Region.X + 1) * (Region.W - Region.Y + 1)));
+
+			FVector3f Average(Value);
+			if (Encoding == ESummedAreaTableEncoding::TileRelativeSnorm16)
+			{
+				Value.W -= FMath::Square(Model.LinearValue(Average));
+				Average += Table.GetReferenceMean();
+			}
+			else
+			{
+				Value.W -= FMath::Square(Model.ScalarValue(Average));
+			}
+
+			if (Model.IsNormal())
+			{
+				Average = Average.GetSafeNormal();
+			}
+
+			return FVector4f(Average, Value.W);
+		}
+
+		void MeasureSummedAreaTablePrecision(const TArray<FString>& Args)
+		{
+			const int32 FilterSize = Args.Num() > 0 ? FMath::Clamp(FCString::Atoi(*Args[0]), 1, 256) : 4;
+			const int32 Width = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 16) : 512;
+			const int32 Height = Args.Num() > 2 ? FMath::Max(FCString::Atoi(*Args[2]), 16) : 512;
+			const FIntPoint Size(Width, Height);
+
+			const EKuwaharaFilterTargetType TargetTypes[] = {
+				EKuwaharaFilterTargetType::SceneColor,
+				EKuwaharaFilterTargetType::BaseColor,
+				EKuwaharaFilterTargetType::Normal,
+				EKuwaharaFilterTargetType::Material,
+			};
+
+			const ESummedAreaTableEncoding Encodings[] = {
+				ESummedAreaTableEncoding::Float16,
+				ESummedAreaTableEncoding::TileRelativeSnorm16,
+			};
+
+			UE_LOG(LogAnimepoy, Display, TEXT("Kuwahara summed area table precision, FilterSize %d, %dx%d, against %s (%lld bytes)"),
+				FilterSize, Width, Height, GetEncodingName(ESummedAreaTableEncoding::Float32), GetSummedAreaTableBytes(Size, ESummedAreaTableEncoding::Float32));
+
+			for (EKuwaharaFilterTargetType TargetType : TargetTypes)
+			{
+				TArray<FLinearColor> Image;
+				GenerateTestImage(Size, TargetType, Image);
+
+				for (ESummedAreaTableEncoding Encoding : Encodings)
+				{
+					const FPrecisionReport Report = MeasurePrecision(Image, Size, TargetType, FilterSize, Encoding);
+					UE_LOG(LogAnimepoy, Display, TEXT("  TargetType %d %-20s %10lld bytes  max error %.6f  mean error %.6f  region mismatches %.2f%%"),
+						(int32)TargetType, GetEncodingName(Encoding), Report.SummedAreaTableBytes, Report.MaxError, Report.MeanError,
+						100.0 * double(Report.RegionMismatches) / double(FMath::Max<int64>(Report.NumPixels, 1)));
+				}
+			}
+		}
+
+		// Lanes are indexed [ThreadId.y][ThreadId.x] like the shader.
+		using FLaneValues = FVector4f[GTileSize][GTileSize];
+
+		void WaveMultiPrefixSumRows(FLaneValues& Values, FScanCost& Cost)
+		{
+			for (int32 Y = 0; Y < GTileSize; ++Y)
+			{
+				FVector4f Sum(0.f, 0.f, 0.f, 0.f);
+				for (int32 X = 0; X < GTileSize; ++X)
+				{
+					const FVector4f Value = Values[Y][X];
+					Values[Y][X] += Sum; // Value += WaveMultiPrefixSum(Value, Mask)
+					Sum += Value;
+				}
+			}
+
+			Cost.WaveOps += GTileSize * GTileSize;
+			Cost.Adds += GTileSize * GTileSize;
+		}
+
+		void KoggeStoneScanRows(FLaneValues& Values, FLaneValues& SummedAreaTable, FScanCost& Cost)
+		{
+			FLaneValues ScanSummedAreaTable;
+
+			FMemory::Memcpy(SummedAreaTable, Values, sizeof(FLaneValues));
+			Cost.SharedStores += GTileSize * GTileSize;
+			Cost.Barriers++;
+
+			for (int32 Step = 0; Step < 4; ++Step)
+			{
+				const int32 Offset = 1 << Step;
+				const FLaneValues& Src = (Step & 1) ? ScanSummedAreaTable : SummedAreaTable;
+				FLaneValues& Dst = (Step & 1) ? SummedAreaTable : ScanSummedAreaTable;
+
+				for (int32 Y = 0; Y < GTileSize; ++Y)
+				{
+					for (int32 X = Offset; X < GTileSize; ++X)
+					{
+						Values[Y][X] += Src[Y][X - Offset];
+					}
+				}
+
+				FMemory::Memcpy(Dst, Values, sizeof(FLaneValues));
+				Cost.SharedLoads += GTileSize * (GTileSize - Offset);
+				Cost.Adds += GTileSize * (GTileSize - Offset);
+				Cost.SharedStores += GTileSize * GTileSize;
+				Cost.Barriers++;
+			}
+		}
+
+		void CompareScanAlgorithms(const TArray<FString>& Args)
+		{
+			const int32 NumTiles = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 256;
+
+			FRandomStream Random(762);
+			TArray<FVector4f> Tile;
+			TArray<FVector4f> WaveResult;
+			TArray<FVector4f> KoggeStoneResult;
+			Tile.SetNumUninitialized(GTileSize * GTileSize);
+			WaveResult.SetNumUninitialized(GTileSize * GTileSize);
+			KoggeStoneResult.SetNumUninitialized(GTileSize * GTileSize);
+
+			double MaxRelativeError = 0.0;
+			FScanCost WaveCost;
+			FScanCost KoggeStoneCost;
+
+			for (int32 TileIndex = 0; TileIndex < NumTiles; ++TileIndex)
+			{
+				// Alternate SDR and HDR tiles.
+				const float Range = (TileIndex & 1) ? 64.f : 1.f;
+				for (FVector4f& Value : Tile)
+				{
+					const FVector3f Color(Random.FRand(), Random.FRand(), Random.FRand());
+					Value = FVector4f(Range * Color, FMath::Square(Range * Color.Y));
+				}
+
+				WaveCost = CreateSummedAreaTable(Tile, EScanAlgorithm::WaveMultiPrefixSum, WaveResult);
+				KoggeStoneCost = CreateSummedAreaTable(Tile, EScanAlgorithm::KoggeStone, KoggeStoneResult);
+
+				for (int32 Index = 0; Index < Tile.Num(); ++Index)
+				{
+					for (int32 Component = 0; Component < 4; ++Component)
+					{
+						const double Expected = WaveResult[Index][Component];
+						const double Error = FMath::Abs(Expected - KoggeStoneResult[Index][Component]) / FMath::Max(FMath::Abs(Expected), 1e-6);
+						MaxRelativeError = FMath::Max(MaxRelativeError, Error);
+					}
+				}
+			}
+
+			UE_LOG(LogAnimepoy, Display, TEXT("Kuwahara summed area table scans over %d tiles, max relative difference %.3g"), NumTiles, MaxRelativeError);
+			for (const TPair<EScanAlgorithm, FScanCost>& Result : { TPair<EScanAlgorithm, FScanCost>(EScanAlgorithm::WaveMultiPrefixSum, WaveCost), TPair<EScanAlgorithm, FScanCost>(EScanAlgorithm::KoggeStone, KoggeStoneCost) })
+			{
+				UE_LOG(LogAnimepoy, Display, TEXT("  %-20s per group: %5lld adds  %5lld shared loads  %5lld shared stores  %5lld wave ops  %2d barriers"),
+					GetScanAlgorithmName(Result.Key), Result.Value.Adds, Result.Value.SharedLoads, Result.Value.SharedStores, Result.Value.WaveOps, Result.Value.Barriers);
+			}
+		}
+
+		FAutoConsoleCommand GCompareScanAlgorithmsCommand(
+			TEXT("Animepoy.Kuwahara.CompareScans"),
+			TEXT("Runs both CreateSummedAreaTable variants on random tiles and logs their difference and work per thread group.\n")
+			TEXT("Usage: Animepoy.Kuwahara.CompareScans [NumTiles=256]"),
+			FConsoleCommandWithArgsDelegate::CreateStatic(&CompareScanAlgorithms));
+
+		FAutoConsoleCommand GMeasureSummedAreaTablePrecisionCommand(
+			TEXT("Animepoy.Kuwahara.MeasureSATPrecision"),
+			TEXT("Measures the Kuwahara filter error of each summed area table encoding against the float table on a synthetic image.\n")
+			TEXT("Usage: Animepoy.Kuwahara.MeasureSATPrecision [FilterSize=4] [Width=512] [Height=512]"),
+			FConsoleCommandWithArgsDelegate::CreateStatic(&MeasureSummedAreaTablePrecision));
+	}
+
+	const TCHAR* GetEncodingName(ESummedAreaTableEncoding Encoding)
+	{
+		switch (Encoding)
+		{
+		case ESummedAreaTableEncoding::Float32: return TEXT("Float32");
+		case ESummedAreaTableEncoding::Float16: return TEXT("Float16");
+		case ESummedAreaTableEncoding::TileRelativeSnorm16: return TEXT("TileRelativeSnorm16");
+		default: return TEXT("Unknown");
+		}
+	}
+
+	const TCHAR* GetScanAlgorithmName(EScanAlgorithm Algorithm)
+	{
+		switch (Algorithm)
+		{
+		case EScanAlgorithm::WaveMultiPrefixSum: return TEXT("WaveMultiPrefixSum");
+		case EScanAlgorithm::KoggeStone: return TEXT("KoggeStone");
+		default: return TEXT("Unknown");
+		}
+	}
+
+	FScanCost CreateSummedAreaTable(TConstArrayView<FVector4f> Tile, EScanAlgorithm Algorithm, TArrayView<FVector4f> OutSummedAreaTable)
+	{
+		check(Tile.Num() == GTileSize * GTileSize && OutSummedAreaTable.Num() == Tile.Num());
+
+		FScanCost Cost;
+		FLaneValues Values;
+		FLaneValues SummedAreaTable;
+		FMemory::Memcpy(Values, Tile.GetData(), sizeof(FLaneValues));
+
+		if (Algorithm == EScanAlgorithm::WaveMultiPrefixSum)
+		{
+			WaveMultiPrefixSumRows(Values, Cost); // Sum horizontally
+			FMemory::Memcpy(SummedAreaTable, Values, sizeof(FLaneValues));
+			Cost.SharedStores += GTileSize * GTileSize;
+			Cost.Barriers++;
+		}
+		else
+		{
+			KoggeStoneScanRows(Values, SummedAreaTable, Cost); // Sum horizontally
+		}
+
+		// Load column major
+		for (int32 Y = 0; Y < GTileSize; ++Y)
+		{
+			for (int32 X = 0; X < GTileSize; ++X)
+			{
+				Values[Y][X] = SummedAreaTable[X][Y];
+			}
+		}
+		Cost.SharedLoads += GTileSize * GTileSize;
+
+		if (Algorithm == EScanAlgorithm::WaveMultiPrefixSum)
+		{
+			WaveMultiPrefixSumRows(Values, Cost); // Sum vertically
+		}
+		else
+		{
+			Cost.Barriers++;
+			KoggeStoneScanRows(Values, SummedAreaTable, Cost); // Sum vertically
+		}
+
+		// Lane (x, y) holds the table at pixel (y, x).
+		for (int32 Y = 0; Y < GTileSize; ++Y)
+		{
+			for (int32 X = 0; X < GTileSize; ++X)
+			{
+				OutSummedAreaTable[X * GTileSize + Y] = Values[Y][X];
+			}
+		}
+
+		return Cost;
+	}
+
+	int64 GetSummedAreaTableBytes(FIntPoint Size, ESummedAreaTableEncoding Encoding)
+	{
+		const int64 NumPixels = int64(Size.X) * Size.Y;
+		const FIntPoint NumTiles = FIntPoint::DivideAndRoundUp(Size, GTileSize);
+
+		switch (Encoding)
+		{
+		case ESummedAreaTableEncoding::Float32: return 16 * NumPixels;
+		case ESummedAreaTableEncoding::Float16: return 8 * NumPixels;
+		case ESummedAreaTableEncoding::TileRelativeSnorm16: return 8 * NumPixels + 16 * int64(NumTiles.X) * NumTiles.Y;
+		default: return 0;
+		}
+	}
+
+	void KuwaharaFilter(
+		TConstArrayView<FLinearColor> Input,
+		FIntPoint Size,
+		EKuwaharaFilterTargetType TargetType,
+		int32 FilterSize,
+		ESummedAreaTableEncoding Encoding,
+		TArrayView<FLinearColor> Output,
+		TArrayView<int32> OutRegions,
+		const FVector3f& ViewForward)
+	{
+		check(Input.Num() == Size.X * Size.Y && Output.Num() == Input.Num() && OutRegions.Num() == Input.Num());
+
+		const FValueModel Model(TargetType, ViewForward);
+		const FSummedAreaTable Table(Model, Input, Size, Encoding);
+		const bool bHierarchical = FilterSize > MaxTileLocalFilterSize;
+
+		for (int32 Y = 0; Y < Size.Y; ++Y)
+		{
+			for (int32 X = 0; X < Size.X; ++X)
+			{
+				const FIntPoint Border(X - X % GTileSize, Y - Y % GTileSize);
+
+				const int32 Left = FMath::Max(X - FilterSize, 0);
+				const int32 Top = FMath::Max(Y - FilterSize, 0);
+				const int32 Right = FMath::Min(X + FilterSize, Size.X - 1);
+				const int32 Bottom = FMath::Min(Y + FilterSize, Size.Y - 1);
+
+				const FIntVector4 Regions[4] = {
+					FIntVector4(Left, Top, X, Y),
+					FIntVector4(X, Top, Right, Y),
+					FIntVector4(Left, Y, X, Bottom),
+					FIntVector4(X, Y, Right, Bottom),
+				};
+
+				auto CalcRegion = [&](int32 Index)
+				{
+					return bHierarchical
+						? CalcHierarchicalAverageAndVariance(Table, Model, Encoding, Regions[Index])
+						: CalcAverageAndVariance(Table, Model, Encoding, Regions[Index], Border);
+				};
+
+				int32 MinRegion = 0;
+				FVector4f ValueAndMinVariance = CalcRegion(0);
+				for (int32 Index = 1; Index < 4; ++Index)
+				{
+					const FVector4f ValueAndVariance = CalcRegion(Index);
+					if (ValueAndVariance.W < ValueAndMinVariance.W)
+					{
+						ValueAndMinVariance = ValueAndVariance;
+						MinRegion = Index;
+					}
+				}
+
+				const int32 PixelIndex = Y * Size.X + X;
+				Output[PixelIndex] = Model.Store(FVector3f(ValueAndMinVariance), Input[PixelIndex].A);
+				OutRegions[PixelIndex] = MinRegion;
+			}
+		}
+	}
+
+	FPrecisionReport MeasurePrecision(
+		TConstArrayView<FLinearColor> Input,
+		FIntPoint Size,
+		EKuwaharaFilterTargetType TargetType,
+		int32 FilterSize,
+		ESummedAreaTableEncoding Encoding)
+	{
+		const int32 NumPixels = Size.X * Size.Y;
+
+		TArray<FLinearColor> Reference;
+		TArray<int32> ReferenceRegions;
+		Reference.SetNumUninitialized(NumPixels);
+		ReferenceRegions.SetNumUninitialized(NumPixels);
+		KuwaharaFilter(Input, Size, TargetType, FilterSize, ESummedAreaTableEncoding::Float32, Reference, ReferenceRegions);
+
+		TArray<FLinearColor> Result;
+		TArray<int32> ResultRegions;
+		Result.SetNumUninitialized(NumPixels);
+		ResultRegions.SetNumUninitialized(NumPixels);
+		KuwaharaFilter(Input, Size, TargetType, FilterSize, Encoding, Result, ResultRegions);
+
+		FPrecisionReport Report;
+		Report.NumPixels = NumPixels;
+		Report.SummedAreaTableBytes = GetSummedAreaTableBytes(Size, Encoding);
+
+		double SumError = 0.0;
+		for (int32 Index = 0; Index < NumPixels; ++Index)
+		{
+			const FLinearColor& A = Reference[Index];
+			const FLinearColor& B = Result[Index];
+			const double Error = FMath::Max3(FMath::Abs(A.R - B.R), FMath::Abs(A.G - B.G), FMath::Abs(A.B - B.B));
+
+			// NaN from an overflowing table counts as the largest error.
+			const double SafeError = FMath::IsFinite(Error) ? Error : MAX_flt;
+			Report.MaxError = FMath::Max(Report.MaxError, SafeError);
+			SumError += SafeError;
+			Report.RegionMismatches += ReferenceRegions[Index] != ResultRegions[Index] ? 1 : 0;
+		}
+		Report.MeanError = SumError / FMath::Max(NumPixels, 1);
+
+		return Report;
+	}
+
+	void GenerateTestImage(FIntPoint Size, EKuwaharaFilterTargetType TargetType, TArray<FLinearColor>& OutImage)
+	{
+		FRandomStream RandomStream(0x4B57);
+		OutImage.SetNumUninitialized(Size.X * Size.Y);
+
+		const FVector2f HighlightCenter(0.7f * Size.X, 0.3f * Size.Y);
+		const float HighlightRadius = 0.05f * FMath::Min(Size.X, Size.Y);
+
+		for (int32 Y = 0; Y < Size.Y; ++Y)
+		{
+			for (int32 X = 0; X < Size.X; ++X)
+			{
+				FLinearColor Color(
+					0.5f + 0.4f * FMath::Sin(X / 9.f),
+					0.3f + 0.2f * FMath::Cos(Y / 7.f),
+					0.2f + 0.1f * FMath::Sin((X + Y) / 5.f),
+					1.f);
+
+				// Hard edge
+				if (X > Size.X / 4 && X < Size.X / 2 && Y > Size.Y / 2)
+				{
+					Color = FLinearColor(0.05f, 0.1f, 0.6f, 1.f);
+				}
+
+				Color.R += 0.02f * RandomStream.GetFraction();
+				Color.G += 0.02f * RandomStream.GetFraction();
+				Color.B += 0.02f * RandomStream.GetFraction();
+
+				if (FVector2f::DistSquared(FVector2f(X, Y), HighlightCenter) < FMath::Square(HighlightRadius))
+				{
+					Color *= 40.f;
+					Color.A = 1.f;
+				}
+
+				OutImage[Y * Size.X + X] = TargetType == EKuwaharaFilterTargetType::SceneColor ? Color : Color.GetClamped();
+			}
+		}
+	}
+}
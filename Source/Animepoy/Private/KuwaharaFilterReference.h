@@ -0,0 +1,76 @@
+// @Custom
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PostProcessKuwaharaFilter.h"
+
+// CPU model of the summed area table written by KuwaharaFilterSetupCS and read back by KuwaharaFilterPS.
+// It follows the shader math in float so the error of each storage encoding can be measured off-GPU.
+namespace KuwaharaFilterReference
+{
+	enum class ESummedAreaTableEncoding
+	{
+		Float32,				// PF_A32B32G32R32F, the original SceneColor table.
+		Float16,				// PF_FloatRGBA without offsets.
+		TileRelativeSnorm16,	// PF_R16G16B16A16_SNORM relative to the tile mean, the current table.
+	};
+
+	// Above this KuwaharaFilterPS reads the hierarchical table.
+	constexpr int32 MaxTileLocalFilterSize = 15;
+
+	enum class EScanAlgorithm
+	{
+		WaveMultiPrefixSum,	// USE_WAVE_INTRINSICS
+		KoggeStone,			// Groupshared ScanRows
+	};
+
+	// Work of one 16x16 thread group in CreateSummedAreaTable, counted per lane.
+	struct FScanCost
+	{
+		int64 Adds = 0;
+		int64 SharedLoads = 0;
+		int64 SharedStores = 0;
+		int64 WaveOps = 0;
+		int32 Barriers = 0;
+	};
+
+	struct FPrecisionReport
+	{
+		double MaxError = 0.0;
+		double MeanError = 0.0;
+		int64 RegionMismatches = 0;
+		int64 NumPixels = 0;
+		int64 SummedAreaTableBytes = 0;
+	};
+
+	const TCHAR* GetEncodingName(ESummedAreaTableEncoding Encoding);
+
+	const TCHAR* GetScanAlgorithmName(EScanAlgorithm Algorithm);
+
+	// Runs CreateSummedAreaTable over a row major 16x16 tile and writes the inclusive table row major.
+	FScanCost CreateSummedAreaTable(TConstArrayView<FVector4f> Tile, EScanAlgorithm Algorithm, TArrayView<FVector4f> OutSummedAreaTable);
+
+	int64 GetSummedAreaTableBytes(FIntPoint Size, ESummedAreaTableEncoding Encoding);
+
+	// Filters Input like KuwaharaFilterPS, including the prefix sums for large filter sizes. OutRegions receives the index of the selected quadrant per pixel.
+	void KuwaharaFilter(
+		TConstArrayView<FLinearColor> Input,
+		FIntPoint Size,
+		EKuwaharaFilterTargetType TargetType,
+		int32 FilterSize,
+		ESummedAreaTableEncoding Encoding,
+		TArrayView<FLinearColor> Output,
+		TArrayView<int32> OutRegions,
+		const FVector3f& ViewForward = FVector3f(1.f, 0.f, 0.f));
+
+	// Compares the filter result of Encoding against the Float32 table.
+	FPrecisionReport MeasurePrecision(
+		TConstArrayView<FLinearColor> Input,
+		FIntPoint Size,
+		EKuwaharaFilterTargetType TargetType,
+		int32 FilterSize,
+		ESummedAreaTableEncoding Encoding);
+
+	// Smooth gradients with noise, hard edges and HDR highlights. Non scene color targets are saturated.
+	void GenerateTestImage(FIntPoint Size, EKuwaharaFilterTargetType TargetType, TArray<FLinearColor>& OutImage);
+}
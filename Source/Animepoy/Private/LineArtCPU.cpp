@@ -0,0 +1,603 @@
+// @Custom
+#include "LineArtCPU.h"
+#include "AnimepoyBenchmarkCPU.h"
+#include "AnimepoyModule.h"
+#include "Algo/Count.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/Float16.h"
+#include "Math/VectorRegister.h"
+
+namespace LineArtCPU
+{
+	namespace
+	{
+		// Rows per ParallelFor task.
+		constexpr int32 GBandSize = 16;
+
+		// ShadingCommon.ush
+		constexpr uint32 GShadingModelUnlit = 0;
+		constexpr uint32 GShadingModelDefaultLit = 1;
+		constexpr uint32 GShadingModelEye = 9;
+		constexpr uint32 GShadingModelMask = 0xF;
+
+		// NOLINE_MASK and NOLINEGROUP_MASK
+		constexpr uint32 GNoLineMask = 0x80;
+		constexpr uint32 GNoLineGroupMask = 0x40;
+
+		// LINE_DEPTH_MASK
+		constexpr uint16 GLineDepthMask = 0x7FFF;
+
+		uint16 EncodeLine(float DeviceZ)
+		{
+			return FMath::Max<uint16>(FFloat16(DeviceZ).Encoded & GLineDepthMask, 1);
+		}
+
+		float DecodeLine(uint16 Line)
+		{
+			FFloat16 Depth;
+			Depth.Encoded = Line & GLineDepthMask;
+			return Line != 0 ? Depth.GetFloat() : 0.f;
+		}
+
+		int32 CalcLineDistance2(int32 OffsetX, int32 OffsetY)
+		{
+			const int32 X = OffsetX < 0 ? 2 * OffsetX + 1 : 2 * OffsetX;
+			const int32 Y = OffsetY < 0 ? 2 * OffsetY + 1 : 2 * OffsetY;
+			return X * X + Y * Y;
+		}
+
+		// Lane bits of the first NumValid of four pairs.
+		int32 GetLaneMask(int32 NumValid)
+		{
+			return NumValid >= 4 ? 0xF : (1 << NumValid) - 1;
+		}
+
+		// PixelData of GetPixelData with one plane per member, so four neighbouring pixels load into one register.
+		// Rows are padded to whole registers plus one, so the pairs at the end of a row read padding instead of the next row.
+		struct FPixelPlanes
+		{
+			enum EPlane
+			{
+				DeviceZ,
+				PositionX,
+				PositionY,
+				PositionZ,
+				NormalX,
+				NormalY,
+				NormalZ,
+				Fresnel,
+				Metallic,
+				Specular,
+				Roughness,
+				ShadingModel,
+				NoLine,
+				NoLineGroup,
+				NumPlanes
+			};
+
+			explicit FPixelPlanes(FIntPoint InSize)
+				: Size(InSize)
+				, Stride(Align(InSize.X, 4) + 4)
+			{
+				for (TArray<float>& Plane : Planes)
+				{
+					Plane.SetNumZeroed(Stride * Size.Y);
+				}
+			}
+
+			VectorRegister4Float Load(EPlane Plane, int32 Index) const
+			{
+				return VectorLoad(Planes[Plane].GetData() + Index);
+			}
+
+			FIntPoint Size;
+			int32 Stride;
+			TArray<float> Planes[NumPlanes];
+		};
+
+		// GetPixelData without Substrate, for perspective views.
+		void DecodePixels(const FGBuffer& GBuffer, FPixelPlanes& Planes, EParallelForFlags ParallelForFlags)
+		{
+			const FIntPoint Size = GBuffer.Size;
+
+			ParallelFor(FMath::DivideAndRoundUp(Size.Y, GBandSize), [&GBuffer, &Planes, Size](int32 Band)
+				{
+					const int32 MaxY = FMath::Min(Band * GBandSize + GBandSize, Size.Y);
+					for (int32 Y = Band * GBandSize; Y < MaxY; ++Y)
+					{
+						for (int32 X = 0; X < Size.X; ++X)
+						{
+							const int32 SourceIndex = Y * Size.X + X;
+							const int32 Index = Y * Planes.Stride + X;
+
+							const float DeviceZ = GBuffer.DeviceZ[SourceIndex];
+							const FVector4f Position = GBuffer.SvPositionToTranslatedWorld.TransformFVector4(FVector4f(GBuffer.Min.X + X + 0.5f, GBuffer.Min.Y + Y + 0.5f, DeviceZ, 1.f));
+							const FVector3f TranslatedWorldPosition = FVector3f(Position) / Position.W;
+							const FVector3f CameraVector = (TranslatedWorldPosition - GBuffer.TranslatedWorldCameraOrigin).GetUnsafeNormal();
+
+							// DecodeShadingModelId
+							const FLinearColor& GBufferB = GBuffer.GBufferB[SourceIndex];
+							const uint32 ShadingModel = uint32(FMath::RoundToInt(GBufferB.A * 255.f)) & GShadingModelMask;
+
+							FVector3f WorldNormal(0.f);
+							float Fresnel = 0.f;
+							if (ShadingModel != GShadingModelUnlit)
+							{
+								const FLinearColor& GBufferA = GBuffer.GBufferA[SourceIndex];
+								WorldNormal = 2.f * FVector3f(GBufferA.R, GBufferA.G, GBufferA.B) - FVector3f(1.f);
+								Fresnel = 1.f - FMath::Abs(WorldNormal | CameraVector);
+							}
+
+							const uint32 Flags = ShadingModel == GShadingModelEye ? uint32(255.f * GBufferB.R) : 0;
+
+							Planes.Planes[FPixelPlanes::DeviceZ][Index] = DeviceZ;
+							Planes.Planes[FPixelPlanes::PositionX][Index] = TranslatedWorldPosition.X;
+							Planes.Planes[FPixelPlanes::PositionY][Index] = TranslatedWorldPosition.Y;
+							Planes.Planes[FPixelPlanes::PositionZ][Index] = TranslatedWorldPosition.Z;
+							Planes.Planes[FPixelPlanes::NormalX][Index] = WorldNormal.X;
+							Planes.Planes[FPixelPlanes::NormalY][Index] = WorldNormal.Y;
+							Planes.Planes[FPixelPlanes::NormalZ][Index] = WorldNormal.Z;
+							Planes.Planes[FPixelPlanes::Fresnel][Index] = Fresnel;
+							Planes.Planes[FPixelPlanes::Metallic][Index] = GBufferB.R;
+							Planes.Planes[FPixelPlanes::Specular][Index] = GBufferB.G;
+							Planes.Planes[FPixelPlanes::Roughness][Index] = GBufferB.B;
+							Planes.Planes[FPixelPlanes::ShadingModel][Index] = float(ShadingModel);
+							Planes.Planes[FPixelPlanes::NoLine][Index] = (Flags & GNoLineMask) != 0 ? 1.f : 0.f;
+							Planes.Planes[FPixelPlanes::NoLineGroup][Index] = (Flags & GNoLineGroupMask) != 0 ? 1.f : 0.f;
+						}
+					}
+				}, ParallelForFlags);
+		}
+
+		struct FThresholdRegisters
+		{
+			explicit FThresholdRegisters(const FLineArtThresholds& Thresholds)
+				: Material(VectorSetFloat1(Thresholds.MaterialThreshold))
+				, Depth(VectorSetFloat1(Thresholds.DepthThreshold))
+				, Normal(VectorSetFloat1(Thresholds.NormalThreshold))
+				, Planar(VectorSetFloat1(Thresholds.PlanarThreshold))
+			{
+			}
+
+			VectorRegister4Float Material;
+			VectorRegister4Float Depth;
+			VectorRegister4Float Normal;
+			VectorRegister4Float Planar;
+		};
+
+		// DetectLine for the four pairs from Index0 and Index1. Returns the lane bits of the lines drawn on the first pixels
+		// of the pairs in OutLine0 and on the second pixels, where bShiftLine is set, in OutLine1.
+		void DetectLine4(const FPixelPlanes& Planes, int32 Index0, int32 Index1, const FThresholdRegisters& Thresholds, int32& OutLine0, int32& OutLine1)
+		{
+			const VectorRegister4Float Zero = VectorZeroFloat();
+
+			const VectorRegister4Float DeviceZ0 = Planes.Load(FPixelPlanes::DeviceZ, Index0);
+			const VectorRegister4Float DeviceZ1 = Planes.Load(FPixelPlanes::DeviceZ, Index1);
+			const VectorRegister4Float Near = VectorCompareGT(DeviceZ0, DeviceZ1);
+			const VectorRegister4Float Far = VectorCompareLE(DeviceZ0, DeviceZ1);
+
+			// Cancel line if near object has no line flag.
+			const VectorRegister4Float NoLine = VectorSelect(Near, Planes.Load(FPixelPlanes::NoLine, Index0), Planes.Load(FPixelPlanes::NoLine, Index1));
+			const VectorRegister4Float NoLineGroup = VectorMultiply(Planes.Load(FPixelPlanes::NoLineGroup, Index0), Planes.Load(FPixelPlanes::NoLineGroup, Index1));
+			const VectorRegister4Float Keep = VectorBitwiseAnd(VectorCompareEQ(NoLine, Zero), VectorCompareEQ(NoLineGroup, Zero));
+
+			// MaterialLine
+			VectorRegister4Float Line = VectorBitwiseOr(
+				VectorCompareNE(Planes.Load(FPixelPlanes::ShadingModel, Index0), Planes.Load(FPixelPlanes::ShadingModel, Index1)),
+				VectorCompareNE(Planes.Load(FPixelPlanes::Specular, Index0), Planes.Load(FPixelPlanes::Specular, Index1)));
+
+			const VectorRegister4Float DeltaMetallic = VectorAbs(VectorSubtract(Planes.Load(FPixelPlanes::Metallic, Index0), Planes.Load(FPixelPlanes::Metallic, Index1)));
+			const VectorRegister4Float DeltaRoughness = VectorAbs(VectorSubtract(Planes.Load(FPixelPlanes::Roughness, Index0), Planes.Load(FPixelPlanes::Roughness, Index1)));
+			Line = VectorBitwiseOr(Line, VectorCompareGT(VectorAdd(DeltaMetallic, DeltaRoughness), Thresholds.Material));
+
+			// Depth Line
+			const VectorRegister4Float Fresnel = VectorSelect(Near, Planes.Load(FPixelPlanes::Fresnel, Index0), Planes.Load(FPixelPlanes::Fresnel, Index1));
+			const VectorRegister4Float DepthFactor = VectorMultiplyAdd(Fresnel, VectorSetFloat1(0.1f - 1.f), VectorOneFloat());
+			const VectorRegister4Float DeltaZ = VectorAbs(VectorSubtract(DeviceZ0, DeviceZ1));
+			Line = VectorBitwiseOr(Line, VectorCompareGT(VectorMultiply(DepthFactor, DeltaZ), Thresholds.Depth));
+
+			// Planar Line. A zero distance gives NaN and no line, as in the shader.
+			const VectorRegister4Float VX = VectorSubtract(Planes.Load(FPixelPlanes::PositionX, Index0), Planes.Load(FPixelPlanes::PositionX, Index1));
+			const VectorRegister4Float VY = VectorSubtract(Planes.Load(FPixelPlanes::PositionY, Index0), Planes.Load(FPixelPlanes::PositionY, Index1));
+			const VectorRegister4Float VZ = VectorSubtract(Planes.Load(FPixelPlanes::PositionZ, Index0), Planes.Load(FPixelPlanes::PositionZ, Index1));
+			const VectorRegister4Float InvLength = VectorDivide(VectorOneFloat(), VectorSqrt(VectorMultiplyAdd(VX, VX, VectorMultiplyAdd(VY, VY, VectorMultiply(VZ, VZ)))));
+
+			const VectorRegister4Float NormalX0 = Planes.Load(FPixelPlanes::NormalX, Index0);
+			const VectorRegister4Float NormalY0 = Planes.Load(FPixelPlanes::NormalY, Index0);
+			const VectorRegister4Float NormalZ0 = Planes.Load(FPixelPlanes::NormalZ, Index0);
+			const VectorRegister4Float NormalX1 = Planes.Load(FPixelPlanes::NormalX, Index1);
+			const VectorRegister4Float NormalY1 = Planes.Load(FPixelPlanes::NormalY, Index1);
+			const VectorRegister4Float NormalZ1 = Planes.Load(FPixelPlanes::NormalZ, Index1);
+
+			const VectorRegister4Float NoV0 = VectorAbs(VectorMultiplyAdd(NormalX0, VX, VectorMultiplyAdd(NormalY0, VY, VectorMultiply(NormalZ0, VZ))));
+			const VectorRegister4Float NoV1 = VectorAbs(VectorMultiplyAdd(NormalX1, VX, VectorMultiplyAdd(NormalY1, VY, VectorMultiply(NormalZ1, VZ))));
+			Line = VectorBitwiseOr(Line, VectorCompareGT(VectorMultiply(VectorMax(NoV0, NoV1), InvLength), Thresholds.Planar));
+
+			// Normal Line, always drawn on the first pixel.
+			const VectorRegister4Float DeltaNormal = VectorMultiplyAdd(NormalX0, NormalX1, VectorMultiplyAdd(NormalY0, NormalY1, VectorMultiply(NormalZ0, NormalZ1)));
+			const VectorRegister4Float NormalLine = VectorCompareLT(DeltaNormal, Thresholds.Normal);
+
+			OutLine0 = VectorMaskBits(VectorBitwiseAnd(Keep, VectorSelect(Line, Near, NormalLine)));
+			OutLine1 = VectorMaskBits(VectorBitwiseAnd(Keep, VectorBitwiseAnd(Line, Far)));
+		}
+
+		struct FSurface
+		{
+			float Distance = MAX_flt;
+			FVector3f Normal = FVector3f::ZeroVector;
+			uint32 ShadingModel = GShadingModelDefaultLit;
+			float Metallic = 0.f;
+			float Specular = 0.5f;
+			float Roughness = 0.5f;
+		};
+
+		void IntersectSphere(const FVector3f& Direction, const FVector3f& Center, float Radius, FSurface Surface, FSurface& InOutNearest)
+		{
+			const float A = Direction | Direction;
+			const float B = -2.f * (Direction | Center);
+			const float C = (Center | Center) - Radius * Radius;
+			const float Discriminant = B * B - 4.f * A * C;
+			if (Discriminant >= 0.f)
+			{
+				const float Distance = (-B - FMath::Sqrt(Discriminant)) / (2.f * A);
+				if (Distance > 0.f && Distance < InOutNearest.Distance)
+				{
+					Surface.Distance = Distance;
+					Surface.Normal = (Distance * Direction - Center).GetUnsafeNormal();
+					InOutNearest = Surface;
+				}
+			}
+		}
+
+		void IntersectBox(const FVector3f& Direction, const FVector3f& Min, const FVector3f& Max, FSurface Surface, FSurface& InOutNearest)
+		{
+			float Near = 0.f;
+			float Far = MAX_flt;
+			int32 NearAxis = -1;
+			for (int32 Axis = 0; Axis < 3; ++Axis)
+			{
+				if (Direction[Axis] == 0.f)
+				{
+					if (Min[Axis] > 0.f || Max[Axis] < 0.f)
+					{
+						return;
+					}
+					continue;
+				}
+
+				const float T0 = Min[Axis] / Direction[Axis];
+				const float T1 = Max[Axis] / Direction[Axis];
+				if (FMath::Min(T0, T1) > Near)
+				{
+					Near = FMath::Min(T0, T1);
+					NearAxis = Axis;
+				}
+				Far = FMath::Min(Far, FMath::Max(T0, T1));
+			}
+
+			if (NearAxis >= 0 && Near <= Far && Near < InOutNearest.Distance)
+			{
+				Surface.Distance = Near;
+				Surface.Normal = FVector3f::ZeroVector;
+				Surface.Normal[NearAxis] = Direction[NearAxis] > 0.f ? -1.f : 1.f;
+				InOutNearest = Surface;
+			}
+		}
+
+		void BenchmarkLineArt(const TArray<FString>& Args)
+		{
+			const int32 Width = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 16) : 1920;
+			const int32 Height = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 16) : 1080;
+			const int32 LineWidth = Args.Num() > 2 ? FMath::Clamp(FCString::Atoi(*Args[2]), 1, 128) : 3;
+			const int32 NumIterations = Args.Num() > 3 ? FMath::Max(FCString::Atoi(*Args[3]), 1) : 3;
+			const double Megapixels = double(Width) * Height / 1e6;
+
+			FGBuffer GBuffer;
+			GenerateTestGBuffer(FIntPoint(Width, Height), GBuffer);
+
+			// AAnimepoy defaults.
+			FLineArtPassInputs Inputs;
+			Inputs.DepthLineIntensity = 0.9f;
+			Inputs.NormalLineIntensity = 0.75f;
+			Inputs.MaterialLineIntensity = 0.75f;
+			Inputs.PlanarLineIntensity = 0.f;
+			Inputs.NonLineSpecular = 0.f;
+			Inputs.LineWidth = LineWidth;
+
+			TArray<uint16> LineTexture;
+			TArray<float> LineDepth;
+
+			const FLineArtThresholds Thresholds = GetLineArtThresholds(Inputs);
+			const double DetectSingleThreadSeconds = AnimepoyBenchmarkCPU::MeasureSeconds(NumIterations, [&] { DetectLines(GBuffer, Thresholds, LineTexture, true); });
+			const double DetectSeconds = AnimepoyBenchmarkCPU::MeasureSeconds(NumIterations, [&] { DetectLines(GBuffer, Thresholds, LineTexture); });
+			const double DilateSeconds = AnimepoyBenchmarkCPU::MeasureSeconds(NumIterations, [&] { DilateLines(LineTexture, GBuffer.Size, Thresholds, LineDepth); });
+
+			const int32 NumLinePixels = Algo::CountIf(LineTexture, [](uint16 Line) { return Line != 0; });
+			const int32 NumDrawnPixels = Algo::CountIf(LineDepth, [](float Depth) { return Depth != 0.f; });
+
+			AnimepoyBenchmarkCPU::LogHeader(FString::Printf(TEXT("Line art CPU, %dx%d, LineWidth %d"), Width, Height, LineWidth), NumIterations);
+			AnimepoyBenchmarkCPU::LogThroughput(TEXT("Detect"), Megapixels, DetectSeconds, DetectSingleThreadSeconds, FString::Printf(TEXT("%d line pixels"), NumLinePixels));
+			AnimepoyBenchmarkCPU::LogThroughput(TEXT("Dilate"), Megapixels, DilateSeconds, 0.0, FString::Printf(TEXT("%d drawn pixels"), NumDrawnPixels));
+
+			// Each rule alone at its default intensity, the planar line, off by default, at 0.5. Animepoy.LineArt.CPU.Rules checks
+			// these counts at 128x72. Shading model and specular changes always draw, so they are counted with every rule.
+			const TCHAR* RuleNames[] = { TEXT("Depth"), TEXT("Normal"), TEXT("Material"), TEXT("Planar") };
+			for (int32 Rule = 0; Rule < (int32)UE_ARRAY_COUNT(RuleNames); ++Rule)
+			{
+				Inputs.DepthLineIntensity = Rule == 0 ? 0.9f : 0.f;
+				Inputs.NormalLineIntensity = Rule == 1 ? 0.75f : 0.f;
+				Inputs.MaterialLineIntensity = Rule == 2 ? 0.75f : 0.f;
+				Inputs.PlanarLineIntensity = Rule == 3 ? 0.5f : 0.f;
+
+				DetectLines(GBuffer, GetLineArtThresholds(Inputs), LineTexture);
+				UE_LOG(LogAnimepoy, Display, TEXT("  %s lines only: %d line pixels"), RuleNames[Rule], Algo::CountIf(LineTexture, [](uint16 Line) { return Line != 0; }));
+			}
+		}
+
+		FAutoConsoleCommand GBenchmarkLineArtCommand(
+			TEXT("Animepoy.LineArt.BenchmarkCPU"),
+			TEXT("Times the CPU line detection and dilation on a synthetic G-buffer and counts the lines of each rule.\n")
+			TEXT("Usage: Animepoy.LineArt.BenchmarkCPU [Width=1920] [Height=1080] [LineWidth=3] [Iterations=3]"),
+			FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkLineArt));
+	}
+
+	void DetectLines(const FGBuffer& GBuffer, const FLineArtThresholds& Thresholds, TArray<uint16>& OutLineTexture, bool bSingleThread)
+	{
+		const FIntPoint Size = GBuffer.Size;
+		const int32 NumPixels = Size.X * Size.Y;
+		check(GBuffer.DeviceZ.Num() == NumPixels && GBuffer.GBufferA.Num() == NumPixels && GBuffer.GBufferB.Num() == NumPixels);
+
+		const EParallelForFlags ParallelForFlags = bSingleThread ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None;
+
+		FPixelPlanes Planes(Size);
+		DecodePixels(GBuffer, Planes, ParallelForFlags);
+
+		const FThresholdRegisters ThresholdRegisters(Thresholds);
+		OutLineTexture.SetNumUninitialized(NumPixels);
+
+		// Like a thread of DetectLineCS, each band only writes its own pixels. Pairs across the band borders are evaluated by both bands.
+		ParallelFor(FMath::DivideAndRoundUp(Size.Y, GBandSize), [&Planes, &ThresholdRegisters, &OutLineTexture, Size](int32 Band)
+			{
+				const int32 MinY = Band * GBandSize;
+				const int32 MaxY = FMath::Min(MinY + GBandSize, Size.Y);
+				const int32 Stride = Planes.Stride;
+
+				TArray<uint8> Lines;
+				Lines.SetNumZeroed((MaxY - MinY) * Stride);
+
+				// Pairs within a row.
+				for (int32 Y = MinY; Y < MaxY; ++Y)
+				{
+					uint8* Row = Lines.GetData() + (Y - MinY) * Stride;
+					for (int32 X = 0; X < Size.X - 1; X += 4)
+					{
+						int32 Line0, Line1;
+						DetectLine4(Planes, Y * Stride + X, Y * Stride + X + 1, ThresholdRegisters, Line0, Line1);
+
+						const int32 LaneMask = GetLaneMask(Size.X - 1 - X);
+						for (int32 Lane = 0; Lane < 4; ++Lane)
+						{
+							if (LaneMask & (1 << Lane))
+							{
+								Row[X + Lane] |= (Line0 >> Lane) & 1;
+								Row[X + Lane + 1] |= (Line1 >> Lane) & 1;
+							}
+						}
+					}
+				}
+
+				// Pairs between rows, including the rows just outside the band.
+				for (int32 Y = FMath::Max(MinY - 1, 0); Y < FMath::Min(MaxY, Size.Y - 1); ++Y)
+				{
+					uint8* Row0 = Y >= MinY ? Lines.GetData() + (Y - MinY) * Stride : nullptr;
+					uint8* Row1 = Y + 1 < MaxY ? Lines.GetData() + (Y + 1 - MinY) * Stride : nullptr;
+
+					for (int32 X = 0; X < Size.X; X += 4)
+					{
+						int32 Line0, Line1;
+						DetectLine4(Planes, Y * Stride + X, (Y + 1) * Stride + X, ThresholdRegisters, Line0, Line1);
+
+						const int32 LaneMask = GetLaneMask(Size.X - X);
+						for (int32 Lane = 0; Lane < 4; ++Lane)
+						{
+							if (LaneMask & (1 << Lane))
+							{
+								if (Row0)
+								{
+									Row0[X + Lane] |= (Line0 >> Lane) & 1;
+								}
+
+								if (Row1)
+								{
+									Row1[X + Lane] |= (Line1 >> Lane) & 1;
+								}
+							}
+						}
+					}
+				}
+
+				const TArray<float>& DeviceZ = Planes.Planes[FPixelPlanes::DeviceZ];
+				for (int32 Y = MinY; Y < MaxY; ++Y)
+				{
+					for (int32 X = 0; X < Size.X; ++X)
+					{
+						OutLineTexture[Y * Size.X + X] = Lines[(Y - MinY) * Stride + X] != 0 ? EncodeLine(DeviceZ[Y * Stride + X]) : 0;
+					}
+				}
+			}, ParallelForFlags);
+	}
+
+	void DilateLines(TConstArrayView<uint16> LineTexture, FIntPoint Size, const FLineArtThresholds& Thresholds, TArray<float>& OutLineDepth, bool bSingleThread)
+	{
+		check(LineTexture.Num() == Size.X * Size.Y);
+
+		const EParallelForFlags ParallelForFlags = bSingleThread ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None;
+
+		// Decoded lines with the rows padded by the search range, so offsets outside the image read no line like FindLine skips them.
+		const int32 Padding = FMath::Max(-Thresholds.SearchRangeMin, Thresholds.SearchRangeMax);
+		const int32 Stride = Align(Size.X + 2 * Padding, 4) + 4;
+
+		TArray<float> Lines;
+		Lines.SetNumZeroed(Stride * Size.Y);
+
+		ParallelFor(Size.Y, [&Lines, LineTexture, Size, Padding, Stride](int32 Y)
+			{
+				for (int32 X = 0; X < Size.X; ++X)
+				{
+					Lines[Y * Stride + Padding + X] = DecodeLine(LineTexture[Y * Size.X + X]);
+				}
+			}, ParallelForFlags);
+
+		TArray<FIntPoint> Offsets;
+		for (int32 Y = Thresholds.SearchRangeMin; Y <= Thresholds.SearchRangeMax; ++Y)
+		{
+			for (int32 X = Thresholds.SearchRangeMin; X <= Thresholds.SearchRangeMax; ++X)
+			{
+				if (CalcLineDistance2(X, Y) < Thresholds.LineWidth2)
+				{
+					Offsets.Add(FIntPoint(X, Y));
+				}
+			}
+		}
+
+		OutLineDepth.SetNumUninitialized(Size.X * Size.Y);
+
+		// The nearest line in range is the largest DeviceZ, four pixels at a time.
+		ParallelFor(FMath::DivideAndRoundUp(Size.Y, GBandSize), [&Lines, &Offsets, &OutLineDepth, Size, Padding, Stride](int32 Band)
+			{
+				TArray<float> Row;
+				Row.SetNumUninitialized(Align(Size.X, 4));
+
+				const int32 MaxY = FMath::Min(Band * GBandSize + GBandSize, Size.Y);
+				for (int32 Y = Band * GBandSize; Y < MaxY; ++Y)
+				{
+					for (int32 X = 0; X < Size.X; X += 4)
+					{
+						VectorRegister4Float Depth = VectorZeroFloat();
+						for (const FIntPoint& Offset : Offsets)
+						{
+							const int32 LineY = Y + Offset.Y;
+							if (LineY >= 0 && LineY < Size.Y)
+							{
+								Depth = VectorMax(Depth, VectorLoad(Lines.GetData() + LineY * Stride + Padding + X + Offset.X));
+							}
+						}
+						VectorStore(Depth, Row.GetData() + X);
+					}
+
+					FMemory::Memcpy(OutLineDepth.GetData() + Y * Size.X, Row.GetData(), Size.X * sizeof(float));
+				}
+			}, ParallelForFlags);
+	}
+
+	void CompositeLines(float* SceneColor, FIntPoint Size, TConstArrayView<float> LineDepth, const FLinearColor& LineColor, bool bPreview, bool bSingleThread)
+	{
+		check(SceneColor && LineDepth.Num() == Size.X * Size.Y);
+
+		const VectorRegister4Float Scale = MakeVectorRegisterFloat(
+			LineColor.A * LineColor.R + 1.f - LineColor.A,
+			LineColor.A * LineColor.G + 1.f - LineColor.A,
+			LineColor.A * LineColor.B + 1.f - LineColor.A,
+			1.f);
+		const VectorRegister4Float White = MakeVectorRegisterFloat(1.f, 1.f, 1.f, 0.f);
+		const VectorRegister4Float ColorMask = GlobalVectorConstants::XYZMask();
+
+		ParallelFor(FMath::DivideAndRoundUp(Size.Y, GBandSize), [&](int32 Band)
+			{
+				const int32 MaxY = FMath::Min(Band * GBandSize + GBandSize, Size.Y);
+				for (int32 Index = Band * GBandSize * Size.X; Index < MaxY * Size.X; ++Index)
+				{
+					float* Pixel = SceneColor + 4 * Index;
+					VectorRegister4Float Color = VectorLoad(Pixel);
+
+					// ClearSceneColorAndGBufferPS
+					if (bPreview)
+					{
+						Color = VectorSelect(ColorMask, White, Color);
+					}
+
+					if (LineDepth[Index] != 0.f)
+					{
+						Color = VectorMultiply(Color, Scale);
+					}
+
+					VectorStore(Color, Pixel);
+				}
+			}, bSingleThread ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+	}
+
+	void GenerateTestGBuffer(FIntPoint Size, FGBuffer& OutGBuffer)
+	{
+		// Camera at the origin looking down +X with a 90 degree horizontal field of view and reversed infinite depth.
+		const float NearPlane = 10.f;
+		const float TanHalfFovX = 1.f;
+		const float TanHalfFovY = TanHalfFovX * Size.Y / Size.X;
+
+		// (X, Y, DeviceZ, 1) to NearPlane * Direction / DeviceZ, where Direction has a view depth of 1.
+		FMatrix44f SvPositionToTranslatedWorld(ForceInitToZero);
+		SvPositionToTranslatedWorld.M[3][0] = NearPlane;
+		SvPositionToTranslatedWorld.M[0][1] = 2.f * NearPlane * TanHalfFovX / Size.X;
+		SvPositionToTranslatedWorld.M[3][1] = -NearPlane * TanHalfFovX;
+		SvPositionToTranslatedWorld.M[1][2] = -2.f * NearPlane * TanHalfFovY / Size.Y;
+		SvPositionToTranslatedWorld.M[3][2] = NearPlane * TanHalfFovY;
+		SvPositionToTranslatedWorld.M[2][3] = 1.f;
+
+		OutGBuffer.Size = Size;
+		OutGBuffer.SvPositionToTranslatedWorld = SvPositionToTranslatedWorld;
+		OutGBuffer.TranslatedWorldCameraOrigin = FVector3f::ZeroVector;
+		OutGBuffer.DeviceZ.SetNumUninitialized(Size.X * Size.Y);
+		OutGBuffer.GBufferA.SetNumUninitialized(Size.X * Size.Y);
+		OutGBuffer.GBufferB.SetNumUninitialized(Size.X * Size.Y);
+
+		FSurface Floor;
+		Floor.Normal = FVector3f(0.f, 0.f, 1.f);
+		Floor.Roughness = 0.8f;
+
+		FSurface Wall;
+		Wall.Normal = FVector3f(-1.f, 0.f, 0.f);
+		Wall.Roughness = 0.9f;
+
+		FSurface Metal;
+		Metal.Metallic = 1.f;
+		Metal.Roughness = 0.3f;
+
+		// The eye shading model carries the line flags in metallic.
+		FSurface NoLine;
+		NoLine.ShadingModel = GShadingModelEye;
+		NoLine.Metallic = (GNoLineMask + 0.5f) / 255.f;
+
+		FSurface Box;
+		Box.Roughness = 0.6f;
+
+		ParallelFor(Size.Y, [&](int32 Y)
+			{
+				for (int32 X = 0; X < Size.X; ++X)
+				{
+					const FVector3f Direction(
+						1.f,
+						(2.f * (X + 0.5f) / Size.X - 1.f) * TanHalfFovX,
+						(1.f - 2.f * (Y + 0.5f) / Size.Y) * TanHalfFovY);
+
+					FSurface Nearest = Wall;
+					Nearest.Distance = 3000.f;
+
+					if (Direction.Z < 0.f && -100.f / Direction.Z < Nearest.Distance)
+					{
+						Nearest = Floor;
+						Nearest.Distance = -100.f / Direction.Z;
+					}
+
+					IntersectSphere(Direction, FVector3f(600.f, -150.f, 0.f), 100.f, Metal, Nearest);
+					IntersectSphere(Direction, FVector3f(500.f, 160.f, -20.f), 80.f, NoLine, Nearest);
+					IntersectBox(Direction, FVector3f(800.f, -60.f, -100.f), FVector3f(900.f, 100.f, 60.f), Box, Nearest);
+
+					const int32 Index = Y * Size.X + X;
+					const FVector3f EncodedNormal = 0.5f * Nearest.Normal + FVector3f(0.5f);
+					OutGBuffer.DeviceZ[Index] = NearPlane / Nearest.Distance;
+					OutGBuffer.GBufferA[Index] = FLinearColor(EncodedNormal.X, EncodedNormal.Y, EncodedNormal.Z, 0.f);
+					OutGBuffer.GBufferB[Index] = FLinearColor(Nearest.Metallic, Nearest.Specular, Nearest.Roughness, Nearest.ShadingModel / 255.f);
+				}
+			});
+	}
+}
@@ -0,0 +1,40 @@
+// @Custom
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PostProcessLineArt.h"
+
+// Line detection on the CPU, for generating line passes offline on machines without a GPU.
+// Follows DetectLineCS and FindLine of PostProcessLineArt.usf for the G-buffer without Substrate,
+// with the thresholds of GetLineArtThresholds, so a pass can be checked against the same FLineArtPassInputs.
+namespace LineArtCPU
+{
+	// G-buffer planes as dumped from a capture, one entry per pixel with no row padding.
+	struct FGBuffer
+	{
+		FIntPoint Size = FIntPoint::ZeroValue;
+		TArray<float> DeviceZ;
+		TArray<FLinearColor> GBufferA;	// Encoded world normal.
+		TArray<FLinearColor> GBufferB;	// Metallic, specular, roughness and the shading model ID.
+
+		// View uniform parameters of the capture, for ReconstructTranslatedWorldPositionAndCameraDirectionFromDeviceZ.
+		FMatrix44f SvPositionToTranslatedWorld = FMatrix44f::Identity;
+		FVector3f TranslatedWorldCameraOrigin = FVector3f::ZeroVector;
+
+		// SvPosition of the first pixel in the capture, for planes cropped out of it.
+		FIntPoint Min = FIntPoint::ZeroValue;
+	};
+
+	// DetectLineCS without the line history. OutLineTexture receives the R16_UINT line buffer of EncodeLine.
+	void DetectLines(const FGBuffer& GBuffer, const FLineArtThresholds& Thresholds, TArray<uint16>& OutLineTexture, bool bSingleThread = false);
+
+	// FindLine of CompositeLinePS without the jump flood. OutLineDepth receives the DeviceZ of the line drawn on each pixel, 0 for none.
+	void DilateLines(TConstArrayView<uint16> LineTexture, FIntPoint Size, const FLineArtThresholds& Thresholds, TArray<float>& OutLineDepth, bool bSingleThread = false);
+
+	// CompositeLinePS onto Size.X * Size.Y RGBA pixels, 4 floats each with no row padding. The premultiplied line color
+	// blends with BF_DestColor and BF_InverseSourceAlpha where LineDepth has a line. bPreview first clears the color to white.
+	void CompositeLines(float* SceneColor, FIntPoint Size, TConstArrayView<float> LineDepth, const FLinearColor& LineColor, bool bPreview, bool bSingleThread = false);
+
+	// Spheres and a box on a floor in front of a wall, one sphere with the no line flag.
+	void GenerateTestGBuffer(FIntPoint Size, FGBuffer& OutGBuffer);
+}
@@ -1,23 +1,47 @@
 #include "PostProcessDiffusionFilter.h"
+#include "AnimepoyStats.h"
+#include "AnimepoyPipelinePrecache.h"
 #include "PostProcess/PostProcessDownsample.h"
-#include "PostProcess/PostProcessWeightedSampleSum.h"
 #include "DataDrivenShaderPlatformInfo.h"
 #include "ShaderCompiler.h"
 #include "SceneRendering.h"
 #include "SceneTextureParameters.h"
 #include "PixelShaderUtils.h"
+#include "RenderGraphUtils.h"
 #include "UnrealEngine.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Diffusion Filter"), STAT_AnimepoyDiffusionFilter, STATGROUP_Animepoy);
+DECLARE_GPU_STAT_NAMED(AnimepoyDiffusionFilter, TEXT("Animepoy Diffusion Filter"));
 
 namespace {
+	static TAutoConsoleVariable<int32> CVarDiffusionComputeComposite(
+		TEXT("r.Animepoy.Diffusion.ComputeComposite"),
+		1,
+		TEXT("How the diffusion filter composites the blurred mask over the scene color.\n")
+		TEXT(" 0: pixel shader into a new render target\n")
+		TEXT(" 1: compute shader in place, or into the override output, where the formats allow it (default)"),
+		ECVF_RenderThreadSafe);
+
 	const int32 GTileSizeX = 8;
 	const int32 GTileSizeY = 8;
 	const int32 GDownsampleFactor = 4;
 
-	class FGenerateMaskCS : public FGlobalShader
+	// Matches MASK_PYRAMID_MAX_MIPS and MASK_PYRAMID_TILE_SIZE.
+	const int32 GMaxMaskMips = 13;
+	const int32 GMaskPyramidTileSize = 64;
+
+	// Every level of the blur is rounded to the format, and the composite stretches the quarter resolution result.
+	// On a dim glow at the default 8% blur, 8 bit levels leave 27 distinct values over 160 mask texels, with bands
+	// up to 24 texels, 96 pixels on screen, where half floats keep 157. An unblurred mask is rounded once, so 8 bits do.
+	const EPixelFormat GBlurPixelFormat = PF_FloatRGBA;
+	const EPixelFormat GUnblurredMaskPixelFormat = PF_R8G8B8A8;
+
+	class FGenerateMaskPyramidCS : public FGlobalShader
 	{
 	public:
-		DECLARE_GLOBAL_SHADER(FGenerateMaskCS);
-		SHADER_USE_PARAMETER_STRUCT(FGenerateMaskCS, FGlobalShader);
+		DECLARE_GLOBAL_SHADER(FGenerateMaskPyramidCS);
+		SHADER_USE_PARAMETER_STRUCT(FGenerateMaskPyramidCS, FGlobalShader);
 
 		class FPreTonemapLuminance : SHADER_PERMUTATION_BOOL("USE_PRE_TONEMAP_LUMINANCE");
 		using FPermutationDomain = TShaderPermutationDomain<FPreTonemapLuminance>;
@@ -30,17 +54,45 @@ namespace {
 			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, PreTonemapColorTexture)
 			SHADER_PARAMETER(float, LuminanceMin)
 			SHADER_PARAMETER(float, InvLuminanceWidth)
-			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D, OutMaskTexture)
+			SHADER_PARAMETER(uint32, MaskMipCount)
+			SHADER_PARAMETER(uint32, NumMaskGroups)
+			SHADER_PARAMETER_RDG_TEXTURE_UAV_ARRAY(RWTexture2D<float4>, OutMaskMips, [GMaxMaskMips])
+			SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, RWMaskPyramidCounter)
 			END_SHADER_PARAMETER_STRUCT()
 
-			static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+			static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+		{
+			return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+		}
+
+		static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
 		{
 			FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
 			OutEnvironment.SetDefine(TEXT("DOWNSAMPLE_FACTOR"), GDownsampleFactor);
 		}
 	};
 
-	IMPLEMENT_GLOBAL_SHADER(FGenerateMaskCS, "/AnimepoyShaders/Private/PostProcessDiffusionFilter.usf", "GenerateMaskCS", SF_Compute);
+	IMPLEMENT_GLOBAL_SHADER(FGenerateMaskPyramidCS, "/AnimepoyShaders/Private/PostProcessDiffusionFilter.usf", "GenerateMaskPyramidCS", SF_Compute);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FBlurParameters, )
+		SHADER_PARAMETER_STRUCT(FScreenPassTextureViewportParameters, Output)
+		SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2D, BlurSourceTexture)
+		SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2D, BlurBaseTexture)
+		SHADER_PARAMETER(FVector2f, BlurSourceExtentInverse)
+		SHADER_PARAMETER(float, BlurSourceWeight)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D, OutBlurTexture)
+	END_SHADER_PARAMETER_STRUCT()
+
+	class FBlurUpsampleCS : public FGlobalShader
+	{
+	public:
+		DECLARE_GLOBAL_SHADER(FBlurUpsampleCS);
+		SHADER_USE_PARAMETER_STRUCT(FBlurUpsampleCS, FGlobalShader);
+
+		using FParameters = FBlurParameters;
+	};
+
+	IMPLEMENT_GLOBAL_SHADER(FBlurUpsampleCS, "/AnimepoyShaders/Private/PostProcessDiffusionFilter.usf", "BlurUpsampleCS", SF_Compute);
 
 	class FCompositePS : public FGlobalShader
 	{
@@ -72,72 +124,218 @@ namespace {
 	};
 
 	IMPLEMENT_GLOBAL_SHADER(FCompositePS, "/AnimepoyShaders/Private/PostProcessDiffusionFilter.usf", "CompositePS", SF_Pixel);
+
+	class FCompositeCS : public FGlobalShader
+	{
+	public:
+		DECLARE_GLOBAL_SHADER(FCompositeCS);
+		SHADER_USE_PARAMETER_STRUCT(FCompositeCS, FGlobalShader);
+
+		class FInPlace : SHADER_PERMUTATION_BOOL("DIFFUSION_COMPOSITE_IN_PLACE");
+		using FPermutationDomain = TShaderPermutationDomain<FCompositePS::FBlendMode, FInPlace>;
+
+		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER_STRUCT(FScreenPassTextureViewportParameters, Input)
+			SHADER_PARAMETER_STRUCT(FScreenPassTextureViewportParameters, Output)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, SceneColorTexture)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, BlurredColorTexture)
+			SHADER_PARAMETER(float, BlendAmount)
+			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float4>, OutSceneColor)
+			END_SHADER_PARAMETER_STRUCT()
+
+			static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+		{
+			return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+		}
+	};
+
+	IMPLEMENT_GLOBAL_SHADER(FCompositeCS, "/AnimepoyShaders/Private/PostProcessDiffusionFilter.usf", "CompositeCS", SF_Compute);
+
+	// CompositeCS stores to Texture, and with bLoad also reads the scene color back from it.
+	bool CanCompositeWithCompute(FRDGTextureRef Texture, bool bLoad)
+	{
+		const FRDGTextureDesc& Desc = Texture->Desc;
+		const EPixelFormatCapabilities Capabilities = bLoad ? EPixelFormatCapabilities::TypedUAVLoad | EPixelFormatCapabilities::TypedUAVStore : EPixelFormatCapabilities::TypedUAVStore;
+		return EnumHasAnyFlags(Desc.Flags, TexCreate_UAV) && !Desc.IsTextureArray() && UE::PixelFormat::HasCapabilities(Desc.Format, Capabilities);
+	}
+
+	// Standard deviation in mask texels of a pyramid blur with NumLevels levels, measured on impulses.
+	float GetBlurPyramidSigma(int32 NumLevels)
+	{
+		static const float SmallLevelSigmas[] = { 0.f, 1.118f, 2.5f, 5.123f };
+		return NumLevels < (int32)UE_ARRAY_COUNT(SmallLevelSigmas) ? SmallLevelSigmas[NumLevels] : 0.6454f * (1 << NumLevels);
+	}
+
+	FIntPoint GetMipExtent(FIntPoint Extent, int32 MipLevel)
+	{
+		return FIntPoint(FMath::Max(Extent.X >> MipLevel, 1), FMath::Max(Extent.Y >> MipLevel, 1));
+	}
+}
+
+FDiffusionBlurPyramid GetDiffusionBlurPyramid(FIntPoint MaskExtent, float BlurPercentage)
+{
+	// Same radius as AddGaussianBlurPass, whose weights fall off as exp(-16 (x / Radius)^2).
+	const float Radius = MaskExtent.X * FMath::Max(BlurPercentage, 0.f) * 0.01f * 0.5f;
+	const float Sigma = Radius / (4.f * UE_SQRT_2);
+	const int32 MaxLevels = FMath::Min<int32>(FMath::FloorLog2(FMath::Max(FMath::Min(MaskExtent.X, MaskExtent.Y), 1)), GMaxMaskMips - 1);
+
+	FDiffusionBlurPyramid Pyramid;
+	while (Pyramid.NumLevels < MaxLevels && GetBlurPyramidSigma(Pyramid.NumLevels) < Sigma)
+	{
+		++Pyramid.NumLevels;
+	}
+
+	if (Pyramid.NumLevels > 0)
+	{
+		// Blending two levels blends their variances.
+		const float Variance0 = FMath::Square(GetBlurPyramidSigma(Pyramid.NumLevels - 1));
+		const float Variance1 = FMath::Square(GetBlurPyramidSigma(Pyramid.NumLevels));
+		Pyramid.TopLevelWeight = FMath::Clamp((FMath::Square(Sigma) - Variance0) / (Variance1 - Variance0), 0.f, 1.f);
+	}
+
+	return Pyramid;
 }
 
 FScreenPassTexture AddPostProcessDiffusionPass(FRDGBuilder& GraphBuilder, const FViewInfo& View, FPostProcessDiffusionInputs& Inputs)
 {
+	SCOPE_CYCLE_COUNTER(STAT_AnimepoyDiffusionFilter);
+	CSV_SCOPED_TIMING_STAT(Animepoy, DiffusionFilter);
 	RDG_EVENT_SCOPE(GraphBuilder, "AnimeDiffusionFilter");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, AnimepoyDiffusionFilter);
+
+	const FIntPoint MaskTextureExtent = FIntPoint::DivideAndRoundUp(Inputs.SceneColor.ViewRect.Size(), GDownsampleFactor);
+	const FDiffusionBlurPyramid Pyramid = GetDiffusionBlurPyramid(MaskTextureExtent, Inputs.BlurPercentage);
 
 	FRDGTextureRef MaskTexture;
 	{
-		FIntPoint MaskTextureExtent = FIntPoint::DivideAndRoundUp(Inputs.SceneColor.ViewRect.Size(), GDownsampleFactor);
-
-		FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(MaskTextureExtent, PF_B8G8R8A8, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
+		// Levels of the blur pyramid are the mips of the mask.
+		const int32 NumMips = Pyramid.NumLevels + 1;
+		const EPixelFormat Format = Pyramid.NumLevels > 0 ? GBlurPixelFormat : GUnblurredMaskPixelFormat;
+		FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(MaskTextureExtent, Format, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV, NumMips);
 		MaskTexture = GraphBuilder.CreateTexture(Desc, TEXT("DiffusionMask"));
+		AddAnimepoyTransientTexture(EAnimepoyTransientTexture::DiffusionMask, Desc);
+
+		const FIntPoint GroupCount = FComputeShaderUtils::GetGroupCount(MaskTextureExtent, GMaskPyramidTileSize);
 
-		FGenerateMaskCS::FPermutationDomain PermutationVector;
-		PermutationVector.Set<FGenerateMaskCS::FPreTonemapLuminance>(Inputs.bPreTonemapLuminance);
+		// Only the last group to finish reads the counter, to reduce mips beyond one texel per group.
+		FRDGBufferRef CounterBuffer = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateBufferDesc(sizeof(uint32), 1), TEXT("DiffusionMaskPyramidCounter"));
+		FRDGBufferUAVRef CounterUAV = GraphBuilder.CreateUAV(CounterBuffer, PF_R32_UINT);
+		AddClearUAVPass(GraphBuilder, CounterUAV, 0u);
 
-		FGenerateMaskCS::FParameters* Parameters = GraphBuilder.AllocParameters<FGenerateMaskCS::FParameters>();
+		FGenerateMaskPyramidCS::FPermutationDomain PermutationVector;
+		PermutationVector.Set<FGenerateMaskPyramidCS::FPreTonemapLuminance>(Inputs.bPreTonemapLuminance);
+
+		FGenerateMaskPyramidCS::FParameters* Parameters = GraphBuilder.AllocParameters<FGenerateMaskPyramidCS::FParameters>();
 		Parameters->Input = GetScreenPassTextureViewportParameters(FScreenPassTextureViewport(Inputs.SceneColor));
 		Parameters->PreTonemap = GetScreenPassTextureViewportParameters(FScreenPassTextureViewport(View.ViewRect));
 		Parameters->Output = GetScreenPassTextureViewportParameters(FScreenPassTextureViewport(MaskTextureExtent));
-		Parameters->OutMaskTexture = GraphBuilder.CreateUAV(MaskTexture);
 		Parameters->SceneColorTexture = Inputs.SceneColor.Texture;
 		Parameters->PreTonemapColorTexture = Inputs.PreTonemapColor;
 		Parameters->LuminanceMin = FMath::Clamp(Inputs.LuminanceMin, 0.0, 1.0);
 		Parameters->InvLuminanceWidth = 1.f / FMath::Max(Inputs.LuminanceMax - Inputs.LuminanceMin, 0.00001f);
+		Parameters->MaskMipCount = NumMips;
+		Parameters->NumMaskGroups = GroupCount.X * GroupCount.Y;
+		for (int32 MipLevel = 0; MipLevel < GMaxMaskMips; ++MipLevel)
+		{
+			// Unused slots alias the last mip, the shader never writes them.
+			Parameters->OutMaskMips[MipLevel] = GraphBuilder.CreateUAV(FRDGTextureUAVDesc(MaskTexture, FMath::Min(MipLevel, NumMips - 1)));
+		}
+		Parameters->RWMaskPyramidCounter = CounterUAV;
 
 		FComputeShaderUtils::AddPass(
 			GraphBuilder,
-			RDG_EVENT_NAME("DiffusionGenerateMask"),
-			TShaderMapRef<FGenerateMaskCS>(View.ShaderMap, PermutationVector),
+			RDG_EVENT_NAME("DiffusionGenerateMaskPyramid Mips=%d", NumMips),
+			TShaderMapRef<FGenerateMaskPyramidCS>(View.ShaderMap, PermutationVector),
 			Parameters,
-			FComputeShaderUtils::GetGroupCount(MaskTextureExtent, FIntPoint(GTileSizeX, GTileSizeY)));
+			GroupCount);
 	}
 
-	FRDGTextureRef BlurredColorTexture;
+	FRDGTextureRef BlurredColorTexture = MaskTexture;
+	if (Pyramid.NumLevels > 0)
 	{
-		FGaussianBlurInputs BlurInputs;
-		BlurInputs.NameX = TEXT("DiffusionBlurX");
-		BlurInputs.NameY = TEXT("DiffusionBlurY");
-		BlurInputs.Filter = FScreenPassTextureSlice::CreateFromScreenPassTexture(GraphBuilder, FScreenPassTexture(MaskTexture));
-		BlurInputs.TintColor = FLinearColor::White;
-		BlurInputs.CrossCenterWeight = FVector2f::ZeroVector;
-		BlurInputs.KernelSizePercent = Inputs.BlurPercentage;
-		BlurInputs.UseMirrorAddressMode = true;
-
-		BlurredColorTexture = AddGaussianBlurPass(GraphBuilder, View, BlurInputs).Texture;
+		RDG_EVENT_SCOPE(GraphBuilder, "DiffusionBlur Levels=%d", Pyramid.NumLevels);
+
+		FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(MaskTextureExtent, GBlurPixelFormat, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV, Pyramid.NumLevels);
+		BlurredColorTexture = GraphBuilder.CreateTexture(Desc, TEXT("DiffusionBlur"));
+		AddAnimepoyTransientTexture(EAnimepoyTransientTexture::DiffusionBlur, Desc);
+
+		for (int32 MipLevel = Pyramid.NumLevels - 1; MipLevel >= 0; --MipLevel)
+		{
+			const bool bTopLevel = MipLevel == Pyramid.NumLevels - 1;
+			const FIntPoint Extent = GetMipExtent(MaskTextureExtent, MipLevel);
+
+			FBlurParameters* Parameters = GraphBuilder.AllocParameters<FBlurParameters>();
+			Parameters->Output = GetScreenPassTextureViewportParameters(FScreenPassTextureViewport(Extent));
+			Parameters->BlurSourceTexture = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::CreateForMipLevel(bTopLevel ? MaskTexture : BlurredColorTexture, MipLevel + 1));
+			Parameters->BlurBaseTexture = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::CreateForMipLevel(MaskTexture, MipLevel));
+			Parameters->BlurSourceExtentInverse = FVector2f(1.f, 1.f) / FVector2f(GetMipExtent(MaskTextureExtent, MipLevel + 1));
+			Parameters->BlurSourceWeight = bTopLevel ? Pyramid.TopLevelWeight : 1.f;
+			Parameters->OutBlurTexture = GraphBuilder.CreateUAV(FRDGTextureUAVDesc(BlurredColorTexture, MipLevel));
+
+			FComputeShaderUtils::AddPass(
+				GraphBuilder,
+				RDG_EVENT_NAME("DiffusionBlurUpsample %dx%d", Extent.X, Extent.Y),
+				TShaderMapRef<FBlurUpsampleCS>(View.ShaderMap),
+				Parameters,
+				FComputeShaderUtils::GetGroupCount(Extent, FIntPoint(GTileSizeX, GTileSizeY)));
+		}
 	}
 
+	FCompositePS::EBlendMode BlendMode = (FCompositePS::EBlendMode)FMath::Clamp(static_cast<uint8>(Inputs.BlendMode), 0, (uint8)FCompositePS::EBlendMode::MAX - 1);
+	if (Inputs.bDebugMask)
+	{
+		BlendMode = FCompositePS::EBlendMode::Debug;
+	}
+
+	const float BlendAmount = Inputs.bDebugMask ? 1.f : FMath::Clamp(Inputs.Intensity, 0.f, 1.f);
+
 	FScreenPassRenderTarget Output = Inputs.OverrideOutput;
+
+	// Writing the scene color in place, or straight into the override output, saves a full resolution target.
+	const bool bComputeComposite = CVarDiffusionComputeComposite.GetValueOnRenderThread() != 0;
+	const bool bInPlace = bComputeComposite && !Output.IsValid() && CanCompositeWithCompute(Inputs.SceneColor.Texture, true);
+	if (bInPlace || (bComputeComposite && Output.IsValid() && CanCompositeWithCompute(Output.Texture, false)))
+	{
+		if (bInPlace)
+		{
+			Output = FScreenPassRenderTarget(Inputs.SceneColor, ERenderTargetLoadAction::ELoad);
+		}
+
+		FCompositeCS::FPermutationDomain PermutationVector;
+		PermutationVector.Set<FCompositePS::FBlendMode>(BlendMode);
+		PermutationVector.Set<FCompositeCS::FInPlace>(bInPlace);
+
+		FCompositeCS::FParameters* Parameters = GraphBuilder.AllocParameters<FCompositeCS::FParameters>();
+		Parameters->Input = GetScreenPassTextureViewportParameters(FScreenPassTextureViewport(Inputs.SceneColor));
+		Parameters->Output = GetScreenPassTextureViewportParameters(FScreenPassTextureViewport(Output));
+		Parameters->SceneColorTexture = bInPlace ? nullptr : Inputs.SceneColor.Texture;
+		Parameters->BlurredColorTexture = BlurredColorTexture;
+		Parameters->BlendAmount = BlendAmount;
+		Parameters->OutSceneColor = GraphBuilder.CreateUAV(Output.Texture);
+
+		FComputeShaderUtils::AddPass(
+			GraphBuilder,
+			RDG_EVENT_NAME("Diffusion Composite%s", bInPlace ? TEXT(" InPlace") : TEXT("")),
+			TShaderMapRef<FCompositeCS>(View.ShaderMap, PermutationVector),
+			Parameters,
+			FComputeShaderUtils::GetGroupCount(Output.ViewRect.Size(), FIntPoint(GTileSizeX, GTileSizeY)));
+	}
+	else
 	{
 		if (!Output.IsValid())
 		{
 			Output = FScreenPassRenderTarget::CreateFromInput(GraphBuilder, Inputs.SceneColor, View.GetOverwriteLoadAction(), TEXT("Diffusion"));
 		}
 
-		FCompositePS::EBlendMode BlendMode = (FCompositePS::EBlendMode)FMath::Clamp(static_cast<uint8>(Inputs.BlendMode), 0, (uint8)FCompositePS::EBlendMode::MAX - 1);
-
 		FCompositePS::FPermutationDomain PermutationVector;
-		PermutationVector.Set<FCompositePS::FBlendMode>(Inputs.bDebugMask ? FCompositePS::EBlendMode::Debug : BlendMode);
+		PermutationVector.Set<FCompositePS::FBlendMode>(BlendMode);
 
 		FCompositePS::FParameters* Parameters = GraphBuilder.AllocParameters<FCompositePS::FParameters>();
 		Parameters->Input = GetScreenPassTextureViewportParameters(FScreenPassTextureViewport(Inputs.SceneColor));
 		Parameters->Output = GetScreenPassTextureViewportParameters(FScreenPassTextureViewport(Output));
 		Parameters->SceneColorTexture = Inputs.SceneColor.Texture;
 		Parameters->BlurredColorTexture = BlurredColorTexture;
-		Parameters->BlendAmount = Inputs.bDebugMask ? 1.f : FMath::Clamp(Inputs.Intensity, 0.f, 1.f);
+		Parameters->BlendAmount = BlendAmount;
 		Parameters->RenderTargets[0] = Output.GetRenderTargetBinding();
 
 		FPixelShaderUtils::AddFullscreenPass(
@@ -152,3 +350,19 @@ FScreenPassTexture AddPostProcessDiffusionPass(FRDGBuilder& GraphBuilder, const
 
 	return MoveTemp(Output);
 }
+
+void PrecacheDiffusionFilterPipelines(FAnimepoyPipelinePrecache& Precache)
+{
+	Precache.AddComputeShaders<FGenerateMaskPyramidCS>();
+	Precache.AddComputeShaders<FBlurUpsampleCS>();
+	Precache.AddComputeShaders<FCompositeCS>();
+
+	// The pixel shader fallback draws into the tonemapper output, which is 8 bit unless the output is HDR.
+	const EPixelFormat OutputFormat = PF_B8G8R8A8;
+	const ETextureCreateFlags OutputFlags = TexCreate_RenderTargetable | TexCreate_ShaderResource;
+
+	Precache.ForEachPermutation<FCompositePS>([&Precache, OutputFormat, OutputFlags](const TShaderRef<FCompositePS>& PixelShader)
+		{
+			Precache.AddFullscreenPass(PixelShader, TStaticBlendState<CW_RGB>::GetRHI(), OutputFormat, OutputFlags);
+		});
+}
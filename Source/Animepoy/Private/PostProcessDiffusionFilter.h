@@ -20,4 +20,15 @@ struct FPostProcessDiffusionInputs
 	bool bDebugMask;
 };
 
+// Mip pyramid that stands in for a Gaussian blur of KernelSizePercent = BlurPercentage over the mask.
+// The mask is downsampled NumLevels times and upsampled back with a tent filter,
+// the top upsample blended over level NumLevels - 1 by TopLevelWeight to hit the Gaussian's variance.
+struct FDiffusionBlurPyramid
+{
+	int32 NumLevels = 0;
+	float TopLevelWeight = 1.f;
+};
+
+FDiffusionBlurPyramid GetDiffusionBlurPyramid(FIntPoint MaskExtent, float BlurPercentage);
+
 FScreenPassTexture AddPostProcessDiffusionPass(FRDGBuilder& GraphBuilder, const FViewInfo& View, FPostProcessDiffusionInputs& Inputs);
\ No newline at end of file
@@ -1,5 +1,10 @@
 // @Custom
 #include "PostProcessKuwaharaFilter.h"
+#include "AnimepoyBatchedViews.h"
+#include "AnimepoyStats.h"
+#include "AnimepoyPipelinePrecache.h"
+#include "AnimepoySubstrate.h"
+#include "AnimepoyModule.h"
 #include "PostProcess/PostProcessDownsample.h"
 #include "PostProcess/PostProcessWeightedSampleSum.h"
 #include "DataDrivenShaderPlatformInfo.h"
@@ -9,6 +14,11 @@
 #include "PixelShaderUtils.h"
 #include "RenderGraphUtils.h"
 #include "UnrealEngine.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Kuwahara Filter"), STAT_AnimepoyKuwaharaFilter, STATGROUP_Animepoy);
+DECLARE_CYCLE_STAT(TEXT("Kuwahara Filter Multi Target"), STAT_AnimepoyKuwaharaFilterMultiTarget, STATGROUP_Animepoy);
+DECLARE_GPU_STAT_NAMED(AnimepoyKuwaharaFilter, TEXT("Animepoy Kuwahara Filter"));
 
 namespace {
 	enum EValueType
@@ -19,49 +29,138 @@ namespace {
 		MAX
 	};
 
+	enum class EPrefixPass
+	{
+		Row,
+		Column,
+		Tile,
+		MAX
+	};
+
 	class FValueType : SHADER_PERMUTATION_ENUM_CLASS("VALUE_TYPE", EValueType);
+	class FHierarchicalSummedAreaTable : SHADER_PERMUTATION_BOOL("USE_HIERARCHICAL_SUMMED_AREA_TABLE");
+	class FPrefixPass : SHADER_PERMUTATION_ENUM_CLASS("PREFIX_PASS", EPrefixPass);
+	class FWaveIntrinsics : SHADER_PERMUTATION_BOOL("USE_WAVE_INTRINSICS");
 	using FCommonDomain = TShaderPermutationDomain<FValueType>;
+	using FSummedAreaTableDomain = TShaderPermutationDomain<FValueType, FWaveIntrinsics>;
+
+	static TAutoConsoleVariable<int32> CVarKuwaharaWaveIntrinsics(
+		TEXT("r.Animepoy.Kuwahara.WaveIntrinsics"),
+		1,
+		TEXT("How the Kuwahara filter builds its summed area tables.\n")
+		TEXT(" 0: groupshared Kogge-Stone scan\n")
+		TEXT(" 1: WaveMultiPrefixSum where the platform supports it (default)"),
+		ECVF_RenderThreadSafe);
+
+	// WaveMatch and WaveMultiPrefixSum need the partitioned wave operations of SM6.5, which Vulkan and Metal do not expose.
+	bool SupportsWaveIntrinsics(EShaderPlatform Platform)
+	{
+		return IsD3DPlatform(Platform) && RHISupportsWaveOperations(Platform) && IsFeatureLevelSupported(Platform, ERHIFeatureLevel::SM6);
+	}
+
+	bool UseWaveIntrinsics(EShaderPlatform Platform)
+	{
+		// A row of the 16x16 group has to live in a single wave.
+		return CVarKuwaharaWaveIntrinsics.GetValueOnRenderThread() != 0 && SupportsWaveIntrinsics(Platform) && GRHISupportsWaveOperations && GRHIMinimumWaveSize >= 16;
+	}
+
+	bool ShouldCompileSummedAreaTablePermutation(const FGlobalShaderPermutationParameters& Parameters, bool bWaveIntrinsics)
+	{
+		return bWaveIntrinsics ? SupportsWaveIntrinsics(Parameters.Platform) : IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+	}
+
+	void ModifySummedAreaTableCompilationEnvironment(bool bWaveIntrinsics, FShaderCompilerEnvironment& Environment)
+	{
+		if (bWaveIntrinsics)
+		{
+			Environment.CompilerFlags.Add(CFLAG_WaveOperations);
+		}
+	}
 
 	class FKuwaharaFilterSetupCS : public FGlobalShader
 	{
 		DECLARE_GLOBAL_SHADER(FKuwaharaFilterSetupCS);
 		SHADER_USE_PARAMETER_STRUCT(FKuwaharaFilterSetupCS, FGlobalShader);
 
-		using FPermutationDomain = FCommonDomain;
+		using FPermutationDomain = FSummedAreaTableDomain;
 
 		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
 			SHADER_PARAMETER_STRUCT_REF(FViewUniformShaderParameters, View)
 			SHADER_PARAMETER_STRUCT(FScreenPassTextureViewportParameters, Input)
 			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
 			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D, OutSummedAreaTableTexture)
+			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<uint4>, OutSummedAreaTableOffsetTexture)
 			END_SHADER_PARAMETER_STRUCT()
 
 			static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
 		{
-			return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM6);
+			FPermutationDomain PermutationVector(Parameters.PermutationId);
+			return ShouldCompileSummedAreaTablePermutation(Parameters, PermutationVector.Get<FWaveIntrinsics>());
+		}
+
+		static inline void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& Environment)
+		{
+			FGlobalShader::ModifyCompilationEnvironment(Parameters, Environment);
+
+			FPermutationDomain PermutationVector(Parameters.PermutationId);
+			ModifySummedAreaTableCompilationEnvironment(PermutationVector.Get<FWaveIntrinsics>(), Environment);
 		}
 	};
 
 	IMPLEMENT_GLOBAL_SHADER(FKuwaharaFilterSetupCS, "/AnimepoyShaders/Private/PostProcessKuwaharaFilter.usf", "KuwaharaFilterSetupCS", SF_Compute);
 
+	class FKuwaharaFilterPrefixCS : public FGlobalShader
+	{
+		DECLARE_GLOBAL_SHADER(FKuwaharaFilterPrefixCS);
+		SHADER_USE_PARAMETER_STRUCT(FKuwaharaFilterPrefixCS, FGlobalShader);
+
+		using FPermutationDomain = TShaderPermutationDomain<FValueType, FPrefixPass>;
+
+		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER_STRUCT_REF(FViewUniformShaderParameters, View)
+			SHADER_PARAMETER_STRUCT(FScreenPassTextureViewportParameters, Input)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, SummedAreaTableTexture)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D<uint4>, SummedAreaTableOffsetTexture)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, SummedAreaTableRowPrefixTexture)
+			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D, OutPrefixTexture)
+			END_SHADER_PARAMETER_STRUCT()
+
+			static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+		{
+			return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+		}
+	};
+
+	IMPLEMENT_GLOBAL_SHADER(FKuwaharaFilterPrefixCS, "/AnimepoyShaders/Private/PostProcessKuwaharaFilter.usf", "KuwaharaFilterPrefixCS", SF_Compute);
+
 	class FKuwaharaFilterCS : public FGlobalShader
 	{
 		DECLARE_GLOBAL_SHADER(FKuwaharaFilterCS);
 		SHADER_USE_PARAMETER_STRUCT(FKuwaharaFilterCS, FGlobalShader);
 
-		using FPermutationDomain = FCommonDomain;
+		using FPermutationDomain = FSummedAreaTableDomain;
 
 		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER_STRUCT_REF(FViewUniformShaderParameters, View)
 			SHADER_PARAMETER_STRUCT(FScreenPassTextureViewportParameters, Input)
-			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, SummedAreaTableTexture)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
 			SHADER_PARAMETER(int32, FilterSize)
 			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D, OutTexture)
+			SHADER_PARAMETER_STRUCT_INCLUDE(FBatchedViewParameters, BatchedViews)
 			END_SHADER_PARAMETER_STRUCT()
 
-			static inline void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& Environment)
+			static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+		{
+			FPermutationDomain PermutationVector(Parameters.PermutationId);
+			return ShouldCompileSummedAreaTablePermutation(Parameters, PermutationVector.Get<FWaveIntrinsics>());
+		}
+
+		static inline void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& Environment)
 		{
 			FGlobalShader::ModifyCompilationEnvironment(Parameters, Environment);
 
+			FPermutationDomain PermutationVector(Parameters.PermutationId);
+			ModifySummedAreaTableCompilationEnvironment(PermutationVector.Get<FWaveIntrinsics>(), Environment);
 			Environment.SetDefine(TEXT("USE_CACHE"), 1);
 		}
 	};
@@ -73,12 +172,18 @@ namespace {
 		DECLARE_GLOBAL_SHADER(FKuwaharaFilterPS);
 		SHADER_USE_PARAMETER_STRUCT(FKuwaharaFilterPS, FGlobalShader);
 
-		using FPermutationDomain = FCommonDomain;
+		using FPermutationDomain = TShaderPermutationDomain<FValueType, FHierarchicalSummedAreaTable>;
 
 		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER_STRUCT_REF(FViewUniformShaderParameters, View)
 			SHADER_PARAMETER_STRUCT(FScreenPassTextureViewportParameters, Input)
 			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, SummedAreaTableTexture)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D<uint4>, SummedAreaTableOffsetTexture)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, SummedAreaTableRowPrefixTexture)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, SummedAreaTableColumnPrefixTexture)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, SummedAreaTableTilePrefixTexture)
 			SHADER_PARAMETER(int32, FilterSize)
+			SHADER_PARAMETER_STRUCT_INCLUDE(FBatchedViewParameters, BatchedViews)
 			RENDER_TARGET_BINDING_SLOTS()
 			END_SHADER_PARAMETER_STRUCT()
 
@@ -92,17 +197,135 @@ namespace {
 
 	IMPLEMENT_GLOBAL_SHADER(FKuwaharaFilterPS, "/AnimepoyShaders/Private/PostProcessKuwaharaFilter.usf", "KuwaharaFilterPS", SF_Pixel);
 
-	EPixelFormat GetSummedAreaTablePixelFormat(EKuwaharaFilterTargetType TargetType)
+	class FFilterBaseColor : SHADER_PERMUTATION_BOOL("FILTER_BASE_COLOR");
+	class FFilterNormal : SHADER_PERMUTATION_BOOL("FILTER_NORMAL");
+	class FFilterMaterial : SHADER_PERMUTATION_BOOL("FILTER_MATERIAL");
+
+	class FKuwaharaFilterMultiTargetCS : public FGlobalShader
 	{
-		switch (TargetType)
+		DECLARE_GLOBAL_SHADER(FKuwaharaFilterMultiTargetCS);
+		SHADER_USE_PARAMETER_STRUCT(FKuwaharaFilterMultiTargetCS, FGlobalShader);
+
+		using FPermutationDomain = TShaderPermutationDomain<FFilterBaseColor, FFilterNormal, FFilterMaterial, FWaveIntrinsics>;
+
+		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER_STRUCT_REF(FViewUniformShaderParameters, View)
+			SHADER_PARAMETER_STRUCT(FScreenPassTextureViewportParameters, Input)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, BaseColorTexture)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, NormalTexture)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, MaterialTexture)
+			SHADER_PARAMETER(int32, FilterSize)
+			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D, OutBaseColorTexture)
+			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D, OutNormalTexture)
+			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D, OutMaterialTexture)
+			SHADER_PARAMETER_STRUCT_INCLUDE(FBatchedViewParameters, BatchedViews)
+			END_SHADER_PARAMETER_STRUCT()
+
+			static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
 		{
-		case EKuwaharaFilterTargetType::SceneColor: return PF_A32B32G32R32F;
-		case EKuwaharaFilterTargetType::BaseColor: return PF_FloatRGBA;
-		case EKuwaharaFilterTargetType::Normal: return PF_FloatRGBA;
-		case EKuwaharaFilterTargetType::Material: return PF_FloatRGBA;
-		default: return PF_Unknown;
+			FPermutationDomain PermutationVector(Parameters.PermutationId);
+			if (!PermutationVector.Get<FFilterBaseColor>() && !PermutationVector.Get<FFilterNormal>() && !PermutationVector.Get<FFilterMaterial>())
+			{
+				return false;
+			}
+
+			return ShouldCompileSummedAreaTablePermutation(Parameters, PermutationVector.Get<FWaveIntrinsics>());
 		}
-	}
+
+		static inline void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& Environment)
+		{
+			FGlobalShader::ModifyCompilationEnvironment(Parameters, Environment);
+
+			FPermutationDomain PermutationVector(Parameters.PermutationId);
+			ModifySummedAreaTableCompilationEnvironment(PermutationVector.Get<FWaveIntrinsics>(), Environment);
+			Environment.SetDefine(TEXT("USE_CACHE"), 1);
+		}
+	};
+
+	IMPLEMENT_GLOBAL_SHADER(FKuwaharaFilterMultiTargetCS, "/AnimepoyShaders/Private/PostProcessKuwaharaFilter.usf", "KuwaharaFilterMultiTargetCS", SF_Compute);
+
+	class FKuwaharaFilterMultiTargetResolvePS : public FGlobalShader
+	{
+		DECLARE_GLOBAL_SHADER(FKuwaharaFilterMultiTargetResolvePS);
+		SHADER_USE_PARAMETER_STRUCT(FKuwaharaFilterMultiTargetResolvePS, FGlobalShader);
+
+		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER_STRUCT(FScreenPassTextureViewportParameters, Input)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, FilteredTexture)
+			RENDER_TARGET_BINDING_SLOTS()
+			END_SHADER_PARAMETER_STRUCT()
+
+			static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+		{
+			return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+		}
+	};
+
+	IMPLEMENT_GLOBAL_SHADER(FKuwaharaFilterMultiTargetResolvePS, "/AnimepoyShaders/Private/PostProcessKuwaharaFilter.usf", "KuwaharaFilterMultiTargetResolvePS", SF_Pixel);
+
+	class FKuwaharaFilterDownsampleCS : public FGlobalShader
+	{
+		DECLARE_GLOBAL_SHADER(FKuwaharaFilterDownsampleCS);
+		SHADER_USE_PARAMETER_STRUCT(FKuwaharaFilterDownsampleCS, FGlobalShader);
+
+		using FPermutationDomain = FCommonDomain;
+
+		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER_STRUCT_REF(FViewUniformShaderParameters, View)
+			SHADER_PARAMETER_STRUCT(FScreenPassTextureViewportParameters, Input)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, SceneDepthTexture)
+			SHADER_PARAMETER(int32, DownsampleFactor)
+			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D, OutLowResTexture)
+			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float2>, OutGuideTexture)
+			END_SHADER_PARAMETER_STRUCT()
+
+			static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+		{
+			return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+		}
+	};
+
+	IMPLEMENT_GLOBAL_SHADER(FKuwaharaFilterDownsampleCS, "/AnimepoyShaders/Private/PostProcessKuwaharaFilter.usf", "KuwaharaFilterDownsampleCS", SF_Compute);
+
+	class FKuwaharaFilterUpsamplePS : public FGlobalShader
+	{
+		DECLARE_GLOBAL_SHADER(FKuwaharaFilterUpsamplePS);
+		SHADER_USE_PARAMETER_STRUCT(FKuwaharaFilterUpsamplePS, FGlobalShader);
+
+		using FPermutationDomain = FCommonDomain;
+
+		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER_STRUCT_REF(FViewUniformShaderParameters, View)
+			SHADER_PARAMETER_STRUCT(FScreenPassTextureViewportParameters, Input)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, SceneDepthTexture)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, LowResTexture)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, GuideTexture)
+			SHADER_PARAMETER(int32, DownsampleFactor)
+			RENDER_TARGET_BINDING_SLOTS()
+			END_SHADER_PARAMETER_STRUCT()
+
+			static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+		{
+			return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+		}
+	};
+
+	IMPLEMENT_GLOBAL_SHADER(FKuwaharaFilterUpsamplePS, "/AnimepoyShaders/Private/PostProcessKuwaharaFilter.usf", "KuwaharaFilterUpsamplePS", SF_Pixel);
+
+	// Tiles are stored relative to their mean and normalized, see DecodeSummedAreaTable.
+	const EPixelFormat GSummedAreaTablePixelFormat = PF_R16G16B16A16_SNORM;
+	const EPixelFormat GSummedAreaTableOffsetPixelFormat = PF_R32G32B32A32_UINT;
+	const EPixelFormat GSummedAreaTablePrefixPixelFormat = PF_A32B32G32R32F;
+	const EPixelFormat GUpsampleGuidePixelFormat = PF_G32R32F;
+	const EPixelFormat GMultiTargetPixelFormat = PF_FloatRGBA;
+
+	// KuwaharaFilterCS caches an 8 pixel apron around each tile.
+	const int32 GMaxCachedFilterSize = 7;
+
+	// KuwaharaFilterPS combines at most 2x2 tile-local tables per region, larger windows go through the prefix sums.
+	const int32 GMaxTileLocalFilterSize = 15;
 
 	EValueType GetValueType(EKuwaharaFilterTargetType TargetType)
 	{
@@ -115,73 +338,379 @@ namespace {
 		default: return EValueType::Color;
 		}
 	}
+
+	// Filters Input into Output, which may be Input itself.
+	void AddKuwaharaFilterPasses(FRDGBuilder& GraphBuilder, const FViewInfo& View, FRDGTextureRef Input, FRDGTextureRef Output, const FIntRect& ViewRect, EValueType ValueType, int32 FilterSize, const FBatchedViewRects& BatchedViewRects = {})
+	{
+		FGlobalShaderMap* ShaderMap = GetGlobalShaderMap(GMaxRHIFeatureLevel);
+		FScreenPassTextureViewport Viewport(ViewRect);
+		const FBatchedViewParameters BatchedViews = GetBatchedViewParameters(BatchedViewRects);
+
+		FSummedAreaTableDomain PermutationVector{};
+		PermutationVector.Set<FValueType>(ValueType);
+		PermutationVector.Set<FWaveIntrinsics>(UseWaveIntrinsics(View.GetShaderPlatform()));
+
+		bool bUAV = (int)Output->Desc.Flags & (int)TexCreate_UAV;
+		bool bSRGB = (int)Output->Desc.Flags & (int)TexCreate_SRGB;
+		bool bUseCompute = bUAV && !bSRGB && FilterSize <= GMaxCachedFilterSize;
+		bool bUseHierarchical = FilterSize > GMaxTileLocalFilterSize;
+
+		if (bUseCompute)
+		{
+			// The fused compute shader builds the summed area table in groupshared memory, but neighbouring groups
+			// still read the unfiltered apron. Filtering in place therefore reads a copy of the view rect. Every pixel
+			// of a 16 pixel tile lies within the 8 pixel apron of a neighbour, so a copy of only the tile borders
+			// would be the whole rect again. At 1920x1080 in PF_FloatRGBA the copy moves about 33MB, estimated at
+			// 0.1ms on a GPU with 300GB/s, and its memory shows up in "stat Animepoy".
+			FRDGTextureRef InputTexture = Input;
+			if (Input == Output)
+			{
+				FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(Input->Desc.Extent, Input->Desc.Format, FClearValueBinding::None, TexCreate_ShaderResource);
+				InputTexture = GraphBuilder.CreateTexture(Desc, TEXT("KuwaharaFilterInput"));
+				AddAnimepoyTransientTexture(EAnimepoyTransientTexture::KuwaharaFilterInput, Desc);
+
+				FRHICopyTextureInfo CopyInfo;
+				CopyInfo.SourcePosition = FIntVector(Viewport.Rect.Min.X, Viewport.Rect.Min.Y, 0);
+				CopyInfo.DestPosition = CopyInfo.SourcePosition;
+				CopyInfo.Size = FIntVector(Viewport.Rect.Width(), Viewport.Rect.Height(), 1);
+
+				AddCopyTexturePass(GraphBuilder, Input, InputTexture, CopyInfo);
+			}
+
+			FKuwaharaFilterCS::FParameters* Parameters = GraphBuilder.AllocParameters<FKuwaharaFilterCS::FParameters>();
+			Parameters->View = View.ViewUniformBuffer;
+			Parameters->Input = GetScreenPassTextureViewportParameters(Viewport);
+			Parameters->InputTexture = InputTexture;
+			Parameters->FilterSize = FilterSize;
+			Parameters->OutTexture = GraphBuilder.CreateUAV(Output);
+			Parameters->BatchedViews = BatchedViews;
+
+			FComputeShaderUtils::AddPass(
+				GraphBuilder,
+				RDG_EVENT_NAME("KuwaharaFilterCS Views=%d", FMath::Max(BatchedViewRects.Num(), 1)),
+				TShaderMapRef<FKuwaharaFilterCS>(ShaderMap, PermutationVector),
+				Parameters,
+				FComputeShaderUtils::GetGroupCount(Viewport.Rect.Size(), FIntPoint(16, 16))
+			);
+		}
+		else
+		{
+			const FIntPoint NumTiles = FIntPoint::DivideAndRoundUp(Viewport.Rect.Size(), 16);
+
+			FRDGTextureRef SummedAreaTable{};
+			FRDGTextureRef SummedAreaTableOffset{};
+			{
+				FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(Input->Desc.Extent, GSummedAreaTablePixelFormat, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
+				SummedAreaTable = GraphBuilder.CreateTexture(Desc, TEXT("SummedAreaTable"));
+				AddAnimepoyTransientTexture(EAnimepoyTransientTexture::SummedAreaTable, Desc);
+
+				FRDGTextureDesc OffsetDesc = FRDGTextureDesc::Create2D(NumTiles, GSummedAreaTableOffsetPixelFormat, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
+				SummedAreaTableOffset = GraphBuilder.CreateTexture(OffsetDesc, TEXT("SummedAreaTableOffset"));
+				AddAnimepoyTransientTexture(EAnimepoyTransientTexture::SummedAreaTable, OffsetDesc);
+
+				FKuwaharaFilterSetupCS::FParameters* Parameters = GraphBuilder.AllocParameters<FKuwaharaFilterSetupCS::FParameters>();
+				Parameters->View = View.ViewUniformBuffer;
+				Parameters->Input = GetScreenPassTextureViewportParameters(Viewport);
+				Parameters->InputTexture = Input;
+				Parameters->OutSummedAreaTableTexture = GraphBuilder.CreateUAV(SummedAreaTable);
+				Parameters->OutSummedAreaTableOffsetTexture = GraphBuilder.CreateUAV(SummedAreaTableOffset);
+
+				FComputeShaderUtils::AddPass(
+					GraphBuilder,
+					RDG_EVENT_NAME("KuwaharaFilterSetupCS"),
+					TShaderMapRef<FKuwaharaFilterSetupCS>(ShaderMap, PermutationVector),
+					Parameters,
+					FComputeShaderUtils::GetGroupCount(Viewport.Rect.Size(), FIntPoint(16, 16))
+				);
+			}
+
+			FRDGTextureRef SummedAreaTableRowPrefix{};
+			FRDGTextureRef SummedAreaTableColumnPrefix{};
+			FRDGTextureRef SummedAreaTableTilePrefix{};
+
+			if (bUseHierarchical)
+			{
+				// The last tile row and column are never a prefix, but keep the textures valid for single-tile views.
+				const FIntPoint NumPrefixTiles = FIntPoint::ComponentMax(NumTiles - FIntPoint(1, 1), FIntPoint(1, 1));
+
+				FRDGTextureDesc RowDesc = FRDGTextureDesc::Create2D(FIntPoint(NumPrefixTiles.X, Viewport.Rect.Height()), GSummedAreaTablePrefixPixelFormat, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
+				SummedAreaTableRowPrefix = GraphBuilder.CreateTexture(RowDesc, TEXT("SummedAreaTableRowPrefix"));
+				AddAnimepoyTransientTexture(EAnimepoyTransientTexture::SummedAreaTable, RowDesc);
+
+				FRDGTextureDesc ColumnDesc = FRDGTextureDesc::Create2D(FIntPoint(Viewport.Rect.Width(), NumPrefixTiles.Y), GSummedAreaTablePrefixPixelFormat, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
+				SummedAreaTableColumnPrefix = GraphBuilder.CreateTexture(ColumnDesc, TEXT("SummedAreaTableColumnPrefix"));
+				AddAnimepoyTransientTexture(EAnimepoyTransientTexture::SummedAreaTable, ColumnDesc);
+
+				FRDGTextureDesc TileDesc = FRDGTextureDesc::Create2D(NumPrefixTiles, GSummedAreaTablePrefixPixelFormat, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
+				SummedAreaTableTilePrefix = GraphBuilder.CreateTexture(TileDesc, TEXT("SummedAreaTableTilePrefix"));
+				AddAnimepoyTransientTexture(EAnimepoyTransientTexture::SummedAreaTable, TileDesc);
+
+				const auto AddPrefixPass = [&](EPrefixPass PrefixPass, FRDGTextureRef OutPrefix, int32 NumThreads)
+				{
+					FKuwaharaFilterPrefixCS::FPermutationDomain PrefixPermutationVector{};
+					PrefixPermutationVector.Set<FValueType>(ValueType);
+					PrefixPermutationVector.Set<FPrefixPass>(PrefixPass);
+
+					FKuwaharaFilterPrefixCS::FParameters* Parameters = GraphBuilder.AllocParameters<FKuwaharaFilterPrefixCS::FParameters>();
+					Parameters->View = View.ViewUniformBuffer;
+					Parameters->Input = GetScreenPassTextureViewportParameters(Viewport);
+					Parameters->SummedAreaTableTexture = SummedAreaTable;
+					Parameters->SummedAreaTableOffsetTexture = SummedAreaTableOffset;
+					Parameters->SummedAreaTableRowPrefixTexture = PrefixPass == EPrefixPass::Tile ? SummedAreaTableRowPrefix : nullptr;
+					Parameters->OutPrefixTexture = GraphBuilder.CreateUAV(OutPrefix);
+
+					FComputeShaderUtils::AddPass(
+						GraphBuilder,
+						RDG_EVENT_NAME("KuwaharaFilterPrefixCS"),
+						TShaderMapRef<FKuwaharaFilterPrefixCS>(ShaderMap, PrefixPermutationVector),
+						Parameters,
+						FComputeShaderUtils::GetGroupCount(NumThreads, 64)
+					);
+				};
+
+				AddPrefixPass(EPrefixPass::Row, SummedAreaTableRowPrefix, Viewport.Rect.Height());
+				AddPrefixPass(EPrefixPass::Column, SummedAreaTableColumnPrefix, Viewport.Rect.Width());
+				AddPrefixPass(EPrefixPass::Tile, SummedAreaTableTilePrefix, NumPrefixTiles.X);
+			}
+
+			FKuwaharaFilterPS::FPermutationDomain PixelPermutationVector{};
+			PixelPermutationVector.Set<FValueType>(ValueType);
+			PixelPermutationVector.Set<FHierarchicalSummedAreaTable>(bUseHierarchical);
+
+			FKuwaharaFilterPS::FParameters* Parameters = GraphBuilder.AllocParameters<FKuwaharaFilterPS::FParameters>();
+			Parameters->View = View.ViewUniformBuffer;
+			Parameters->Input = GetScreenPassTextureViewportParameters(Viewport);
+			Parameters->SummedAreaTableTexture = SummedAreaTable;
+			Parameters->SummedAreaTableOffsetTexture = SummedAreaTableOffset;
+			Parameters->SummedAreaTableRowPrefixTexture = SummedAreaTableRowPrefix;
+			Parameters->SummedAreaTableColumnPrefixTexture = SummedAreaTableColumnPrefix;
+			Parameters->SummedAreaTableTilePrefixTexture = SummedAreaTableTilePrefix;
+			Parameters->FilterSize = FilterSize;
+			Parameters->BatchedViews = BatchedViews;
+			Parameters->RenderTargets[0] = FRenderTargetBinding(Output, ERenderTargetLoadAction::ELoad);
+
+			FPixelShaderUtils::AddFullscreenPass(
+				GraphBuilder,
+				ShaderMap,
+				RDG_EVENT_NAME("KuwaharaFilterPS Views=%d", FMath::Max(BatchedViewRects.Num(), 1)),
+				TShaderMapRef<FKuwaharaFilterPS>(ShaderMap, PixelPermutationVector),
+				Parameters,
+				Viewport.Rect,
+				TStaticBlendState<CW_RGB>::GetRHI());
+		}
+	}
 }
 
 void AddKuwaharaFilterPass(FRDGBuilder& GraphBuilder, const FViewInfo& View, const FKuwaharaFilterInputs& Inputs)
 {
+	SCOPE_CYCLE_COUNTER(STAT_AnimepoyKuwaharaFilter);
+	CSV_SCOPED_TIMING_STAT(Animepoy, KuwaharaFilter);
 	RDG_EVENT_SCOPE(GraphBuilder, "AnimeKuwaharaFilter");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, AnimepoyKuwaharaFilter);
+
+	const EValueType ValueType = GetValueType(Inputs.TargetType);
+	const int32 DownsampleFactor = Inputs.SceneDepth ? FMath::Max(Inputs.DownsampleFactor, 1) : 1;
+
+	if (DownsampleFactor == 1)
+	{
+		AddKuwaharaFilterPasses(GraphBuilder, View, Inputs.Target, Inputs.Target, GetBatchedViewRect(View.ViewRect, Inputs.BatchedViewRects), ValueType, Inputs.FilterSize, Inputs.BatchedViewRects);
+		return;
+	}
+
+	// The low resolution texture has no seams between views.
+	check(Inputs.BatchedViewRects.IsEmpty());
 
 	FGlobalShaderMap* ShaderMap = GetGlobalShaderMap(GMaxRHIFeatureLevel);
 	FScreenPassTextureViewport Viewport(View.ViewRect);
 
 	FCommonDomain PermutationVector{};
-	PermutationVector.Set<FValueType>(GetValueType(Inputs.TargetType));
+	PermutationVector.Set<FValueType>(ValueType);
 
-	FRDGTextureRef SummedAreaTable{};
+	const FIntPoint LowResSize = FIntPoint::DivideAndRoundUp(Viewport.Rect.Size(), DownsampleFactor);
+	const int32 LowResFilterSize = FMath::Max(FMath::DivideAndRoundNearest(Inputs.FilterSize, DownsampleFactor), 1);
+
+	FRDGTextureRef LowResTexture{};
+	FRDGTextureRef GuideTexture{};
 	{
-		FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(Inputs.Target->Desc.Extent, GetSummedAreaTablePixelFormat(Inputs.TargetType), FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
-		SummedAreaTable = GraphBuilder.CreateTexture(Desc, TEXT("SummedAreaTable"));
+		FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(LowResSize, Inputs.Target->Desc.Format, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
+		LowResTexture = GraphBuilder.CreateTexture(Desc, TEXT("KuwaharaFilterLowRes"));
+
+		FRDGTextureDesc GuideDesc = FRDGTextureDesc::Create2D(LowResSize, GUpsampleGuidePixelFormat, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
+		GuideTexture = GraphBuilder.CreateTexture(GuideDesc, TEXT("KuwaharaFilterGuide"));
 
-		FKuwaharaFilterSetupCS::FParameters* Parameters = GraphBuilder.AllocParameters<FKuwaharaFilterSetupCS::FParameters>();
+		FKuwaharaFilterDownsampleCS::FParameters* Parameters = GraphBuilder.AllocParameters<FKuwaharaFilterDownsampleCS::FParameters>();
 		Parameters->View = View.ViewUniformBuffer;
 		Parameters->Input = GetScreenPassTextureViewportParameters(Viewport);
 		Parameters->InputTexture = Inputs.Target;
-		Parameters->OutSummedAreaTableTexture = GraphBuilder.CreateUAV(SummedAreaTable);
+		Parameters->SceneDepthTexture = Inputs.SceneDepth;
+		Parameters->DownsampleFactor = DownsampleFactor;
+		Parameters->OutLowResTexture = GraphBuilder.CreateUAV(LowResTexture);
+		Parameters->OutGuideTexture = GraphBuilder.CreateUAV(GuideTexture);
 
 		FComputeShaderUtils::AddPass(
 			GraphBuilder,
-			RDG_EVENT_NAME("KuwaharaFilterSetupCS"),
-			TShaderMapRef<FKuwaharaFilterSetupCS>(ShaderMap, PermutationVector),
+			RDG_EVENT_NAME("KuwaharaFilterDownsampleCS %dx%d", LowResSize.X, LowResSize.Y),
+			TShaderMapRef<FKuwaharaFilterDownsampleCS>(ShaderMap, PermutationVector),
 			Parameters,
-			FComputeShaderUtils::GetGroupCount(Viewport.Rect.Size(), FIntPoint(16, 16))
+			FComputeShaderUtils::GetGroupCount(LowResSize, FIntPoint(8, 8))
 		);
 	}
 
-	bool bUAV = (int)Inputs.Target->Desc.Flags & (int)TexCreate_UAV;
-	bool bSRGB = (int)Inputs.Target->Desc.Flags & (int)TexCreate_SRGB;
-	bool bUseCompute = bUAV && !bSRGB;
+	// The low resolution texture is ours, so the filter writes a second one instead of copying it.
+	FRDGTextureRef FilteredLowResTexture{};
+	{
+		FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(LowResSize, Inputs.Target->Desc.Format, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV | TexCreate_RenderTargetable);
+		FilteredLowResTexture = GraphBuilder.CreateTexture(Desc, TEXT("KuwaharaFilterLowResOutput"));
+	}
+
+	AddKuwaharaFilterPasses(GraphBuilder, View, LowResTexture, FilteredLowResTexture, FIntRect(FIntPoint::ZeroValue, LowResSize), ValueType, LowResFilterSize);
+
+	// The upsample is guided by the unfiltered target, so it reads a copy of the view rect.
+	FRDGTextureRef InputTexture{};
+	{
+		FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(Inputs.Target->Desc.Extent, Inputs.Target->Desc.Format, FClearValueBinding::None, TexCreate_ShaderResource);
+		InputTexture = GraphBuilder.CreateTexture(Desc, TEXT("KuwaharaFilterInput"));
+		AddAnimepoyTransientTexture(EAnimepoyTransientTexture::KuwaharaFilterInput, Desc);
+
+		FRHICopyTextureInfo CopyInfo;
+		CopyInfo.SourcePosition = FIntVector(Viewport.Rect.Min.X, Viewport.Rect.Min.Y, 0);
+		CopyInfo.DestPosition = CopyInfo.SourcePosition;
+		CopyInfo.Size = FIntVector(Viewport.Rect.Width(), Viewport.Rect.Height(), 1);
+
+		AddCopyTexturePass(GraphBuilder, Inputs.Target, InputTexture, CopyInfo);
+	}
+
+	FKuwaharaFilterUpsamplePS::FParameters* Parameters = GraphBuilder.AllocParameters<FKuwaharaFilterUpsamplePS::FParameters>();
+	Parameters->View = View.ViewUniformBuffer;
+	Parameters->Input = GetScreenPassTextureViewportParameters(Viewport);
+	Parameters->InputTexture = InputTexture;
+	Parameters->SceneDepthTexture = Inputs.SceneDepth;
+	Parameters->LowResTexture = FilteredLowResTexture;
+	Parameters->GuideTexture = GuideTexture;
+	Parameters->DownsampleFactor = DownsampleFactor;
+	Parameters->RenderTargets[0] = FRenderTargetBinding(Inputs.Target, ERenderTargetLoadAction::ELoad);
+
+	FPixelShaderUtils::AddFullscreenPass(
+		GraphBuilder,
+		ShaderMap,
+		RDG_EVENT_NAME("KuwaharaFilterUpsamplePS"),
+		TShaderMapRef<FKuwaharaFilterUpsamplePS>(ShaderMap, PermutationVector),
+		Parameters,
+		Viewport.Rect,
+		TStaticBlendState<CW_RGB>::GetRHI());
+}
+
+void AddKuwaharaFilterMultiTargetPass(FRDGBuilder& GraphBuilder, const FViewInfo& View, const FKuwaharaFilterMultiTargetInputs& Inputs)
+{
+	if (!Inputs.BaseColor && !Inputs.Normal && !Inputs.Material)
+	{
+		return;
+	}
+
+	// Substrate replaces the G-buffer targets this filters.
+	if (IsSubstrateEnabled())
+	{
+		static bool bWarned = false;
+		UE_CLOG(!bWarned, LogAnimepoy, Warning, TEXT("The G-buffer Kuwahara filter is skipped, it does not support r.Substrate."));
+		bWarned = true;
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_AnimepoyKuwaharaFilterMultiTarget);
+	CSV_SCOPED_TIMING_STAT(Animepoy, KuwaharaFilterMultiTarget);
+	RDG_EVENT_SCOPE(GraphBuilder, "AnimeKuwaharaFilter MultiTarget");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, AnimepoyKuwaharaFilter);
+
+	// Only the groupshared table can be rebuilt per target to share the quadrant, so larger windows are clamped.
+	const int32 FilterSize = FMath::Min(Inputs.FilterSize, GMaxCachedFilterSize);
+
+	FGlobalShaderMap* ShaderMap = GetGlobalShaderMap(GMaxRHIFeatureLevel);
+	FScreenPassTextureViewport Viewport(GetBatchedViewRect(View.ViewRect, Inputs.BatchedViewRects));
+
+	FKuwaharaFilterMultiTargetCS::FPermutationDomain PermutationVector{};
+	PermutationVector.Set<FFilterBaseColor>(Inputs.BaseColor != nullptr);
+	PermutationVector.Set<FFilterNormal>(Inputs.Normal != nullptr);
+	PermutationVector.Set<FFilterMaterial>(Inputs.Material != nullptr);
+	PermutationVector.Set<FWaveIntrinsics>(UseWaveIntrinsics(View.GetShaderPlatform()));
+
+	// The G-buffer is not guaranteed to be UAV compatible, so the filter writes view sized textures that are resolved afterwards.
+	const FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(Viewport.Rect.Size(), GMultiTargetPixelFormat, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
+	FRDGTextureRef FilteredBaseColor = Inputs.BaseColor ? GraphBuilder.CreateTexture(Desc, TEXT("KuwaharaFilterBaseColor")) : nullptr;
+	FRDGTextureRef FilteredNormal = Inputs.Normal ? GraphBuilder.CreateTexture(Desc, TEXT("KuwaharaFilterNormal")) : nullptr;
+	FRDGTextureRef FilteredMaterial = Inputs.Material ? GraphBuilder.CreateTexture(Desc, TEXT("KuwaharaFilterMaterial")) : nullptr;
 
-	if (bUseCompute)
 	{
-		FKuwaharaFilterCS::FParameters* Parameters = GraphBuilder.AllocParameters<FKuwaharaFilterCS::FParameters>();
+		FKuwaharaFilterMultiTargetCS::FParameters* Parameters = GraphBuilder.AllocParameters<FKuwaharaFilterMultiTargetCS::FParameters>();
+		Parameters->View = View.ViewUniformBuffer;
 		Parameters->Input = GetScreenPassTextureViewportParameters(Viewport);
-		Parameters->SummedAreaTableTexture = SummedAreaTable;
-		Parameters->FilterSize = Inputs.FilterSize;
-		Parameters->OutTexture = GraphBuilder.CreateUAV(Inputs.Target);
+		Parameters->BaseColorTexture = Inputs.BaseColor;
+		Parameters->NormalTexture = Inputs.Normal;
+		Parameters->MaterialTexture = Inputs.Material;
+		Parameters->FilterSize = FilterSize;
+		Parameters->OutBaseColorTexture = FilteredBaseColor ? GraphBuilder.CreateUAV(FilteredBaseColor) : nullptr;
+		Parameters->OutNormalTexture = FilteredNormal ? GraphBuilder.CreateUAV(FilteredNormal) : nullptr;
+		Parameters->OutMaterialTexture = FilteredMaterial ? GraphBuilder.CreateUAV(FilteredMaterial) : nullptr;
+		Parameters->BatchedViews = GetBatchedViewParameters(Inputs.BatchedViewRects);
 
 		FComputeShaderUtils::AddPass(
 			GraphBuilder,
-			RDG_EVENT_NAME("KuwaharaFilterCS"),
-			TShaderMapRef<FKuwaharaFilterCS>(ShaderMap, PermutationVector),
+			RDG_EVENT_NAME("KuwaharaFilterMultiTargetCS"),
+			TShaderMapRef<FKuwaharaFilterMultiTargetCS>(ShaderMap, PermutationVector),
 			Parameters,
 			FComputeShaderUtils::GetGroupCount(Viewport.Rect.Size(), FIntPoint(16, 16))
 		);
 	}
-	else
+
+	const TPair<FRDGTextureRef, FRDGTextureRef> Resolves[] = {
+		{ FilteredBaseColor, Inputs.BaseColor },
+		{ FilteredNormal, Inputs.Normal },
+		{ FilteredMaterial, Inputs.Material },
+	};
+
+	for (const TPair<FRDGTextureRef, FRDGTextureRef>& Resolve : Resolves)
 	{
-		FKuwaharaFilterPS::FParameters* Parameters = GraphBuilder.AllocParameters<FKuwaharaFilterPS::FParameters>();
+		if (!Resolve.Key)
+		{
+			continue;
+		}
+
+		FKuwaharaFilterMultiTargetResolvePS::FParameters* Parameters = GraphBuilder.AllocParameters<FKuwaharaFilterMultiTargetResolvePS::FParameters>();
 		Parameters->Input = GetScreenPassTextureViewportParameters(Viewport);
-		Parameters->SummedAreaTableTexture = SummedAreaTable;
-		Parameters->FilterSize = Inputs.FilterSize;
-		Parameters->RenderTargets[0] = FRenderTargetBinding(Inputs.Target, ERenderTargetLoadAction::ELoad);
+		Parameters->FilteredTexture = Resolve.Key;
+		Parameters->RenderTargets[0] = FRenderTargetBinding(Resolve.Value, ERenderTargetLoadAction::ELoad);
 
 		FPixelShaderUtils::AddFullscreenPass(
 			GraphBuilder,
 			ShaderMap,
-			RDG_EVENT_NAME("KuwaharaFilterPS"),
-			TShaderMapRef<FKuwaharaFilterPS>(ShaderMap, PermutationVector),
+			RDG_EVENT_NAME("KuwaharaFilterMultiTargetResolvePS %s", Resolve.Value->Name),
+			TShaderMapRef<FKuwaharaFilterMultiTargetResolvePS>(ShaderMap),
 			Parameters,
 			Viewport.Rect,
 			TStaticBlendState<CW_RGB>::GetRHI());
 	}
 }
+
+void PrecacheKuwaharaFilterPipelines(FAnimepoyPipelinePrecache& Precache)
+{
+	Precache.AddComputeShaders<FKuwaharaFilterSetupCS>();
+	Precache.AddComputeShaders<FKuwaharaFilterPrefixCS>();
+	Precache.AddComputeShaders<FKuwaharaFilterCS>();
+	Precache.AddComputeShaders<FKuwaharaFilterMultiTargetCS>();
+	Precache.AddComputeShaders<FKuwaharaFilterDownsampleCS>();
+
+	// Scene color is the only target whose format is known ahead, the G-buffer resolve is created on first use.
+	const FGlobalShaderMap* ShaderMap = Precache.GetShaderMap();
+	FRHIBlendState* BlendState = TStaticBlendState<CW_RGB>::GetRHI();
+
+	for (const bool bHierarchical : { false, true })
+	{
+		FKuwaharaFilterPS::FPermutationDomain PermutationVector{};
+		PermutationVector.Set<FValueType>(EValueType::Color);
+		PermutationVector.Set<FHierarchicalSummedAreaTable>(bHierarchical);
+		Precache.AddFullscreenPass(TShaderMapRef<FKuwaharaFilterPS>(ShaderMap, PermutationVector), BlendState, Precache.GetSceneColorFormat(), Precache.GetSceneColorFlags());
+	}
+
+	FCommonDomain PermutationVector{};
+	PermutationVector.Set<FValueType>(EValueType::Color);
+	Precache.AddFullscreenPass(TShaderMapRef<FKuwaharaFilterUpsamplePS>(ShaderMap, PermutationVector), BlendState, Precache.GetSceneColorFormat(), Precache.GetSceneColorFlags());
+}
@@ -2,6 +2,7 @@
 #pragma once
 
 #include "ScreenPass.h"
+#include "AnimepoyBatchedViews.h"
 
 enum class EKuwaharaFilterTargetType
 {
@@ -16,6 +17,30 @@ struct FKuwaharaFilterInputs
 	FRDGTextureRef Target;
 	EKuwaharaFilterTargetType TargetType;
 	int32 FilterSize;
+
+	// Filters at 1/DownsampleFactor resolution and upsamples guided by SceneDepth. Needs SceneDepth.
+	int32 DownsampleFactor = 1;
+	FRDGTextureRef SceneDepth = nullptr;
+
+	// Filters these views of the family in one pass instead of View alone. Full resolution only.
+	FBatchedViewRects BatchedViewRects;
 };
 
 void AddKuwaharaFilterPass(FRDGBuilder& GraphBuilder, const FViewInfo& View, const FKuwaharaFilterInputs& Inputs);
+
+struct FKuwaharaFilterMultiTargetInputs
+{
+	// G-buffer targets to filter, null targets are skipped.
+	FRDGTextureRef BaseColor = nullptr;
+	FRDGTextureRef Normal = nullptr;
+	FRDGTextureRef Material = nullptr;
+	// At most 7, larger sizes are clamped.
+	int32 FilterSize;
+
+	// Filters these views of the family in one pass instead of View alone.
+	FBatchedViewRects BatchedViewRects;
+};
+
+// Filters several G-buffer targets with the quadrant of minimum total variance shared between them.
+// Each target adds its variance relative to its own total, so no target outweighs the others by its units.
+void AddKuwaharaFilterMultiTargetPass(FRDGBuilder& GraphBuilder, const FViewInfo& View, const FKuwaharaFilterMultiTargetInputs& Inputs);
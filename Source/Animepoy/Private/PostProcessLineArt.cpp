@@ -1,174 +1,585 @@
-#include "PostProcessLineArt.h"
-#include "ShaderCompiler.h"
-#include "SceneRendering.h"
-#include "SceneTextureParameters.h"
-#include "Substrate/Substrate.h"
-#include "PixelShaderUtils.h"
-
-namespace {
-	class FDetectLineCS : public FGlobalShader
-	{
-	public:
-		DECLARE_GLOBAL_SHADER(FDetectLineCS);
-		SHADER_USE_PARAMETER_STRUCT(FDetectLineCS, FGlobalShader);
-
-		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
-			SHADER_PARAMETER_STRUCT_REF(FViewUniformShaderParameters, View)
-			SHADER_PARAMETER_STRUCT_INCLUDE(FSceneTextureShaderParameters, SceneTextures)
-			SHADER_PARAMETER_RDG_UNIFORM_BUFFER(FSubstrateGlobalUniformParameters, Substrate)
-			SHADER_PARAMETER_STRUCT(FScreenPassTextureViewportParameters, Input)
-			SHADER_PARAMETER(float, MaterialThreshold)
-			SHADER_PARAMETER(float, DepthThreshold)
-			SHADER_PARAMETER(float, NormalThreshold)
-			SHADER_PARAMETER(float, PlanarThreshold)
-			SHADER_PARAMETER(float, NonLineSpecular)
-			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D, OutLineTexture)
-			END_SHADER_PARAMETER_STRUCT()
-	};
-
-	IMPLEMENT_GLOBAL_SHADER(FDetectLineCS, "/AnimepoyShaders/Private/PostProcessLineArt.usf", "DetectLineCS", SF_Compute);
-
-	class FCompositeLinePS : public FGlobalShader
-	{
-	public:
-		DECLARE_GLOBAL_SHADER(FCompositeLinePS);
-		SHADER_USE_PARAMETER_STRUCT(FCompositeLinePS, FGlobalShader);
-
-		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
-			SHADER_PARAMETER_STRUCT_REF(FViewUniformShaderParameters, View)
-			SHADER_PARAMETER_STRUCT(FScreenPassTextureViewportParameters, Input)
-			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, LineTexture)
-			SHADER_PARAMETER(FVector4f, LineColor)
-			SHADER_PARAMETER(int, LineWidth)
-			SHADER_PARAMETER(int, SearchRangeMin)
-			SHADER_PARAMETER(int, SearchRangeMax)
-			RENDER_TARGET_BINDING_SLOTS()
-			END_SHADER_PARAMETER_STRUCT()
-	};
-
-	IMPLEMENT_GLOBAL_SHADER(FCompositeLinePS, "/AnimepoyShaders/Private/PostProcessLineArt.usf", "CompositeLinePS", SF_Pixel);
-
-	class FClearSceneColorAndGBufferPS : public FGlobalShader
-	{
-	public:
-		DECLARE_GLOBAL_SHADER(FClearSceneColorAndGBufferPS);
-		SHADER_USE_PARAMETER_STRUCT(FClearSceneColorAndGBufferPS, FGlobalShader);
-
-		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
-			RENDER_TARGET_BINDING_SLOTS()
-			END_SHADER_PARAMETER_STRUCT()
-	};
-
-	IMPLEMENT_GLOBAL_SHADER(FClearSceneColorAndGBufferPS, "/AnimepoyShaders/Private/PostProcessLineArt.usf", "ClearSceneColorAndGBufferPS", SF_Pixel);
-}
-
-namespace
-{
-	static TAutoConsoleVariable<int32> CVarSubstrate(
-		TEXT("r.Substrate"),
-		0,
-		TEXT("Enable Substrate materials (Beta)."),
-		ECVF_ReadOnly | ECVF_RenderThreadSafe);
-
-	bool IsSubstrateEnabled()
-	{
-		return CVarSubstrate.GetValueOnAnyThread() > 0;
-	}
-
-	TRDGUniformBufferRef<FSubstrateGlobalUniformParameters> BindSubstrateGlobalUniformParameters(const FViewInfo& View)
-	{
-		check(View.SubstrateViewData.SubstrateGlobalUniformParameters != nullptr || !IsSubstrateEnabled());
-		return View.SubstrateViewData.SubstrateGlobalUniformParameters;
-	}
-}
-
-void AddLineArtPass(FRDGBuilder& GraphBuilder, const FViewInfo& View, const FLineArtPassInputs& Inputs)
-{
-	FGlobalShaderMap* ShaderMap = GetGlobalShaderMap(GMaxRHIFeatureLevel);
-	FScreenPassTextureViewport Viewport = FScreenPassTextureViewport(View.ViewRect);
-
-	FScreenPassTexture SceneColor((*Inputs.SceneTextures)->SceneColorTexture, View.ViewRect);
-	FScreenPassTexture SceneDepth((*Inputs.SceneTextures)->SceneDepthTexture, View.ViewRect);
-
-	FRDGTextureRef LineTexture{};
-	{
-		RDG_EVENT_SCOPE(GraphBuilder, "PostProcessLineDetection");
-
-		FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(Viewport.Extent, PF_R32_UINT, FClearValueBinding::Black, TexCreate_ShaderResource | TexCreate_UAV);
-		LineTexture = GraphBuilder.CreateTexture(Desc, TEXT("LineTexture"));
-
-		FRDGTextureUAVRef LineTextureUAV = GraphBuilder.CreateUAV(LineTexture);
-		AddClearUAVPass(GraphBuilder, LineTextureUAV, (uint32)0);
-
-		FDetectLineCS::FParameters* Parameters = GraphBuilder.AllocParameters<FDetectLineCS::FParameters>();
-		Parameters->View = View.ViewUniformBuffer;
-		Parameters->SceneTextures = GetSceneTextureShaderParameters(Inputs.SceneTextures);
-		Parameters->Substrate = BindSubstrateGlobalUniformParameters(View);
-		Parameters->Input = GetScreenPassTextureViewportParameters(Viewport);
-		Parameters->MaterialThreshold = FMath::Lerp(2.f, 0.f, Inputs.MaterialLineIntensity);
-		Parameters->DepthThreshold = FMath::Lerp(Inputs.DepthLineIntensity == 0.f ? 1.f : 0.01f, 0.f, Inputs.DepthLineIntensity);
-		Parameters->NormalThreshold = FMath::Lerp(-1.f, 1.f, Inputs.NormalLineIntensity);
-		Parameters->PlanarThreshold = FMath::Lerp(1.f, 0.f, Inputs.PlanarLineIntensity);
-		Parameters->NonLineSpecular = static_cast<int>(255.f * Inputs.NonLineSpecular) / 255.f;
-		Parameters->OutLineTexture = LineTextureUAV;
-
-		TShaderMapRef<FDetectLineCS> ComputeShader(ShaderMap);
-		FComputeShaderUtils::AddPass(
-			GraphBuilder,
-			RDG_EVENT_NAME("DetectLineCS"),
-			ComputeShader,
-			Parameters,
-			FComputeShaderUtils::GetGroupCount(Viewport.Rect.Size(), FIntPoint(8, 8)));
-	}
-
-	if (Inputs.bPreview)
-	{
-		RDG_EVENT_SCOPE(GraphBuilder, "PostProcessLineComposite Preview");
-
-		FClearSceneColorAndGBufferPS::FParameters* Parameters = GraphBuilder.AllocParameters<FClearSceneColorAndGBufferPS::FParameters>();
-		Parameters->RenderTargets[0] = FRenderTargetBinding(SceneColor.Texture, ERenderTargetLoadAction::ENoAction);
-
-		FRHIBlendState* BlendState = TStaticBlendState<
-			CW_RGB, BO_Add, BF_One, BF_Zero, BO_Add, BF_One, BF_Zero,
-			CW_ALPHA
-		>::GetRHI();
-
-		FPixelShaderUtils::AddFullscreenPass(
-			GraphBuilder,
-			ShaderMap,
-			RDG_EVENT_NAME("ClearSceneColorPS"),
-			TShaderMapRef<FClearSceneColorAndGBufferPS>(ShaderMap),
-			Parameters,
-			Viewport.Rect,
-			BlendState);
-	}
-
-	{
-		RDG_EVENT_SCOPE(GraphBuilder, "PostProcessLineComposite");
-
-		FCompositeLinePS::FParameters* Parameters = GraphBuilder.AllocParameters<FCompositeLinePS::FParameters>();
-		Parameters->View = View.ViewUniformBuffer;
-		Parameters->Input = GetScreenPassTextureViewportParameters(Viewport);
-		Parameters->LineTexture = LineTexture;
-		Parameters->LineColor = Inputs.LineColor;
-		Parameters->LineWidth = Inputs.LineWidth * Inputs.LineWidth;
-		Parameters->SearchRangeMin = -(Inputs.LineWidth / 2);
-		Parameters->SearchRangeMax = (Inputs.LineWidth - 1) / 2;
-		Parameters->RenderTargets[0] = FRenderTargetBinding(SceneColor.Texture, ERenderTargetLoadAction::ELoad);
-		Parameters->RenderTargets.DepthStencil = FDepthStencilBinding(SceneDepth.Texture, ERenderTargetLoadAction::ELoad, FExclusiveDepthStencil::DepthWrite_StencilNop);
-
-		FRHIBlendState* BlendState = TStaticBlendState<CW_RGB, BO_Add, BF_DestColor, BF_InverseSourceAlpha>::GetRHI();
-		FRHIDepthStencilState* DepthStencilState = TStaticDepthStencilState<true, CF_Always>::GetRHI();
-
-		FPixelShaderUtils::AddFullscreenPass(
-			GraphBuilder,
-			ShaderMap,
-			RDG_EVENT_NAME("CompositeLinePS"),
-			TShaderMapRef<FCompositeLinePS>(ShaderMap),
-			Parameters,
-			Viewport.Rect,
-			BlendState,
-			nullptr,
-			DepthStencilState);
-	}
-}
\ No newline at end of file
+#include "PostProcessLineArt.h"
+#include "ShaderCompiler.h"
+#include "SceneRendering.h"
+#include "SceneTextureParameters.h"
+#include "Substrate/Substrate.h"
+#include "PixelShaderUtils.h"
+#include "RenderGraphUtils.h"
+#include "RHIGPUReadback.h"
+#include "CommonRenderResources.h"
+#include "SystemTextures.h"
+#include "AnimepoyStats.h"
+#include "AnimepoyPipelinePrecache.h"
+#include "AnimepoySubstrate.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Line Art Tiles"), STAT_AnimepoyLineArtTiles, STATGROUP_Animepoy);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Line Art Active Tiles"), STAT_AnimepoyLineArtActiveTiles, STATGROUP_Animepoy);
+DECLARE_CYCLE_STAT(TEXT("Line Art"), STAT_AnimepoyLineArt, STATGROUP_Animepoy);
+DECLARE_GPU_STAT_NAMED(AnimepoyLineArt, TEXT("Animepoy Line Art"));
+
+namespace {
+	class FJumpFlood : SHADER_PERMUTATION_BOOL("USE_JUMP_FLOOD");
+	class FLineHistory : SHADER_PERMUTATION_BOOL("USE_LINE_HISTORY");
+
+	static TAutoConsoleVariable<int32> CVarLineArtAmortize(
+		TEXT("r.Animepoy.LineArt.Amortize"),
+		0,
+		TEXT("Detects lines on half of the tiles each frame and reprojects last frame's lines for the rest.\n")
+		TEXT(" 0: detect every tile every frame (default)\n")
+		TEXT(" 1: amortize over two frames"),
+		ECVF_RenderThreadSafe);
+
+	static TAutoConsoleVariable<int32> CVarLineArtJumpFloodWidth(
+		TEXT("r.Animepoy.LineArt.JumpFloodWidth"),
+		8,
+		TEXT("Line widths from this value up are dilated with a jump flood instead of searching every pixel in the line width.\n")
+		TEXT(" 0: always search"),
+		ECVF_RenderThreadSafe);
+
+	class FDetectLineCS : public FGlobalShader
+	{
+	public:
+		DECLARE_GLOBAL_SHADER(FDetectLineCS);
+		SHADER_USE_PARAMETER_STRUCT(FDetectLineCS, FGlobalShader);
+
+		using FPermutationDomain = TShaderPermutationDomain<FLineHistory>;
+
+		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER_STRUCT_REF(FViewUniformShaderParameters, View)
+			SHADER_PARAMETER_STRUCT_INCLUDE(FSceneTextureShaderParameters, SceneTextures)
+			SHADER_PARAMETER_RDG_UNIFORM_BUFFER(FSubstrateGlobalUniformParameters, Substrate)
+			SHADER_PARAMETER_STRUCT(FScreenPassTextureViewportParameters, Input)
+			SHADER_PARAMETER(float, MaterialThreshold)
+			SHADER_PARAMETER(float, DepthThreshold)
+			SHADER_PARAMETER(float, NormalThreshold)
+			SHADER_PARAMETER(float, PlanarThreshold)
+			SHADER_PARAMETER(float, NonLineSpecular)
+			SHADER_PARAMETER(int, SearchRangeMin)
+			SHADER_PARAMETER(int, SearchRangeMax)
+			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D, OutLineTexture)
+			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D, OutLineTileMask)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, LineHistoryTexture)
+			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D, OutLineHistory)
+			SHADER_PARAMETER(uint32, LineHistoryFrameIndex)
+			SHADER_PARAMETER(int, LineHistoryValid)
+			SHADER_PARAMETER_STRUCT_INCLUDE(FBatchedViewParameters, BatchedViews)
+			END_SHADER_PARAMETER_STRUCT()
+	};
+
+	IMPLEMENT_GLOBAL_SHADER(FDetectLineCS, "/AnimepoyShaders/Private/PostProcessLineArt.usf", "DetectLineCS", SF_Compute);
+
+	class FBuildLineTileListCS : public FGlobalShader
+	{
+	public:
+		DECLARE_GLOBAL_SHADER(FBuildLineTileListCS);
+		SHADER_USE_PARAMETER_STRUCT(FBuildLineTileListCS, FGlobalShader);
+
+		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER(FIntPoint, LineTileCount)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, LineTileMask)
+			SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, RWLineTileList)
+			SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, RWLineTileIndirectArgs)
+			END_SHADER_PARAMETER_STRUCT()
+	};
+
+	IMPLEMENT_GLOBAL_SHADER(FBuildLineTileListCS, "/AnimepoyShaders/Private/PostProcessLineArt.usf", "BuildLineTileListCS", SF_Compute);
+
+	class FJumpFloodInitCS : public FGlobalShader
+	{
+	public:
+		DECLARE_GLOBAL_SHADER(FJumpFloodInitCS);
+		SHADER_USE_PARAMETER_STRUCT(FJumpFloodInitCS, FGlobalShader);
+
+		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER_STRUCT(FScreenPassTextureViewportParameters, Input)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, LineTexture)
+			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D, RWLineSeedTexture)
+			END_SHADER_PARAMETER_STRUCT()
+	};
+
+	IMPLEMENT_GLOBAL_SHADER(FJumpFloodInitCS, "/AnimepoyShaders/Private/PostProcessLineArt.usf", "JumpFloodInitCS", SF_Compute);
+
+	class FJumpFloodCS : public FGlobalShader
+	{
+	public:
+		DECLARE_GLOBAL_SHADER(FJumpFloodCS);
+		SHADER_USE_PARAMETER_STRUCT(FJumpFloodCS, FGlobalShader);
+
+		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER_STRUCT(FScreenPassTextureViewportParameters, Input)
+			SHADER_PARAMETER(int, JumpFloodStep)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, LineSeedTexture)
+			SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D, RWLineSeedTexture)
+			SHADER_PARAMETER_STRUCT_INCLUDE(FBatchedViewParameters, BatchedViews)
+			END_SHADER_PARAMETER_STRUCT()
+	};
+
+	IMPLEMENT_GLOBAL_SHADER(FJumpFloodCS, "/AnimepoyShaders/Private/PostProcessLineArt.usf", "JumpFloodCS", SF_Compute);
+
+	class FCompositeLineTileVS : public FGlobalShader
+	{
+	public:
+		DECLARE_GLOBAL_SHADER(FCompositeLineTileVS);
+		SHADER_USE_PARAMETER_STRUCT(FCompositeLineTileVS, FGlobalShader);
+
+		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER_STRUCT(FScreenPassTextureViewportParameters, Input)
+			SHADER_PARAMETER_RDG_BUFFER_SRV(Buffer<uint>, LineTileList)
+			END_SHADER_PARAMETER_STRUCT()
+	};
+
+	IMPLEMENT_GLOBAL_SHADER(FCompositeLineTileVS, "/AnimepoyShaders/Private/PostProcessLineArt.usf", "CompositeLineTileVS", SF_Vertex);
+
+	class FCompositeLinePS : public FGlobalShader
+	{
+	public:
+		DECLARE_GLOBAL_SHADER(FCompositeLinePS);
+		SHADER_USE_PARAMETER_STRUCT(FCompositeLinePS, FGlobalShader);
+
+		using FPermutationDomain = TShaderPermutationDomain<FJumpFlood>;
+
+		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			SHADER_PARAMETER_STRUCT_REF(FViewUniformShaderParameters, View)
+			SHADER_PARAMETER_STRUCT(FScreenPassTextureViewportParameters, Input)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, LineTexture)
+			SHADER_PARAMETER_RDG_TEXTURE(Texture2D, LineSeedTexture)
+			SHADER_PARAMETER(FVector4f, LineColor)
+			SHADER_PARAMETER(int, LineWidth)
+			SHADER_PARAMETER(int, SearchRangeMin)
+			SHADER_PARAMETER(int, SearchRangeMax)
+			SHADER_PARAMETER_STRUCT_INCLUDE(FBatchedViewParameters, BatchedViews)
+			END_SHADER_PARAMETER_STRUCT()
+	};
+
+	IMPLEMENT_GLOBAL_SHADER(FCompositeLinePS, "/AnimepoyShaders/Private/PostProcessLineArt.usf", "CompositeLinePS", SF_Pixel);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FCompositeLineTileParameters, )
+		SHADER_PARAMETER_STRUCT_INCLUDE(FCompositeLineTileVS::FParameters, VS)
+		SHADER_PARAMETER_STRUCT_INCLUDE(FCompositeLinePS::FParameters, PS)
+		RDG_BUFFER_ACCESS(IndirectArgs, ERHIAccess::IndirectArgs)
+		RENDER_TARGET_BINDING_SLOTS()
+	END_SHADER_PARAMETER_STRUCT()
+
+	class FClearSceneColorAndGBufferPS : public FGlobalShader
+	{
+	public:
+		DECLARE_GLOBAL_SHADER(FClearSceneColorAndGBufferPS);
+		SHADER_USE_PARAMETER_STRUCT(FClearSceneColorAndGBufferPS, FGlobalShader);
+
+		BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+			RENDER_TARGET_BINDING_SLOTS()
+			END_SHADER_PARAMETER_STRUCT()
+	};
+
+	IMPLEMENT_GLOBAL_SHADER(FClearSceneColorAndGBufferPS, "/AnimepoyShaders/Private/PostProcessLineArt.usf", "ClearSceneColorAndGBufferPS", SF_Pixel);
+}
+
+namespace
+{
+	TRDGUniformBufferRef<FSubstrateGlobalUniformParameters> BindSubstrateGlobalUniformParameters(const FViewInfo& View)
+	{
+		check(View.SubstrateViewData.SubstrateGlobalUniformParameters != nullptr || !IsSubstrateEnabled());
+		return View.SubstrateViewData.SubstrateGlobalUniformParameters;
+	}
+
+	// Matches LINE_TILE_SIZE.
+	constexpr int32 GLineTileSize = 8;
+
+	// Reads the instance count of the composite draw back a few frames late for STAT_AnimepoyLineArtActiveTiles.
+	class FLineTileReadback : public FRenderResource
+	{
+	public:
+		void Enqueue(FRDGBuilder& GraphBuilder, FRDGBufferRef IndirectArgs)
+		{
+			while (NumPending > 0)
+			{
+				FRHIGPUBufferReadback* Readback = Readbacks[(WriteIndex + MaxPending - NumPending) % MaxPending].Get();
+				if (!Readback->IsReady())
+				{
+					break;
+				}
+
+				const FRHIDrawIndirectParameters* Args = static_cast<const FRHIDrawIndirectParameters*>(Readback->Lock(sizeof(FRHIDrawIndirectParameters)));
+				ActiveTiles = Args->InstanceCount;
+				Readback->Unlock();
+				--NumPending;
+			}
+
+			SET_DWORD_STAT(STAT_AnimepoyLineArtActiveTiles, ActiveTiles);
+
+			if (NumPending < MaxPending)
+			{
+				TUniquePtr<FRHIGPUBufferReadback>& Readback = Readbacks[WriteIndex];
+				if (!Readback)
+				{
+					Readback = MakeUnique<FRHIGPUBufferReadback>(TEXT("LineTileReadback"));
+				}
+				AddEnqueueCopyPass(GraphBuilder, Readback.Get(), IndirectArgs, sizeof(FRHIDrawIndirectParameters));
+				WriteIndex = (WriteIndex + 1) % MaxPending;
+				++NumPending;
+			}
+		}
+
+		virtual void ReleaseRHI() override
+		{
+			for (TUniquePtr<FRHIGPUBufferReadback>& Readback : Readbacks)
+			{
+				Readback.Reset();
+			}
+			WriteIndex = 0;
+			NumPending = 0;
+		}
+
+	private:
+		static constexpr int32 MaxPending = 4;
+		TUniquePtr<FRHIGPUBufferReadback> Readbacks[MaxPending];
+		int32 WriteIndex = 0;
+		int32 NumPending = 0;
+		uint32 ActiveTiles = 0;
+	};
+
+	TGlobalResource<FLineTileReadback> GLineTileReadback;
+}
+
+FLineArtThresholds GetLineArtThresholds(const FLineArtPassInputs& Inputs)
+{
+	FLineArtThresholds Thresholds;
+	Thresholds.MaterialThreshold = FMath::Lerp(2.f, 0.f, Inputs.MaterialLineIntensity);
+	Thresholds.DepthThreshold = FMath::Lerp(Inputs.DepthLineIntensity == 0.f ? 1.f : 0.01f, 0.f, Inputs.DepthLineIntensity);
+	Thresholds.NormalThreshold = FMath::Lerp(-1.f, 1.f, Inputs.NormalLineIntensity);
+	Thresholds.PlanarThreshold = FMath::Lerp(1.f, 0.f, Inputs.PlanarLineIntensity);
+	Thresholds.NonLineSpecular = static_cast<int>(255.f * Inputs.NonLineSpecular) / 255.f;
+	Thresholds.SearchRangeMin = -(Inputs.LineWidth / 2);
+	Thresholds.SearchRangeMax = (Inputs.LineWidth - 1) / 2;
+	Thresholds.LineWidth2 = Inputs.LineWidth * Inputs.LineWidth;
+	return Thresholds;
+}
+
+bool IsLineArtAmortized(bool bAmortize)
+{
+	return bAmortize || CVarLineArtAmortize.GetValueOnRenderThread() != 0;
+}
+
+FLineArtDetection AddLineArtDetectionPass(FRDGBuilder& GraphBuilder, const FViewInfo& View, const FLineArtPassInputs& Inputs)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AnimepoyLineArt);
+	CSV_SCOPED_TIMING_STAT(Animepoy, LineArt);
+	RDG_EVENT_SCOPE(GraphBuilder, "AnimeLineArt");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, AnimepoyLineArt);
+
+	FGlobalShaderMap* ShaderMap = GetGlobalShaderMap(GMaxRHIFeatureLevel);
+	FScreenPassTextureViewport Viewport = FScreenPassTextureViewport(GetBatchedViewRect(View.ViewRect, Inputs.BatchedViewRects));
+	const FBatchedViewParameters BatchedViews = GetBatchedViewParameters(Inputs.BatchedViewRects);
+
+	const FLineArtThresholds Thresholds = GetLineArtThresholds(Inputs);
+	const FIntPoint LineTileCount = FIntPoint::DivideAndRoundUp(Viewport.Rect.Size(), GLineTileSize);
+	const ERDGPassFlags PassFlags = Inputs.bAsyncCompute ? ERDGPassFlags::AsyncCompute : ERDGPassFlags::Compute;
+
+	FLineArtDetection Detection;
+	{
+		RDG_EVENT_SCOPE(GraphBuilder, "PostProcessLineDetection");
+
+		// DetectLineCS writes every pixel of the viewport.
+		FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(Viewport.Extent, PF_R16_UINT, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
+		Detection.LineTexture = GraphBuilder.CreateTexture(Desc, TEXT("LineTexture"));
+		AddAnimepoyTransientTexture(EAnimepoyTransientTexture::LineTexture, Desc);
+
+		FRDGTextureUAVRef LineTextureUAV = GraphBuilder.CreateUAV(Detection.LineTexture);
+
+		FRDGTextureDesc TileMaskDesc = FRDGTextureDesc::Create2D(LineTileCount, PF_R8_UINT, FClearValueBinding::Black, TexCreate_ShaderResource | TexCreate_UAV);
+		Detection.LineTileMask = GraphBuilder.CreateTexture(TileMaskDesc, TEXT("LineTileMask"));
+
+		// On the queue of DetectLineCS, so the async queue does not wait on the graphics queue for it.
+		FRDGTextureUAVRef LineTileMaskUAV = GraphBuilder.CreateUAV(Detection.LineTileMask);
+		AddClearUAVPass(GraphBuilder, PassFlags, LineTileMaskUAV, (uint32)0);
+
+		// The graph treats every texture of the uniform buffer as read, so the scene color, which the detection never samples,
+		// is swapped for a dummy. Otherwise the passes writing it would wait for the async detection to finish.
+		TRDGUniformBufferRef<FSceneTextureUniformParameters> SceneTextures = Inputs.SceneTextures;
+		if (Inputs.bAsyncCompute)
+		{
+			FSceneTextureUniformParameters* SceneTextureParameters = GraphBuilder.AllocParameters<FSceneTextureUniformParameters>();
+			*SceneTextureParameters = *Inputs.SceneTextures->GetContents();
+			SceneTextureParameters->SceneColorTexture = GSystemTextures.GetBlackDummy(GraphBuilder);
+			SceneTextures = GraphBuilder.CreateUniformBuffer(SceneTextureParameters);
+		}
+
+		FDetectLineCS::FParameters* Parameters = GraphBuilder.AllocParameters<FDetectLineCS::FParameters>();
+		Parameters->View = View.ViewUniformBuffer;
+		Parameters->SceneTextures = GetSceneTextureShaderParameters(SceneTextures);
+		Parameters->Substrate = BindSubstrateGlobalUniformParameters(View);
+		Parameters->Input = GetScreenPassTextureViewportParameters(Viewport);
+		Parameters->MaterialThreshold = Thresholds.MaterialThreshold;
+		Parameters->DepthThreshold = Thresholds.DepthThreshold;
+		Parameters->NormalThreshold = Thresholds.NormalThreshold;
+		Parameters->PlanarThreshold = Thresholds.PlanarThreshold;
+		Parameters->NonLineSpecular = Thresholds.NonLineSpecular;
+		Parameters->SearchRangeMin = Thresholds.SearchRangeMin;
+		Parameters->SearchRangeMax = Thresholds.SearchRangeMax;
+		Parameters->OutLineTexture = LineTextureUAV;
+		Parameters->OutLineTileMask = LineTileMaskUAV;
+		Parameters->BatchedViews = BatchedViews;
+
+		// The reprojection needs the matrices of a single view.
+		const bool bAmortize = Inputs.History != nullptr && Inputs.BatchedViewRects.IsEmpty() && Inputs.bAmortize;
+		if (bAmortize)
+		{
+			FLineArtHistory& History = *Inputs.History;
+			const bool bHistoryValid = History.LineHistory.IsValid() && History.ViewRect == View.ViewRect && History.LineHistory->GetDesc().Extent == Viewport.Extent;
+
+			FRDGTextureDesc HistoryDesc = FRDGTextureDesc::Create2D(Viewport.Extent, PF_R16G16_UINT, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
+			FRDGTextureRef LineHistory = GraphBuilder.CreateTexture(HistoryDesc, TEXT("LineHistory"));
+
+			Parameters->LineHistoryTexture = bHistoryValid ? GraphBuilder.RegisterExternalTexture(History.LineHistory) : GSystemTextures.GetZeroUIntDummy(GraphBuilder);
+			Parameters->OutLineHistory = GraphBuilder.CreateUAV(LineHistory);
+			Parameters->LineHistoryFrameIndex = History.FrameIndex++;
+			Parameters->LineHistoryValid = bHistoryValid ? 1 : 0;
+
+			GraphBuilder.QueueTextureExtraction(LineHistory, &History.LineHistory);
+			History.ViewRect = View.ViewRect;
+		}
+		else if (Inputs.History)
+		{
+			Inputs.History->LineHistory.SafeRelease();
+		}
+
+		FDetectLineCS::FPermutationDomain PermutationVector;
+		PermutationVector.Set<FLineHistory>(bAmortize);
+
+		TShaderMapRef<FDetectLineCS> ComputeShader(ShaderMap, PermutationVector);
+		Detection.DetectPass = FComputeShaderUtils::AddPass(
+			GraphBuilder,
+			RDG_EVENT_NAME("DetectLineCS%s Views=%d", bAmortize ? TEXT(" Amortized") : TEXT(""), FMath::Max(Inputs.BatchedViewRects.Num(), 1)),
+			PassFlags,
+			ComputeShader,
+			Parameters,
+			FComputeShaderUtils::GetGroupCount(Viewport.Rect.Size(), FIntPoint(GLineTileSize, GLineTileSize)));
+	}
+
+	return Detection;
+}
+
+FLineArtCompositePasses AddLineArtCompositePass(FRDGBuilder& GraphBuilder, const FViewInfo& View, const FLineArtPassInputs& Inputs, const FLineArtDetection& Detection)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AnimepoyLineArt);
+	CSV_SCOPED_TIMING_STAT(Animepoy, LineArt);
+	RDG_EVENT_SCOPE(GraphBuilder, "AnimeLineArt");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, AnimepoyLineArt);
+
+	FGlobalShaderMap* ShaderMap = GetGlobalShaderMap(GMaxRHIFeatureLevel);
+	FScreenPassTextureViewport Viewport = FScreenPassTextureViewport(GetBatchedViewRect(View.ViewRect, Inputs.BatchedViewRects));
+	const FBatchedViewParameters BatchedViews = GetBatchedViewParameters(Inputs.BatchedViewRects);
+
+	FScreenPassTexture SceneColor((*Inputs.SceneTextures)->SceneColorTexture, Viewport.Rect);
+
+	const FLineArtThresholds Thresholds = GetLineArtThresholds(Inputs);
+	const int32 SearchRangeMin = Thresholds.SearchRangeMin;
+	const int32 SearchRangeMax = Thresholds.SearchRangeMax;
+	const FIntPoint LineTileCount = FIntPoint::DivideAndRoundUp(Viewport.Rect.Size(), GLineTileSize);
+	FRDGTextureRef LineTexture = Detection.LineTexture;
+
+	FLineArtCompositePasses Passes;
+	FRDGBufferRef LineTileList{};
+	FRDGBufferRef LineTileIndirectArgs{};
+	{
+		RDG_EVENT_SCOPE(GraphBuilder, "PostProcessLineTileClassification");
+
+		LineTileList = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateBufferDesc(sizeof(uint32), LineTileCount.X * LineTileCount.Y), TEXT("LineTileList"));
+		LineTileIndirectArgs = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateIndirectDesc<FRHIDrawIndirectParameters>(1), TEXT("LineTileIndirectArgs"));
+
+		FRDGBufferUAVRef LineTileIndirectArgsUAV = GraphBuilder.CreateUAV(LineTileIndirectArgs, PF_R32_UINT);
+		AddClearUAVPass(GraphBuilder, LineTileIndirectArgsUAV, 0u);
+
+		FBuildLineTileListCS::FParameters* Parameters = GraphBuilder.AllocParameters<FBuildLineTileListCS::FParameters>();
+		Parameters->LineTileCount = LineTileCount;
+		Parameters->LineTileMask = Detection.LineTileMask;
+		Parameters->RWLineTileList = GraphBuilder.CreateUAV(LineTileList, PF_R32_UINT);
+		Parameters->RWLineTileIndirectArgs = LineTileIndirectArgsUAV;
+
+		TShaderMapRef<FBuildLineTileListCS> ComputeShader(ShaderMap);
+		Passes.BuildLineTileListPass = FComputeShaderUtils::AddPass(
+			GraphBuilder,
+			RDG_EVENT_NAME("BuildLineTileListCS %dx%d", LineTileCount.X, LineTileCount.Y),
+			ComputeShader,
+			Parameters,
+			FComputeShaderUtils::GetGroupCount(LineTileCount, FIntPoint(8, 8)));
+
+		SET_DWORD_STAT(STAT_AnimepoyLineArtTiles, LineTileCount.X * LineTileCount.Y);
+#if STATS
+		GLineTileReadback.Enqueue(GraphBuilder, LineTileIndirectArgs);
+#endif // STATS
+	}
+
+	const int32 JumpFloodWidth = CVarLineArtJumpFloodWidth.GetValueOnRenderThread();
+	const bool bJumpFlood = JumpFloodWidth > 0 && Inputs.LineWidth >= JumpFloodWidth;
+
+	FRDGTextureRef LineSeedTexture{};
+	if (bJumpFlood)
+	{
+		RDG_EVENT_SCOPE(GraphBuilder, "PostProcessLineJumpFlood");
+
+		FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(Viewport.Extent, PF_R32_UINT, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
+		FRDGTextureRef SeedTextures[2] =
+		{
+			GraphBuilder.CreateTexture(Desc, TEXT("LineSeedTexture0")),
+			GraphBuilder.CreateTexture(Desc, TEXT("LineSeedTexture1")),
+		};
+
+		{
+			FJumpFloodInitCS::FParameters* Parameters = GraphBuilder.AllocParameters<FJumpFloodInitCS::FParameters>();
+			Parameters->Input = GetScreenPassTextureViewportParameters(Viewport);
+			Parameters->LineTexture = LineTexture;
+			Parameters->RWLineSeedTexture = GraphBuilder.CreateUAV(SeedTextures[0]);
+
+			TShaderMapRef<FJumpFloodInitCS> ComputeShader(ShaderMap);
+			FComputeShaderUtils::AddPass(
+				GraphBuilder,
+				RDG_EVENT_NAME("JumpFloodInitCS"),
+				ComputeShader,
+				Parameters,
+				FComputeShaderUtils::GetGroupCount(Viewport.Rect.Size(), FIntPoint(8, 8)));
+		}
+
+		// Steps from the search radius down to 1, plus one more step of 1 to fix most of its errors.
+		TArray<int32, TInlineAllocator<16>> Steps;
+		for (int32 Step = FMath::RoundDownToPowerOfTwo(FMath::Max(-SearchRangeMin, SearchRangeMax)); Step > 0; Step /= 2)
+		{
+			Steps.Add(Step);
+		}
+		Steps.Add(1);
+
+		int32 Source = 0;
+		for (int32 Step : Steps)
+		{
+			FJumpFloodCS::FParameters* Parameters = GraphBuilder.AllocParameters<FJumpFloodCS::FParameters>();
+			Parameters->Input = GetScreenPassTextureViewportParameters(Viewport);
+			Parameters->JumpFloodStep = Step;
+			Parameters->LineSeedTexture = SeedTextures[Source];
+			Parameters->RWLineSeedTexture = GraphBuilder.CreateUAV(SeedTextures[1 - Source]);
+			Parameters->BatchedViews = BatchedViews;
+
+			TShaderMapRef<FJumpFloodCS> ComputeShader(ShaderMap);
+			FComputeShaderUtils::AddPass(
+				GraphBuilder,
+				RDG_EVENT_NAME("JumpFloodCS Step=%d", Step),
+				ComputeShader,
+				Parameters,
+				FComputeShaderUtils::GetGroupCount(Viewport.Rect.Size(), FIntPoint(8, 8)));
+
+			Source = 1 - Source;
+		}
+
+		LineSeedTexture = SeedTextures[Source];
+	}
+
+	if (Inputs.bPreview)
+	{
+		RDG_EVENT_SCOPE(GraphBuilder, "PostProcessLineComposite Preview");
+
+		FClearSceneColorAndGBufferPS::FParameters* Parameters = GraphBuilder.AllocParameters<FClearSceneColorAndGBufferPS::FParameters>();
+		Parameters->RenderTargets[0] = FRenderTargetBinding(SceneColor.Texture, ERenderTargetLoadAction::ENoAction);
+
+		FRHIBlendState* BlendState = TStaticBlendState<
+			CW_RGB, BO_Add, BF_One, BF_Zero, BO_Add, BF_One, BF_Zero,
+			CW_ALPHA
+		>::GetRHI();
+
+		FPixelShaderUtils::AddFullscreenPass(
+			GraphBuilder,
+			ShaderMap,
+			RDG_EVENT_NAME("ClearSceneColorPS"),
+			TShaderMapRef<FClearSceneColorAndGBufferPS>(ShaderMap),
+			Parameters,
+			Viewport.Rect,
+			BlendState);
+	}
+
+	{
+		RDG_EVENT_SCOPE(GraphBuilder, "PostProcessLineComposite");
+
+		FCompositeLineTileParameters* Parameters = GraphBuilder.AllocParameters<FCompositeLineTileParameters>();
+		Parameters->VS.Input = GetScreenPassTextureViewportParameters(Viewport);
+		Parameters->VS.LineTileList = GraphBuilder.CreateSRV(LineTileList, PF_R32_UINT);
+		Parameters->PS.View = View.ViewUniformBuffer;
+		Parameters->PS.Input = GetScreenPassTextureViewportParameters(Viewport);
+		Parameters->PS.LineTexture = LineTexture;
+		Parameters->PS.LineSeedTexture = LineSeedTexture;
+		Parameters->PS.LineColor = Inputs.LineColor;
+		Parameters->PS.LineWidth = Thresholds.LineWidth2;
+		Parameters->PS.SearchRangeMin = SearchRangeMin;
+		Parameters->PS.SearchRangeMax = SearchRangeMax;
+		Parameters->PS.BatchedViews = BatchedViews;
+		Parameters->IndirectArgs = LineTileIndirectArgs;
+		Parameters->RenderTargets[0] = FRenderTargetBinding(SceneColor.Texture, ERenderTargetLoadAction::ELoad);
+
+		TShaderMapRef<FCompositeLineTileVS> VertexShader(ShaderMap);
+		FCompositeLinePS::FPermutationDomain PermutationVector;
+		PermutationVector.Set<FJumpFlood>(bJumpFlood);
+		TShaderMapRef<FCompositeLinePS> PixelShader(ShaderMap, PermutationVector);
+		const FIntRect ViewportRect = Viewport.Rect;
+
+		Passes.CompositePass = GraphBuilder.AddPass(
+			RDG_EVENT_NAME("CompositeLinePS"),
+			Parameters,
+			ERDGPassFlags::Raster,
+			[Parameters, VertexShader, PixelShader, ViewportRect](FRHICommandList& RHICmdList)
+			{
+				RHICmdList.SetViewport(ViewportRect.Min.X, ViewportRect.Min.Y, 0.f, ViewportRect.Max.X, ViewportRect.Max.Y, 1.f);
+
+				FGraphicsPipelineStateInitializer GraphicsPSOInit;
+				RHICmdList.ApplyCachedRenderTargets(GraphicsPSOInit);
+				GraphicsPSOInit.BlendState = TStaticBlendState<CW_RGB, BO_Add, BF_DestColor, BF_InverseSourceAlpha>::GetRHI();
+				GraphicsPSOInit.RasterizerState = TStaticRasterizerState<>::GetRHI();
+				GraphicsPSOInit.DepthStencilState = TStaticDepthStencilState<false, CF_Always>::GetRHI();
+				GraphicsPSOInit.BoundShaderState.VertexDeclarationRHI = GEmptyVertexDeclaration.VertexDeclarationRHI;
+				GraphicsPSOInit.BoundShaderState.VertexShaderRHI = VertexShader.GetVertexShader();
+				GraphicsPSOInit.BoundShaderState.PixelShaderRHI = PixelShader.GetPixelShader();
+				GraphicsPSOInit.PrimitiveType = PT_TriangleList;
+				SetGraphicsPipelineState(RHICmdList, GraphicsPSOInit, 0);
+
+				SetShaderParameters(RHICmdList, VertexShader, VertexShader.GetVertexShader(), Parameters->VS);
+				SetShaderParameters(RHICmdList, PixelShader, PixelShader.GetPixelShader(), Parameters->PS);
+
+				RHICmdList.DrawPrimitiveIndirect(Parameters->IndirectArgs->GetIndirectRHICallBuffer(), 0);
+			});
+	}
+
+	return Passes;
+}
+
+void AddLineArtPass(FRDGBuilder& GraphBuilder, const FViewInfo& View, const FLineArtPassInputs& Inputs)
+{
+	AddLineArtCompositePass(GraphBuilder, View, Inputs, AddLineArtDetectionPass(GraphBuilder, View, Inputs));
+}
+
+void PrecacheLineArtPipelines(FAnimepoyPipelinePrecache& Precache)
+{
+	Precache.AddComputeShaders<FDetectLineCS>();
+	Precache.AddComputeShaders<FBuildLineTileListCS>();
+	Precache.AddComputeShaders<FJumpFloodInitCS>();
+	Precache.AddComputeShaders<FJumpFloodCS>();
+
+	const FGlobalShaderMap* ShaderMap = Precache.GetShaderMap();
+	TShaderMapRef<FCompositeLineTileVS> VertexShader(ShaderMap);
+
+	// Matches the state CompositeLinePS sets in AddLineArtPass.
+	Precache.ForEachPermutation<FCompositeLinePS>([&Precache, &VertexShader](const TShaderRef<FCompositeLinePS>& PixelShader)
+		{
+			FGraphicsPipelineStateInitializer GraphicsPSOInit;
+			GraphicsPSOInit.BlendState = TStaticBlendState<CW_RGB, BO_Add, BF_DestColor, BF_InverseSourceAlpha>::GetRHI();
+			GraphicsPSOInit.RasterizerState = TStaticRasterizerState<>::GetRHI();
+			GraphicsPSOInit.DepthStencilState = TStaticDepthStencilState<false, CF_Always>::GetRHI();
+			GraphicsPSOInit.BoundShaderState.VertexDeclarationRHI = GEmptyVertexDeclaration.VertexDeclarationRHI;
+			GraphicsPSOInit.BoundShaderState.VertexShaderRHI = VertexShader.GetVertexShader();
+			GraphicsPSOInit.BoundShaderState.PixelShaderRHI = PixelShader.GetPixelShader();
+			GraphicsPSOInit.PrimitiveType = PT_TriangleList;
+			Precache.AddSceneColorPipeline(GraphicsPSOInit, false);
+		});
+
+	FRHIBlendState* PreviewBlendState = TStaticBlendState<
+		CW_RGB, BO_Add, BF_One, BF_Zero, BO_Add, BF_One, BF_Zero,
+		CW_ALPHA
+	>::GetRHI();
+	Precache.AddFullscreenPass(TShaderMapRef<FClearSceneColorAndGBufferPS>(ShaderMap), PreviewBlendState, Precache.GetSceneColorFormat(), Precache.GetSceneColorFlags());
+}
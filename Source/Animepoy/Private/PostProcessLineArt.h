@@ -1,20 +1,85 @@
-#pragma once
-
-#include "CoreMinimal.h"
-#include "ScreenPass.h"
-#include "SceneTexturesConfig.h"
-
-struct FLineArtPassInputs
-{
-	TRDGUniformBufferRef<FSceneTextureUniformParameters> SceneTextures;
-	float DepthLineIntensity;
-	float NormalLineIntensity;
-	float MaterialLineIntensity;
-	float PlanarLineIntensity;
-	float NonLineSpecular;
-	int32 LineWidth;
-	FLinearColor LineColor;
-	bool bPreview;
-};
-
-void AddLineArtPass(FRDGBuilder& GraphBuilder, const FViewInfo& View, const FLineArtPassInputs& Inputs);
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ScreenPass.h"
+#include "SceneTexturesConfig.h"
+#include "AnimepoyBatchedViews.h"
+
+// Per view state of the amortized line detection. Lives across frames on the render thread.
+struct FLineArtHistory
+{
+	TRefCountPtr<IPooledRenderTarget> LineHistory;
+	FIntRect ViewRect;
+	uint32 FrameIndex = 0;
+};
+
+struct FLineArtPassInputs
+{
+	TRDGUniformBufferRef<FSceneTextureUniformParameters> SceneTextures;
+	float DepthLineIntensity;
+	float NormalLineIntensity;
+	float MaterialLineIntensity;
+	float PlanarLineIntensity;
+	float NonLineSpecular;
+	int32 LineWidth;
+	FLinearColor LineColor;
+	bool bPreview;
+
+	// Views without persistent state detect every pixel every frame.
+	FLineArtHistory* History = nullptr;
+
+	// Detects half of the tiles each frame and reprojects the rest from History, see IsLineArtAmortized.
+	bool bAmortize = false;
+
+	// Detects lines on the async compute queue. The graph fences it against the G-buffer writes before and the composite after,
+	// so it only overlaps graphics work added between AddLineArtDetectionPass and AddLineArtCompositePass.
+	bool bAsyncCompute = false;
+
+	// Detects and composites these views of the family in one pass instead of View alone. Disables the history.
+	FBatchedViewRects BatchedViewRects;
+};
+
+// DetectLineCS thresholds and the CompositeLinePS search range of FLineArtPassInputs.
+struct FLineArtThresholds
+{
+	float MaterialThreshold;
+	float DepthThreshold;
+	float NormalThreshold;
+	float PlanarThreshold;
+	float NonLineSpecular;
+	int32 SearchRangeMin;
+	int32 SearchRangeMax;
+
+	// Squared, compared with CalcLineDistance2.
+	int32 LineWidth2;
+};
+
+FLineArtThresholds GetLineArtThresholds(const FLineArtPassInputs& Inputs);
+
+// Amortized detection keeps a history per view, so those views cannot share a pass.
+// True when bAmortize asks for it or r.Animepoy.LineArt.Amortize forces it.
+bool IsLineArtAmortized(bool bAmortize);
+
+// Lines found by DetectLineCS, handed from AddLineArtDetectionPass to AddLineArtCompositePass.
+struct FLineArtDetection
+{
+	FRDGTextureRef LineTexture = nullptr;
+	FRDGTextureRef LineTileMask = nullptr;
+
+	// The DetectLineCS pass, so its queue and order can be checked before the graph runs.
+	FRDGPassRef DetectPass = nullptr;
+};
+
+// The passes of AddLineArtCompositePass that consume FLineArtDetection, in the order they were added.
+struct FLineArtCompositePasses
+{
+	FRDGPassRef BuildLineTileListPass = nullptr;
+	FRDGPassRef CompositePass = nullptr;
+};
+
+// Detection reads the G-buffer and depth but not the scene color, so passes filtering the scene color may be added before the composite.
+FLineArtDetection AddLineArtDetectionPass(FRDGBuilder& GraphBuilder, const FViewInfo& View, const FLineArtPassInputs& Inputs);
+FLineArtCompositePasses AddLineArtCompositePass(FRDGBuilder& GraphBuilder, const FViewInfo& View, const FLineArtPassInputs& Inputs, const FLineArtDetection& Detection);
+
+// Detects and composites right away.
+void AddLineArtPass(FRDGBuilder& GraphBuilder, const FViewInfo& View, const FLineArtPassInputs& Inputs);
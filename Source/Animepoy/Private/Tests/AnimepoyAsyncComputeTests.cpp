@@ -0,0 +1,189 @@
+// @Custom
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "AnimepoySceneViewExtension.h"
+#include "AnimepoySubstrate.h"
+#include "PostProcessLineArt.h"
+#include "SceneRendering.h"
+#include "SceneRenderTargetParameters.h"
+#include "HAL/IConsoleManager.h"
+#include "RenderingThread.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace
+{
+	// Sets a console variable until the end of the scope, at the priority it was last set with so the change is not refused.
+	class FScopedConsoleVariable
+	{
+	public:
+		FScopedConsoleVariable(const TCHAR* Name, const TCHAR* Value)
+			: Variable(IConsoleManager::Get().FindConsoleVariable(Name))
+		{
+			check(Variable);
+			PreviousValue = Variable->GetString();
+			Set(Value);
+		}
+
+		~FScopedConsoleVariable()
+		{
+			Set(*PreviousValue);
+		}
+
+		void Set(const TCHAR* Value)
+		{
+			Variable->Set(Value, (EConsoleVariableFlags)(Variable->GetFlags() & ECVF_SetByMask));
+		}
+
+	private:
+		IConsoleVariable* Variable;
+		FString PreviousValue;
+	};
+
+	// Asks the render thread, which sees the console variables set before the call.
+	bool UseAsyncLineDetectionOnRenderThread(bool bOverlapped, bool bSupportsEfficientAsyncCompute = true)
+	{
+		bool bAsync = false;
+		ENQUEUE_RENDER_COMMAND(AnimepoyTestAsyncLineDetection)([&bAsync, bOverlapped, bSupportsEfficientAsyncCompute](FRHICommandListImmediate& RHICmdList)
+			{
+				TGuardValue<bool> SupportsEfficientAsyncCompute(GSupportsEfficientAsyncCompute, bSupportsEfficientAsyncCompute);
+				bAsync = UseAsyncLineDetection(bOverlapped);
+			});
+		FlushRenderingCommands();
+		return bAsync;
+	}
+
+	// What the graph made of the line art passes, read before it runs.
+	struct FLineArtGraph
+	{
+		bool bDetectAsync = false;
+		bool bDetectBeforeTileList = false;
+		bool bTileListBeforeComposite = false;
+	};
+
+	// Adds the async detection and the composite for a small view to a graph of their own.
+	FLineArtGraph BuildLineArtGraph(FSceneInterface* Scene)
+	{
+		FSceneViewFamily ViewFamily(FSceneViewFamily::ConstructionValues(nullptr, Scene, FEngineShowFlags(ESFIM_Game)).SetTime(FGameTime()));
+
+		FSceneViewInitOptions ViewInitOptions;
+		ViewInitOptions.ViewFamily = &ViewFamily;
+		ViewInitOptions.SetViewRectangle(FIntRect(0, 0, 128, 72));
+		ViewInitOptions.ViewOrigin = FVector::ZeroVector;
+		ViewInitOptions.ViewRotationMatrix = FMatrix::Identity;
+		ViewInitOptions.ProjectionMatrix = FReversedZPerspectiveMatrix(HALF_PI / 2.f, 128.f, 72.f, 10.f);
+
+		FLineArtGraph Graph;
+		ENQUEUE_RENDER_COMMAND(AnimepoyTestLineArtGraph)([&Graph, &ViewInitOptions](FRHICommandListImmediate& RHICmdList)
+			{
+				FViewInfo View(ViewInitOptions);
+				View.InitRHIResources();
+
+				FRDGBuilder GraphBuilder(RHICmdList);
+
+				// The detection reads the dummy G-buffer, the composite draws into a scene color of its own.
+				FSceneTextureUniformParameters* SceneTextureParameters = GraphBuilder.AllocParameters<FSceneTextureUniformParameters>();
+				SetupSceneTextureUniformParameters(GraphBuilder, nullptr, View.GetFeatureLevel(), ESceneTextureSetupMode::None, *SceneTextureParameters);
+				SceneTextureParameters->SceneColorTexture = GraphBuilder.CreateTexture(
+					FRDGTextureDesc::Create2D(View.ViewRect.Size(), PF_FloatRGBA, FClearValueBinding::Black, TexCreate_ShaderResource | TexCreate_RenderTargetable),
+					TEXT("SceneColor"));
+
+				FLineArtPassInputs Inputs;
+				Inputs.SceneTextures = GraphBuilder.CreateUniformBuffer(SceneTextureParameters);
+				Inputs.DepthLineIntensity = 0.9f;
+				Inputs.NormalLineIntensity = 0.75f;
+				Inputs.MaterialLineIntensity = 0.75f;
+				Inputs.PlanarLineIntensity = 0.f;
+				Inputs.NonLineSpecular = 0.f;
+				Inputs.LineWidth = 1;
+				Inputs.LineColor = FLinearColor::Black;
+				Inputs.bPreview = false;
+				Inputs.bAsyncCompute = true;
+
+				const FLineArtDetection Detection = AddLineArtDetectionPass(GraphBuilder, View, Inputs);
+				const FLineArtCompositePasses Passes = AddLineArtCompositePass(GraphBuilder, View, Inputs, Detection);
+
+				// The passes are freed when the graph runs.
+				Graph.bDetectAsync = Detection.DetectPass->GetPipeline() == ERHIPipeline::AsyncCompute;
+				Graph.bDetectBeforeTileList = Detection.DetectPass->GetHandle() < Passes.BuildLineTileListPass->GetHandle();
+				Graph.bTileListBeforeComposite = Passes.BuildLineTileListPass->GetHandle() < Passes.CompositePass->GetHandle();
+
+				GraphBuilder.Execute();
+			});
+		FlushRenderingCommands();
+		return Graph;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FAnimepoyAsyncLineDetectionTest, "Animepoy.AsyncCompute.LineDetection", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FAnimepoyAsyncLineDetectionTest::RunTest(const FString& Parameters)
+{
+	FScopedConsoleVariable AsyncCompute(TEXT("r.Animepoy.AsyncCompute"), TEXT("1"));
+	FScopedConsoleVariable GovernorBudget(TEXT("r.Animepoy.Governor.Budget"), TEXT("0"));
+
+	TestTrue(TEXT("Async detection overlapped by the Kuwahara filter"), UseAsyncLineDetectionOnRenderThread(true));
+	TestFalse(TEXT("Async detection with nothing to overlap"), UseAsyncLineDetectionOnRenderThread(false));
+	TestFalse(TEXT("Async detection without efficient async compute"), UseAsyncLineDetectionOnRenderThread(true, false));
+
+	AddExpectedError(TEXT("r.Animepoy.AsyncCompute is ignored"), EAutomationExpectedErrorFlags::Contains, 0);
+	GovernorBudget.Set(TEXT("2"));
+	TestFalse(TEXT("Async detection while the governor times the passes"), UseAsyncLineDetectionOnRenderThread(true));
+	GovernorBudget.Set(TEXT("0"));
+
+	AsyncCompute.Set(TEXT("0"));
+	TestFalse(TEXT("Async detection with r.Animepoy.AsyncCompute off"), UseAsyncLineDetectionOnRenderThread(true));
+
+	return true;
+}
+
+// The graph fences DetectLineCS against the passes that read its output, so those have to come after it. To see the
+// queues in a real frame, run r.Animepoy.AsyncCompute 1 and r.RDG.DumpGraph 1 and look for DetectLineCS on the
+// async compute queue of the dumped graph, with BuildLineTileListCS and CompositeLinePS after its fence.
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FAnimepoyAsyncLineDetectionGraphTest, "Animepoy.AsyncCompute.LineDetectionGraph", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FAnimepoyAsyncLineDetectionGraphTest::RunTest(const FString& Parameters)
+{
+	if (IsSubstrateEnabled())
+	{
+		AddInfo(TEXT("Skipped, the line art does not support r.Substrate."));
+		return true;
+	}
+
+	FSceneInterface* Scene = nullptr;
+	for (const FWorldContext& Context : GEngine->GetWorldContexts())
+	{
+		if (Context.World() && Context.World()->Scene)
+		{
+			Scene = Context.World()->Scene;
+			break;
+		}
+	}
+
+	if (!TestNotNull(TEXT("World with a scene"), Scene))
+	{
+		return false;
+	}
+
+	const FLineArtGraph Graph = BuildLineArtGraph(Scene);
+
+	// The graph moves async passes to the graphics queue where the platform or r.RDG.AsyncCompute has none.
+	const IConsoleVariable* RDGAsyncCompute = IConsoleManager::Get().FindConsoleVariable(TEXT("r.RDG.AsyncCompute"));
+	if (GSupportsEfficientAsyncCompute && (!RDGAsyncCompute || RDGAsyncCompute->GetInt() != 0))
+	{
+		TestTrue(TEXT("DetectLineCS on the async compute queue"), Graph.bDetectAsync);
+	}
+	else
+	{
+		AddInfo(TEXT("No async compute queue, only the order of the passes is checked."));
+	}
+
+	TestTrue(TEXT("DetectLineCS before BuildLineTileListCS"), Graph.bDetectBeforeTileList);
+	TestTrue(TEXT("BuildLineTileListCS before CompositeLinePS"), Graph.bTileListBeforeComposite);
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,107 @@
+// @Custom
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "LineArtCPU.h"
+#include "Algo/Count.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace
+{
+	// Small enough to run in the editor, large enough for every object of GenerateTestGBuffer to span several pixels.
+	const FIntPoint GTestSize(128, 72);
+
+	// Pixels of the test scene that each rule draws differently.
+	const FIntPoint GBoxTop(65, 31);			// The top edge of the box, in front of the wall.
+	const FIntPoint GWallAtFloor(10, 37);		// The last wall row above the floor.
+	const FIntPoint GFloorAtWall(10, 38);		// The first floor row below the wall.
+	const FIntPoint GFloorAtMetalSphere(47, 47);	// The floor right below the metal sphere, nearer than its bottom.
+	const FIntPoint GMetalSphereTop(47, 25);	// The top edge of the metal sphere, in front of the wall.
+	const FIntPoint GWall(10, 20);
+
+	// The floor in front of the no line sphere is nearer, so the shading model change draws on the floor with every rule.
+	const FIntPoint GNoLineSphereFloor[] = { { 82, 49 }, { 88, 49 } };
+
+	struct FRuleExpectation
+	{
+		const TCHAR* Name;
+		float DepthLineIntensity;
+		float NormalLineIntensity;
+		float MaterialLineIntensity;
+		float PlanarLineIntensity;
+		int32 NumLinePixels;
+		bool bBoxTop;
+		bool bWallAtFloor;
+		bool bFloorAtWall;
+		bool bFloorAtMetalSphere;
+		bool bMetalSphereTop;
+	};
+
+	// Each rule alone at the intensity of the AAnimepoy defaults, 0.5 for the planar line which is off by default.
+	// NumLinePixels are the counts "Animepoy.LineArt.BenchmarkCPU 128 72" logs for each rule. They are mostly the silhouettes
+	// of the metal sphere and the box and the crease of the floor and the wall, see the pixels above. A change to
+	// GenerateTestGBuffer or the rules changes them, so take them from the benchmark again after checking the pixels still pass.
+	const FRuleExpectation GRuleExpectations[] =
+	{
+		{ TEXT("Depth"), 0.9f, 0.f, 0.f, 0.f, 82, true, false, false, false, true },
+		{ TEXT("Normal"), 0.f, 0.75f, 0.f, 0.f, 164, false, true, false, false, false },
+		{ TEXT("Material"), 0.f, 0.f, 0.75f, 0.f, 64, false, false, false, true, true },
+		{ TEXT("Planar"), 0.f, 0.f, 0.f, 0.5f, 157, true, false, true, true, true },
+	};
+
+	bool HasLine(const TArray<uint16>& LineTexture, const FIntPoint& Pixel)
+	{
+		return LineTexture[Pixel.Y * GTestSize.X + Pixel.X] != 0;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FAnimepoyLineArtCPURulesTest, "Animepoy.LineArt.CPU.Rules", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FAnimepoyLineArtCPURulesTest::RunTest(const FString& Parameters)
+{
+	LineArtCPU::FGBuffer GBuffer;
+	LineArtCPU::GenerateTestGBuffer(GTestSize, GBuffer);
+
+	// The no line sphere is the only surface with the eye shading model.
+	const int32 NumNoLinePixels = Algo::CountIf(GBuffer.GBufferB, [](const FLinearColor& GBufferB) { return FMath::RoundToInt(GBufferB.A * 255.f) == 9; });
+	TestTrue(TEXT("No line sphere in view"), NumNoLinePixels > 0);
+
+	FLineArtPassInputs Inputs;
+	Inputs.NonLineSpecular = 0.f;
+	Inputs.LineWidth = 1;
+
+	for (const FRuleExpectation& Expected : GRuleExpectations)
+	{
+		Inputs.DepthLineIntensity = Expected.DepthLineIntensity;
+		Inputs.NormalLineIntensity = Expected.NormalLineIntensity;
+		Inputs.MaterialLineIntensity = Expected.MaterialLineIntensity;
+		Inputs.PlanarLineIntensity = Expected.PlanarLineIntensity;
+
+		TArray<uint16> LineTexture;
+		LineArtCPU::DetectLines(GBuffer, GetLineArtThresholds(Inputs), LineTexture);
+
+		TestEqual(FString::Printf(TEXT("%s line pixels"), Expected.Name), (int32)Algo::CountIf(LineTexture, [](uint16 Line) { return Line != 0; }), Expected.NumLinePixels);
+		TestEqual(FString::Printf(TEXT("%s line on the top of the box"), Expected.Name), HasLine(LineTexture, GBoxTop), Expected.bBoxTop);
+		TestEqual(FString::Printf(TEXT("%s line on the wall at the floor"), Expected.Name), HasLine(LineTexture, GWallAtFloor), Expected.bWallAtFloor);
+		TestEqual(FString::Printf(TEXT("%s line on the floor at the wall"), Expected.Name), HasLine(LineTexture, GFloorAtWall), Expected.bFloorAtWall);
+		TestEqual(FString::Printf(TEXT("%s line on the floor at the metal sphere"), Expected.Name), HasLine(LineTexture, GFloorAtMetalSphere), Expected.bFloorAtMetalSphere);
+		TestEqual(FString::Printf(TEXT("%s line on the top of the metal sphere"), Expected.Name), HasLine(LineTexture, GMetalSphereTop), Expected.bMetalSphereTop);
+		TestFalse(FString::Printf(TEXT("%s line on the wall"), Expected.Name), HasLine(LineTexture, GWall));
+
+		for (const FIntPoint& Pixel : GNoLineSphereFloor)
+		{
+			TestTrue(FString::Printf(TEXT("%s line on the floor at %s in front of the no line sphere"), Expected.Name, *Pixel.ToString()), HasLine(LineTexture, Pixel));
+		}
+
+		int32 NumNoLineSphereLines = 0;
+		for (int32 Index = 0; Index < LineTexture.Num(); ++Index)
+		{
+			NumNoLineSphereLines += LineTexture[Index] != 0 && FMath::RoundToInt(GBuffer.GBufferB[Index].A * 255.f) == 9;
+		}
+		TestEqual(FString::Printf(TEXT("%s lines on the no line sphere"), Expected.Name), NumNoLineSphereLines, 0);
+	}
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
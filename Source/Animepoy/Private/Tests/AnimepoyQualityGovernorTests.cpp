@@ -0,0 +1,161 @@
+// @Custom
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "AnimepoyQualityGovernor.h"
+#include "Containers/Queue.h"
+#include "Math/RandomStream.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace
+{
+	constexpr float GTestBudgetMs = 5.f;
+
+	// Line art is the most expensive pass and the total is over budget.
+	const FAnimepoyPassTimings GOverBudgetTimings{ 2.f, 3.f, 1.f };
+	// Under UpgradeThreshold of the budget, with room left for line art at its cost before the downgrade.
+	const FAnimepoyPassTimings GUnderBudgetTimings{ 0.5f, 1.f, 0.5f };
+	// Within budget but over UpgradeThreshold of it.
+	const FAnimepoyPassTimings GNearBudgetTimings{ 1.5f, 1.f, 1.5f };
+
+	// Feeds Timings until the levels change and returns the number of frames fed, including the one that changed them,
+	// or 0 when they did not change within MaxFrames.
+	int32 UpdateUntilChanged(FAnimepoyQualityGovernor& Governor, const FAnimepoyPassTimings& Timings, float BudgetMs, int32 MaxFrames)
+	{
+		for (int32 Frame = 1; Frame <= MaxFrames; ++Frame)
+		{
+			if (Governor.Update(Timings, BudgetMs))
+			{
+				return Frame;
+			}
+		}
+		return 0;
+	}
+
+	void TestLevels(FAutomationTestBase& Test, const TCHAR* What, const FAnimepoyQualityGovernor& Governor, const FAnimepoyQualityLevels& Expected)
+	{
+		Test.TestEqual(What, Governor.GetLevels().ToString(), Expected.ToString());
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FAnimepoyQualityGovernorDowngradeTest, "Animepoy.Governor.Downgrade", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FAnimepoyQualityGovernorDowngradeTest::RunTest(const FString& Parameters)
+{
+	const FAnimepoyQualityGovernorSettings Settings;
+	FAnimepoyQualityGovernor Governor(Settings);
+
+	TestEqual(TEXT("Frames over budget before the first downgrade"), UpdateUntilChanged(Governor, GOverBudgetTimings, GTestBudgetMs, 1000), Settings.DowngradeFrames);
+	TestLevels(*this, TEXT("Levels after the first downgrade"), Governor, { 0, 1, 0 });
+
+	// Line art is at its lowest level, so the Kuwahara filter is the most expensive pass left.
+	TestEqual(TEXT("Frames over budget before the second downgrade"), UpdateUntilChanged(Governor, GOverBudgetTimings, GTestBudgetMs, 1000), Settings.SettleFrames + Settings.DowngradeFrames);
+	TestLevels(*this, TEXT("Levels after the second downgrade"), Governor, { 1, 1, 0 });
+
+	TestTrue(TEXT("Change when turning the governor off"), Governor.Update(GOverBudgetTimings, 0.f));
+	TestLevels(*this, TEXT("Levels with the governor off"), Governor, {});
+	TestFalse(TEXT("Change with the governor off"), Governor.Update(GOverBudgetTimings, 0.f));
+
+	FAnimepoyQualityGovernor WithinBudget(Settings);
+	TestEqual(TEXT("Downgrade within budget"), UpdateUntilChanged(WithinBudget, GNearBudgetTimings, GTestBudgetMs, 1000), 0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FAnimepoyQualityGovernorUpgradeTest, "Animepoy.Governor.Upgrade", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FAnimepoyQualityGovernorUpgradeTest::RunTest(const FString& Parameters)
+{
+	const FAnimepoyQualityGovernorSettings Settings;
+
+	FAnimepoyQualityGovernor NearBudget(Settings);
+	UpdateUntilChanged(NearBudget, GOverBudgetTimings, GTestBudgetMs, 1000);
+	TestEqual(TEXT("Upgrade within budget but over the upgrade threshold"), UpdateUntilChanged(NearBudget, GNearBudgetTimings, GTestBudgetMs, Settings.MaxUpgradeFrames * 2), 0);
+
+	FAnimepoyQualityGovernor Governor(Settings);
+	UpdateUntilChanged(Governor, GOverBudgetTimings, GTestBudgetMs, 1000);
+	TestLevels(*this, TEXT("Levels after the downgrade"), Governor, { 0, 1, 0 });
+
+	// The frames right after a change are ignored.
+	TestEqual(TEXT("Frames under the upgrade threshold before the upgrade"), UpdateUntilChanged(Governor, GUnderBudgetTimings, GTestBudgetMs, 1000), Settings.SettleFrames + Settings.UpgradeFrames);
+	TestLevels(*this, TEXT("Levels after the upgrade"), Governor, {});
+
+	TestEqual(TEXT("Upgrade with nothing downgraded"), UpdateUntilChanged(Governor, GUnderBudgetTimings, GTestBudgetMs, 1000), 0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FAnimepoyQualityGovernorBackoffTest, "Animepoy.Governor.Backoff", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FAnimepoyQualityGovernorBackoffTest::RunTest(const FString& Parameters)
+{
+	const FAnimepoyQualityGovernorSettings Settings;
+	FAnimepoyQualityGovernor Governor(Settings);
+
+	UpdateUntilChanged(Governor, GOverBudgetTimings, GTestBudgetMs, 1000);
+
+	// Every upgrade undone right away doubles the wait before the next one, up to MaxUpgradeFrames.
+	int32 ExpectedUpgradeFrames = Settings.UpgradeFrames;
+	const auto FailUpgrades = [&](int32 NumAttempts)
+	{
+		for (int32 Attempt = 0; Attempt < NumAttempts; ++Attempt)
+		{
+			TestEqual(FString::Printf(TEXT("Frames before the upgrade after %d frames"), ExpectedUpgradeFrames), UpdateUntilChanged(Governor, GUnderBudgetTimings, GTestBudgetMs, Settings.MaxUpgradeFrames * 2), Settings.SettleFrames + ExpectedUpgradeFrames);
+			TestEqual(FString::Printf(TEXT("Frames before undoing the upgrade after %d frames"), ExpectedUpgradeFrames), UpdateUntilChanged(Governor, GOverBudgetTimings, GTestBudgetMs, 1000), Settings.SettleFrames + Settings.DowngradeFrames);
+			ExpectedUpgradeFrames = FMath::Min(ExpectedUpgradeFrames * 2, Settings.MaxUpgradeFrames);
+		}
+	};
+
+	FailUpgrades(3);
+	TestEqual(TEXT("Wait after three undone upgrades"), ExpectedUpgradeFrames, Settings.UpgradeFrames * 8);
+
+	// An upgrade that holds for longer than FailedUpgradeWindow leaves the wait alone.
+	TestEqual(TEXT("Frames before the held upgrade"), UpdateUntilChanged(Governor, GUnderBudgetTimings, GTestBudgetMs, Settings.MaxUpgradeFrames * 2), Settings.SettleFrames + ExpectedUpgradeFrames);
+	TestEqual(TEXT("Change while the upgrade holds"), UpdateUntilChanged(Governor, GUnderBudgetTimings, GTestBudgetMs, Settings.FailedUpgradeWindow), 0);
+	TestTrue(TEXT("Downgrade after the held upgrade"), UpdateUntilChanged(Governor, GOverBudgetTimings, GTestBudgetMs, 1000) > 0);
+	FailUpgrades(3);
+	TestEqual(TEXT("Wait capped at MaxUpgradeFrames"), ExpectedUpgradeFrames, Settings.MaxUpgradeFrames);
+	TestEqual(TEXT("Frames before the upgrade at the cap"), UpdateUntilChanged(Governor, GUnderBudgetTimings, GTestBudgetMs, Settings.MaxUpgradeFrames * 2), Settings.SettleFrames + Settings.MaxUpgradeFrames);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FAnimepoyQualityGovernorOscillationTest, "Animepoy.Governor.Oscillation", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FAnimepoyQualityGovernorOscillationTest::RunTest(const FString& Parameters)
+{
+	// Line art fits the budget only amortized, at a third of its cost, and restoring it would go over again.
+	// The timings arrive a few frames late and noisy, like GPU readbacks, as in Animepoy.Governor.Simulate.
+	const float BudgetMs = 3.5f;
+	const FAnimepoyPassTimings BaseTimings{ 0.5f, 3.f, 0.5f };
+	static const float LineArtCosts[] = { 1.f, 1.f / 3.f };
+	constexpr int32 ReadbackLatency = 3;
+	constexpr int32 NumFrames = 5000;
+
+	FAnimepoyQualityGovernor Governor;
+	TQueue<FAnimepoyPassTimings> InFlight;
+	FRandomStream Noise(0x414E494D);
+	int32 NumChanges = 0;
+
+	for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+	{
+		FAnimepoyPassTimings Timings;
+		Timings.KuwaharaFilter = BaseTimings.KuwaharaFilter * Noise.FRandRange(0.95f, 1.05f);
+		Timings.LineArt = BaseTimings.LineArt * LineArtCosts[Governor.GetLevels().LineArt] * Noise.FRandRange(0.95f, 1.05f);
+		Timings.DiffusionFilter = BaseTimings.DiffusionFilter * Noise.FRandRange(0.95f, 1.05f);
+		InFlight.Enqueue(Timings);
+
+		FAnimepoyPassTimings ReadBack;
+		if (Frame >= ReadbackLatency && InFlight.Dequeue(ReadBack))
+		{
+			NumChanges += Governor.Update(ReadBack, BudgetMs);
+		}
+	}
+
+	TestEqual(TEXT("Changes"), NumChanges, 1);
+	TestLevels(*this, TEXT("Final levels"), Governor, { 0, 1, 0 });
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,52 @@
+// @Custom
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "AnimepoyBenchmarkCPU.h"
+#include "AnimepoyCPU.h"
+#include "DiffusionFilterCPU.h"
+#include "KuwaharaFilterReference.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FAnimepoyTiledCPUWholeFrameTest, "Animepoy.Tiled.CPU.WholeFrame", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FAnimepoyTiledCPUWholeFrameTest::RunTest(const FString& Parameters)
+{
+	// Not a multiple of the tiles, so the last row and column of tiles are cut by the edge of the image.
+	const FIntPoint Size(328, 200);
+
+	// Every CPU stage on, as in Animepoy.Tiled.BenchmarkCPU.
+	FAnimepoyRenderProxy RenderProxy = GetDefault<AAnimepoy>()->CreateRenderProxy();
+	RenderProxy.bLineArt = true;
+	RenderProxy.LineWidth = 3;
+	RenderProxy.bPrePostProcessKuwaharaFilter = true;
+	RenderProxy.PrePostProcessKuwaharaFilterSize = 4;
+	RenderProxy.bDiffusionFilter = true;
+
+	// The diffusion mask gets a quarter of the budget, just enough for it at full resolution. The tiles get the rest.
+	const int64 MemoryBudget = 4 * DiffusionFilterCPU::FTiledMask::GetMaskBytes(Size, 0);
+	TestEqual(TEXT("Diffusion mask level"), DiffusionFilterCPU::FTiledMask(Size, AnimepoyCPU::GetDiffusionInputs(RenderProxy), MemoryBudget / 4).GetLevel(), 0);
+	TestTrue(TEXT("Frame over the budget"), AnimepoyCPU::GetFrameBytes(Size, RenderProxy, true) > MemoryBudget);
+
+	TArray<FLinearColor> Image;
+	KuwaharaFilterReference::GenerateTestImage(Size, EKuwaharaFilterTargetType::SceneColor, Image);
+	LineArtCPU::FGBuffer GBuffer;
+	LineArtCPU::GenerateTestGBuffer(Size, GBuffer);
+
+	TArray<FLinearColor> Reference;
+	Reference.SetNumUninitialized(Image.Num());
+	AnimepoyCPU::FilterFrame(&Image[0].R, &Reference[0].R, Size, &GBuffer, RenderProxy);
+
+	TArray<FLinearColor> Result;
+	Result.SetNumZeroed(Image.Num());
+	TestTrue(TEXT("Filtered in tiles"), AnimepoyCPU::FilterTiled(AnimepoyCPU::MakeTiledImage(&Image[0].R, &Result[0].R, Size, &GBuffer), RenderProxy, MemoryBudget));
+
+	// Every tile sees the neighbours of the whole image, so not a single bit may differ.
+	const AnimepoyBenchmarkCPU::FImageDifference Difference = AnimepoyBenchmarkCPU::CompareImages(Reference, Result, true);
+	TestEqual(TEXT("Pixels differing from the whole frame"), Difference.NumDifferent, 0);
+	TestEqual(TEXT("Largest difference to the whole frame"), Difference.MaxError, 0.f, 0.f);
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
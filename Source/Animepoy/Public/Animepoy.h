@@ -1,117 +1,251 @@
-// Fill out your copyright notice in the Description page of Project Settings.
-
-#pragma once
-
-#include "CoreMinimal.h"
-#include "GameFramework/Actor.h"
-#include "Animepoy.generated.h"
-
-UENUM(BlueprintType)
-enum class EAnimeDiffusionBlendMode : uint8
-{
-	Lighten,
-	Screen,
-	Overlay,
-	SoftLight,
-};
-
-struct FAnimepoyRenderProxy
-{
-	bool bEnable;
-
-	// Line Art
-	bool bLineArt;
-	FLinearColor LineColor;
-	int32 LineWidth;
-	float DepthLineIntensity;
-	float NormalLineIntensity;
-	float MaterialLineIntensity;
-	float PlanarLineIntensity;
-	bool bPreviewLine;
-
-	// Kuwahara Filter
-	bool bPrePostProcessKuwaharaFilter;
-	int32 PrePostProcessKuwaharaFilterSize;
-
-	// Diffusion Filter
-	bool bDiffusionFilter;
-	float DiffusionFilterIntensity;
-	float DiffusionLuminanceMin;
-	float DiffusionLuminanceMax;
-	float DiffusionBlurPercentage;
-	EAnimeDiffusionBlendMode DiffusionBlendMode;
-	bool bPreviewDiffusionMask;
-};
-
-UCLASS()
-class ANIMEPOY_API AAnimepoy : public AActor
-{
-	GENERATED_BODY()
-
-public:
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Line Art")
-	bool bLineArt = false;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Line Art")
-	FLinearColor LineColor = FLinearColor(0.f, 0.f, 0.f, 1.f);
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Line Art", meta = (ClampMin = "1", ClampMax = "7"))
-	int32 LineWidth = 1;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Line Art", meta = (ClampMin = "0.0", ClampMax = "1.0"))
-	float DepthLineIntensity = 0.9f;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Line Art", meta = (ClampMin = "0.0", ClampMax = "1.0"))
-	float NormalLineIntensity = 0.75f;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Line Art", meta = (ClampMin = "0.0", ClampMax = "1.0"))
-	float PlanarLineIntensity = 0.0f;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Line Art", meta = (ClampMin = "0.0", ClampMax = "1.0"))
-	float MaterialLineIntensity = 0.75f;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Line Art")
-	bool bPreviewLine = false;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Kuwahara Filter")
-	bool bPrePostProcessKuwaharaFilter = false;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Kuwahara Filter", meta = (ClampMin = "1", ClampMax = "7"))
-	int32 PrePostProcessKuwaharaFilterSize = 1;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Diffusion Filter")
-	bool bDiffusionFilter = false;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Diffusion Filter", meta = (ClampMin = "0.0", ClampMax = "1.0"))
-	float DiffusionFilterIntensity = 0.5f;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Diffusion Filter", meta = (ClampMin = "0.0", ClampMax = "1.0"))
-	float DiffusionLuminanceMin = 0.f;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Diffusion Filter", meta = (ClampMin = "0.0", ClampMax = "1.0"))
-	float DiffusionLuminanceMax = 1.f;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Diffusion Filter", meta = (ClampMin = "0.0", ClampMax = "100.0"))
-	float DiffusionBlurPercentage = 8.f;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Diffusion Filter")
-	EAnimeDiffusionBlendMode DiffusionBlendMode = EAnimeDiffusionBlendMode::Overlay;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Diffusion Filter")
-	bool bPreviewDiffusionMask = false;
-
-public:
-	AAnimepoy();
-
-protected:
-	virtual void BeginPlay() override;
-
-	virtual void BeginDestroy() override;
-
-	virtual void Tick(float DeltaSeconds);
-
-	virtual bool ShouldTickIfViewportsOnly() const 
-	{ 
-		return true;  
-	}
-};
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "Animepoy.generated.h"
+
+UENUM(BlueprintType)
+enum class EAnimeDiffusionBlendMode : uint8
+{
+	Lighten,
+	Screen,
+	Overlay,
+	SoftLight,
+};
+
+UENUM(BlueprintType)
+enum class EAnimeKuwaharaFilterResolution : uint8
+{
+	Full,
+	Half,
+	Quarter,
+};
+
+struct FAnimepoyRenderProxy
+{
+	bool bEnable;
+
+	// Line Art
+	bool bLineArt;
+	FLinearColor LineColor;
+	int32 LineWidth;
+	float DepthLineIntensity;
+	float NormalLineIntensity;
+	float MaterialLineIntensity;
+	float PlanarLineIntensity;
+	bool bPreviewLine;
+	// Set by the quality governor, the actor has no such setting.
+	bool bLineArtAmortize = false;
+
+	// Kuwahara Filter
+	bool bPrePostProcessKuwaharaFilter;
+	int32 PrePostProcessKuwaharaFilterSize;
+	EAnimeKuwaharaFilterResolution PrePostProcessKuwaharaFilterResolution;
+	bool bGBufferKuwaharaFilter;
+	bool bGBufferKuwaharaFilterBaseColor;
+	bool bGBufferKuwaharaFilterNormal;
+	bool bGBufferKuwaharaFilterMaterial;
+	int32 GBufferKuwaharaFilterSize;
+
+	// Diffusion Filter
+	bool bDiffusionFilter;
+	float DiffusionFilterIntensity;
+	float DiffusionLuminanceMin;
+	float DiffusionLuminanceMax;
+	float DiffusionBlurPercentage;
+	EAnimeDiffusionBlendMode DiffusionBlendMode;
+	bool bPreviewDiffusionMask;
+};
+
+UCLASS()
+class ANIMEPOY_API AAnimepoy : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	// The renderer only sees the properties when they are published. Blueprints and the editor do that on every change,
+	// C++ has to use the setters, or call PublishRenderProxy after writing the properties directly.
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetLineArt, EditAnywhere, Category = "Line Art")
+	bool bLineArt = false;
+
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetLineColor, EditAnywhere, Category = "Line Art")
+	FLinearColor LineColor = FLinearColor(0.f, 0.f, 0.f, 1.f);
+
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetLineWidth, EditAnywhere, Category = "Line Art", meta = (ClampMin = "1", ClampMax = "128", UIMax = "32"))
+	int32 LineWidth = 1;
+
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetDepthLineIntensity, EditAnywhere, Category = "Line Art", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float DepthLineIntensity = 0.9f;
+
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetNormalLineIntensity, EditAnywhere, Category = "Line Art", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float NormalLineIntensity = 0.75f;
+
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetPlanarLineIntensity, EditAnywhere, Category = "Line Art", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float PlanarLineIntensity = 0.0f;
+
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetMaterialLineIntensity, EditAnywhere, Category = "Line Art", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float MaterialLineIntensity = 0.75f;
+
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetPreviewLine, EditAnywhere, Category = "Line Art")
+	bool bPreviewLine = false;
+
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetPrePostProcessKuwaharaFilter, EditAnywhere, Category = "Kuwahara Filter")
+	bool bPrePostProcessKuwaharaFilter = false;
+
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetPrePostProcessKuwaharaFilterSize, EditAnywhere, Category = "Kuwahara Filter", meta = (ClampMin = "1", ClampMax = "256", UIMax = "64"))
+	int32 PrePostProcessKuwaharaFilterSize = 1;
+
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetPrePostProcessKuwaharaFilterResolution, EditAnywhere, Category = "Kuwahara Filter")
+	EAnimeKuwaharaFilterResolution PrePostProcessKuwaharaFilterResolution = EAnimeKuwaharaFilterResolution::Full;
+
+	// Filters the G-buffer after deferred lighting, sharing one quadrant selection between the targets.
+	// Needs an engine with the PostDeferredLighting_RenderThread extension point. Animepoy.Build.cs sets USE_POST_DEFERRED_LIGHTING_PASS=0,
+	// and then the G-buffer properties do nothing. Skipped with Substrate.
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetGBufferKuwaharaFilter, EditAnywhere, Category = "Kuwahara Filter")
+	bool bGBufferKuwaharaFilter = false;
+
+	// Only with USE_POST_DEFERRED_LIGHTING_PASS=1, see bGBufferKuwaharaFilter.
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetGBufferKuwaharaFilterBaseColor, EditAnywhere, Category = "Kuwahara Filter")
+	bool bGBufferKuwaharaFilterBaseColor = true;
+
+	// Only with USE_POST_DEFERRED_LIGHTING_PASS=1, see bGBufferKuwaharaFilter.
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetGBufferKuwaharaFilterNormal, EditAnywhere, Category = "Kuwahara Filter")
+	bool bGBufferKuwaharaFilterNormal = false;
+
+	// Only with USE_POST_DEFERRED_LIGHTING_PASS=1, see bGBufferKuwaharaFilter.
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetGBufferKuwaharaFilterMaterial, EditAnywhere, Category = "Kuwahara Filter")
+	bool bGBufferKuwaharaFilterMaterial = false;
+
+	// At most 7, the shared quadrant selection keeps the whole window in groupshared memory. Larger sizes are clamped.
+	// Only with USE_POST_DEFERRED_LIGHTING_PASS=1, see bGBufferKuwaharaFilter.
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetGBufferKuwaharaFilterSize, EditAnywhere, Category = "Kuwahara Filter", meta = (ClampMin = "1", ClampMax = "7"))
+	int32 GBufferKuwaharaFilterSize = 4;
+
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetDiffusionFilter, EditAnywhere, Category = "Diffusion Filter")
+	bool bDiffusionFilter = false;
+
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetDiffusionFilterIntensity, EditAnywhere, Category = "Diffusion Filter", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float DiffusionFilterIntensity = 0.5f;
+
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetDiffusionLuminanceMin, EditAnywhere, Category = "Diffusion Filter", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float DiffusionLuminanceMin = 0.f;
+
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetDiffusionLuminanceMax, EditAnywhere, Category = "Diffusion Filter", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float DiffusionLuminanceMax = 1.f;
+
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetDiffusionBlurPercentage, EditAnywhere, Category = "Diffusion Filter", meta = (ClampMin = "0.0", ClampMax = "100.0"))
+	float DiffusionBlurPercentage = 8.f;
+
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetDiffusionBlendMode, EditAnywhere, Category = "Diffusion Filter")
+	EAnimeDiffusionBlendMode DiffusionBlendMode = EAnimeDiffusionBlendMode::Overlay;
+
+	UPROPERTY(BlueprintReadWrite, BlueprintSetter = SetPreviewDiffusionMask, EditAnywhere, Category = "Diffusion Filter")
+	bool bPreviewDiffusionMask = false;
+
+public:
+	AAnimepoy();
+
+	// Hands the current settings to the renderer. The setters, the editor and BeginPlay call this,
+	// C++ that writes the properties directly has to call it itself.
+	void PublishRenderProxy();
+
+	FAnimepoyRenderProxy CreateRenderProxy() const;
+
+	virtual void SetActorHiddenInGame(bool bNewHidden) override;
+
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+
+	virtual void PostEditUndo() override;
+#endif
+
+public:
+	UFUNCTION(BlueprintSetter)
+	void SetLineArt(bool bInLineArt);
+
+	UFUNCTION(BlueprintSetter)
+	void SetLineColor(const FLinearColor& InLineColor);
+
+	UFUNCTION(BlueprintSetter)
+	void SetLineWidth(int32 InLineWidth);
+
+	UFUNCTION(BlueprintSetter)
+	void SetDepthLineIntensity(float InDepthLineIntensity);
+
+	UFUNCTION(BlueprintSetter)
+	void SetNormalLineIntensity(float InNormalLineIntensity);
+
+	UFUNCTION(BlueprintSetter)
+	void SetPlanarLineIntensity(float InPlanarLineIntensity);
+
+	UFUNCTION(BlueprintSetter)
+	void SetMaterialLineIntensity(float InMaterialLineIntensity);
+
+	UFUNCTION(BlueprintSetter)
+	void SetPreviewLine(bool bInPreviewLine);
+
+	UFUNCTION(BlueprintSetter)
+	void SetPrePostProcessKuwaharaFilter(bool bInPrePostProcessKuwaharaFilter);
+
+	UFUNCTION(BlueprintSetter)
+	void SetPrePostProcessKuwaharaFilterSize(int32 InPrePostProcessKuwaharaFilterSize);
+
+	UFUNCTION(BlueprintSetter)
+	void SetPrePostProcessKuwaharaFilterResolution(EAnimeKuwaharaFilterResolution InPrePostProcessKuwaharaFilterResolution);
+
+	UFUNCTION(BlueprintSetter)
+	void SetGBufferKuwaharaFilter(bool bInGBufferKuwaharaFilter);
+
+	UFUNCTION(BlueprintSetter)
+	void SetGBufferKuwaharaFilterBaseColor(bool bInGBufferKuwaharaFilterBaseColor);
+
+	UFUNCTION(BlueprintSetter)
+	void SetGBufferKuwaharaFilterNormal(bool bInGBufferKuwaharaFilterNormal);
+
+	UFUNCTION(BlueprintSetter)
+	void SetGBufferKuwaharaFilterMaterial(bool bInGBufferKuwaharaFilterMaterial);
+
+	UFUNCTION(BlueprintSetter)
+	void SetGBufferKuwaharaFilterSize(int32 InGBufferKuwaharaFilterSize);
+
+	UFUNCTION(BlueprintSetter)
+	void SetDiffusionFilter(bool bInDiffusionFilter);
+
+	UFUNCTION(BlueprintSetter)
+	void SetDiffusionFilterIntensity(float InDiffusionFilterIntensity);
+
+	UFUNCTION(BlueprintSetter)
+	void SetDiffusionLuminanceMin(float InDiffusionLuminanceMin);
+
+	UFUNCTION(BlueprintSetter)
+	void SetDiffusionLuminanceMax(float InDiffusionLuminanceMax);
+
+	UFUNCTION(BlueprintSetter)
+	void SetDiffusionBlurPercentage(float InDiffusionBlurPercentage);
+
+	UFUNCTION(BlueprintSetter)
+	void SetDiffusionBlendMode(EAnimeDiffusionBlendMode InDiffusionBlendMode);
+
+	UFUNCTION(BlueprintSetter)
+	void SetPreviewDiffusionMask(bool bInPreviewDiffusionMask);
+
+protected:
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	virtual void PostRegisterAllComponents() override;
+
+private:
+	template<typename T>
+	void SetRenderProperty(T& Property, const T& Value)
+	{
+		if (Property != Value)
+		{
+			Property = Value;
+			PublishRenderProxy();
+		}
+	}
+};
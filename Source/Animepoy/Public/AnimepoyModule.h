@@ -5,6 +5,8 @@
 #include "CoreMinimal.h"
 #include "Modules/ModuleManager.h"
 
+ANIMEPOY_API DECLARE_LOG_CATEGORY_EXTERN(LogAnimepoy, Log, All);
+
 class FAnimepoyModule : public IModuleInterface
 {
 public:
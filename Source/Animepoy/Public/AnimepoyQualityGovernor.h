@@ -0,0 +1,130 @@
+// @Custom
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Animepoy.h"
+
+// GPU time of the Animepoy passes over all views of one frame, in milliseconds.
+struct FAnimepoyPassTimings
+{
+	float KuwaharaFilter = 0.f;
+	float LineArt = 0.f;
+	float DiffusionFilter = 0.f;
+
+	float GetTotal() const { return KuwaharaFilter + LineArt + DiffusionFilter; }
+};
+
+// How far each pass is scaled down from the actor's settings. Zero everywhere leaves them alone.
+struct FAnimepoyQualityLevels
+{
+	// 1 and 2 shrink the filter to 3/4 and 1/2, 3 and 4 also filter at half and quarter resolution at most.
+	int32 KuwaharaFilter = 0;
+	// 1 amortizes line detection over two frames.
+	int32 LineArt = 0;
+	// 1 and 2 shrink the blur to 3/4 and 1/2.
+	int32 DiffusionFilter = 0;
+
+	static constexpr int32 MaxKuwaharaFilter = 4;
+	static constexpr int32 MaxLineArt = 1;
+	static constexpr int32 MaxDiffusionFilter = 2;
+
+	bool operator==(const FAnimepoyQualityLevels& Other) const
+	{
+		return KuwaharaFilter == Other.KuwaharaFilter && LineArt == Other.LineArt && DiffusionFilter == Other.DiffusionFilter;
+	}
+
+	bool operator!=(const FAnimepoyQualityLevels& Other) const
+	{
+		return !(*this == Other);
+	}
+
+	// Returns RenderProxy with the levels applied.
+	FAnimepoyRenderProxy Apply(const FAnimepoyRenderProxy& RenderProxy) const;
+
+	FString ToString() const;
+};
+
+struct FAnimepoyQualityGovernorSettings
+{
+	// Weight of a new frame in the smoothed timings.
+	float Smoothing = 0.1f;
+
+	// Scales up only once the smoothed total is this fraction of the budget or less.
+	float UpgradeThreshold = 0.75f;
+
+	// Consecutive frames over budget before scaling down, and under UpgradeThreshold before scaling back up.
+	int32 DowngradeFrames = 10;
+	int32 UpgradeFrames = 60;
+
+	// Frames to ignore after a change, while older frames are still read back and the smoothing catches up.
+	int32 SettleFrames = 8;
+
+	// An upgrade undone within this many frames doubles the wait before the next one, up to MaxUpgradeFrames.
+	int32 FailedUpgradeWindow = 120;
+	int32 MaxUpgradeFrames = 960;
+};
+
+// Fits the Animepoy passes into a GPU time budget by stepping their quality down one level at a time,
+// always on the most expensive pass that can still go down, and back up in the reverse order.
+// Pure logic on timings handed in, so it runs the same on measured frames and on synthetic traces.
+class FAnimepoyQualityGovernor
+{
+public:
+	explicit FAnimepoyQualityGovernor(const FAnimepoyQualityGovernorSettings& InSettings = {})
+		: Settings(InSettings)
+		, UpgradeFrames(InSettings.UpgradeFrames)
+	{
+	}
+
+	// Feeds the timings of one frame read back at the levels currently returned by GetLevels.
+	// Returns true when the levels changed. A budget of zero or less restores full quality.
+	bool Update(const FAnimepoyPassTimings& Timings, float BudgetMs);
+
+	void Reset();
+
+	const FAnimepoyQualityLevels& GetLevels() const { return Levels; }
+
+	const FAnimepoyPassTimings& GetSmoothedTimings() const { return SmoothedTimings; }
+
+private:
+	enum class EPass : uint8
+	{
+		KuwaharaFilter,
+		LineArt,
+		DiffusionFilter,
+	};
+
+	struct FDowngrade
+	{
+		EPass Pass;
+		// Smoothed time of the pass before and after it was stepped down. Their ratio predicts
+		// the cost of restoring it even when the load has changed since.
+		float PassTimeBefore;
+		float PassTimeAfter;
+	};
+
+	float GetPassTime(EPass Pass) const;
+	bool Downgrade();
+	bool Upgrade();
+	void OnChanged();
+
+	FAnimepoyQualityGovernorSettings Settings;
+	FAnimepoyQualityLevels Levels;
+	FAnimepoyPassTimings SmoothedTimings;
+	bool bHasTimings = false;
+	int32 FramesMeasured = 0;
+
+	// Passes stepped down, in order, so the last one is restored first.
+	TArray<FDowngrade, TInlineAllocator<8>> Downgrades;
+
+	int32 FramesOverBudget = 0;
+	int32 FramesUnderBudget = 0;
+	int32 FramesToSettle = 0;
+	int32 FramesSinceUpgrade = MAX_int32;
+	int32 UpgradeFrames;
+};
+
+// r.Animepoy.Governor.Budget, the GPU milliseconds per frame the passes are fitted into. Zero or less turns the governor off.
+float GetQualityGovernorBudget();
+float GetQualityGovernorBudget_RenderThread();
+void SetQualityGovernorBudget(float BudgetMs);
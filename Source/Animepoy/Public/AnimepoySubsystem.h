@@ -1,47 +1,80 @@
-// Fill out your copyright notice in the Description page of Project Settings.
-
-#pragma once
-
-#include "CoreMinimal.h"
-#include "Subsystems/WorldSubsystem.h"
-#include "Animepoy.h"
-#include "AnimepoySubsystem.generated.h"
-
-UCLASS()
-class ANIMEPOY_API UAnimepoySubsystem : public UWorldSubsystem
-{
-	GENERATED_BODY()
-
-public:
-	virtual void Initialize(FSubsystemCollectionBase& Collection)override;
-
-	virtual void Deinitialize()override;
-
-public:
-	void OnActorSpawned(AActor* Actor);
-
-	void OnActorDeleted(AActor* Actor);
-
-	void OnActorListChanged();
-
-	void SetAnimepoyRenderProxy(const FAnimepoyRenderProxy& NewAnimepoyRenderProxy)
-	{
-		FScopeLock Lock(&Mutex);
-		AnimepoyRenderProxy = NewAnimepoyRenderProxy;
-	}
-
-	FAnimepoyRenderProxy GetAnimepoyRenderProxy() const
-	{
-		FScopeLock Lock(&Mutex);
-		return AnimepoyRenderProxy;
-	}
-
-private:
-	TSharedPtr<class FAnimepoySceneViewExtension, ESPMode::ThreadSafe> AnimepoySceneViewExtension;
-
-	AAnimepoy* Animepoy;
-
-	mutable FCriticalSection Mutex;
-
-	FAnimepoyRenderProxy AnimepoyRenderProxy = {};
-};
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/TripleBuffer.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Animepoy.h"
+#include "AnimepoyQualityGovernor.h"
+#include "AnimepoySubsystem.generated.h"
+
+UCLASS()
+class ANIMEPOY_API UAnimepoySubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection)override;
+
+	virtual void Deinitialize()override;
+
+	virtual void Tick(float DeltaTime)override;
+
+	virtual TStatId GetStatId() const override;
+
+public:
+	void OnActorSpawned(AActor* Actor);
+
+	// Publishes the settings of the next actor in the world, or none, when the current one goes away.
+	void OnActorDeleted(AActor* Actor);
+
+	// Picks the first actor of the world again and publishes its settings.
+	void OnActorListChanged();
+
+	// Creates the pipelines of every Animepoy pass, so enabling one later does not compile on its first frame.
+	// Meant for loading screens. With bWaitForCompletion the game thread waits for the render thread to finish.
+	UFUNCTION(BlueprintCallable, Category = "Animepoy")
+	void WarmUpShaders(bool bWaitForCompletion = false);
+
+	// Scales the passes down until they fit BudgetMs of GPU time per frame, and back up once they fit with room to spare.
+	// Zero turns the governor off and restores the settings of the actor. Same as r.Animepoy.Governor.Budget.
+	UFUNCTION(BlueprintCallable, Category = "Animepoy")
+	void SetQualityBudget(float BudgetMs);
+
+	const FAnimepoyQualityLevels& GetQualityLevels() const { return QualityGovernor.GetLevels(); }
+
+	// Game thread. Publishes a new snapshot, scaled by the quality governor, without blocking the reader.
+	void SetAnimepoyRenderProxy(const FAnimepoyRenderProxy& NewAnimepoyRenderProxy)
+	{
+		BaseRenderProxy = NewAnimepoyRenderProxy;
+		RenderProxies.WriteAndSwap(QualityGovernor.GetLevels().Apply(BaseRenderProxy));
+	}
+
+	// The view extension is the only reader. Returns false and leaves OutAnimepoyRenderProxy alone when nothing was published since the last call.
+	bool UpdateAnimepoyRenderProxy(FAnimepoyRenderProxy& OutAnimepoyRenderProxy)
+	{
+		if (!RenderProxies.IsDirty())
+		{
+			return false;
+		}
+
+		OutAnimepoyRenderProxy = RenderProxies.SwapAndRead();
+		return true;
+	}
+
+private:
+	TSharedPtr<class FAnimepoySceneViewExtension, ESPMode::ThreadSafe> AnimepoySceneViewExtension;
+
+	TWeakObjectPtr<AAnimepoy> Animepoy;
+
+	TTripleBuffer<FAnimepoyRenderProxy> RenderProxies{ FAnimepoyRenderProxy{} };
+
+	// Settings of the actor before the quality governor scales them.
+	FAnimepoyRenderProxy BaseRenderProxy = {};
+
+	FAnimepoyQualityGovernor QualityGovernor;
+
+	// Selects the first actor of the world other than DeletedActor and publishes its settings.
+	void SelectAnimepoy(const AActor* DeletedActor);
+};